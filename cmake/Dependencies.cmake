@@ -12,6 +12,10 @@ list(APPEND Caffe_LINKER_LIBS PUBLIC ${Boost_LIBRARIES})
 # ---[ Threads
 find_package(Threads REQUIRED)
 list(APPEND Caffe_LINKER_LIBS PRIVATE ${CMAKE_THREAD_LIBS_INIT})
+if(UNIX AND NOT APPLE)
+  # shm_open lives in librt on older glibc
+  list(APPEND Caffe_LINKER_LIBS PRIVATE rt)
+endif()
 
 # ---[ OpenMP
 if(USE_OPENMP)
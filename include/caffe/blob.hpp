@@ -13,6 +13,12 @@ const int kMaxBlobAxes = 32;
 
 namespace caffe {
 
+/// @brief The rows of a row-sparse diff that may be nonzero.
+struct DiffRows {
+  vector<int> rows;
+  vector<bool> marked;
+};
+
 /**
  * @brief A wrapper around SyncedMemory holders serving as the basic
  *        computational unit through which Layer%s, Net%s, and Solver%s
@@ -24,7 +30,7 @@ template <typename Dtype>
 class Blob {
  public:
   Blob()
-       : data_(), diff_(), count_(0), capacity_(0) {}
+       : data_(), diff_(), count_(0), capacity_(0), inference_only_(false) {}
 
   /// @brief Deprecated; use <code>Blob(const vector<int>& shape)</code>.
   explicit Blob(const int num, const int channels, const int height,
@@ -215,6 +221,8 @@ class Blob {
     CHECK(diff_);
     return diff_;
   }
+  /// @brief Whether the diff exists; empty and inference-only blobs lack one.
+  inline bool has_diff() const { return diff_.get() != NULL; }
 
   const Dtype* cpu_data() const;
   void set_cpu_data(Dtype* data);
@@ -227,7 +235,45 @@ class Blob {
   Dtype* mutable_gpu_data();
   Dtype* mutable_cpu_diff();
   Dtype* mutable_gpu_diff();
+  /// @brief Subtract the diff from the data -- only its rows if row-sparse.
   void Update();
+  /// @brief Zero the diff in the current mode -- only its rows if row-sparse.
+  void ClearDiff();
+
+  /**
+   * @brief Make the diff row-sparse: whatever writes it records the rows
+   *        (slices along the first axis) it writes with AddDiffRow, and the
+   *        rest of the diff stays zero, so that ClearDiff, Update and the CPU
+   *        solvers only need to visit those rows.  The rows are shared along
+   *        with the diff by ShareDiff.
+   */
+  void set_sparse_diff(bool sparse_diff);
+  inline bool sparse_diff() const { return diff_rows_.get() != NULL; }
+  /// @brief Record that row of a row-sparse diff was written.
+  inline void AddDiffRow(int row) {
+    if (!diff_rows_) { return; }
+    vector<bool>& marked = diff_rows_->marked;
+    if (row >= marked.size()) { marked.resize(row + 1, false); }
+    if (!marked[row]) {
+      marked[row] = true;
+      diff_rows_->rows.push_back(row);
+    }
+  }
+  /// @brief The rows of a row-sparse diff written since it was last cleared.
+  inline const vector<int>& diff_rows() const {
+    CHECK(diff_rows_);
+    return diff_rows_->rows;
+  }
+
+  /**
+   * @brief Give up the diff, for blobs that are only ever run forward: the
+   *        Blob then has no diff storage, does not allocate one when
+   *        reshaped, and ShareDiff leaves it without one.  Accessing the diff
+   *        is an error; ClearDiff and the diff norms do nothing.
+   */
+  void set_inference_only(bool inference_only);
+  inline bool inference_only() const { return inference_only_; }
+
   void FromProto(const BlobProto& proto, bool reshape = true);
   void ToProto(BlobProto* proto, bool write_diff = false) const;
 
@@ -260,9 +306,21 @@ class Blob {
    *        in their Forward pass.
    *
    * This deallocates the SyncedMemory holding this Blob's diff_, as
-   * shared_ptr calls its destructor when reset with the "=" operator.
+   * shared_ptr calls its destructor when reset with the "=" operator.  If
+   * other is inference only, this Blob is left without a diff as well.
    */
   void ShareDiff(const Blob& other);
+  /**
+   * @brief Make data_ a view of the count() values of the data_ of Blob
+   *        other found at offset, so that writing this Blob writes that part
+   *        of other.
+   *
+   * The view lasts until this Blob is reshaped to a different count, which
+   * gives it memory of its own again.
+   */
+  void ShareData(const Blob& other, int offset);
+  /// @brief Make diff_ a view of the diff_ of Blob other, as ShareData does.
+  void ShareDiff(const Blob& other, int offset);
 
   bool ShapeEquals(const BlobProto& other);
 
@@ -270,9 +328,11 @@ class Blob {
   shared_ptr<SyncedMemory> data_;
   shared_ptr<SyncedMemory> diff_;
   shared_ptr<SyncedMemory> shape_data_;
+  shared_ptr<DiffRows> diff_rows_;
   vector<int> shape_;
   int count_;
   int capacity_;
+  bool inference_only_;
 
   DISABLE_COPY_AND_ASSIGN(Blob);
 };  // class Blob
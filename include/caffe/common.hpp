@@ -166,6 +166,11 @@ class Caffe {
   inline static bool multiprocess() { return Get().multiprocess_; }
   inline static void set_multiprocess(bool val) { Get().multiprocess_ = val; }
   inline static bool root_solver() { return Get().solver_rank_ == 0; }
+  // Threads filling large arrays in caffe_rng_uniform, caffe_rng_gaussian
+  // and caffe_rng_bernoulli; 0 uses one per hardware thread. The numbers
+  // drawn do not depend on it.
+  inline static int rng_threads() { return Get().rng_threads_; }
+  inline static void set_rng_threads(int val) { Get().rng_threads_ = val; }
 
  protected:
 #ifndef CPU_ONLY
@@ -180,6 +185,7 @@ class Caffe {
   int solver_count_;
   int solver_rank_;
   bool multiprocess_;
+  int rng_threads_;
 
  private:
   // The private constructor to avoid duplicate instantiation.
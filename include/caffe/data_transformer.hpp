@@ -37,6 +37,14 @@ class DataTransformer {
    */
   void Transform(const Datum& datum, Blob<Dtype>* transformed_blob);
 
+  /**
+   * @brief Applies the transformation to a Datum, writing the result
+   * straight into the item_id-th item of transformed_blob, e.g. the data
+   * of a prefetch Batch.
+   */
+  void Transform(const Datum& datum, Blob<Dtype>* transformed_blob,
+                 int item_id);
+
   /**
    * @brief Applies the transformation defined in the data layer's
    * transform_param block to a vector of Datum.
@@ -75,6 +83,19 @@ class DataTransformer {
    *    set_cpu_data() is used. See image_data_layer.cpp for an example.
    */
   void Transform(const cv::Mat& cv_img, Blob<Dtype>* transformed_blob);
+
+  /**
+   * @brief Applies the transformation to a cv::Mat, writing the result
+   * straight into the item_id-th item of transformed_blob.
+   */
+  void Transform(const cv::Mat& cv_img, Blob<Dtype>* transformed_blob,
+                 int item_id);
+
+  /**
+   * @brief Decodes an encoded Datum into a cv::Mat, honoring the
+   * force_color and force_gray settings of transform_param.
+   */
+  cv::Mat DecodeDatum(const Datum& datum);
 #endif  // USE_OPENCV
 
   /**
@@ -137,8 +158,22 @@ class DataTransformer {
    *    A uniformly random integer value from ({0, 1, ..., n-1}).
    */
   virtual int Rand(int n);
+  /// @brief Generates a random float from Uniform([a, b)).
+  float RandUniform(float a, float b);
+  /// @brief Draws the per-channel gains and the brightness shift of the
+  ///        color augmentation; identity outside of the TRAIN phase.
+  void RandJitter(int channels, vector<Dtype>* gains, Dtype* bias);
+#ifdef USE_OPENCV
+  /// @brief Applies scale jitter and random resized crop to an image.
+  cv::Mat Augment(const cv::Mat& cv_img);
+#endif  // USE_OPENCV
 
   void Transform(const Datum& datum, Dtype* transformed_data);
+  // Checks the mean against an input of the given shape, replicating a
+  // single mean_value across the channels.
+  void CheckMean(int channels, int height, int width);
+  // Picks the top-left corner of the crop of an input of the given size.
+  void CropOffsets(int height, int width, int* h_off, int* w_off);
   // Tranformation parameters
   TransformationParameter param_;
 
@@ -147,6 +182,8 @@ class DataTransformer {
   Phase phase_;
   Blob<Dtype> data_mean_;
   vector<Dtype> mean_values_;
+  // Whether images are resized or randomly cropped before the transformation.
+  bool resize_augment_;
 };
 
 }  // namespace caffe
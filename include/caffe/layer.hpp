@@ -269,6 +269,28 @@ class Layer {
     return true;
   }
 
+  /**
+   * @brief Return whether Forward writes the diff of a given bottom blob,
+   *        e.g. as scratch space.
+   *
+   * Nets that only run forward give up the diffs of their blobs (see
+   * Blob::set_inference_only), except for those.
+   */
+  virtual inline bool ForwardUsesBottomDiff(const int bottom_index) const {
+    return false;
+  }
+
+  /**
+   * @brief Return whether Backward records with Blob::AddDiffRow every row it
+   *        writes to the diff of a given param blob.
+   *
+   * Only such params may have a row-sparse diff (see Blob::set_sparse_diff),
+   * which is checked when the net shares its params.
+   */
+  virtual inline bool RecordsDiffRows(const int param_id) const {
+    return false;
+  }
+
   /**
    * @brief Specifies whether the layer should compute gradients w.r.t. a
    *        parameter at a particular index given by param_id.
@@ -35,6 +35,10 @@ class AccuracyLayer : public Layer<Dtype> {
 
   virtual inline const char* type() const { return "Accuracy"; }
   virtual inline int ExactNumBottomBlobs() const { return 2; }
+  /// The GPU implementation counts in the diffs of its inputs.
+  virtual inline bool ForwardUsesBottomDiff(const int bottom_index) const {
+    return true;
+  }
 
   // If there are two top blobs, then the second blob will contain
   // accuracies per class.
@@ -76,10 +76,17 @@ class ConcatLayer : public Layer<Dtype> {
   virtual void Backward_gpu(const vector<Blob<Dtype>*>& top,
       const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom);
 
+  /// @brief Whether bottom is a view of top at offset, as placed there by
+  ///        Net::ShareConcatInputs.
+  bool InPlace(const Blob<Dtype>& bottom, const Blob<Dtype>& top,
+      int offset) const;
+
   int count_;
   int num_concats_;
   int concat_input_size_;
   int concat_axis_;
+  // Which inputs need no copy.
+  vector<bool> in_place_;
 };
 
 }  // namespace caffe
@@ -1,6 +1,7 @@
 #ifndef CAFFE_CUDNN_DECONV_LAYER_HPP_
 #define CAFFE_CUDNN_DECONV_LAYER_HPP_
 
+#include <utility>
 #include <vector>
 
 #include "caffe/blob.hpp"
@@ -32,6 +33,9 @@ class CuDNNDeconvolutionLayer : public DeconvolutionLayer<Dtype> {
                        const vector<Blob<Dtype>*>& top);
   virtual ~CuDNNDeconvolutionLayer();
 
+  /// @brief The number of input shapes whose algorithm choices are cached.
+  inline int num_cached_plans() const { return plans_.size(); }
+
  protected:
   virtual void Forward_gpu(const vector<Blob<Dtype>*>& bottom,
                            const vector<Blob<Dtype>*>& top);
@@ -57,6 +61,18 @@ class CuDNNDeconvolutionLayer : public DeconvolutionLayer<Dtype> {
   size_t *workspace_fwd_sizes_;
   size_t *workspace_bwd_data_sizes_;
   size_t *workspace_bwd_filter_sizes_;
+  /// @brief The algorithms and workspace sizes chosen for one bottom.
+  struct AlgoChoice {
+    cudnnConvolutionFwdAlgo_t fwd_algo;
+    cudnnConvolutionBwdFilterAlgo_t bwd_filter_algo;
+    cudnnConvolutionBwdDataAlgo_t bwd_data_algo;
+    size_t workspace_fwd_size;
+    size_t workspace_bwd_filter_size;
+    size_t workspace_bwd_data_size;
+  };
+  /// @brief The choices for recent bottom shapes, most recently used first.
+  vector<std::pair<vector<int>, vector<AlgoChoice> > > plans_;
+
   size_t workspaceSizeInBytes;  // size of underlying storage
   void *workspaceData;  // underlying storage
   void **workspace;  // aliases into workspaceData
@@ -1,6 +1,7 @@
 #ifndef CAFFE_DATA_LAYER_HPP_
 #define CAFFE_DATA_LAYER_HPP_
 
+#include <string>
 #include <vector>
 
 #include "caffe/blob.hpp"
@@ -10,6 +11,7 @@
 #include "caffe/layers/base_data_layer.hpp"
 #include "caffe/proto/caffe.pb.h"
 #include "caffe/util/db.hpp"
+#include "caffe/util/db_packed.hpp"
 
 namespace caffe {
 
@@ -25,14 +27,60 @@ class DataLayer : public BasePrefetchingDataLayer<Dtype> {
   virtual inline int MinTopBlobs() const { return 1; }
   virtual inline int MaxTopBlobs() const { return 2; }
 
+  virtual void Forward_cpu(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top);
+  virtual void Forward_gpu(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top);
+
+  /// @brief Whether records are read in a per-epoch shuffled order.
+  bool shuffle() const { return shuffle_; }
+  /// @brief The shuffle seed and the position of the last record handed to
+  ///        Forward, for saving with the solver state.
+  void GetState(DataReaderState* state) const;
+  /// @brief Moves the reader to a position saved by GetState, discarding
+  ///        any batches that were already prefetched.
+  void SetState(const DataReaderState& state);
+
  protected:
   void Next();
   bool Skip();
+  void ReadDatum(Datum* datum);
+  string Key();
   virtual void load_batch(Batch<Dtype>* batch);
 
+  // Shuffled reading: the record stream is a sequence of epochs, each one a
+  // permutation of the database seeded by shuffle_seed_ and the epoch number.
+  void StartEpoch(uint64_t epoch);
+  bool ReadRecord(string* key, string* value);
+  void FillShuffleBuffer();
+  void SeekToPosition(uint64_t position);
+  uint64_t StreamPosition(uint64_t consumed) const;
+
   shared_ptr<db::DB> db_;
   shared_ptr<db::Cursor> cursor_;
   uint64_t offset_;
+
+  bool shuffle_;
+  unsigned int shuffle_seed_;
+  shared_ptr<Caffe::RNG> shuffle_rng_;
+  // Packed databases seek blocks by index, the others by the first key of
+  // each block.
+  db::PackedCursor* packed_cursor_;
+  vector<string> block_keys_;
+  uint64_t num_records_;
+  vector<int> block_order_;
+  int block_pos_;
+  int block_read_;
+  vector<string> shuffle_keys_;
+  vector<string> shuffle_buffer_;
+  // Stream position the reader was last moved to and the number of records
+  // handed to Forward since then.
+  uint64_t start_position_;
+  uint64_t consumed_;
+
+  // Prefix of the keys of this layer's images in the decoded image cache;
+  // empty if the cache is disabled.
+  string cache_prefix_;
 };
 
 }  // namespace caffe
@@ -1,6 +1,7 @@
 #ifndef CAFFE_DROPOUT_LAYER_HPP_
 #define CAFFE_DROPOUT_LAYER_HPP_
 
+#include <stdint.h>
 #include <vector>
 
 #include "caffe/blob.hpp"
@@ -55,7 +56,8 @@ class DropoutLayer : public NeuronLayer<Dtype> {
    *         \end{array} \right.
    *      @f$, where @f$ u \sim U(0, 1)@f$ is generated independently for each
    *      input at each iteration. At test time, we simply have
-   *      @f$ y_{\mbox{test}} = \mathbb{E}[y_{\mbox{train}}] = x @f$.
+   *      @f$ y_{\mbox{test}} = \mathbb{E}[y_{\mbox{train}}] = x @f$,
+   *      and the output shares the memory of the input.
    */
   virtual void Forward_cpu(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top);
@@ -66,12 +68,19 @@ class DropoutLayer : public NeuronLayer<Dtype> {
   virtual void Backward_gpu(const vector<Blob<Dtype>*>& top,
       const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom);
 
-  /// when divided by UINT_MAX, the randomly generated values @f$u\sim U(0,1)@f$
+  /// @brief Draws the key of the mask of the next forward pass.
+  void NewMaskKey();
+
+  /// the mask of the last forward pass, one bit per input, set if the input
+  /// was kept
   Blob<unsigned int> rand_vec_;
+  /// the key of the counter-based generator of the mask
+  uint32_t mask_key_[2];
   /// the probability @f$ p @f$ of dropping any input
   Dtype threshold_;
   /// the scale for undropped inputs at train time @f$ 1 / (1 - p) @f$
   Dtype scale_;
+  /// the threshold above which a random 32 bit value keeps its input
   unsigned int uint_thres_;
 };
 
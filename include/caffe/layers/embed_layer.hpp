@@ -6,6 +6,7 @@
 #include "caffe/blob.hpp"
 #include "caffe/layer.hpp"
 #include "caffe/proto/caffe.pb.h"
+#include "caffe/util/worker_pool.hpp"
 
 namespace caffe {
 
@@ -29,6 +30,9 @@ class EmbedLayer : public Layer<Dtype> {
   virtual inline const char* type() const { return "Embed"; }
   virtual inline int ExactNumBottomBlobs() const { return 1; }
   virtual inline int ExactNumTopBlobs() const { return 1; }
+  virtual inline bool RecordsDiffRows(const int param_id) const {
+    return param_id == 0;
+  }
 
  protected:
   virtual void Forward_cpu(const vector<Blob<Dtype>*>& bottom,
@@ -45,6 +49,8 @@ class EmbedLayer : public Layer<Dtype> {
   int N_;
   bool bias_term_;
   Blob<Dtype> bias_multiplier_;
+  /// @brief The threads gathering the output rows in Forward_cpu.
+  shared_ptr<WorkerPool> gather_pool_;
 };
 
 }  // namespace caffe
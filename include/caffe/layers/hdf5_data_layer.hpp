@@ -7,20 +7,35 @@
 #include <vector>
 
 #include "caffe/blob.hpp"
+#include "caffe/internal_thread.hpp"
 #include "caffe/layer.hpp"
 #include "caffe/proto/caffe.pb.h"
+#include "caffe/util/blocking_queue.hpp"
 
 #include "caffe/layers/base_data_layer.hpp"
 
 namespace caffe {
 
+/// @brief A run of consecutive rows of every top dataset of an HDF5 file,
+///        with the order in which they are served.
+template <typename Dtype>
+class HDF5Chunk {
+ public:
+  std::vector<shared_ptr<Blob<Dtype> > > blobs_;
+  std::vector<unsigned int> permutation_;
+};
+
 /**
  * @brief Provides data to the Net from HDF5 files.
  *
+ * By default each file is loaded whole when it is reached. With
+ * hdf5_data_param.chunk_size set, files are instead read chunk_size rows at
+ * a time by a prefetching thread, so only a few chunks are ever resident.
+ *
  * TODO(dox): thorough documentation for Forward and proto params.
  */
 template <typename Dtype>
-class HDF5DataLayer : public Layer<Dtype> {
+class HDF5DataLayer : public Layer<Dtype>, public InternalThread {
  public:
   explicit HDF5DataLayer(const LayerParameter& param)
       : Layer<Dtype>(param), offset_() {}
@@ -49,6 +64,12 @@ class HDF5DataLayer : public Layer<Dtype> {
       const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom) {}
   virtual void LoadHDF5FileData(const char* filename);
 
+  // Streaming mode: the thread reads chunks, the forward pass consumes them.
+  virtual void InternalThreadEntry();
+  void LoadHDF5Chunk(hid_t file_id, hsize_t first_row, hsize_t num_rows,
+      HDF5Chunk<Dtype>* chunk);
+  void NextChunk();
+
   std::vector<std::string> hdf_filenames_;
   unsigned int num_files_;
   unsigned int current_file_;
@@ -57,6 +78,10 @@ class HDF5DataLayer : public Layer<Dtype> {
   std::vector<unsigned int> data_permutation_;
   std::vector<unsigned int> file_permutation_;
   uint64_t offset_;
+
+  std::vector<shared_ptr<HDF5Chunk<Dtype> > > chunks_;
+  BlockingQueue<HDF5Chunk<Dtype>*> chunk_free_;
+  BlockingQueue<HDF5Chunk<Dtype>*> chunk_full_;
 };
 
 }  // namespace caffe
@@ -61,6 +61,10 @@ class HingeLossLayer : public LossLayer<Dtype> {
       : LossLayer<Dtype>(param) {}
 
   virtual inline const char* type() const { return "HingeLoss"; }
+  /// The margins are computed in the diff of the predictions.
+  virtual inline bool ForwardUsesBottomDiff(const int bottom_index) const {
+    return bottom_index == 0;
+  }
 
  protected:
   /// @copydoc HingeLossLayer
@@ -36,9 +36,15 @@ class ImageDataLayer : public BasePrefetchingDataLayer<Dtype> {
   shared_ptr<Caffe::RNG> prefetch_rng_;
   virtual void ShuffleImages();
   virtual void load_batch(Batch<Dtype>* batch);
+  // Reads and decodes the image of lines_[line_id], through the decoded
+  // image cache when it is enabled.
+  cv::Mat ReadImage(int line_id);
 
   vector<std::pair<std::string, int> > lines_;
   int lines_id_;
+  // Prefix of the keys of this layer's images in the decoded image cache;
+  // empty if the cache is disabled.
+  string cache_prefix_;
 };
 
 
@@ -19,7 +19,8 @@ template <typename Dtype> class RecurrentLayer;
 /**
  * @brief Processes sequential inputs using a "Long Short-Term Memory" (LSTM)
  *        [1] style recurrent neural network (RNN). Implemented by unrolling
- *        the LSTM computation through time.
+ *        the LSTM computation through time, or on the CPU by the FUSED
+ *        engine (see RecurrentParameter), which computes it in the layer.
  *
  * The specific architecture used in this implementation is as described in
  * "Learning to Execute" [2], reproduced below:
@@ -49,6 +50,11 @@ class LSTMLayer : public RecurrentLayer<Dtype> {
  public:
   explicit LSTMLayer(const LayerParameter& param)
       : RecurrentLayer<Dtype>(param) {}
+  virtual void LayerSetUp(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top);
+  virtual void Reshape(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top);
+  virtual void Reset();
 
   virtual inline const char* type() const { return "LSTM"; }
 
@@ -58,6 +64,37 @@ class LSTMLayer : public RecurrentLayer<Dtype> {
   virtual void RecurrentOutputBlobNames(vector<string>* names) const;
   virtual void RecurrentInputShapes(vector<BlobShape>* shapes) const;
   virtual void OutputBlobNames(vector<string>* names) const;
+
+  /**
+   * @brief With the FUSED engine, computes all timesteps directly: the input
+   *        transformation of the whole sequence is a single matrix product,
+   *        leaving one product with W_hc and one pass over the gates per
+   *        timestep.  Otherwise runs the unrolled net.
+   */
+  virtual void Forward_cpu(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top);
+  virtual void Forward_gpu(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top);
+  virtual void Backward_cpu(const vector<Blob<Dtype>*>& top,
+      const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom);
+
+  /// @brief Whether the FUSED engine is used instead of the unrolled net.
+  bool fused_;
+  /// @brief The hidden and output dimension.
+  int hidden_dim_;
+  /// @brief The number of elements per timestep and stream of x, x_static.
+  int input_dim_, static_dim_;
+  /// @brief The gate activations [i, f, o, g] of each timestep (T x N x 4D).
+  Blob<Dtype> gates_;
+  /// @brief The cell states c_0 to c_T ((T + 1) x N x D).
+  Blob<Dtype> cell_;
+  /// @brief The inputs cont_t * h_{t-1} to W_hc of each timestep.
+  Blob<Dtype> h_conted_;
+  /// @brief The hidden and cell state after the last timestep (1 x N x D).
+  Blob<Dtype> h_T_, c_T_;
+  /// @brief W_xc_static * x_static, added to the gates of every timestep.
+  Blob<Dtype> static_gates_;
+  Blob<Dtype> bias_multiplier_;
 };
 
 /**
@@ -174,6 +174,12 @@ class RecurrentLayer : public Layer<Dtype> {
    */
   bool expose_hidden_;
 
+  /**
+   * @brief Whether the layer runs its single timestep unrolled net once per
+   *        input timestep, for inference on streams.
+   */
+  bool streaming_;
+
   vector<Blob<Dtype>* > recur_input_blobs_;
   vector<Blob<Dtype>* > recur_output_blobs_;
   vector<Blob<Dtype>* > output_blobs_;
@@ -54,6 +54,10 @@ class SigmoidCrossEntropyLossLayer : public LossLayer<Dtype> {
       const vector<Blob<Dtype>*>& top);
 
   virtual inline const char* type() const { return "SigmoidCrossEntropyLoss"; }
+  /// The GPU implementation sums the loss in the diffs of its inputs.
+  virtual inline bool ForwardUsesBottomDiff(const int bottom_index) const {
+    return true;
+  }
 
  protected:
   /// @copydoc SigmoidCrossEntropyLossLayer
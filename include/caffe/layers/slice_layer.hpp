@@ -39,11 +39,18 @@ class SliceLayer : public Layer<Dtype> {
   virtual void Backward_gpu(const vector<Blob<Dtype>*>& top,
       const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom);
 
+  /// @brief Whether top is a view of bottom at offset, as placed there by
+  ///        Net::ShareSliceOutputs.
+  bool InPlace(const Blob<Dtype>& top, const Blob<Dtype>& bottom,
+      int offset) const;
+
   int count_;
   int num_slices_;
   int slice_size_;
   int slice_axis_;
   vector<int> slice_point_;
+  // Which outputs need no copy.
+  vector<bool> in_place_;
 };
 
 }  // namespace caffe
@@ -62,6 +62,10 @@ class SoftmaxWithLossLayer : public LossLayer<Dtype> {
   virtual inline int ExactNumTopBlobs() const { return -1; }
   virtual inline int MinTopBlobs() const { return 1; }
   virtual inline int MaxTopBlobs() const { return 2; }
+  /// The GPU implementation sums the loss in the diff of the predictions.
+  virtual inline bool ForwardUsesBottomDiff(const int bottom_index) const {
+    return bottom_index == 0;
+  }
 
  protected:
   virtual void Forward_cpu(const vector<Blob<Dtype>*>& bottom,
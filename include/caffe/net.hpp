@@ -78,7 +78,9 @@ class Net {
    * @brief Reshape all layers from bottom to top.
    *
    * This is useful to propagate changes to layer sizes without running
-   * a forward pass, e.g. to compute output feature size.
+   * a forward pass, e.g. to compute output feature size.  Only the layers
+   * whose bottom shapes changed since they were last reshaped are reshaped
+   * again, so repeating the shapes of the last call costs next to nothing.
    */
   void Reshape();
 
@@ -191,6 +193,10 @@ class Net {
     return param_names_index_;
   }
   inline const vector<int>& param_owners() const { return param_owners_; }
+  /// @brief The (layer id, index in the layer's blobs) of each param
+  inline const vector<pair<int, int> >& param_layer_indices() const {
+    return param_layer_indices_;
+  }
   inline const vector<string>& param_display_names() const {
     return param_display_names_;
   }
@@ -272,6 +278,28 @@ class Net {
   void BackwardDebugInfo(const int layer_id);
   /// @brief Helper for displaying debug info in Update.
   void UpdateDebugInfo(const int param_id);
+  /**
+   * @brief Makes the inputs of concat layers views of their output, so that
+   *        their producers write them in place. Returns how many were placed.
+   */
+  int ShareConcatInputs();
+  /**
+   * @brief Makes the outputs of slice layers views of their input, so that
+   *        slicing copies nothing. Returns how many were placed.
+   */
+  int ShareSliceOutputs();
+  /**
+   * @brief Makes the blobs and params of a forward_only net inference only,
+   *        except for the diffs Forward uses. Returns the bytes of diff
+   *        storage given up.
+   */
+  size_t DropDiffs();
+  /// @brief Whether a layer after layer_id writes the blob blob_id.
+  bool WrittenAfter(int layer_id, int blob_id) const;
+  /// @brief The last layer before layer_id writing blob_id, or -1.
+  int ProducerOf(int layer_id, int blob_id) const;
+  /// @brief Remember the bottom shapes layer layer_id was reshaped for.
+  void RecordBottomShapes(int layer_id);
 
   /// @brief The network name
   string name_;
@@ -330,6 +358,13 @@ class Net {
   size_t memory_used_;
   /// Whether to compute and display debug info for the net.
   bool debug_info_;
+  /// Whether to place the inputs of concat layers in their outputs
+  bool share_concat_inputs_;
+  /// Whether the net only runs forward, without splits and with slices
+  /// viewing their input
+  bool forward_only_;
+  /// The shapes of the bottoms of each layer when it was last reshaped
+  vector<vector<vector<int> > > layer_bottom_shapes_;
   // Callbacks
   vector<Callback*> before_forward_;
   vector<Callback*> after_forward_;
@@ -2,8 +2,8 @@
 #define CAFFE_PARALLEL_HPP_
 
 #ifdef USE_NCCL
-
 #include <boost/thread.hpp>
+#endif
 
 #include <string>
 #include <vector>
@@ -16,7 +16,14 @@
 #include "caffe/solver.hpp"
 #include "caffe/syncedmem.hpp"
 #include "caffe/util/blocking_queue.hpp"
+#include "caffe/util/gradient_codec.hpp"
+#include "caffe/util/ring_comm.hpp"
+#ifdef USE_NCCL
 #include "caffe/util/nccl.hpp"
+#endif
+
+// Forward declare boost::barrier, see internal_thread.hpp.
+namespace boost { class barrier; }
 
 namespace caffe {
 
@@ -48,6 +55,147 @@ class Params {
 DISABLE_COPY_AND_ASSIGN(Params);
 };
 
+// Params stored in host memory.
+template<typename Dtype>
+class CPUParams : public Params<Dtype> {
+ public:
+  explicit CPUParams(shared_ptr<Solver<Dtype> > root_solver);
+  virtual ~CPUParams();
+
+  void Configure(Solver<Dtype>* solver) const;
+
+ protected:
+  using Params<Dtype>::size_;
+  using Params<Dtype>::data_;
+  using Params<Dtype>::diff_;
+};
+
+/**
+ * Data-parallel training of CPU solvers running on threads of one process.
+ * Each thread runs a solver replica reading its own shard of the data, and
+ * gradients are averaged through shared memory: every replica sums and
+ * scales its slice of the parameters across all replicas, layer by layer as
+ * backward completes if layer_wise_reduce is set.
+ */
+template<typename Dtype>
+class CPUSync : public CPUParams<Dtype>,
+                public Solver<Dtype>::Callback,
+                public Net<Dtype>::Callback {
+ public:
+  explicit CPUSync(shared_ptr<Solver<Dtype> > solver);
+  ~CPUSync() {}
+
+  void set_barrier(boost::barrier* value) { barrier_ = value; }
+  void set_syncs(vector<CPUSync<Dtype>*>* value) { syncs_ = value; }
+
+  /**
+   * Copies the weights of rank 0 to the other solvers.
+   */
+  void Broadcast();
+
+  /**
+   * Trains with the given number of solvers, this one and threads - 1
+   * replicas, until max_iter.
+   */
+  void Run(int threads, const char* restore);
+
+ protected:
+  void on_start() {}
+  void run(int layer);  // Net callback
+  void on_gradients_ready();
+  // Averages the gradients in [offset, offset + size) of the parameter
+  // buffers of all solvers, working on the slice given by the solver rank.
+  void Reduce(size_t offset, size_t size);
+
+  shared_ptr<Solver<Dtype> > solver_;
+  boost::barrier* barrier_;
+  vector<CPUSync<Dtype>*>* syncs_;
+  using Params<Dtype>::size_;
+  using Params<Dtype>::data_;
+  using Params<Dtype>::diff_;
+};
+
+/**
+ * Data-parallel training of CPU solvers running in separate processes, on
+ * one host or several. Gradients are summed by ring allreduce over a
+ * RingTransport. With layer_wise_reduce, the params are grouped into
+ * buckets of about reduce_bucket_size bytes in backward order, and a
+ * background thread reduces each bucket as soon as the backward of its
+ * layers is done, overlapping communication with the backward of the layers
+ * below. Bucketing amortizes the latency of every collective over more
+ * data than the params of a single layer. Gradients can be compressed on
+ * the wire with gradient_compression, see GradientCodec.
+ */
+template<typename Dtype>
+class RingSync : public CPUParams<Dtype>,
+                 public Solver<Dtype>::Callback,
+                 public Net<Dtype>::Callback,
+                 public InternalThread {
+ public:
+  /**
+   * Connects the solvers of all ranks through uri, see GetRingTransport.
+   * Caffe::solver_count() and solver_rank() give the ranks.
+   */
+  RingSync(shared_ptr<Solver<Dtype> > solver, const string& uri);
+  ~RingSync();
+
+  /**
+   * Copies the weights of rank 0 to all ranks and trains until max_iter.
+   */
+  void Run();
+
+  /**
+   * Sets the function polled for stop and snapshot requests, on rank 0.
+   * Its answer is passed on to all ranks, so that they act on it after the
+   * same iteration.
+   */
+  void SetActionFunction(ActionCallback func) { root_action_ = func; }
+
+ protected:
+  SolverAction::Enum GetRequestedAction();
+  void on_start();
+  void run(int layer);  // Net callback
+  void on_gradients_ready();
+  virtual void InternalThreadEntry();
+  void AddBucket(int layer, size_t offset, size_t count);
+  void Reduce(size_t offset, size_t count);
+  void AccumulateBytes();
+
+  shared_ptr<Solver<Dtype> > solver_;
+  RingComm<Dtype> comm_;
+  // Encodes the gradients exchanged, if compressed.
+  shared_ptr<GradientCodec<Dtype> > codec_;
+  // The bucket to reduce once the backward of each layer is done, or -1.
+  vector<int> layer_buckets_;
+  // Where the params of each bucket are in the buffers.
+  vector<size_t> bucket_offsets_;
+  vector<size_t> bucket_counts_;
+  // Buckets queued for, and done with, the background reduction.
+  BlockingQueue<int> pending_;
+  BlockingQueue<int> reduced_;
+  int num_pending_;
+  int backward_passes_;
+  // Time spent reducing, and waiting for the reduction after backward,
+  // since the last display.
+  float comm_ms_;
+  float wait_ms_;
+  // Bytes sent, and that would be sent without compression, since the last
+  // display and in total.
+  double sent_bytes_;
+  double raw_bytes_;
+  double total_sent_bytes_;
+  double total_raw_bytes_;
+  // The action function of rank 0, and the request it sent for the current
+  // iteration.
+  ActionCallback root_action_;
+  SolverAction::Enum action_;
+  using Params<Dtype>::size_;
+  using Params<Dtype>::data_;
+  using Params<Dtype>::diff_;
+};
+
+#ifdef USE_NCCL
+
 // Params stored in GPU memory.
 template<typename Dtype>
 class GPUParams : public Params<Dtype> {
@@ -117,7 +265,8 @@ class NCCL : public GPUParams<Dtype>,
   using Params<Dtype>::diff_;
 };
 
+#endif  // USE_NCCL
+
 }  // namespace caffe
 
-#endif  // USE_NCCL
 #endif  // header
@@ -5,12 +5,38 @@
 #include <vector>
 
 #include "caffe/solver.hpp"
+#include "caffe/util/math_functions.hpp"
+#include "caffe/util/worker_pool.hpp"
 
 namespace caffe {
 
+/**
+ * @brief Gradient preprocessing folded into the fused CPU updates: the
+ *        gradient g of a weight w is replaced by
+ *        g * scale + decay * (l1 ? sign(w) : w),
+ *        where scale covers the iter_size normalization and the clipping.
+ *        The default is the identity.
+ */
+template <typename Dtype>
+struct GradientPrep {
+  GradientPrep() : scale(1), decay(0), l1(false) {}
+  inline Dtype operator()(Dtype g, Dtype w) const {
+    return g * scale + decay * (l1 ? Dtype(caffe_sign(w)) : w);
+  }
+  Dtype scale;
+  Dtype decay;
+  bool l1;
+};
+
 /**
  * @brief Optimizes the parameters of a Net using
  *        stochastic gradient descent (SGD) with momentum.
+ *
+ * On the CPU, the normalization, regularization and update of a param are
+ * fused into a single pass by ComputeUpdateValueCPU, and params are updated
+ * by solver_param.update_threads threads, unless FuseUpdateCPU() is false.
+ * Params with a row-sparse diff (see Blob::set_sparse_diff) only have the
+ * rows with a gradient updated.
  */
 template <typename Dtype>
 class SGDSolver : public Solver<Dtype> {
@@ -30,10 +56,27 @@ class SGDSolver : public Solver<Dtype> {
   virtual void Normalize(int param_id);
   virtual void Regularize(int param_id);
   virtual void ComputeUpdateValue(int param_id, Dtype rate);
+  /**
+   * @brief Computes the update of the elements [offset, offset + count) of a
+   *        param on the CPU in a single pass over them, preprocessing their
+   *        gradient with prep on the fly.
+   */
+  virtual void ComputeUpdateValueCPU(int param_id, Dtype rate,
+      const GradientPrep<Dtype>& prep, int offset, int count);
   virtual void ClipGradients();
-  virtual void SnapshotSolverState(const string& model_filename);
-  virtual void SnapshotSolverStateToBinaryProto(const string& model_filename);
-  virtual void SnapshotSolverStateToHDF5(const string& model_filename);
+  /**
+   * @brief Whether the CPU update goes through ComputeUpdateValueCPU alone,
+   *        bypassing ClipGradients, Normalize, Regularize and
+   *        ComputeUpdateValue. Only true for the solvers defined here, so
+   *        that subclasses overriding those still have them called;
+   *        subclasses may opt back in.
+   */
+  virtual bool FuseUpdateCPU() const;
+  /// @brief Returns the factor that clips the gradients to clip_gradients.
+  Dtype GetClipScale();
+  // Updates the params of a part of update_parts_; run by the update threads.
+  void ApplyUpdateCPU(int part, Dtype rate, Dtype diff_scale);
+  virtual void SnapshotSolverState(SolverState* state);
   virtual void RestoreSolverStateFromHDF5(const string& state_file);
   virtual void RestoreSolverStateFromBinaryProto(const string& state_file);
   // history maintains the historical momentum data.
@@ -41,6 +84,10 @@ class SGDSolver : public Solver<Dtype> {
   // temp maintains other information that might be needed in computation
   //   of gradients/updates and is not needed in snapshots
   vector<shared_ptr<Blob<Dtype> > > history_, update_, temp_;
+  // ids of the params updated by each CPU update thread.
+  vector<vector<int> > update_parts_;
+  // The threads running the parts of the fused CPU update.
+  shared_ptr<WorkerPool> update_pool_;
 
   DISABLE_COPY_AND_ASSIGN(SGDSolver);
 };
@@ -56,6 +103,8 @@ class NesterovSolver : public SGDSolver<Dtype> {
 
  protected:
   virtual void ComputeUpdateValue(int param_id, Dtype rate);
+  virtual void ComputeUpdateValueCPU(int param_id, Dtype rate,
+      const GradientPrep<Dtype>& prep, int offset, int count);
 
   DISABLE_COPY_AND_ASSIGN(NesterovSolver);
 };
@@ -71,6 +120,8 @@ class AdaGradSolver : public SGDSolver<Dtype> {
 
  protected:
   virtual void ComputeUpdateValue(int param_id, Dtype rate);
+  virtual void ComputeUpdateValueCPU(int param_id, Dtype rate,
+      const GradientPrep<Dtype>& prep, int offset, int count);
   void constructor_sanity_check() {
     CHECK_EQ(0, this->param_.momentum())
         << "Momentum cannot be used with AdaGrad.";
@@ -91,6 +142,8 @@ class RMSPropSolver : public SGDSolver<Dtype> {
 
  protected:
   virtual void ComputeUpdateValue(int param_id, Dtype rate);
+  virtual void ComputeUpdateValueCPU(int param_id, Dtype rate,
+      const GradientPrep<Dtype>& prep, int offset, int count);
   void constructor_sanity_check() {
     CHECK_EQ(0, this->param_.momentum())
         << "Momentum cannot be used with RMSProp.";
@@ -115,6 +168,8 @@ class AdaDeltaSolver : public SGDSolver<Dtype> {
  protected:
   void AdaDeltaPreSolve();
   virtual void ComputeUpdateValue(int param_id, Dtype rate);
+  virtual void ComputeUpdateValueCPU(int param_id, Dtype rate,
+      const GradientPrep<Dtype>& prep, int offset, int count);
 
   DISABLE_COPY_AND_ASSIGN(AdaDeltaSolver);
 };
@@ -139,6 +194,8 @@ class AdamSolver : public SGDSolver<Dtype> {
  protected:
   void AdamPreSolve();
   virtual void ComputeUpdateValue(int param_id, Dtype rate);
+  virtual void ComputeUpdateValueCPU(int param_id, Dtype rate,
+      const GradientPrep<Dtype>& prep, int offset, int count);
 
   DISABLE_COPY_AND_ASSIGN(AdamSolver);
 };
@@ -7,6 +7,8 @@
 #include "caffe/net.hpp"
 #include "caffe/solver_factory.hpp"
 #include "caffe/util/benchmark.hpp"
+#include "caffe/util/evaluator.hpp"
+#include "caffe/util/snapshot_writer.hpp"
 
 namespace caffe {
 
@@ -63,9 +65,17 @@ class Solver {
   void Restore(const char* resume_file);
   // The Solver::Snapshot function implements the basic snapshotting utility
   // that stores the learned net. You should implement the SnapshotSolverState()
-  // function that produces a SolverState protocol buffer that needs to be
-  // written to disk together with the learned net.
+  // function that fills the SolverState protocol buffer that needs to be
+  // written to disk together with the learned net. With snapshot_async, the
+  // files are written in the background: call WaitForSnapshot() before
+  // reading them.
   void Snapshot();
+  void WaitForSnapshot();
+  // With test_async, the test nets are evaluated in the background on a copy
+  // of the params: call WaitForTests() before using them.
+  void WaitForTests();
+  // Total time in ms that training was stalled by snapshots.
+  float snapshot_stall_time() const { return snapshot_stall_ms_; }
   virtual ~Solver() {}
   inline const SolverParameter& param() const { return param_; }
   inline shared_ptr<Net<Dtype> > net() { return net_; }
@@ -98,14 +108,18 @@ class Solver {
   // Make and apply the update value for the current iteration.
   virtual void ApplyUpdate() = 0;
   string SnapshotFilename(const string extension);
-  string SnapshotToBinaryProto();
-  string SnapshotToHDF5();
   // The test routine
   void TestAll();
   void Test(const int test_net_id = 0);
-  virtual void SnapshotSolverState(const string& model_filename) = 0;
+  // Copies the solver specific state, e.g. the history, to state. The
+  // iteration, learned net and data reader positions are filled by Snapshot.
+  virtual void SnapshotSolverState(SolverState* state) = 0;
   virtual void RestoreSolverStateFromHDF5(const string& state_file) = 0;
   virtual void RestoreSolverStateFromBinaryProto(const string& state_file) = 0;
+  // Saves and restores the read positions of the shuffling data layers of the
+  // train net, so that a resumed run continues the same record order.
+  void GetDataReaderState(SolverState* state) const;
+  void SetDataReaderState(const SolverState& state);
   void DisplayOutputBlobs(const int net_id);
   void UpdateSmoothedLoss(Dtype loss, int start_iter, int average_loss);
 
@@ -129,6 +143,13 @@ class Solver {
   Timer iteration_timer_;
   float iterations_last_;
 
+  // Writes the snapshots of the root solver.
+  shared_ptr<SnapshotWriter<Dtype> > snapshot_writer_;
+  float snapshot_stall_ms_;
+
+  // Evaluates the test nets of the root solver, with test_async.
+  shared_ptr<Evaluator<Dtype> > evaluator_;
+
   DISABLE_COPY_AND_ASSIGN(Solver);
 };
 
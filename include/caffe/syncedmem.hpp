@@ -58,6 +58,12 @@ class SyncedMemory {
  public:
   SyncedMemory();
   explicit SyncedMemory(size_t size);
+  /**
+   * @brief Creates a view of the size bytes of base found at offset. Views
+   *        read and write the memory of base, and share its head.
+   */
+  SyncedMemory(const shared_ptr<SyncedMemory>& base, size_t offset,
+      size_t size);
   ~SyncedMemory();
   const void* cpu_data();
   void set_cpu_data(void* data);
@@ -66,8 +72,14 @@ class SyncedMemory {
   void* mutable_cpu_data();
   void* mutable_gpu_data();
   enum SyncedHead { UNINITIALIZED, HEAD_AT_CPU, HEAD_AT_GPU, SYNCED };
-  SyncedHead head() { return head_; }
+  SyncedHead head() { return base_ ? base_->head() : head_; }
   size_t size() { return size_; }
+  /// @brief The memory this is a view of, or NULL.
+  SyncedMemory* base() const { return base_.get(); }
+  /// @brief The offset in bytes of this view in its base.
+  size_t offset() const { return offset_; }
+  /// @brief Whether this is a view of the bytes of memory found at offset.
+  bool is_view_of(const SyncedMemory& memory, size_t offset) const;
 
 #ifndef CPU_ONLY
   void async_gpu_push(const cudaStream_t& stream);
@@ -86,6 +98,8 @@ class SyncedMemory {
   bool cpu_malloc_use_cuda_;
   bool own_gpu_data_;
   int device_;
+  shared_ptr<SyncedMemory> base_;
+  size_t offset_;
 
   DISABLE_COPY_AND_ASSIGN(SyncedMemory);
 };  // class SyncedMemory
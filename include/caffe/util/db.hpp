@@ -19,6 +19,11 @@ class Cursor {
   virtual string key() = 0;
   virtual string value() = 0;
   virtual bool valid() = 0;
+  // Positions the cursor on the record stored under key. Only the key-ordered
+  // backends (LEVELDB, LMDB) support it; PACKED seeks by index instead.
+  virtual void SeekToKey(const string& key) {
+    LOG(FATAL) << "This database backend does not support seeking by key";
+  }
 
   DISABLE_COPY_AND_ASSIGN(Cursor);
 };
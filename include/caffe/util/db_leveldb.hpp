@@ -24,6 +24,7 @@ class LevelDBCursor : public Cursor {
   virtual string key() { return iter_->key().ToString(); }
   virtual string value() { return iter_->value().ToString(); }
   virtual bool valid() { return iter_->Valid(); }
+  virtual void SeekToKey(const string& key) { iter_->Seek(key); }
 
  private:
   leveldb::Iterator* iter_;
@@ -35,6 +35,11 @@ class LMDBCursor : public Cursor {
         mdb_value_.mv_size);
   }
   virtual bool valid() { return valid_; }
+  virtual void SeekToKey(const string& key) {
+    mdb_key_.mv_size = key.size();
+    mdb_key_.mv_data = const_cast<char*>(key.data());
+    Seek(MDB_SET_KEY);
+  }
 
  private:
   void Seek(MDB_cursor_op op) {
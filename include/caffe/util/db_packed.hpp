@@ -0,0 +1,110 @@
+#ifndef CAFFE_UTIL_DB_PACKED_HPP
+#define CAFFE_UTIL_DB_PACKED_HPP
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include <string>
+#include <vector>
+
+#include "caffe/util/db.hpp"
+
+namespace caffe { namespace db {
+
+/**
+ * @brief Append-only packed record store.
+ *
+ * A packed database is a directory holding two files:
+ *   - data.pack:  records laid out back to back, each one a little header
+ *                 (uint32 key size, uint32 value size) followed by the key
+ *                 and value bytes;
+ *   - index.pack: one uint64 byte offset into data.pack per record.
+ *
+ * Both files are memory-mapped for reading, so iteration is a sequential
+ * scan of the data file and any record can be reached in O(1) through the
+ * index, which makes shuffling and sharding cheap.
+ */
+class PackedCursor : public Cursor {
+ public:
+  PackedCursor(const char* data, const uint64_t* offsets, size_t begin,
+      size_t end)
+    : data_(data), offsets_(offsets), begin_(begin), end_(end), pos_(begin) { }
+  virtual void SeekToFirst() { pos_ = begin_; }
+  virtual void Next() { ++pos_; }
+  virtual string key();
+  virtual string value();
+  virtual bool valid() { return pos_ < end_; }
+
+  /// @brief Moves to the index-th record of this cursor's range in O(1).
+  void Seek(size_t index) { pos_ = begin_ + index; }
+  /// @brief Index of the current record within this cursor's range.
+  size_t position() const { return pos_ - begin_; }
+  /// @brief Number of records visible to this cursor.
+  size_t size() const { return end_ - begin_; }
+
+ private:
+  void Header(uint32_t* key_size, uint32_t* value_size) const;
+
+  const char* data_;
+  const uint64_t* offsets_;
+  size_t begin_, end_, pos_;
+};
+
+class PackedDB;
+
+class PackedTransaction : public Transaction {
+ public:
+  explicit PackedTransaction(PackedDB* db) : db_(db) { CHECK_NOTNULL(db_); }
+  virtual void Put(const string& key, const string& value) {
+    keys_.push_back(key);
+    values_.push_back(value);
+  }
+  virtual void Commit();
+
+ private:
+  PackedDB* db_;
+  vector<string> keys_, values_;
+
+  DISABLE_COPY_AND_ASSIGN(PackedTransaction);
+};
+
+class PackedDB : public DB {
+ public:
+  PackedDB()
+    : data_file_(NULL), index_file_(NULL), data_(NULL), data_size_(0),
+      offsets_(NULL), index_size_(0), write_offset_(0) { }
+  virtual ~PackedDB() { Close(); }
+  virtual void Open(const string& source, Mode mode);
+  virtual void Close();
+  virtual PackedCursor* NewCursor() { return NewCursor(0, num_records()); }
+  virtual PackedTransaction* NewTransaction() {
+    return new PackedTransaction(this);
+  }
+
+  /// @brief Returns a cursor over the records [begin, end) of the index.
+  PackedCursor* NewCursor(size_t begin, size_t end);
+  /**
+   * @brief Returns a cursor over the shard-th of num_shards contiguous,
+   *        near-equal parts of the database.
+   */
+  PackedCursor* NewShardCursor(int shard, int num_shards);
+  size_t num_records() const { return index_size_ / sizeof(uint64_t); }
+
+  /// @brief Appends records to the end of the database; used by
+  ///        PackedTransaction::Commit.
+  void Append(const vector<string>& keys, const vector<string>& values);
+
+ private:
+  FILE* data_file_;
+  FILE* index_file_;
+  const char* data_;
+  size_t data_size_;
+  const uint64_t* offsets_;
+  size_t index_size_;
+  uint64_t write_offset_;
+};
+
+}  // namespace db
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_DB_PACKED_HPP
@@ -0,0 +1,79 @@
+#ifndef CAFFE_UTIL_EVALUATOR_HPP_
+#define CAFFE_UTIL_EVALUATOR_HPP_
+
+#include <vector>
+
+#include "caffe/blob.hpp"
+#include "caffe/common.hpp"
+#include "caffe/internal_thread.hpp"
+#include "caffe/net.hpp"
+#include "caffe/proto/caffe.pb.h"
+#include "caffe/util/blocking_queue.hpp"
+
+namespace caffe {
+
+/**
+ * @brief Adds up the outputs of the forward passes of a test net, and logs
+ *        their means.
+ */
+template <typename Dtype>
+class TestScores {
+ public:
+  TestScores() : loss_(), iterations_() { }
+
+  /// @brief Runs a forward pass of net and adds up its outputs.
+  void Forward(Net<Dtype>* net);
+  /// @brief Logs the mean outputs of net, and its mean loss if compute_loss.
+  void Log(const Net<Dtype>& net, bool compute_loss) const;
+
+ protected:
+  Dtype loss_;
+  vector<Dtype> scores_;
+  vector<int> output_ids_;
+  int iterations_;
+};
+
+/**
+ * @brief Evaluates the test nets of a solver on a background thread, while
+ *        training continues.
+ *
+ * The test nets keep their own copy of the params, refreshed from the train
+ * net by Submit() at the iteration being tested, so that the updates made in
+ * the meantime do not leak into the evaluation. One evaluation runs at a
+ * time: Submit() waits for the previous one to finish before copying.
+ */
+template <typename Dtype>
+class Evaluator : public InternalThread {
+ public:
+  Evaluator(const SolverParameter& param, const Net<Dtype>& net,
+      const vector<shared_ptr<Net<Dtype> > >& test_nets);
+  virtual ~Evaluator();
+
+  /**
+   * @brief Copies the params of the train net to the test nets and starts
+   *        evaluating them. Returns the time in ms spent waiting for the
+   *        previous evaluation.
+   */
+  float Submit(int iter);
+  /// @brief Blocks until the last submitted evaluation is logged.
+  void Wait();
+
+ protected:
+  virtual void InternalThreadEntry();
+  void Evaluate(int iter);
+
+  SolverParameter param_;
+  vector<shared_ptr<Net<Dtype> > > test_nets_;
+  // The params of the train net and their copies in the test nets.
+  vector<Blob<Dtype>*> sources_;
+  vector<Blob<Dtype>*> targets_;
+  // Holds a token while no evaluation runs, and the iterations to test.
+  BlockingQueue<int> idle_;
+  BlockingQueue<int> pending_;
+
+  DISABLE_COPY_AND_ASSIGN(Evaluator);
+};
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_EVALUATOR_HPP_
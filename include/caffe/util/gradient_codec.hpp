@@ -0,0 +1,105 @@
+#ifndef CAFFE_UTIL_GRADIENT_CODEC_HPP_
+#define CAFFE_UTIL_GRADIENT_CODEC_HPP_
+
+#include <stdint.h>
+
+#include <vector>
+
+#include "caffe/common.hpp"
+#include "caffe/proto/caffe.pb.h"
+
+namespace caffe {
+
+/**
+ * @brief Lossy encoding of gradients, to reduce the bytes exchanged by
+ *        data-parallel training.
+ *
+ * Codecs are created for a gradient buffer of a given size, and encode
+ * ranges of it identified by their offset, so that lossy codecs can keep
+ * the error of each value and add it back the next time it is encoded
+ * (error feedback).
+ */
+template <typename Dtype>
+class GradientCodec {
+ public:
+  GradientCodec() { }
+  virtual ~GradientCodec() { }
+
+  /**
+   * @brief Bytes per encoded value for codecs whose messages can be summed
+   *        and re-encoded at every hop of a ring reduction, 0 for codecs
+   *        whose messages are gathered from every rank and summed at once.
+   */
+  virtual int value_size() const { return 0; }
+
+  /**
+   * @brief Encodes the count values of data, found at offset in the
+   *        gradient buffer, into message.
+   */
+  virtual void Encode(const Dtype* data, size_t offset, size_t count,
+      vector<char>* message) = 0;
+  /// @brief Adds the count values encoded in message to data.
+  virtual void DecodeAdd(const char* message, size_t count, Dtype* data) = 0;
+
+  DISABLE_COPY_AND_ASSIGN(GradientCodec);
+};
+
+/**
+ * @brief Sends values in IEEE half precision. Without error feedback: the
+ *        rounding error is small compared to the noise of the gradients.
+ */
+template <typename Dtype>
+class FP16GradientCodec : public GradientCodec<Dtype> {
+ public:
+  FP16GradientCodec() { }
+  virtual int value_size() const { return sizeof(uint16_t); }
+  virtual void Encode(const Dtype* data, size_t offset, size_t count,
+      vector<char>* message);
+  virtual void DecodeAdd(const char* message, size_t count, Dtype* data);
+};
+
+/**
+ * @brief Sends the indices and values of the ratio * count values of
+ *        largest magnitude, and keeps the others for the next encoding.
+ */
+template <typename Dtype>
+class TopKGradientCodec : public GradientCodec<Dtype> {
+ public:
+  TopKGradientCodec(size_t size, float ratio);
+  virtual void Encode(const Dtype* data, size_t offset, size_t count,
+      vector<char>* message);
+  virtual void DecodeAdd(const char* message, size_t count, Dtype* data);
+
+ protected:
+  float ratio_;
+  vector<Dtype> residual_;
+  vector<Dtype> magnitudes_;
+};
+
+/**
+ * @brief Sends the sign of every value and their mean magnitude, and keeps
+ *        the difference with the values sent for the next encoding.
+ */
+template <typename Dtype>
+class SignGradientCodec : public GradientCodec<Dtype> {
+ public:
+  explicit SignGradientCodec(size_t size);
+  virtual void Encode(const Dtype* data, size_t offset, size_t count,
+      vector<char>* message);
+  virtual void DecodeAdd(const char* message, size_t count, Dtype* data);
+
+ protected:
+  vector<Dtype> residual_;
+};
+
+/**
+ * @brief Returns the codec selected by param.gradient_compression() for a
+ *        gradient buffer of size values, or NULL to send values as is.
+ */
+template <typename Dtype>
+GradientCodec<Dtype>* GetGradientCodec(const SolverParameter& param,
+    size_t size);
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_GRADIENT_CODEC_HPP_
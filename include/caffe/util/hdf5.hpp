@@ -8,8 +8,22 @@
 
 #include "caffe/blob.hpp"
 
+/**
+ Forward declare boost::mutex instead of including boost/thread.hpp
+ to avoid a boost/NVCC issues (#1009, #1010) on OSX.
+ */
+namespace boost { class mutex; }
+
 namespace caffe {
 
+/**
+ * @brief The lock to hold around every use of the HDF5 library, which is not
+ *        thread-safe unless built so: HDF5 data is read by prefetch threads
+ *        while snapshots may be written in the background.  It is not
+ *        recursive, and the helpers below do not take it themselves.
+ */
+boost::mutex& hdf5_mutex();
+
 template <typename Dtype>
 void hdf5_load_nd_dataset_helper(
     hid_t file_id, const char* dataset_name_, int min_dim, int max_dim,
@@ -20,6 +34,19 @@ void hdf5_load_nd_dataset(
     hid_t file_id, const char* dataset_name_, int min_dim, int max_dim,
     Blob<Dtype>* blob, bool reshape = false);
 
+/**
+ * @brief Loads rows [first_row, first_row + num_rows) along the first axis of
+ *        a dataset into blob, which is reshaped to hold exactly those rows.
+ *        Only the selected rows are read from the file.
+ */
+template <typename Dtype>
+void hdf5_load_nd_dataset_rows(
+    hid_t file_id, const char* dataset_name_, hsize_t first_row,
+    hsize_t num_rows, Blob<Dtype>* blob);
+
+/// @brief Returns the length of the first axis of a dataset.
+hsize_t hdf5_get_num_rows(hid_t file_id, const char* dataset_name_);
+
 template <typename Dtype>
 void hdf5_save_nd_dataset(
     const hid_t file_id, const string& dataset_name, const Blob<Dtype>& blob,
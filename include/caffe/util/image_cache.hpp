@@ -0,0 +1,54 @@
+#ifndef CAFFE_UTIL_IMAGE_CACHE_HPP_
+#define CAFFE_UTIL_IMAGE_CACHE_HPP_
+
+#ifdef USE_OPENCV
+#include <string>
+
+#include "caffe/common.hpp"
+
+namespace cv { class Mat; }
+
+namespace caffe {
+
+/**
+ * @brief Process-wide cache of decoded images and their labels.
+ *
+ * Data layers that enable it (DataParameter and ImageDataParameter
+ * decoded_cache_bytes) share a single instance, so the TRAIN and TEST nets
+ * of one process reuse each other's entries. The byte budget is the largest
+ * one requested by any layer. Once it is reached new images are simply not
+ * cached: with data read in epochs, keeping the first images seen gives a
+ * steady hit rate where LRU eviction would miss on every access.
+ *
+ * Cached images are shared with the callers and must not be modified.
+ */
+class ImageCache {
+ public:
+  static ImageCache& Get();
+
+  /// @brief Raises the byte budget to at least capacity.
+  void Reserve(size_t capacity);
+  bool Lookup(const string& key, cv::Mat* image, int* label) const;
+  void Insert(const string& key, const cv::Mat& image, int label);
+
+  size_t size() const;
+  size_t capacity() const;
+
+ private:
+  ImageCache();
+
+  /**
+   Keep the entries and their lock out of the header, so that neither OpenCV
+   nor boost/thread.hpp need to be included here (see BlockingQueue).
+   */
+  class Impl;
+
+  shared_ptr<Impl> impl_;
+
+  DISABLE_COPY_AND_ASSIGN(ImageCache);
+};
+
+}  // namespace caffe
+
+#endif  // USE_OPENCV
+#endif  // CAFFE_UTIL_IMAGE_CACHE_HPP_
@@ -145,6 +145,8 @@ cv::Mat DecodeDatumToCVMatNative(const Datum& datum);
 cv::Mat DecodeDatumToCVMat(const Datum& datum, bool is_color);
 
 void CVMatToDatum(const cv::Mat& cv_img, Datum* datum);
+// Inverse of CVMatToDatum for an unencoded uint8 Datum.
+cv::Mat DatumToCVMat(const Datum& datum);
 #endif  // USE_OPENCV
 
 }  // namespace caffe
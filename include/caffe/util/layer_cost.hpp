@@ -0,0 +1,35 @@
+#ifndef CAFFE_UTIL_LAYER_COST_HPP_
+#define CAFFE_UTIL_LAYER_COST_HPP_
+
+#include <vector>
+
+#include "caffe/blob.hpp"
+#include "caffe/layer.hpp"
+
+namespace caffe {
+
+/**
+ * @brief Rough counts of the arithmetic operations and of the bytes of blobs
+ *        read and written by the forward and backward passes of a layer,
+ *        used to report the GFLOP/s and GB/s achieved by benchmarks.
+ *
+ * FLOPs are modeled for the compute-heavy layer types (convolution, inner
+ * product, pooling, normalization, element-wise and softmax layers), other
+ * layers count as 0 FLOPs. Bytes count every blob once per pass, ignoring
+ * caches and the temporary buffers of the layers.
+ */
+struct LayerCost {
+  double forward_flops;
+  double backward_flops;
+  double forward_bytes;
+  double backward_bytes;
+};
+
+template <typename Dtype>
+LayerCost EstimateLayerCost(Layer<Dtype>* layer,
+    const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top,
+    const vector<bool>& propagate_down);
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_LAYER_COST_HPP_
@@ -0,0 +1,70 @@
+#ifndef CAFFE_UTIL_PHILOX_H_
+#define CAFFE_UTIL_PHILOX_H_
+
+#include <stdint.h>
+
+// Callable from both host and device code when compiled by nvcc.
+#ifdef __CUDACC__
+#define CAFFE_PHILOX_FUNC __host__ __device__ inline
+#else
+#define CAFFE_PHILOX_FUNC inline
+#endif
+
+namespace caffe {
+
+/**
+ * @brief The Philox4x32-10 counter-based generator of Salmon et al.,
+ *        "Parallel Random Numbers: As Easy as 1, 2, 3" (SC 2011).
+ *
+ * Maps a 64 bit key and a 128 bit counter to 4 random 32 bit words, with no
+ * state carried from one call to the next. Element i of a stream drawn under
+ * one key is word i % 4 of the counter i / 4, so that any thread can compute
+ * any part of the stream on its own, on the CPU and the GPU alike.
+ */
+CAFFE_PHILOX_FUNC void philox4x32(const uint32_t key[2],
+    const uint32_t counter[4], uint32_t out[4]) {
+  const uint32_t kMul0 = 0xD2511F53u, kMul1 = 0xCD9E8D57u;
+  const uint32_t kWeyl0 = 0x9E3779B9u, kWeyl1 = 0xBB67AE85u;
+  uint32_t k0 = key[0], k1 = key[1];
+  uint32_t c0 = counter[0], c1 = counter[1], c2 = counter[2],
+      c3 = counter[3];
+  for (int round = 0; round < 10; ++round) {
+    const uint64_t p0 = static_cast<uint64_t>(kMul0) * c0;
+    const uint64_t p1 = static_cast<uint64_t>(kMul1) * c2;
+    const uint32_t hi0 = static_cast<uint32_t>(p0 >> 32);
+    const uint32_t hi1 = static_cast<uint32_t>(p1 >> 32);
+    c0 = hi1 ^ c1 ^ k0;
+    c1 = static_cast<uint32_t>(p1);
+    c2 = hi0 ^ c3 ^ k1;
+    c3 = static_cast<uint32_t>(p0);
+    k0 += kWeyl0;
+    k1 += kWeyl1;
+  }
+  out[0] = c0;
+  out[1] = c1;
+  out[2] = c2;
+  out[3] = c3;
+}
+
+/**
+ * @brief Returns the 32 Bernoulli draws for the elements 32 * word to
+ *        32 * word + 31 of the stream under key, packed LSB first: bit b is
+ *        set if element 32 * word + b exceeds threshold.
+ */
+CAFFE_PHILOX_FUNC uint32_t philox_bernoulli_word(const uint32_t key[2],
+    const uint32_t word, const uint32_t threshold) {
+  uint32_t bits = 0;
+  for (uint32_t group = 0; group < 8; ++group) {
+    const uint32_t counter[4] = {word * 8 + group, word >> 29, 0, 0};
+    uint32_t r[4];
+    philox4x32(key, counter, r);
+    for (int j = 0; j < 4; ++j) {
+      bits |= static_cast<uint32_t>(r[j] > threshold) << (group * 4 + j);
+    }
+  }
+  return bits;
+}
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_PHILOX_H_
@@ -0,0 +1,138 @@
+#ifndef CAFFE_UTIL_RING_COMM_HPP_
+#define CAFFE_UTIL_RING_COMM_HPP_
+
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+#include "caffe/common.hpp"
+#include "caffe/util/gradient_codec.hpp"
+
+namespace caffe {
+
+/**
+ * @brief A ring of processes: each rank sends to rank + 1 and receives from
+ *        rank - 1, modulo the size of the ring.
+ */
+class RingTransport {
+ public:
+  RingTransport(int rank, int size) : rank_(rank), size_(size) { }
+  virtual ~RingTransport() { }
+
+  /**
+   * @brief Sends send_size bytes to the next rank while receiving recv_size
+   *        bytes from the previous one. Either size can be 0.
+   */
+  virtual void SendRecv(const void* send, size_t send_size, void* recv,
+      size_t recv_size) = 0;
+
+  int rank() const { return rank_; }
+  int size() const { return size_; }
+
+ protected:
+  int rank_;
+  int size_;
+
+  DISABLE_COPY_AND_ASSIGN(RingTransport);
+};
+
+/**
+ * @brief A ring of TCP connections. Ranks meet at the address of rank 0,
+ *        which hands out the addresses of everyone's ring listener.
+ */
+class TCPRingTransport : public RingTransport {
+ public:
+  TCPRingTransport(const string& host, int port, int rank, int size);
+  virtual ~TCPRingTransport();
+  virtual void SendRecv(const void* send, size_t send_size, void* recv,
+      size_t recv_size);
+
+ private:
+  int next_fd_;
+  int prev_fd_;
+};
+
+/**
+ * @brief A ring through a POSIX shared memory segment, for ranks on one
+ *        host. Each rank owns a slot that it writes and the next rank reads,
+ *        large messages going through in slot-sized pieces.
+ */
+class ShmRingTransport : public RingTransport {
+ public:
+  ShmRingTransport(const string& name, int rank, int size);
+  virtual ~ShmRingTransport();
+  virtual void SendRecv(const void* send, size_t send_size, void* recv,
+      size_t recv_size);
+
+ private:
+  void* segment_;
+  size_t segment_size_;
+  // Pieces written to our slot and read from the previous rank's slot.
+  uint64_t pieces_sent_;
+  uint64_t pieces_received_;
+};
+
+/**
+ * @brief Returns the transport for uri, either tcp://HOST:PORT with the
+ *        address of rank 0, or shm://NAME.
+ */
+RingTransport* GetRingTransport(const string& uri, int rank, int size);
+
+/**
+ * @brief Collectives over a RingTransport.
+ */
+template <typename Dtype>
+class RingComm {
+ public:
+  RingComm(const string& uri, int rank, int size)
+    : transport_(GetRingTransport(uri, rank, size)), bytes_sent_() { }
+
+  /// @brief Sums data across all ranks, in place.
+  void AllReduce(Dtype* data, size_t count);
+  /**
+   * @brief Sums data across all ranks, in place, exchanging it encoded by
+   *        codec. data is found at offset in the buffer of the codec. All
+   *        ranks end up with the same, approximate, sums.
+   */
+  void AllReduce(Dtype* data, size_t count, size_t offset,
+      GradientCodec<Dtype>* codec);
+  /// @brief Copies data of rank 0 to all ranks.
+  void Broadcast(Dtype* data, size_t count);
+
+  int rank() const { return transport_->rank(); }
+  int size() const { return transport_->size(); }
+  /// @brief Bytes sent to the next rank so far.
+  size_t bytes_sent() const { return bytes_sent_; }
+
+ private:
+  void SendRecv(const void* send, size_t send_size, void* recv,
+      size_t recv_size) {
+    transport_->SendRecv(send, send_size, recv, recv_size);
+    bytes_sent_ += send_size;
+  }
+  // Codecs whose messages add up are reduced along the ring like raw
+  // values, the others by gathering the messages of all ranks.
+  void RingAllReduce(Dtype* data, size_t count, size_t offset,
+      GradientCodec<Dtype>* codec);
+  void GatherAllReduce(Dtype* data, size_t count, size_t offset,
+      GradientCodec<Dtype>* codec);
+
+  size_t ChunkBegin(size_t count, int chunk) const {
+    return count * chunk / size();
+  }
+  size_t ChunkSize(size_t count, int chunk) const {
+    return ChunkBegin(count, chunk + 1) - ChunkBegin(count, chunk);
+  }
+
+  shared_ptr<RingTransport> transport_;
+  vector<Dtype> buffer_;
+  vector<vector<char> > messages_;
+  size_t bytes_sent_;
+
+  DISABLE_COPY_AND_ASSIGN(RingComm);
+};
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_RING_COMM_HPP_
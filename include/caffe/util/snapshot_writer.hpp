@@ -0,0 +1,67 @@
+#ifndef CAFFE_UTIL_SNAPSHOT_WRITER_HPP_
+#define CAFFE_UTIL_SNAPSHOT_WRITER_HPP_
+
+#include <string>
+
+#include "caffe/common.hpp"
+#include "caffe/internal_thread.hpp"
+#include "caffe/proto/caffe.pb.h"
+#include "caffe/util/blocking_queue.hpp"
+
+namespace caffe {
+
+/**
+ * @brief An in-memory copy of everything a solver snapshot writes: the
+ *        learned net and the solver state, along with their file names.
+ */
+struct SnapshotData {
+  SolverParameter_SnapshotFormat format;
+  bool write_diff;
+  string model_filename;
+  string state_filename;
+  NetParameter net;
+  SolverState state;
+};
+
+/**
+ * @brief Writes solver snapshots, optionally on a background thread.
+ *
+ * The solver fills the buffer returned by Acquire() with a copy of its net
+ * and state, which is cheap compared to serializing them, and hands it back
+ * through Submit(). A single buffer is used, so at most one snapshot is held
+ * in memory, and only until it is written: Acquire() blocks while the
+ * previous snapshot is still being written. Every file is first written
+ * under a temporary name, fsync'd and then renamed, so an interrupted write
+ * never leaves a truncated snapshot.
+ */
+template <typename Dtype>
+class SnapshotWriter : public InternalThread {
+ public:
+  explicit SnapshotWriter(bool async);
+  virtual ~SnapshotWriter();
+
+  /// @brief Returns the buffer to fill, once the last snapshot is written.
+  SnapshotData* Acquire();
+  /// @brief Writes a buffer returned by Acquire(), in the background if
+  ///        async.
+  void Submit(SnapshotData* data);
+  /// @brief Blocks until all submitted snapshots are on disk.
+  void Wait();
+
+  /// @brief Writes the model then the solver state files of data.
+  static void Write(const SnapshotData& data);
+
+ protected:
+  virtual void InternalThreadEntry();
+
+  bool async_;
+  SnapshotData data_;
+  BlockingQueue<SnapshotData*> free_;
+  BlockingQueue<SnapshotData*> full_;
+
+  DISABLE_COPY_AND_ASSIGN(SnapshotWriter);
+};
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_SNAPSHOT_WRITER_HPP_
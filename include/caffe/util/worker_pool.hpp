@@ -0,0 +1,47 @@
+#ifndef CAFFE_UTIL_WORKER_POOL_HPP_
+#define CAFFE_UTIL_WORKER_POOL_HPP_
+
+#include <boost/function.hpp>
+
+#include "caffe/common.hpp"
+
+namespace caffe {
+
+/**
+ * @brief A fixed set of threads, started once, that run the parts of a task
+ *        in parallel. Meant for work repeated on every iteration, where
+ *        spawning threads per call would cost more than the work itself.
+ */
+class WorkerPool {
+ public:
+  /// @brief Starts num_threads - 1 workers, the caller being the last one.
+  explicit WorkerPool(int num_threads);
+  ~WorkerPool();
+
+  inline int num_threads() const { return num_threads_; }
+
+  /**
+   * @brief Runs task(part) for every part in [0, num_threads()), the calling
+   *        thread running part 0, and returns once all of them are done.
+   *        Run must not be called by several threads at once.
+   */
+  void Run(const boost::function<void(int)>& task);
+
+ protected:
+  /**
+   Move synchronization fields out instead of including boost/thread.hpp
+   to avoid a boost/NVCC issues (#1009, #1010) on OSX.
+   */
+  class sync;
+
+  void Entry(int part);
+
+  int num_threads_;
+  shared_ptr<sync> sync_;
+
+  DISABLE_COPY_AND_ASSIGN(WorkerPool);
+};
+
+}  // namespace caffe
+
+#endif  // CAFFE_UTIL_WORKER_POOL_HPP_
@@ -108,20 +108,26 @@ void CheckContiguousArray(PyArrayObject* arr, string name,
 // Net constructor
 shared_ptr<Net<Dtype> > Net_Init(string network_file, int phase,
     const int level, const bp::object& stages,
-    const bp::object& weights) {
+    const bp::object& weights, const bp::object& forward_only) {
   CheckFile(network_file);
 
-  // Convert stages from list to vector
-  vector<string> stages_vector;
+  // Set phase, stages and level, as Net does for a file
+  NetParameter param;
+  ReadNetParamsFromTextFileOrDie(network_file, &param);
+  param.mutable_state()->set_phase(static_cast<Phase>(phase));
   if (!stages.is_none()) {
     for (int i = 0; i < len(stages); i++) {
-      stages_vector.push_back(bp::extract<string>(stages[i]));
+      param.mutable_state()->add_stage(bp::extract<string>(stages[i]));
     }
   }
+  param.mutable_state()->set_level(level);
+  // Override forward_only, which drops the diffs of a TEST net
+  if (!forward_only.is_none()) {
+    param.set_forward_only(bp::extract<bool>(forward_only));
+  }
 
   // Initialize net
-  shared_ptr<Net<Dtype> > net(new Net<Dtype>(network_file,
-        static_cast<Phase>(phase), level, &stages_vector));
+  shared_ptr<Net<Dtype> > net(new Net<Dtype>(param));
 
   // Load weights
   if (!weights.is_none()) {
@@ -241,6 +247,13 @@ struct NdarrayCallPolicies : public bp::default_call_policies {
   }
 };
 
+Dtype* Blob_MutableCpuDiff(Blob<Dtype>* blob) {
+  if (blob->inference_only()) {
+    throw std::runtime_error("Blob of a forward_only net has no diff");
+  }
+  return blob->mutable_cpu_diff();
+}
+
 bp::object Blob_Reshape(bp::tuple args, bp::dict kwargs) {
   if (bp::len(kwargs) > 0) {
     throw std::runtime_error("Blob.reshape takes no kwargs");
@@ -408,7 +421,8 @@ BOOST_PYTHON_MODULE(_caffe) {
     .def("__init__", bp::make_constructor(&Net_Init,
           bp::default_call_policies(), (bp::arg("network_file"), "phase",
             bp::arg("level")=0, bp::arg("stages")=bp::object(),
-            bp::arg("weights")=bp::object())))
+            bp::arg("weights")=bp::object(),
+            bp::arg("forward_only")=bp::object())))
     // Legacy constructor
     .def("__init__", bp::make_constructor(&Net_Init_Load))
     .def("_forward", &Net<Dtype>::ForwardFromTo)
@@ -474,8 +488,9 @@ BOOST_PYTHON_MODULE(_caffe) {
 #endif
     .add_property("data",     bp::make_function(&Blob<Dtype>::mutable_cpu_data,
           NdarrayCallPolicies()))
-    .add_property("diff",     bp::make_function(&Blob<Dtype>::mutable_cpu_diff,
-          NdarrayCallPolicies()));
+    .add_property("diff",     bp::make_function(&Blob_MutableCpuDiff,
+          NdarrayCallPolicies()))
+    .add_property("inference_only", &Blob<Dtype>::inference_only);
   BP_REGISTER_SHARED_PTR_TO_PYTHON(Blob<Dtype>);
 
   bp::class_<Layer<Dtype>, shared_ptr<PythonLayer<Dtype> >,
@@ -236,6 +236,15 @@ layer {
         net = caffe.Net(self.f.name, caffe.TEST, level=1)
         self.check_net(net, ['NoLevel', 'Level1Only', 'Level>=0', 'Level>=1'])
 
+    def test_forward_only(self):
+        net = caffe.Net(self.f.name, caffe.TEST, level=1, forward_only=True)
+        self.check_net(net, ['NoLevel', 'Level1Only', 'Level>=0', 'Level>=1'])
+        net.forward()
+        for blob in net.blobs.values():
+            self.assertTrue(blob.inference_only)
+            with self.assertRaises(RuntimeError):
+                blob.diff
+
 
 class TestStages(unittest.TestCase):
 
@@ -37,10 +37,17 @@ void Blob<Dtype>::Reshape(const vector<int>& shape) {
     shape_[i] = shape[i];
     shape_data[i] = shape[i];
   }
-  if (count_ > capacity_) {
+  // Views into other Blobs cannot be resized in place.
+  const size_t size = count_ * sizeof(Dtype);
+  const bool resized_view = (data_ && data_->base() && data_->size() != size)
+      || (diff_ && diff_->base() && diff_->size() != size);
+  if (count_ > capacity_ || resized_view) {
     capacity_ = count_;
     data_.reset(new SyncedMemory(capacity_ * sizeof(Dtype)));
-    diff_.reset(new SyncedMemory(capacity_ * sizeof(Dtype)));
+    if (!inference_only_) {
+      diff_.reset(new SyncedMemory(capacity_ * sizeof(Dtype)));
+    }
+    if (diff_rows_) { diff_rows_.reset(new DiffRows()); }
   }
 }
 
@@ -63,14 +70,14 @@ template <typename Dtype>
 Blob<Dtype>::Blob(const int num, const int channels, const int height,
     const int width)
   // capacity_ must be initialized before calling Reshape
-  : capacity_(0) {
+  : capacity_(0), inference_only_(false) {
   Reshape(num, channels, height, width);
 }
 
 template <typename Dtype>
 Blob<Dtype>::Blob(const vector<int>& shape)
   // capacity_ must be initialized before calling Reshape
-  : capacity_(0) {
+  : capacity_(0), inference_only_(false) {
   Reshape(shape);
 }
 
@@ -91,9 +98,9 @@ void Blob<Dtype>::set_cpu_data(Dtype* data) {
   CHECK(data);
   // Make sure CPU and GPU sizes remain equal
   size_t size = count_ * sizeof(Dtype);
-  if (data_->size() != size) {
+  if (data_->size() != size || data_->base()) {
     data_.reset(new SyncedMemory(size));
-    diff_.reset(new SyncedMemory(size));
+    if (!inference_only_) { diff_.reset(new SyncedMemory(size)); }
   }
   data_->set_cpu_data(data);
 }
@@ -109,9 +116,9 @@ void Blob<Dtype>::set_gpu_data(Dtype* data) {
   CHECK(data);
   // Make sure CPU and GPU sizes remain equal
   size_t size = count_ * sizeof(Dtype);
-  if (data_->size() != size) {
+  if (data_->size() != size || data_->base()) {
     data_.reset(new SyncedMemory(size));
-    diff_.reset(new SyncedMemory(size));
+    if (!inference_only_) { diff_.reset(new SyncedMemory(size)); }
   }
   data_->set_gpu_data(data);
 }
@@ -161,7 +168,52 @@ void Blob<Dtype>::ShareData(const Blob& other) {
 template <typename Dtype>
 void Blob<Dtype>::ShareDiff(const Blob& other) {
   CHECK_EQ(count_, other.count());
-  diff_ = other.diff();
+  if (inference_only_) { return; }
+  diff_ = other.diff_;
+  diff_rows_ = other.diff_rows_;
+}
+
+template <typename Dtype>
+void Blob<Dtype>::ShareData(const Blob& other, int offset) {
+  CHECK_GE(offset, 0);
+  CHECK_LE(offset + count_, other.count());
+  data_.reset(new SyncedMemory(other.data(), offset * sizeof(Dtype),
+      count_ * sizeof(Dtype)));
+}
+
+template <typename Dtype>
+void Blob<Dtype>::ShareDiff(const Blob& other, int offset) {
+  CHECK_GE(offset, 0);
+  CHECK_LE(offset + count_, other.count());
+  diff_rows_.reset();
+  if (inference_only_ || !other.diff_) {
+    diff_.reset();
+    return;
+  }
+  diff_.reset(new SyncedMemory(other.diff_, offset * sizeof(Dtype),
+      count_ * sizeof(Dtype)));
+}
+
+template <typename Dtype>
+void Blob<Dtype>::set_inference_only(bool inference_only) {
+  inference_only_ = inference_only;
+  if (inference_only) {
+    diff_.reset();
+    diff_rows_.reset();
+  } else if (!diff_) {
+    diff_.reset(new SyncedMemory(capacity_ * sizeof(Dtype)));
+  }
+}
+
+template <typename Dtype>
+void Blob<Dtype>::set_sparse_diff(bool sparse_diff) {
+  if (!sparse_diff) {
+    diff_rows_.reset();
+  } else if (!diff_rows_) {
+    // Any row may have been written so far.
+    if (diff_) { caffe_set(count_, Dtype(0), mutable_cpu_diff()); }
+    diff_rows_.reset(new DiffRows());
+  }
 }
 
 // The "update" method is used for parameter blobs in a Net, which are stored
@@ -169,13 +221,33 @@ void Blob<Dtype>::ShareDiff(const Blob& other) {
 // Blob<int> or Blob<unsigned int>.
 template <> void Blob<unsigned int>::Update() { NOT_IMPLEMENTED; }
 template <> void Blob<int>::Update() { NOT_IMPLEMENTED; }
+template <> void Blob<unsigned int>::ClearDiff() { NOT_IMPLEMENTED; }
+template <> void Blob<int>::ClearDiff() { NOT_IMPLEMENTED; }
+template <> void Blob<unsigned int>::set_sparse_diff(bool sparse_diff) {
+  NOT_IMPLEMENTED;
+}
+template <> void Blob<int>::set_sparse_diff(bool sparse_diff) {
+  NOT_IMPLEMENTED;
+}
 
 template <typename Dtype>
 void Blob<Dtype>::Update() {
+  CHECK(diff_) << "Cannot update a blob without diff.";
   // We will perform update based on where the data is located.
   switch (data_->head()) {
   case SyncedMemory::HEAD_AT_CPU:
     // perform computation on CPU
+    if (diff_rows_) {
+      const int row_size = count(1);
+      const vector<int>& rows = diff_rows_->rows;
+      const Dtype* diff = static_cast<const Dtype*>(diff_->cpu_data());
+      Dtype* data = static_cast<Dtype*>(data_->mutable_cpu_data());
+      for (int i = 0; i < rows.size(); ++i) {
+        caffe_axpy<Dtype>(row_size, Dtype(-1), diff + rows[i] * row_size,
+            data + rows[i] * row_size);
+      }
+      break;
+    }
     caffe_axpy<Dtype>(count_, Dtype(-1),
         static_cast<const Dtype*>(diff_->cpu_data()),
         static_cast<Dtype*>(data_->mutable_cpu_data()));
@@ -196,6 +268,38 @@ void Blob<Dtype>::Update() {
   }
 }
 
+template <typename Dtype>
+void Blob<Dtype>::ClearDiff() {
+  if (!diff_) { return; }
+  if (diff_rows_) {
+    vector<int>& rows = diff_rows_->rows;
+    if (Caffe::mode() == Caffe::CPU) {
+      const int row_size = count(1);
+      Dtype* diff = mutable_cpu_diff();
+      for (int i = 0; i < rows.size(); ++i) {
+        caffe_set(row_size, Dtype(0), diff + rows[i] * row_size);
+      }
+    }
+    for (int i = 0; i < rows.size(); ++i) {
+      diff_rows_->marked[rows[i]] = false;
+    }
+    rows.clear();
+    if (Caffe::mode() == Caffe::CPU) { return; }
+  }
+  switch (Caffe::mode()) {
+  case Caffe::CPU:
+    caffe_set(count_, Dtype(0), mutable_cpu_diff());
+    break;
+  case Caffe::GPU:
+#ifndef CPU_ONLY
+    caffe_gpu_set(count_, Dtype(0), mutable_gpu_diff());
+#else
+    NO_GPU;
+#endif
+    break;
+  }
+}
+
 template <> unsigned int Blob<unsigned int>::asum_data() const {
   NOT_IMPLEMENTED;
   return 0;
@@ -321,6 +425,16 @@ Dtype Blob<Dtype>::sumsq_diff() const {
   switch (diff_->head()) {
   case SyncedMemory::HEAD_AT_CPU:
     diff = cpu_diff();
+    if (diff_rows_) {
+      const int row_size = count(1);
+      const vector<int>& rows = diff_rows_->rows;
+      sumsq = 0;
+      for (int i = 0; i < rows.size(); ++i) {
+        const Dtype* row = diff + rows[i] * row_size;
+        sumsq += caffe_cpu_dot(row_size, row, row);
+      }
+      break;
+    }
     sumsq = caffe_cpu_dot(count_, diff, diff);
     break;
   case SyncedMemory::HEAD_AT_GPU:
@@ -441,8 +555,7 @@ void Blob<Dtype>::CopyFrom(const Blob& source, bool copy_diff, bool reshape) {
   switch (Caffe::mode()) {
   case Caffe::GPU:
     if (copy_diff) {
-      caffe_copy(count_, source.gpu_diff(),
-          static_cast<Dtype*>(diff_->mutable_gpu_data()));
+      caffe_copy(count_, source.gpu_diff(), mutable_gpu_diff());
     } else {
       caffe_copy(count_, source.gpu_data(),
           static_cast<Dtype*>(data_->mutable_gpu_data()));
@@ -450,8 +563,7 @@ void Blob<Dtype>::CopyFrom(const Blob& source, bool copy_diff, bool reshape) {
     break;
   case Caffe::CPU:
     if (copy_diff) {
-      caffe_copy(count_, source.cpu_diff(),
-          static_cast<Dtype*>(diff_->mutable_cpu_data()));
+      caffe_copy(count_, source.cpu_diff(), mutable_cpu_diff());
     } else {
       caffe_copy(count_, source.cpu_data(),
           static_cast<Dtype*>(data_->mutable_cpu_data()));
@@ -498,6 +610,10 @@ void Blob<Dtype>::FromProto(const BlobProto& proto, bool reshape) {
       data_vec[i] = proto.data(i);
     }
   }
+  // Inference-only blobs ignore the diffs stored along with snapshots.
+  if (inference_only_) {
+    return;
+  }
   if (proto.double_diff_size() > 0) {
     CHECK_EQ(count_, proto.double_diff_size());
     Dtype* diff_vec = mutable_cpu_diff();
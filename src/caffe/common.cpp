@@ -53,7 +53,8 @@ void GlobalInit(int* pargc, char*** pargv) {
 
 Caffe::Caffe()
     : random_generator_(), mode_(Caffe::CPU),
-      solver_count_(1), solver_rank_(0), multiprocess_(false) { }
+      solver_count_(1), solver_rank_(0), multiprocess_(false),
+      rng_threads_(0) { }
 
 Caffe::~Caffe() { }
 
@@ -107,7 +108,8 @@ void* Caffe::RNG::generator() {
 Caffe::Caffe()
     : cublas_handle_(NULL), curand_generator_(NULL), random_generator_(),
     mode_(Caffe::CPU),
-    solver_count_(1), solver_rank_(0), multiprocess_(false) {
+    solver_count_(1), solver_rank_(0), multiprocess_(false),
+    rng_threads_(0) {
   // Try to create a cublas handler, and report an error if failed (but we will
   // keep the program running as one might just want to run CPU code).
   if (cublasCreate(&cublas_handle_) != CUBLAS_STATUS_SUCCESS) {
@@ -1,7 +1,13 @@
 #ifdef USE_OPENCV
 #include <opencv2/core/core.hpp>
+#include <opencv2/imgproc/imgproc.hpp>
 #endif  // USE_OPENCV
 
+#include <boost/random/uniform_real.hpp>
+#include <boost/random/variate_generator.hpp>
+
+#include <algorithm>
+#include <cmath>
 #include <string>
 #include <vector>
 
@@ -36,6 +42,111 @@ DataTransformer<Dtype>::DataTransformer(const TransformationParameter& param,
       mean_values_.push_back(param_.mean_value(c));
     }
   }
+  // check the augmentation
+  CHECK_GT(param_.min_crop_area(), 0);
+  CHECK_LE(param_.min_crop_area(), 1);
+  CHECK_GE(param_.max_aspect_ratio(), 1);
+  CHECK_GT(param_.min_resize_ratio(), 0);
+  CHECK_LE(param_.min_resize_ratio(), param_.max_resize_ratio());
+  CHECK_GE(param_.brightness(), 0);
+  CHECK_GE(param_.color_gain(), 0);
+  CHECK_LT(param_.color_gain(), 1);
+  resize_augment_ = phase_ == TRAIN && (param_.min_crop_area() < 1 ||
+      param_.max_aspect_ratio() > 1 || param_.min_resize_ratio() != 1 ||
+      param_.max_resize_ratio() != 1);
+  if (resize_augment_) {
+    CHECK(param_.crop_size()) << "Resizing augmentation requires crop_size";
+    CHECK(!param_.has_mean_file()) <<
+      "Resizing augmentation cannot be used with mean_file; use mean_value";
+  }
+}
+
+namespace {
+
+// Crops, mirrors, color jitters, subtracts the mean from and scales one
+// channel in a single pass, writing it as a contiguous height x width plane
+// of dst: dst = (src * gain + bias - mean) * scale. src points at the
+// top-left pixel of the crop, with rows src_step and pixels src_stride
+// elements apart. mean points at the matching pixel of a per-pixel mean plane
+// with rows mean_step apart, or is NULL to subtract mean_value instead.
+// The branches are hoisted out of the inner loops, which are left simple
+// enough for the compiler to vectorize, conversion to Dtype included.
+template <typename Dtype, typename SrcType>
+void TransformPlane(const SrcType* src, int src_step, int src_stride,
+    const Dtype* mean, int mean_step, Dtype mean_value, Dtype gain, Dtype bias,
+    Dtype scale, int height, int width, bool do_mirror, Dtype* dst) {
+  const Dtype shift = mean_value - bias;
+  for (int h = 0; h < height; ++h) {
+    const SrcType* src_row = src + h * src_step;
+    Dtype* dst_row = dst + h * width;
+    if (mean) {
+      const Dtype* mean_row = mean + h * mean_step;
+      if (do_mirror) {
+        Dtype* dst_end = dst_row + width - 1;
+        for (int w = 0; w < width; ++w) {
+          dst_end[-w] = (static_cast<Dtype>(src_row[w * src_stride]) * gain
+              + bias - mean_row[w]) * scale;
+        }
+      } else {
+        for (int w = 0; w < width; ++w) {
+          dst_row[w] = (static_cast<Dtype>(src_row[w * src_stride]) * gain
+              + bias - mean_row[w]) * scale;
+        }
+      }
+    } else {
+      if (do_mirror) {
+        Dtype* dst_end = dst_row + width - 1;
+        for (int w = 0; w < width; ++w) {
+          dst_end[-w] = (static_cast<Dtype>(src_row[w * src_stride]) * gain
+              - shift) * scale;
+        }
+      } else {
+        for (int w = 0; w < width; ++w) {
+          dst_row[w] = (static_cast<Dtype>(src_row[w * src_stride]) * gain
+              - shift) * scale;
+        }
+      }
+    }
+  }
+}
+
+}  // namespace
+
+template<typename Dtype>
+void DataTransformer<Dtype>::CheckMean(int channels, int height, int width) {
+  if (param_.has_mean_file()) {
+    CHECK_EQ(channels, data_mean_.channels());
+    CHECK_EQ(height, data_mean_.height());
+    CHECK_EQ(width, data_mean_.width());
+  }
+  if (mean_values_.size() > 0) {
+    CHECK(mean_values_.size() == 1 || mean_values_.size() == channels) <<
+     "Specify either 1 mean_value or as many as channels: " << channels;
+    if (channels > 1 && mean_values_.size() == 1) {
+      // Replicate the mean_value for simplicity
+      for (int c = 1; c < channels; ++c) {
+        mean_values_.push_back(mean_values_[0]);
+      }
+    }
+  }
+}
+
+template<typename Dtype>
+void DataTransformer<Dtype>::CropOffsets(int height, int width,
+                                         int* h_off, int* w_off) {
+  const int crop_size = param_.crop_size();
+  *h_off = 0;
+  *w_off = 0;
+  if (crop_size) {
+    // We only do random crop when we do training.
+    if (phase_ == TRAIN) {
+      *h_off = Rand(height - crop_size + 1);
+      *w_off = Rand(width - crop_size + 1);
+    } else {
+      *h_off = (height - crop_size) / 2;
+      *w_off = (width - crop_size) / 2;
+    }
+  }
 }
 
 template<typename Dtype>
@@ -49,79 +160,38 @@ void DataTransformer<Dtype>::Transform(const Datum& datum,
   const int crop_size = param_.crop_size();
   const Dtype scale = param_.scale();
   const bool do_mirror = param_.mirror() && Rand(2);
-  const bool has_mean_file = param_.has_mean_file();
   const bool has_uint8 = data.size() > 0;
-  const bool has_mean_values = mean_values_.size() > 0;
 
   CHECK_GT(datum_channels, 0);
   CHECK_GE(datum_height, crop_size);
   CHECK_GE(datum_width, crop_size);
+  CheckMean(datum_channels, datum_height, datum_width);
 
-  Dtype* mean = NULL;
-  if (has_mean_file) {
-    CHECK_EQ(datum_channels, data_mean_.channels());
-    CHECK_EQ(datum_height, data_mean_.height());
-    CHECK_EQ(datum_width, data_mean_.width());
-    mean = data_mean_.mutable_cpu_data();
-  }
-  if (has_mean_values) {
-    CHECK(mean_values_.size() == 1 || mean_values_.size() == datum_channels) <<
-     "Specify either 1 mean_value or as many as channels: " << datum_channels;
-    if (datum_channels > 1 && mean_values_.size() == 1) {
-      // Replicate the mean_value for simplicity
-      for (int c = 1; c < datum_channels; ++c) {
-        mean_values_.push_back(mean_values_[0]);
-      }
-    }
-  }
+  const int height = crop_size ? crop_size : datum_height;
+  const int width = crop_size ? crop_size : datum_width;
+  int h_off, w_off;
+  CropOffsets(datum_height, datum_width, &h_off, &w_off);
 
-  int height = datum_height;
-  int width = datum_width;
+  vector<Dtype> gains;
+  Dtype bias;
+  RandJitter(datum_channels, &gains, &bias);
 
-  int h_off = 0;
-  int w_off = 0;
-  if (crop_size) {
-    height = crop_size;
-    width = crop_size;
-    // We only do random crop when we do training.
-    if (phase_ == TRAIN) {
-      h_off = Rand(datum_height - crop_size + 1);
-      w_off = Rand(datum_width - crop_size + 1);
-    } else {
-      h_off = (datum_height - crop_size) / 2;
-      w_off = (datum_width - crop_size) / 2;
-    }
-  }
-
-  Dtype datum_element;
-  int top_index, data_index;
+  const Dtype* mean = param_.has_mean_file() ? data_mean_.cpu_data() : NULL;
   for (int c = 0; c < datum_channels; ++c) {
-    for (int h = 0; h < height; ++h) {
-      for (int w = 0; w < width; ++w) {
-        data_index = (c * datum_height + h_off + h) * datum_width + w_off + w;
-        if (do_mirror) {
-          top_index = (c * height + h) * width + (width - 1 - w);
-        } else {
-          top_index = (c * height + h) * width + w;
-        }
-        if (has_uint8) {
-          datum_element =
-            static_cast<Dtype>(static_cast<uint8_t>(data[data_index]));
-        } else {
-          datum_element = datum.float_data(data_index);
-        }
-        if (has_mean_file) {
-          transformed_data[top_index] =
-            (datum_element - mean[data_index]) * scale;
-        } else {
-          if (has_mean_values) {
-            transformed_data[top_index] =
-              (datum_element - mean_values_[c]) * scale;
-          } else {
-            transformed_data[top_index] = datum_element * scale;
-          }
-        }
-      }
+    // Datum pixels are stored channel by channel, like the output.
+    const int data_index = (c * datum_height + h_off) * datum_width + w_off;
+    const Dtype* mean_c = mean ? mean + data_index : NULL;
+    const Dtype mean_value = mean_values_.size() > 0 ? mean_values_[c] : 0;
+    Dtype* dst = transformed_data + c * height * width;
+    if (has_uint8) {
+      TransformPlane(
+          reinterpret_cast<const uint8_t*>(data.data()) + data_index,
+          datum_width, 1, mean_c, datum_width, mean_value, gains[c], bias,
+          scale, height, width, do_mirror, dst);
+    } else {
+      TransformPlane(datum.float_data().data() + data_index,
+          datum_width, 1, mean_c, datum_width, mean_value, gains[c], bias,
+          scale, height, width, do_mirror, dst);
     }
   }
 }
@@ -130,20 +200,18 @@ void DataTransformer<Dtype>::Transform(const Datum& datum,
 template<typename Dtype>
 void DataTransformer<Dtype>::Transform(const Datum& datum,
                                        Blob<Dtype>* transformed_blob) {
+  Transform(datum, transformed_blob, 0);
+}
+
+template<typename Dtype>
+void DataTransformer<Dtype>::Transform(const Datum& datum,
+                                       Blob<Dtype>* transformed_blob,
+                                       int item_id) {
   // If datum is encoded, decode and transform the cv::image.
   if (datum.encoded()) {
 #ifdef USE_OPENCV
-    CHECK(!(param_.force_color() && param_.force_gray()))
-        << "cannot set both force_color and force_gray";
-    cv::Mat cv_img;
-    if (param_.force_color() || param_.force_gray()) {
-    // If force_color then decode in color otherwise decode in gray.
-      cv_img = DecodeDatumToCVMat(datum, param_.force_color());
-    } else {
-      cv_img = DecodeDatumToCVMatNative(datum);
-    }
     // Transform the cv::image into blob.
-    return Transform(cv_img, transformed_blob);
+    return Transform(DecodeDatum(datum), transformed_blob, item_id);
 #else
     LOG(FATAL) << "Encoded datum requires OpenCV; compile with USE_OPENCV.";
 #endif  // USE_OPENCV
@@ -152,6 +220,15 @@ void DataTransformer<Dtype>::Transform(const Datum& datum,
       LOG(ERROR) << "force_color and force_gray only for encoded datum";
     }
   }
+  if (resize_augment_) {
+#ifdef USE_OPENCV
+    // Resizing needs the image as a cv::Mat.
+    return Transform(DatumToCVMat(datum), transformed_blob, item_id);
+#else
+    LOG(FATAL) << "Resizing augmentation requires OpenCV; "
+               << "compile with USE_OPENCV.";
+#endif  // USE_OPENCV
+  }
 
   const int crop_size = param_.crop_size();
   const int datum_channels = datum.channels();
@@ -167,7 +244,8 @@ void DataTransformer<Dtype>::Transform(const Datum& datum,
   CHECK_EQ(channels, datum_channels);
   CHECK_LE(height, datum_height);
   CHECK_LE(width, datum_width);
-  CHECK_GE(num, 1);
+  CHECK_GE(item_id, 0);
+  CHECK_LT(item_id, num);
 
   if (crop_size) {
     CHECK_EQ(crop_size, height);
@@ -178,7 +256,7 @@ void DataTransformer<Dtype>::Transform(const Datum& datum,
   }
 
   Dtype* transformed_data = transformed_blob->mutable_cpu_data();
-  Transform(datum, transformed_data);
+  Transform(datum, transformed_data + transformed_blob->offset(item_id));
 }
 
 template<typename Dtype>
@@ -186,45 +264,53 @@ void DataTransformer<Dtype>::Transform(const vector<Datum> & datum_vector,
                                        Blob<Dtype>* transformed_blob) {
   const int datum_num = datum_vector.size();
   const int num = transformed_blob->num();
-  const int channels = transformed_blob->channels();
-  const int height = transformed_blob->height();
-  const int width = transformed_blob->width();
 
   CHECK_GT(datum_num, 0) << "There is no datum to add";
   CHECK_LE(datum_num, num) <<
     "The size of datum_vector must be no greater than transformed_blob->num()";
-  Blob<Dtype> uni_blob(1, channels, height, width);
   for (int item_id = 0; item_id < datum_num; ++item_id) {
-    int offset = transformed_blob->offset(item_id);
-    uni_blob.set_cpu_data(transformed_blob->mutable_cpu_data() + offset);
-    Transform(datum_vector[item_id], &uni_blob);
+    Transform(datum_vector[item_id], transformed_blob, item_id);
   }
 }
 
 #ifdef USE_OPENCV
+template<typename Dtype>
+cv::Mat DataTransformer<Dtype>::DecodeDatum(const Datum& datum) {
+  CHECK(datum.encoded()) << "Datum is not encoded";
+  CHECK(!(param_.force_color() && param_.force_gray()))
+      << "cannot set both force_color and force_gray";
+  if (param_.force_color() || param_.force_gray()) {
+    // If force_color then decode in color otherwise decode in gray.
+    return DecodeDatumToCVMat(datum, param_.force_color());
+  }
+  return DecodeDatumToCVMatNative(datum);
+}
+
 template<typename Dtype>
 void DataTransformer<Dtype>::Transform(const vector<cv::Mat> & mat_vector,
                                        Blob<Dtype>* transformed_blob) {
   const int mat_num = mat_vector.size();
   const int num = transformed_blob->num();
-  const int channels = transformed_blob->channels();
-  const int height = transformed_blob->height();
-  const int width = transformed_blob->width();
 
   CHECK_GT(mat_num, 0) << "There is no MAT to add";
   CHECK_EQ(mat_num, num) <<
     "The size of mat_vector must be equals to transformed_blob->num()";
-  Blob<Dtype> uni_blob(1, channels, height, width);
   for (int item_id = 0; item_id < mat_num; ++item_id) {
-    int offset = transformed_blob->offset(item_id);
-    uni_blob.set_cpu_data(transformed_blob->mutable_cpu_data() + offset);
-    Transform(mat_vector[item_id], &uni_blob);
+    Transform(mat_vector[item_id], transformed_blob, item_id);
   }
 }
 
 template<typename Dtype>
 void DataTransformer<Dtype>::Transform(const cv::Mat& cv_img,
                                        Blob<Dtype>* transformed_blob) {
+  Transform(cv_img, transformed_blob, 0);
+}
+
+template<typename Dtype>
+void DataTransformer<Dtype>::Transform(const cv::Mat& input_img,
+                                       Blob<Dtype>* transformed_blob,
+                                       int item_id) {
+  const cv::Mat cv_img = resize_augment_ ? Augment(input_img) : input_img;
   const int crop_size = param_.crop_size();
   const int img_channels = cv_img.channels();
   const int img_height = cv_img.rows;
@@ -239,89 +325,91 @@ void DataTransformer<Dtype>::Transform(const cv::Mat& cv_img,
   CHECK_EQ(channels, img_channels);
   CHECK_LE(height, img_height);
   CHECK_LE(width, img_width);
-  CHECK_GE(num, 1);
+  CHECK_GE(item_id, 0);
+  CHECK_LT(item_id, num);
 
   CHECK(cv_img.depth() == CV_8U) << "Image data type must be unsigned byte";
 
   const Dtype scale = param_.scale();
   const bool do_mirror = param_.mirror() && Rand(2);
-  const bool has_mean_file = param_.has_mean_file();
-  const bool has_mean_values = mean_values_.size() > 0;
 
   CHECK_GT(img_channels, 0);
   CHECK_GE(img_height, crop_size);
   CHECK_GE(img_width, crop_size);
+  CheckMean(img_channels, img_height, img_width);
 
-  Dtype* mean = NULL;
-  if (has_mean_file) {
-    CHECK_EQ(img_channels, data_mean_.channels());
-    CHECK_EQ(img_height, data_mean_.height());
-    CHECK_EQ(img_width, data_mean_.width());
-    mean = data_mean_.mutable_cpu_data();
-  }
-  if (has_mean_values) {
-    CHECK(mean_values_.size() == 1 || mean_values_.size() == img_channels) <<
-     "Specify either 1 mean_value or as many as channels: " << img_channels;
-    if (img_channels > 1 && mean_values_.size() == 1) {
-      // Replicate the mean_value for simplicity
-      for (int c = 1; c < img_channels; ++c) {
-        mean_values_.push_back(mean_values_[0]);
-      }
-    }
-  }
-
-  int h_off = 0;
-  int w_off = 0;
-  cv::Mat cv_cropped_img = cv_img;
   if (crop_size) {
     CHECK_EQ(crop_size, height);
     CHECK_EQ(crop_size, width);
-    // We only do random crop when we do training.
-    if (phase_ == TRAIN) {
-      h_off = Rand(img_height - crop_size + 1);
-      w_off = Rand(img_width - crop_size + 1);
-    } else {
-      h_off = (img_height - crop_size) / 2;
-      w_off = (img_width - crop_size) / 2;
-    }
-    cv::Rect roi(w_off, h_off, crop_size, crop_size);
-    cv_cropped_img = cv_img(roi);
   } else {
     CHECK_EQ(img_height, height);
     CHECK_EQ(img_width, width);
   }
+  int h_off, w_off;
+  CropOffsets(img_height, img_width, &h_off, &w_off);
+
+  CHECK(cv_img.data);
+
+  vector<Dtype> gains;
+  Dtype bias;
+  RandJitter(img_channels, &gains, &bias);
+
+  Dtype* transformed_data =
+      transformed_blob->mutable_cpu_data() + transformed_blob->offset(item_id);
+  const Dtype* mean = param_.has_mean_file() ? data_mean_.cpu_data() : NULL;
+  // The image is interleaved (HWC): a channel is read with a pixel stride of
+  // img_channels and written as its own plane.
+  const uchar* crop = cv_img.ptr<uchar>(h_off) + w_off * img_channels;
+  for (int c = 0; c < img_channels; ++c) {
+    const Dtype* mean_c = mean ?
+        mean + (c * img_height + h_off) * img_width + w_off : NULL;
+    const Dtype mean_value = mean_values_.size() > 0 ? mean_values_[c] : 0;
+    TransformPlane(crop + c, static_cast<int>(cv_img.step), img_channels,
+        mean_c, img_width, mean_value, gains[c], bias, scale, height, width,
+        do_mirror, transformed_data + c * height * width);
+  }
+}
 
-  CHECK(cv_cropped_img.data);
-
-  Dtype* transformed_data = transformed_blob->mutable_cpu_data();
-  int top_index;
-  for (int h = 0; h < height; ++h) {
-    const uchar* ptr = cv_cropped_img.ptr<uchar>(h);
-    int img_index = 0;
-    for (int w = 0; w < width; ++w) {
-      for (int c = 0; c < img_channels; ++c) {
-        if (do_mirror) {
-          top_index = (c * height + h) * width + (width - 1 - w);
-        } else {
-          top_index = (c * height + h) * width + w;
-        }
-        // int top_index = (c * height + h) * width + w;
-        Dtype pixel = static_cast<Dtype>(ptr[img_index++]);
-        if (has_mean_file) {
-          int mean_index = (c * img_height + h_off + h) * img_width + w_off + w;
-          transformed_data[top_index] =
-            (pixel - mean[mean_index]) * scale;
-        } else {
-          if (has_mean_values) {
-            transformed_data[top_index] =
-              (pixel - mean_values_[c]) * scale;
-          } else {
-            transformed_data[top_index] = pixel * scale;
-          }
-        }
+template<typename Dtype>
+cv::Mat DataTransformer<Dtype>::Augment(const cv::Mat& cv_img) {
+  const int crop_size = param_.crop_size();
+  cv::Mat img = cv_img;
+  // Scale jitter, never below the crop size.
+  if (param_.min_resize_ratio() != 1 || param_.max_resize_ratio() != 1) {
+    const float ratio = RandUniform(param_.min_resize_ratio(),
+        param_.max_resize_ratio());
+    const int height = std::max(crop_size,
+        static_cast<int>(std::floor(img.rows * ratio + 0.5f)));
+    const int width = std::max(crop_size,
+        static_cast<int>(std::floor(img.cols * ratio + 0.5f)));
+    cv::Mat resized;
+    cv::resize(img, resized, cv::Size(width, height));
+    img = resized;
+  }
+  // Random resized crop. If no region of the drawn area and aspect ratio
+  // fits in a few attempts, the whole image is used.
+  if (param_.min_crop_area() < 1 || param_.max_aspect_ratio() > 1) {
+    const float area = static_cast<float>(img.rows) * img.cols;
+    const float log_ratio = std::log(param_.max_aspect_ratio());
+    cv::Rect roi(0, 0, img.cols, img.rows);
+    for (int attempt = 0; attempt < 10; ++attempt) {
+      const float target = area * RandUniform(param_.min_crop_area(), 1);
+      const float aspect = std::exp(RandUniform(-log_ratio, log_ratio));
+      const int width =
+          static_cast<int>(std::floor(std::sqrt(target * aspect) + 0.5f));
+      const int height =
+          static_cast<int>(std::floor(std::sqrt(target / aspect) + 0.5f));
+      if (width > 0 && height > 0 && width <= img.cols && height <= img.rows) {
+        roi = cv::Rect(Rand(img.cols - width + 1), Rand(img.rows - height + 1),
+            width, height);
+        break;
       }
     }
+    cv::Mat resized;
+    cv::resize(img(roi), resized, cv::Size(crop_size, crop_size));
+    img = resized;
   }
+  return img;
 }
 #endif  // USE_OPENCV
 
@@ -442,17 +530,8 @@ template<typename Dtype>
 vector<int> DataTransformer<Dtype>::InferBlobShape(const Datum& datum) {
   if (datum.encoded()) {
 #ifdef USE_OPENCV
-    CHECK(!(param_.force_color() && param_.force_gray()))
-        << "cannot set both force_color and force_gray";
-    cv::Mat cv_img;
-    if (param_.force_color() || param_.force_gray()) {
-    // If force_color then decode in color otherwise decode in gray.
-      cv_img = DecodeDatumToCVMat(datum, param_.force_color());
-    } else {
-      cv_img = DecodeDatumToCVMatNative(datum);
-    }
     // InferBlobShape using the cv::image.
-    return InferBlobShape(cv_img);
+    return InferBlobShape(DecodeDatum(datum));
 #else
     LOG(FATAL) << "Encoded datum requires OpenCV; compile with USE_OPENCV.";
 #endif  // USE_OPENCV
@@ -522,9 +601,11 @@ vector<int> DataTransformer<Dtype>::InferBlobShape(
 template <typename Dtype>
 void DataTransformer<Dtype>::InitRand() {
   const bool needs_rand = param_.mirror() ||
-      (phase_ == TRAIN && param_.crop_size());
+      (phase_ == TRAIN && (param_.crop_size() || resize_augment_ ||
+       param_.brightness() > 0 || param_.color_gain() > 0));
   if (needs_rand) {
-    const unsigned int rng_seed = caffe_rng_rand();
+    const unsigned int rng_seed = param_.has_rand_seed() ?
+        param_.rand_seed() + Caffe::solver_rank() : caffe_rng_rand();
     rng_.reset(new Caffe::RNG(rng_seed));
   } else {
     rng_.reset();
@@ -540,6 +621,41 @@ int DataTransformer<Dtype>::Rand(int n) {
   return ((*rng)() % n);
 }
 
+template <typename Dtype>
+float DataTransformer<Dtype>::RandUniform(float a, float b) {
+  CHECK(rng_);
+  CHECK_LE(a, b);
+  if (a == b) {
+    return a;
+  }
+  caffe::rng_t* rng =
+      static_cast<caffe::rng_t*>(rng_->generator());
+  boost::uniform_real<float> random_distribution(a, b);
+  boost::variate_generator<caffe::rng_t*, boost::uniform_real<float> >
+      variate_generator(rng, random_distribution);
+  return variate_generator();
+}
+
+template <typename Dtype>
+void DataTransformer<Dtype>::RandJitter(int channels, vector<Dtype>* gains,
+                                        Dtype* bias) {
+  gains->assign(channels, Dtype(1));
+  *bias = 0;
+  if (phase_ != TRAIN) {
+    return;
+  }
+  const float color_gain = param_.color_gain();
+  if (color_gain > 0) {
+    for (int c = 0; c < channels; ++c) {
+      (*gains)[c] = RandUniform(1 - color_gain, 1 + color_gain);
+    }
+  }
+  const float brightness = param_.brightness();
+  if (brightness > 0) {
+    *bias = RandUniform(-brightness, brightness);
+  }
+}
+
 INSTANTIATE_CLASS(DataTransformer);
 
 }  // namespace caffe
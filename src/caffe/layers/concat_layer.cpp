@@ -50,7 +50,42 @@ void ConcatLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom,
   if (bottom.size() == 1) {
     top[0]->ShareData(*bottom[0]);
     top[0]->ShareDiff(*bottom[0]);
+    return;
   }
+  // A change of layout leaves the inputs placed in the output where they
+  // were, which Forward would then copy over each other. Give the output new
+  // memory instead, so that the old one is only written through its views,
+  // until the net places the inputs again.
+  bool moved = false;
+  int offset = 0;
+  in_place_.resize(bottom.size(), false);
+  for (int i = 0; i < bottom.size(); ++i) {
+    const bool in_place = InPlace(*bottom[i], *top[0], offset);
+    moved |= in_place_[i] && !in_place;
+    in_place_[i] = in_place;
+    offset += bottom[i]->count();
+  }
+  if (moved) {
+    Blob<Dtype> output(top_shape);
+    top[0]->ShareData(output, 0);
+    top[0]->ShareDiff(output, 0);
+    in_place_.assign(bottom.size(), false);
+  }
+}
+
+template <typename Dtype>
+bool ConcatLayer<Dtype>::InPlace(const Blob<Dtype>& bottom,
+    const Blob<Dtype>& top, int offset) const {
+  if (num_concats_ != 1 || !bottom.data() || !top.data()) {
+    return false;
+  }
+  if (!bottom.data()->is_view_of(*top.data(), offset * sizeof(Dtype)) ||
+      bottom.has_diff() != top.has_diff()) {
+    return false;
+  }
+  // The diffs of forward only nets may have been dropped.
+  return !bottom.has_diff() ||
+      bottom.diff()->is_view_of(*top.diff(), offset * sizeof(Dtype));
 }
 
 template <typename Dtype>
@@ -61,13 +96,15 @@ void ConcatLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
   int offset_concat_axis = 0;
   const int top_concat_axis = top[0]->shape(concat_axis_);
   for (int i = 0; i < bottom.size(); ++i) {
-    const Dtype* bottom_data = bottom[i]->cpu_data();
     const int bottom_concat_axis = bottom[i]->shape(concat_axis_);
-    for (int n = 0; n < num_concats_; ++n) {
-      caffe_copy(bottom_concat_axis * concat_input_size_,
-          bottom_data + n * bottom_concat_axis * concat_input_size_,
-          top_data + (n * top_concat_axis + offset_concat_axis)
-              * concat_input_size_);
+    if (!in_place_[i]) {
+      const Dtype* bottom_data = bottom[i]->cpu_data();
+      for (int n = 0; n < num_concats_; ++n) {
+        caffe_copy(bottom_concat_axis * concat_input_size_,
+            bottom_data + n * bottom_concat_axis * concat_input_size_,
+            top_data + (n * top_concat_axis + offset_concat_axis)
+                * concat_input_size_);
+      }
     }
     offset_concat_axis += bottom_concat_axis;
   }
@@ -82,7 +119,7 @@ void ConcatLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
   const int top_concat_axis = top[0]->shape(concat_axis_);
   for (int i = 0; i < bottom.size(); ++i) {
     const int bottom_concat_axis = bottom[i]->shape(concat_axis_);
-    if (propagate_down[i]) {
+    if (propagate_down[i] && !in_place_[i]) {
       Dtype* bottom_diff = bottom[i]->mutable_cpu_diff();
       for (int n = 0; n < num_concats_; ++n) {
         caffe_copy(bottom_concat_axis * concat_input_size_, top_diff +
@@ -114,6 +114,18 @@ void CuDNNDeconvolutionLayer<Dtype>::Reshape(
   // planning strategy and a rewrite of Caffe's GPU memory mangagement
   size_t workspace_limit_bytes = 8*1024*1024;
 
+  // Look up the choices made for this shape, moving them to the front.
+  const vector<int>& shape = bottom[0]->shape();
+  int plan_id = 0;
+  while (plan_id < plans_.size() && plans_[plan_id].first != shape) {
+    ++plan_id;
+  }
+  const bool cached = plan_id < plans_.size();
+  if (cached) {
+    std::rotate(plans_.begin(), plans_.begin() + plan_id,
+        plans_.begin() + plan_id + 1);
+  }
+
   for (int i = 0; i < bottom.size(); i++) {
     cudnn::setTensor4dDesc<Dtype>(&bottom_descs_[i],
                                   this->num_,
@@ -141,6 +153,17 @@ void CuDNNDeconvolutionLayer<Dtype>::Reshape(
                                      stride_h,
                                      stride_w);
 
+    if (cached) {
+      const AlgoChoice& choice = plans_[0].second[i];
+      fwd_algo_[i] = choice.fwd_algo;
+      bwd_filter_algo_[i] = choice.bwd_filter_algo;
+      bwd_data_algo_[i] = choice.bwd_data_algo;
+      workspace_fwd_sizes_[i] = choice.workspace_fwd_size;
+      workspace_bwd_filter_sizes_[i] = choice.workspace_bwd_filter_size;
+      workspace_bwd_data_sizes_[i] = choice.workspace_bwd_data_size;
+      continue;
+    }
+
     // choose forward and backward algorithms + workspace(s)
     CUDNN_CHECK(cudnnGetConvolutionForwardAlgorithm(
         handle_[0],
@@ -226,6 +249,24 @@ void CuDNNDeconvolutionLayer<Dtype>::Reshape(
         &workspace_bwd_data_sizes_[i]));
   }
 
+  const int plan_cache_size =
+      this->layer_param_.convolution_param().plan_cache_size();
+  if (!cached && plan_cache_size > 0) {
+    vector<AlgoChoice> choices(bottom.size());
+    for (int i = 0; i < bottom.size(); i++) {
+      choices[i].fwd_algo = fwd_algo_[i];
+      choices[i].bwd_filter_algo = bwd_filter_algo_[i];
+      choices[i].bwd_data_algo = bwd_data_algo_[i];
+      choices[i].workspace_fwd_size = workspace_fwd_sizes_[i];
+      choices[i].workspace_bwd_filter_size = workspace_bwd_filter_sizes_[i];
+      choices[i].workspace_bwd_data_size = workspace_bwd_data_sizes_[i];
+    }
+    if (plans_.size() >= static_cast<size_t>(plan_cache_size)) {
+      plans_.resize(plan_cache_size - 1);
+    }
+    plans_.insert(plans_.begin(), std::make_pair(shape, choices));
+  }
+
   // reduce over all workspace sizes to get a maximum to allocate / reallocate
   size_t total_workspace_fwd = 0;
   size_t total_workspace_bwd_data = 0;
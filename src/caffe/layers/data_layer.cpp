@@ -3,21 +3,71 @@
 #endif  // USE_OPENCV
 #include <stdint.h>
 
+#include <algorithm>
+#include <string>
 #include <vector>
 
 #include "caffe/data_transformer.hpp"
 #include "caffe/layers/data_layer.hpp"
 #include "caffe/util/benchmark.hpp"
+#include "caffe/util/image_cache.hpp"
+#include "caffe/util/math_functions.hpp"
+#include "caffe/util/rng.hpp"
 
 namespace caffe {
 
 template <typename Dtype>
 DataLayer<Dtype>::DataLayer(const LayerParameter& param)
   : BasePrefetchingDataLayer<Dtype>(param),
-    offset_() {
-  db_.reset(db::GetDB(param.data_param().backend()));
-  db_->Open(param.data_param().source(), db::READ);
+    offset_(),
+    shuffle_(param.data_param().shuffle()),
+    shuffle_seed_(),
+    packed_cursor_(),
+    num_records_(),
+    block_pos_(),
+    block_read_(),
+    start_position_(),
+    consumed_() {
+  const DataParameter& data_param = param.data_param();
+  db_.reset(db::GetDB(data_param.backend()));
+  db_->Open(data_param.source(), db::READ);
   cursor_.reset(db_->NewCursor());
+  if (shuffle_) {
+    CHECK_GT(data_param.shuffle_block(), 0);
+    CHECK_GT(data_param.shuffle_buffer(), 0);
+    if (data_param.has_shuffle_seed()) {
+      shuffle_seed_ = data_param.shuffle_seed();
+    } else {
+      shuffle_seed_ = caffe_rng_rand();
+      LOG_IF(WARNING, Caffe::solver_count() > 1)
+          << "Set shuffle_seed so that all solvers share one record order";
+    }
+    packed_cursor_ = dynamic_cast<db::PackedCursor*>(cursor_.get());
+    if (packed_cursor_) {
+      num_records_ = packed_cursor_->size();
+    } else {
+      // Other backends are seeked by key, so remember where each block starts.
+      for (; cursor_->valid(); cursor_->Next(), ++num_records_) {
+        if (num_records_ % data_param.shuffle_block() == 0) {
+          block_keys_.push_back(cursor_->key());
+        }
+      }
+    }
+    CHECK_GT(num_records_, 0) << "No records in " << data_param.source();
+    LOG_IF(INFO, Caffe::root_solver())
+        << "Shuffling " << num_records_ << " records every epoch";
+    SeekToPosition(0);
+  }
+  if (data_param.decoded_cache_bytes() > 0) {
+#ifdef USE_OPENCV
+    const TransformationParameter& transform_param = param.transform_param();
+    cache_prefix_ = data_param.source() + (transform_param.force_color() ?
+        "\ncolor\n" : transform_param.force_gray() ? "\ngray\n" : "\n\n");
+    ImageCache::Get().Reserve(data_param.decoded_cache_bytes());
+#else
+    LOG(WARNING) << "decoded_cache_bytes requires OpenCV; ignoring it.";
+#endif  // USE_OPENCV
+  }
 }
 
 template <typename Dtype>
@@ -31,11 +81,10 @@ void DataLayer<Dtype>::DataLayerSetUp(const vector<Blob<Dtype>*>& bottom,
   const int batch_size = this->layer_param_.data_param().batch_size();
   // Read a data point, and use it to initialize the top blob.
   Datum datum;
-  datum.ParseFromString(cursor_->value());
+  ReadDatum(&datum);
 
   // Use data_transformer to infer the expected blob shape from datum.
   vector<int> top_shape = this->data_transformer_->InferBlobShape(datum);
-  this->transformed_data_.Reshape(top_shape);
   // Reshape top[0] and prefetch_data according to the batch_size.
   top_shape[0] = batch_size;
   top[0]->Reshape(top_shape);
@@ -66,15 +115,171 @@ bool DataLayer<Dtype>::Skip() {
   return !keep;
 }
 
+template<typename Dtype>
+void DataLayer<Dtype>::ReadDatum(Datum* datum) {
+  if (shuffle_) {
+    datum->ParseFromString(shuffle_buffer_.back());
+  } else {
+    datum->ParseFromString(cursor_->value());
+  }
+}
+
+template<typename Dtype>
+string DataLayer<Dtype>::Key() {
+  return shuffle_ ? shuffle_keys_.back() : cursor_->key();
+}
+
 template<typename Dtype>
 void DataLayer<Dtype>::Next() {
+  offset_++;
+  if (shuffle_) {
+    shuffle_keys_.pop_back();
+    shuffle_buffer_.pop_back();
+    FillShuffleBuffer();
+    if (shuffle_buffer_.empty()) {
+      LOG_IF(INFO, Caffe::root_solver())
+          << "Restarting data prefetching with a new shuffled epoch.";
+      StartEpoch(offset_ / num_records_);
+    }
+    return;
+  }
   cursor_->Next();
   if (!cursor_->valid()) {
     LOG_IF(INFO, Caffe::root_solver())
         << "Restarting data prefetching from start.";
     cursor_->SeekToFirst();
   }
-  offset_++;
+}
+
+template<typename Dtype>
+void DataLayer<Dtype>::StartEpoch(uint64_t epoch) {
+  // Each epoch has its own generator so that any position of the stream can
+  // be reproduced from the seed alone.
+  shuffle_rng_.reset(new Caffe::RNG(shuffle_seed_ + epoch));
+  const uint64_t block = this->layer_param_.data_param().shuffle_block();
+  block_order_.resize((num_records_ + block - 1) / block);
+  for (int i = 0; i < block_order_.size(); ++i) {
+    block_order_[i] = i;
+  }
+  caffe::rng_t* rng = static_cast<caffe::rng_t*>(shuffle_rng_->generator());
+  caffe::shuffle(block_order_.begin(), block_order_.end(), rng);
+  block_pos_ = -1;
+  block_read_ = block;
+  shuffle_keys_.clear();
+  shuffle_buffer_.clear();
+  FillShuffleBuffer();
+}
+
+template<typename Dtype>
+bool DataLayer<Dtype>::ReadRecord(string* key, string* value) {
+  const int block = this->layer_param_.data_param().shuffle_block();
+  if (block_read_ == block || !cursor_->valid()) {
+    if (++block_pos_ == block_order_.size()) {
+      return false;
+    }
+    const int index = block_order_[block_pos_];
+    if (packed_cursor_) {
+      packed_cursor_->Seek(static_cast<uint64_t>(index) * block);
+    } else {
+      cursor_->SeekToKey(block_keys_[index]);
+    }
+    block_read_ = 0;
+  }
+  *key = cursor_->key();
+  *value = cursor_->value();
+  cursor_->Next();
+  ++block_read_;
+  return true;
+}
+
+template<typename Dtype>
+void DataLayer<Dtype>::FillShuffleBuffer() {
+  const int capacity = this->layer_param_.data_param().shuffle_buffer();
+  while (shuffle_buffer_.size() < capacity) {
+    shuffle_keys_.push_back(string());
+    shuffle_buffer_.push_back(string());
+    if (!ReadRecord(&shuffle_keys_.back(), &shuffle_buffer_.back())) {
+      shuffle_keys_.pop_back();
+      shuffle_buffer_.pop_back();
+      break;
+    }
+  }
+  if (shuffle_buffer_.size() > 1) {
+    // The record to hand out next is kept at the back of the buffer.
+    caffe::rng_t* rng = static_cast<caffe::rng_t*>(shuffle_rng_->generator());
+    boost::uniform_int<int> dist(0, shuffle_buffer_.size() - 1);
+    const int index = dist(*rng);
+    std::swap(shuffle_keys_[index], shuffle_keys_.back());
+    std::swap(shuffle_buffer_[index], shuffle_buffer_.back());
+  }
+}
+
+template<typename Dtype>
+void DataLayer<Dtype>::SeekToPosition(uint64_t position) {
+  offset_ = position;
+  StartEpoch(position / num_records_);
+  for (uint64_t i = position % num_records_; i > 0; --i) {
+    shuffle_keys_.pop_back();
+    shuffle_buffer_.pop_back();
+    FillShuffleBuffer();
+  }
+  start_position_ = position;
+  consumed_ = 0;
+}
+
+// Maps the number of records handed to Forward since start_position_ to the
+// stream position, following the skipping pattern of Skip().
+template<typename Dtype>
+uint64_t DataLayer<Dtype>::StreamPosition(uint64_t consumed) const {
+  if (consumed == 0) {
+    return start_position_;
+  }
+  if (this->layer_param_.phase() == TEST) {
+    return start_position_ + consumed;
+  }
+  const uint64_t size = Caffe::solver_count();
+  const uint64_t rank = Caffe::solver_rank();
+  const uint64_t first =
+      start_position_ + (rank + size - start_position_ % size) % size;
+  return first + (consumed - 1) * size + 1;
+}
+
+template<typename Dtype>
+void DataLayer<Dtype>::GetState(DataReaderState* state) const {
+  CHECK(shuffle_) << "Only shuffled data layers keep a read position";
+  state->set_layer(this->layer_param_.name());
+  state->set_seed(shuffle_seed_);
+  state->set_position(StreamPosition(consumed_));
+}
+
+template<typename Dtype>
+void DataLayer<Dtype>::SetState(const DataReaderState& state) {
+  CHECK(shuffle_) << "Only shuffled data layers keep a read position";
+  this->StopInternalThread();
+  // Batches read ahead from the old position are dropped.
+  Batch<Dtype>* batch;
+  while (this->prefetch_full_.try_pop(&batch)) {
+    this->prefetch_free_.push(batch);
+  }
+  shuffle_seed_ = state.seed();
+  SeekToPosition(state.position());
+  LOG_IF(INFO, Caffe::root_solver()) << "Data layer " << state.layer()
+      << " resumed at record " << state.position();
+  this->StartInternalThread();
+}
+
+template <typename Dtype>
+void DataLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
+    const vector<Blob<Dtype>*>& top) {
+  BasePrefetchingDataLayer<Dtype>::Forward_cpu(bottom, top);
+  consumed_ += top[0]->shape(0);
+}
+
+template <typename Dtype>
+void DataLayer<Dtype>::Forward_gpu(const vector<Blob<Dtype>*>& bottom,
+    const vector<Blob<Dtype>*>& top) {
+  BasePrefetchingDataLayer<Dtype>::Forward_gpu(bottom, top);
+  consumed_ += top[0]->shape(0);
 }
 
 // This function is called on prefetch thread
@@ -86,39 +291,76 @@ void DataLayer<Dtype>::load_batch(Batch<Dtype>* batch) {
   double trans_time = 0;
   CPUTimer timer;
   CHECK(batch->data_.count());
-  CHECK(this->transformed_data_.count());
   const int batch_size = this->layer_param_.data_param().batch_size();
 
   Datum datum;
+#ifdef USE_OPENCV
+  cv::Mat cv_img;
+#endif  // USE_OPENCV
   for (int item_id = 0; item_id < batch_size; ++item_id) {
     timer.Start();
     while (Skip()) {
       Next();
     }
-    datum.ParseFromString(cursor_->value());
+    // With the decoded image cache enabled, encoded records are decoded once
+    // and served from the cache afterwards.
+    bool decoded = false;
+    int label = 0;
+#ifdef USE_OPENCV
+    string cache_key;
+    if (!cache_prefix_.empty()) {
+      cache_key = cache_prefix_ + Key();
+      decoded = ImageCache::Get().Lookup(cache_key, &cv_img, &label);
+    }
+#endif  // USE_OPENCV
+    if (!decoded) {
+      ReadDatum(&datum);
+      label = datum.label();
+#ifdef USE_OPENCV
+      if (!cache_prefix_.empty() && datum.encoded()) {
+        cv_img = this->data_transformer_->DecodeDatum(datum);
+        ImageCache::Get().Insert(cache_key, cv_img, label);
+        decoded = true;
+      }
+#endif  // USE_OPENCV
+    }
     read_time += timer.MicroSeconds();
 
     if (item_id == 0) {
       // Reshape according to the first datum of each batch
       // on single input batches allows for inputs of varying dimension.
       // Use data_transformer to infer the expected blob shape from datum.
-      vector<int> top_shape = this->data_transformer_->InferBlobShape(datum);
-      this->transformed_data_.Reshape(top_shape);
+      vector<int> top_shape;
+#ifdef USE_OPENCV
+      if (decoded) {
+        top_shape = this->data_transformer_->InferBlobShape(cv_img);
+      } else {
+        top_shape = this->data_transformer_->InferBlobShape(datum);
+      }
+#else
+      top_shape = this->data_transformer_->InferBlobShape(datum);
+#endif  // USE_OPENCV
       // Reshape batch according to the batch_size.
       top_shape[0] = batch_size;
       batch->data_.Reshape(top_shape);
     }
 
-    // Apply data transformations (mirror, scale, crop...)
+    // Apply data transformations (mirror, scale, crop...) straight into
+    // the batch.
     timer.Start();
-    int offset = batch->data_.offset(item_id);
-    Dtype* top_data = batch->data_.mutable_cpu_data();
-    this->transformed_data_.set_cpu_data(top_data + offset);
-    this->data_transformer_->Transform(datum, &(this->transformed_data_));
+#ifdef USE_OPENCV
+    if (decoded) {
+      this->data_transformer_->Transform(cv_img, &batch->data_, item_id);
+    } else {
+      this->data_transformer_->Transform(datum, &batch->data_, item_id);
+    }
+#else
+    this->data_transformer_->Transform(datum, &batch->data_, item_id);
+#endif  // USE_OPENCV
     // Copy label.
     if (this->output_labels_) {
       Dtype* top_label = batch->label_.mutable_cpu_data();
-      top_label[item_id] = datum.label();
+      top_label[item_id] = label;
     }
     trans_time += timer.MicroSeconds();
     Next();
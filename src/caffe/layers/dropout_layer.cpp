@@ -1,9 +1,8 @@
-// TODO (sergeyk): effect should not be dependent on phase. wasted memcpy.
-
 #include <vector>
 
 #include "caffe/layers/dropout_layer.hpp"
 #include "caffe/util/math_functions.hpp"
+#include "caffe/util/philox.hpp"
 
 namespace caffe {
 
@@ -22,9 +21,21 @@ template <typename Dtype>
 void DropoutLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top) {
   NeuronLayer<Dtype>::Reshape(bottom, top);
-  // Set up the cache for random number generation
-  // ReshapeLike does not work because rand_vec_ is of Dtype uint
-  rand_vec_.Reshape(bottom[0]->shape());
+  if (this->phase_ == TEST) {
+    // Dropout is the identity at test time: let the output be the input, so
+    // that Forward and Backward have nothing left to copy.
+    top[0]->ShareData(*bottom[0]);
+    top[0]->ShareDiff(*bottom[0]);
+    return;
+  }
+  // Set up the mask, one bit per input
+  rand_vec_.Reshape(vector<int>(1, (bottom[0]->count() + 31) / 32));
+}
+
+template <typename Dtype>
+void DropoutLayer<Dtype>::NewMaskKey() {
+  mask_key_[0] = caffe_rng_rand();
+  mask_key_[1] = caffe_rng_rand();
 }
 
 template <typename Dtype>
@@ -32,13 +43,17 @@ void DropoutLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
     const vector<Blob<Dtype>*>& top) {
   const Dtype* bottom_data = bottom[0]->cpu_data();
   Dtype* top_data = top[0]->mutable_cpu_data();
-  unsigned int* mask = rand_vec_.mutable_cpu_data();
   const int count = bottom[0]->count();
   if (this->phase_ == TRAIN) {
-    // Create random numbers
-    caffe_rng_bernoulli(count, 1. - threshold_, mask);
+    // Draw the mask 32 inputs at a time
+    unsigned int* mask = rand_vec_.mutable_cpu_data();
+    NewMaskKey();
+    for (int i = 0; i < rand_vec_.count(); ++i) {
+      mask[i] = philox_bernoulli_word(mask_key_, i, uint_thres_);
+    }
     for (int i = 0; i < count; ++i) {
-      top_data[i] = bottom_data[i] * mask[i] * scale_;
+      top_data[i] = bottom_data[i] * ((mask[i / 32] >> (i % 32)) & 1)
+          * scale_;
     }
   } else {
     caffe_copy(bottom[0]->count(), bottom_data, top_data);
@@ -56,7 +71,8 @@ void DropoutLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
       const unsigned int* mask = rand_vec_.cpu_data();
       const int count = bottom[0]->count();
       for (int i = 0; i < count; ++i) {
-        bottom_diff[i] = top_diff[i] * mask[i] * scale_;
+        bottom_diff[i] = top_diff[i] * ((mask[i / 32] >> (i % 32)) & 1)
+            * scale_;
       }
     } else {
       caffe_copy(top[0]->count(), top_diff, bottom_diff);
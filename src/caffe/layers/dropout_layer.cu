@@ -2,15 +2,23 @@
 
 #include "caffe/layers/dropout_layer.hpp"
 #include "caffe/util/math_functions.hpp"
+#include "caffe/util/philox.hpp"
 
 namespace caffe {
 
+__global__ void DropoutMask(const int n, const uint32_t key0,
+    const uint32_t key1, const unsigned int threshold, unsigned int* mask) {
+  const uint32_t key[2] = {key0, key1};
+  CUDA_KERNEL_LOOP(index, n) {
+    mask[index] = philox_bernoulli_word(key, index, threshold);
+  }
+}
+
 template <typename Dtype>
 __global__ void DropoutForward(const int n, const Dtype* in,
-    const unsigned int* mask, const unsigned int threshold, const float scale,
-    Dtype* out) {
+    const unsigned int* mask, const float scale, Dtype* out) {
   CUDA_KERNEL_LOOP(index, n) {
-    out[index] = in[index] * (mask[index] > threshold) * scale;
+    out[index] = in[index] * ((mask[index / 32] >> (index % 32)) & 1) * scale;
   }
 }
 
@@ -23,11 +31,15 @@ void DropoutLayer<Dtype>::Forward_gpu(const vector<Blob<Dtype>*>& bottom,
   if (this->phase_ == TRAIN) {
     unsigned int* mask =
         static_cast<unsigned int*>(rand_vec_.mutable_gpu_data());
-    caffe_gpu_rng_uniform(count, mask);
-    // set thresholds
+    const int num_words = rand_vec_.count();
+    NewMaskKey();
+    // NOLINT_NEXT_LINE(whitespace/operators)
+    DropoutMask<<<CAFFE_GET_BLOCKS(num_words), CAFFE_CUDA_NUM_THREADS>>>(
+        num_words, mask_key_[0], mask_key_[1], uint_thres_, mask);
+    CUDA_POST_KERNEL_CHECK;
     // NOLINT_NEXT_LINE(whitespace/operators)
     DropoutForward<Dtype><<<CAFFE_GET_BLOCKS(count), CAFFE_CUDA_NUM_THREADS>>>(
-        count, bottom_data, mask, uint_thres_, scale_, top_data);
+        count, bottom_data, mask, scale_, top_data);
     CUDA_POST_KERNEL_CHECK;
   } else {
     caffe_copy(count, bottom_data, top_data);
@@ -36,10 +48,10 @@ void DropoutLayer<Dtype>::Forward_gpu(const vector<Blob<Dtype>*>& bottom,
 
 template <typename Dtype>
 __global__ void DropoutBackward(const int n, const Dtype* in_diff,
-    const unsigned int* mask, const unsigned int threshold, const float scale,
-    Dtype* out_diff) {
+    const unsigned int* mask, const float scale, Dtype* out_diff) {
   CUDA_KERNEL_LOOP(index, n) {
-    out_diff[index] = in_diff[index] * scale * (mask[index] > threshold);
+    out_diff[index] = in_diff[index] * scale
+        * ((mask[index / 32] >> (index % 32)) & 1);
   }
 }
 
@@ -57,7 +69,7 @@ void DropoutLayer<Dtype>::Backward_gpu(const vector<Blob<Dtype>*>& top,
       // NOLINT_NEXT_LINE(whitespace/operators)
       DropoutBackward<Dtype><<<CAFFE_GET_BLOCKS(count),
         CAFFE_CUDA_NUM_THREADS>>>(
-          count, top_diff, mask, uint_thres_, scale_, bottom_diff);
+          count, top_diff, mask, scale_, bottom_diff);
       CUDA_POST_KERNEL_CHECK;
     } else {
       caffe_copy(top[0]->count(), top_diff, bottom_diff);
@@ -1,3 +1,7 @@
+#include <boost/bind.hpp>
+#include <boost/thread.hpp>
+
+#include <algorithm>
 #include <vector>
 
 #include "caffe/filler.hpp"
@@ -6,6 +10,29 @@
 
 namespace caffe {
 
+// Copies the weight rows indexed by bottom_data[begin, end) to the output.
+template <typename Dtype>
+void embed_gather(const Dtype* bottom_data, const Dtype* weight, int K, int N,
+    int begin, int end, Dtype* top_data) {
+  int index;
+  for (int n = begin; n < end; ++n) {
+    index = static_cast<int>(bottom_data[n]);
+    DCHECK_GE(index, 0);
+    DCHECK_LT(index, K);
+    DCHECK_EQ(static_cast<Dtype>(index), bottom_data[n]) << "non-integer input";
+    caffe_copy(N, weight + index * N, top_data + n * N);
+  }
+}
+
+// Gathers the part-th slice of part_size rows out of the M output rows.
+template <typename Dtype>
+void embed_gather_part(const Dtype* bottom_data, const Dtype* weight, int K,
+    int N, int M, int part_size, Dtype* top_data, int part) {
+  const int begin = std::min(M, part * part_size);
+  embed_gather(bottom_data, weight, K, N, begin,
+      std::min(M, begin + part_size), top_data);
+}
+
 template <typename Dtype>
 void EmbedLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top) {
@@ -43,6 +70,15 @@ void EmbedLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
     }
   }  // parameter initialization
   this->param_propagate_down_.resize(this->blobs_.size(), true);
+  if (this->layer_param_.embed_param().sparse_update()) {
+    this->blobs_[0]->set_sparse_diff(true);
+  }
+  int gather_threads = this->layer_param_.embed_param().gather_threads();
+  CHECK_GE(gather_threads, 0);
+  if (gather_threads == 0) {
+    gather_threads = std::max(1u, boost::thread::hardware_concurrency());
+  }
+  gather_pool_.reset(new WorkerPool(gather_threads));
 }
 
 template <typename Dtype>
@@ -53,9 +89,9 @@ void EmbedLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom,
   vector<int> top_shape = bottom[0]->shape();
   top_shape.push_back(N_);
   top[0]->Reshape(top_shape);
-  // Set up the bias multiplier
-  if (bias_term_) {
-    vector<int> bias_shape(1, M_);
+  // Set up the bias multiplier, unless it already has the right size.
+  vector<int> bias_shape(1, M_);
+  if (bias_term_ && bias_multiplier_.shape() != bias_shape) {
     bias_multiplier_.Reshape(bias_shape);
     caffe_set(M_, Dtype(1), bias_multiplier_.mutable_cpu_data());
   }
@@ -67,13 +103,13 @@ void EmbedLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
   const Dtype* bottom_data = bottom[0]->cpu_data();
   const Dtype* weight = this->blobs_[0]->cpu_data();
   Dtype* top_data = top[0]->mutable_cpu_data();
-  int index;
-  for (int n = 0; n < M_; ++n) {
-    index = static_cast<int>(bottom_data[n]);
-    DCHECK_GE(index, 0);
-    DCHECK_LT(index, K_);
-    DCHECK_EQ(static_cast<Dtype>(index), bottom_data[n]) << "non-integer input";
-    caffe_copy(N_, weight + index * N_, top_data + n * N_);
+  const int num_threads = gather_pool_->num_threads();
+  if (num_threads == 1 || M_ < num_threads) {
+    embed_gather(bottom_data, weight, K_, N_, 0, M_, top_data);
+  } else {
+    const int part_size = (M_ + num_threads - 1) / num_threads;
+    gather_pool_->Run(boost::bind(&embed_gather_part<Dtype>, bottom_data,
+        weight, K_, N_, M_, part_size, top_data, _1));
   }
   if (bias_term_) {
     const Dtype* bias = this->blobs_[1]->cpu_data();
@@ -89,8 +125,10 @@ void EmbedLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
   if (this->param_propagate_down_[0]) {
     const Dtype* top_diff = top[0]->cpu_diff();
     const Dtype* bottom_data = bottom[0]->cpu_data();
-    // Gradient with respect to weight
-    Dtype* weight_diff = this->blobs_[0]->mutable_cpu_diff();
+    // Gradient with respect to weight, recording the rows written if they
+    // are tracked.
+    Blob<Dtype>* weight = this->blobs_[0].get();
+    Dtype* weight_diff = weight->mutable_cpu_diff();
     int index;
     for (int n = 0; n < M_; ++n) {
       index = static_cast<int>(bottom_data[n]);
@@ -99,6 +137,7 @@ void EmbedLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
       DCHECK_EQ(static_cast<Dtype>(index), bottom_data[n])
           << "non-integer input";
       caffe_axpy(N_, Dtype(1), top_diff + n * N_, weight_diff + index * N_);
+      weight->AddDiffRow(index);
     }
   }
   if (bias_term_ && this->param_propagate_down_[1]) {
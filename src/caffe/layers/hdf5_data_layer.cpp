@@ -1,11 +1,11 @@
 /*
 TODO:
-- load file in a separate thread ("prefetch")
 - can be smarter about the memcpy call instead of doing it row-by-row
   :: use util functions caffe_copy, and Blob->offset()
   :: don't forget to update hdf5_daa_layer.cu accordingly
-- add ability to shuffle filenames if flag is set
 */
+#include <boost/thread.hpp>
+#include <algorithm>
 #include <fstream>  // NOLINT(readability/streams)
 #include <string>
 #include <vector>
@@ -16,16 +16,20 @@ TODO:
 
 #include "caffe/layers/hdf5_data_layer.hpp"
 #include "caffe/util/hdf5.hpp"
+#include "caffe/util/rng.hpp"
 
 namespace caffe {
 
 template <typename Dtype>
-HDF5DataLayer<Dtype>::~HDF5DataLayer<Dtype>() { }
+HDF5DataLayer<Dtype>::~HDF5DataLayer<Dtype>() {
+  this->StopInternalThread();
+}
 
 // Load data and label from HDF5 filename into the class property blobs.
 template <typename Dtype>
 void HDF5DataLayer<Dtype>::LoadHDF5FileData(const char* filename) {
   DLOG(INFO) << "Loading HDF5 file: " << filename;
+  boost::mutex::scoped_lock lock(hdf5_mutex());
   hid_t file_id = H5Fopen(filename, H5F_ACC_RDONLY, H5P_DEFAULT);
   if (file_id < 0) {
     LOG(FATAL) << "Failed opening HDF5 file: " << filename;
@@ -107,8 +111,30 @@ void HDF5DataLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
     std::random_shuffle(file_permutation_.begin(), file_permutation_.end());
   }
 
-  // Load the first HDF5 file and initialize the line counter.
-  LoadHDF5FileData(hdf_filenames_[file_permutation_[current_file_]].c_str());
+  if (this->layer_param_.hdf5_data_param().chunk_size() > 0) {
+    // Restart the reader from the beginning if the layer is set up again.
+    this->StopInternalThread();
+    HDF5Chunk<Dtype>* chunk;
+    while (chunk_full_.try_pop(&chunk)) {
+      chunk_free_.push(chunk);
+    }
+    if (chunks_.empty()) {
+      const int prefetch = this->layer_param_.hdf5_data_param().prefetch();
+      CHECK_GT(prefetch, 0) << "Streaming needs at least one chunk in flight.";
+      chunks_.resize(prefetch);
+      for (int i = 0; i < prefetch; ++i) {
+        chunks_[i].reset(new HDF5Chunk<Dtype>());
+        chunk_free_.push(chunks_[i].get());
+      }
+    }
+    this->StartInternalThread();
+    // Wait for the first chunk, which gives the shape of the tops.
+    NextChunk();
+  } else {
+    // Load the first HDF5 file.
+    LoadHDF5FileData(hdf_filenames_[file_permutation_[current_file_]].c_str());
+  }
+  // Initialize the line counter.
   current_row_ = 0;
 
   // Reshape blobs.
@@ -125,6 +151,94 @@ void HDF5DataLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
   }
 }
 
+// Load rows [first_row, first_row + num_rows) of every top into a chunk.
+template <typename Dtype>
+void HDF5DataLayer<Dtype>::LoadHDF5Chunk(hid_t file_id, hsize_t first_row,
+    hsize_t num_rows, HDF5Chunk<Dtype>* chunk) {
+  const int top_size = this->layer_param_.top_size();
+  chunk->blobs_.resize(top_size);
+  for (int i = 0; i < top_size; ++i) {
+    if (!chunk->blobs_[i]) {
+      chunk->blobs_[i].reset(new Blob<Dtype>());
+    }
+    // Reshaping keeps the chunk's memory once it is large enough.
+    hdf5_load_nd_dataset_rows(file_id, this->layer_param_.top(i).c_str(),
+        first_row, num_rows, chunk->blobs_[i].get());
+  }
+  chunk->permutation_.resize(num_rows);
+  for (int i = 0; i < num_rows; ++i) {
+    chunk->permutation_[i] = i;
+  }
+  if (this->layer_param_.hdf5_data_param().shuffle()) {
+    shuffle(chunk->permutation_.begin(), chunk->permutation_.end());
+  }
+}
+
+// Read the files chunk by chunk, forever, ahead of the forward passes.
+template <typename Dtype>
+void HDF5DataLayer<Dtype>::InternalThreadEntry() {
+  const HDF5DataParameter& param = this->layer_param_.hdf5_data_param();
+  const hsize_t chunk_size = param.chunk_size();
+  const int top_size = this->layer_param_.top_size();
+  try {
+    while (!must_stop()) {
+      for (int f = 0; f < num_files_ && !must_stop(); ++f) {
+        const string& filename = hdf_filenames_[file_permutation_[f]];
+        vector<hsize_t> chunk_rows;
+        hsize_t num_rows;
+        {
+          boost::mutex::scoped_lock lock(hdf5_mutex());
+          hid_t file_id = H5Fopen(filename.c_str(), H5F_ACC_RDONLY,
+              H5P_DEFAULT);
+          CHECK_GE(file_id, 0) << "Failed opening HDF5 file: " << filename;
+          num_rows = hdf5_get_num_rows(file_id,
+              this->layer_param_.top(0).c_str());
+          for (int i = 1; i < top_size; ++i) {
+            CHECK_EQ(hdf5_get_num_rows(file_id,
+                this->layer_param_.top(i).c_str()), num_rows);
+          }
+          CHECK_GE(H5Fclose(file_id), 0) << "Failed to close " << filename;
+        }
+        for (hsize_t row = 0; row < num_rows; row += chunk_size) {
+          chunk_rows.push_back(row);
+        }
+        if (param.shuffle()) {
+          shuffle(chunk_rows.begin(), chunk_rows.end());
+        }
+        DLOG(INFO) << "Streaming " << num_rows << " rows from " << filename
+                   << " in " << chunk_rows.size() << " chunks";
+        for (int c = 0; c < chunk_rows.size(); ++c) {
+          HDF5Chunk<Dtype>* chunk = chunk_free_.pop();
+          {
+            boost::mutex::scoped_lock lock(hdf5_mutex());
+            hid_t file_id = H5Fopen(filename.c_str(), H5F_ACC_RDONLY,
+                H5P_DEFAULT);
+            CHECK_GE(file_id, 0) << "Failed opening HDF5 file: " << filename;
+            LoadHDF5Chunk(file_id, chunk_rows[c],
+                std::min(chunk_size, num_rows - chunk_rows[c]), chunk);
+            CHECK_GE(H5Fclose(file_id), 0) << "Failed to close " << filename;
+          }
+          chunk_full_.push(chunk);
+        }
+      }
+      if (param.shuffle()) {
+        shuffle(file_permutation_.begin(), file_permutation_.end());
+      }
+    }
+  } catch (boost::thread_interrupted&) {
+    // Interrupted exception is expected on shutdown
+  }
+}
+
+// Swap in the next chunk read by the thread and hand back the current one.
+template <typename Dtype>
+void HDF5DataLayer<Dtype>::NextChunk() {
+  HDF5Chunk<Dtype>* chunk = chunk_full_.pop("Waiting for HDF5 data");
+  hdf_blobs_.swap(chunk->blobs_);
+  data_permutation_.swap(chunk->permutation_);
+  chunk_free_.push(chunk);
+}
+
 template <typename Dtype>
 bool HDF5DataLayer<Dtype>::Skip() {
   int size = Caffe::solver_count();
@@ -138,22 +252,26 @@ bool HDF5DataLayer<Dtype>::Skip() {
 template<typename Dtype>
 void HDF5DataLayer<Dtype>::Next() {
   if (++current_row_ == hdf_blobs_[0]->shape(0)) {
-    if (num_files_ > 1) {
-      ++current_file_;
-      if (current_file_ == num_files_) {
-        current_file_ = 0;
-        if (this->layer_param_.hdf5_data_param().shuffle()) {
-          std::random_shuffle(file_permutation_.begin(),
-                              file_permutation_.end());
+    if (this->layer_param_.hdf5_data_param().chunk_size() > 0) {
+      NextChunk();
+    } else {
+      if (num_files_ > 1) {
+        ++current_file_;
+        if (current_file_ == num_files_) {
+          current_file_ = 0;
+          if (this->layer_param_.hdf5_data_param().shuffle()) {
+            std::random_shuffle(file_permutation_.begin(),
+                                file_permutation_.end());
+          }
+          DLOG(INFO) << "Looping around to first file.";
         }
-        DLOG(INFO) << "Looping around to first file.";
+        LoadHDF5FileData(
+          hdf_filenames_[file_permutation_[current_file_]].c_str());
       }
-      LoadHDF5FileData(
-        hdf_filenames_[file_permutation_[current_file_]].c_str());
+      if (this->layer_param_.hdf5_data_param().shuffle())
+        std::random_shuffle(data_permutation_.begin(), data_permutation_.end());
     }
     current_row_ = 0;
-    if (this->layer_param_.hdf5_data_param().shuffle())
-      std::random_shuffle(data_permutation_.begin(), data_permutation_.end());
   }
   offset_++;
 }
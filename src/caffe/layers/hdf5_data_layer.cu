@@ -1,8 +1,3 @@
-/*
-TODO:
-- only load parts of the file, in accordance with a prototxt param "max_mem"
-*/
-
 #include <stdint.h>
 #include <vector>
 
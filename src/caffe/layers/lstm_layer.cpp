@@ -1,3 +1,4 @@
+#include <cmath>
 #include <string>
 #include <vector>
 
@@ -10,6 +11,372 @@
 
 namespace caffe {
 
+// The nonlinearities of LSTMUnitLayer, so that both engines agree.
+template <typename Dtype>
+inline Dtype lstm_sigmoid(Dtype x) {
+  return 1. / (1. + exp(-x));
+}
+
+template <typename Dtype>
+inline Dtype lstm_tanh(Dtype x) {
+  return 2. * lstm_sigmoid(2. * x) - 1.;
+}
+
+// Computes one timestep of the FUSED engine for num streams: replaces the gate
+// inputs [i', f', o', g'] by the gate activations and writes c_t and h_t.
+// Unlike LSTMUnitLayer, each loop runs branch-free over a contiguous row so
+// that the compiler can vectorize it.
+template <typename Dtype>
+void lstm_step_forward(const int num, const int dim, const Dtype* cont,
+    const Dtype* c_prev, Dtype* gates, Dtype* c, Dtype* h) {
+  for (int n = 0; n < num; ++n) {
+    Dtype* i = gates;
+    Dtype* f = gates + dim;
+    Dtype* o = gates + 2 * dim;
+    Dtype* g = gates + 3 * dim;
+    for (int d = 0; d < 3 * dim; ++d) {
+      gates[d] = lstm_sigmoid(gates[d]);
+    }
+    for (int d = 0; d < dim; ++d) {
+      g[d] = lstm_tanh(g[d]);
+    }
+    // Forget the previous cell state at the beginning of a sequence.
+    const Dtype keep = cont[n];
+    for (int d = 0; d < dim; ++d) {
+      f[d] *= keep;
+      c[d] = f[d] * c_prev[d] + i[d] * g[d];
+      h[d] = o[d] * lstm_tanh(c[d]);
+    }
+    gates += 4 * dim;
+    c_prev += dim;
+    c += dim;
+    h += dim;
+  }
+}
+
+// Backpropagates one timestep of the FUSED engine given the gradient h_diff
+// w.r.t. h_t and c_diff w.r.t. c_t, which is replaced by the gradient w.r.t.
+// c_{t-1}.  The gradient w.r.t. the gate inputs is written to gates_diff.
+template <typename Dtype>
+void lstm_step_backward(const int num, const int dim, const Dtype* gates,
+    const Dtype* c_prev, const Dtype* c, const Dtype* h_diff, Dtype* c_diff,
+    Dtype* gates_diff) {
+  for (int n = 0; n < num; ++n) {
+    const Dtype* i = gates;
+    const Dtype* f = gates + dim;
+    const Dtype* o = gates + 2 * dim;
+    const Dtype* g = gates + 3 * dim;
+    Dtype* i_diff = gates_diff;
+    Dtype* f_diff = gates_diff + dim;
+    Dtype* o_diff = gates_diff + 2 * dim;
+    Dtype* g_diff = gates_diff + 3 * dim;
+    for (int d = 0; d < dim; ++d) {
+      const Dtype tanh_c = lstm_tanh(c[d]);
+      const Dtype c_term_diff =
+          c_diff[d] + h_diff[d] * o[d] * (1 - tanh_c * tanh_c);
+      c_diff[d] = c_term_diff * f[d];
+      i_diff[d] = c_term_diff * g[d] * i[d] * (1 - i[d]);
+      f_diff[d] = c_term_diff * c_prev[d] * f[d] * (1 - f[d]);
+      o_diff[d] = h_diff[d] * tanh_c * o[d] * (1 - o[d]);
+      g_diff[d] = c_term_diff * i[d] * (1 - g[d] * g[d]);
+    }
+    gates += 4 * dim;
+    gates_diff += 4 * dim;
+    c_prev += dim;
+    c += dim;
+    h_diff += dim;
+    c_diff += dim;
+  }
+}
+
+template <typename Dtype>
+void LSTMLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top) {
+  const RecurrentParameter& recurrent_param =
+      this->layer_param_.recurrent_param();
+  fused_ = recurrent_param.engine() == RecurrentParameter_Engine_FUSED ||
+      (recurrent_param.engine() == RecurrentParameter_Engine_DEFAULT &&
+       Caffe::mode() == Caffe::CPU);
+  if (!fused_) {
+    RecurrentLayer<Dtype>::LayerSetUp(bottom, top);
+    return;
+  }
+  CHECK_GE(bottom[0]->num_axes(), 2)
+      << "bottom[0] must have at least 2 axes -- (#timesteps, #streams, ...)";
+  this->T_ = bottom[0]->shape(0);
+  this->N_ = bottom[0]->shape(1);
+  hidden_dim_ = recurrent_param.num_output();
+  CHECK_GT(hidden_dim_, 0) << "num_output must be positive";
+  this->expose_hidden_ = recurrent_param.expose_hidden();
+  // The FUSED engine takes any number of timesteps and keeps its hidden
+  // state anyway, so streaming only rules out exposing it and Backward.
+  this->streaming_ = recurrent_param.streaming();
+  CHECK(!(this->streaming_ && this->expose_hidden_))
+      << "A streaming layer keeps its hidden state.";
+  this->static_input_ = (bottom.size() > 2 + 2 * this->expose_hidden_);
+  input_dim_ = bottom[0]->count(2);
+  static_dim_ = this->static_input_ ? bottom[2]->count(1) : 0;
+
+  // The parameters are those of the unrolled net, in the same order -- W_xc,
+  // b_c, W_xc_static given a static input, and W_hc -- so that either engine
+  // can use weights trained by the other.
+  const int gate_dim = 4 * hidden_dim_;
+  shared_ptr<Filler<Dtype> > weight_filler(
+      GetFiller<Dtype>(recurrent_param.weight_filler()));
+  shared_ptr<Filler<Dtype> > bias_filler(
+      GetFiller<Dtype>(recurrent_param.bias_filler()));
+  this->blobs_.resize(3 + this->static_input_);
+  vector<int> weight_shape(2);
+  weight_shape[0] = gate_dim;
+  weight_shape[1] = input_dim_;
+  this->blobs_[0].reset(new Blob<Dtype>(weight_shape));
+  weight_filler->Fill(this->blobs_[0].get());
+  vector<int> bias_shape(1, gate_dim);
+  this->blobs_[1].reset(new Blob<Dtype>(bias_shape));
+  bias_filler->Fill(this->blobs_[1].get());
+  if (this->static_input_) {
+    weight_shape[1] = static_dim_;
+    this->blobs_[2].reset(new Blob<Dtype>(weight_shape));
+    weight_filler->Fill(this->blobs_[2].get());
+  }
+  weight_shape[1] = hidden_dim_;
+  this->blobs_.back().reset(new Blob<Dtype>(weight_shape));
+  weight_filler->Fill(this->blobs_.back().get());
+  this->param_propagate_down_.clear();
+  this->param_propagate_down_.resize(this->blobs_.size(), true);
+}
+
+template <typename Dtype>
+void LSTMLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom,
+      const vector<Blob<Dtype>*>& top) {
+  if (!fused_) {
+    RecurrentLayer<Dtype>::Reshape(bottom, top);
+    return;
+  }
+  // Unlike the unrolled net, the FUSED engine takes any number of timesteps.
+  CHECK_GE(bottom[0]->num_axes(), 2)
+      << "bottom[0] must have at least 2 axes -- (#timesteps, #streams, ...)";
+  this->T_ = bottom[0]->shape(0);
+  this->N_ = bottom[0]->shape(1);
+  CHECK_EQ(input_dim_, bottom[0]->count(2))
+      << "Input size incompatible with LSTM parameters.";
+  CHECK_EQ(bottom[1]->num_axes(), 2)
+      << "bottom[1] must have exactly 2 axes -- (#timesteps, #streams)";
+  CHECK_EQ(this->T_, bottom[1]->shape(0));
+  CHECK_EQ(this->N_, bottom[1]->shape(1));
+  if (this->static_input_) {
+    CHECK_EQ(this->N_, bottom[2]->shape(0));
+    CHECK_EQ(static_dim_, bottom[2]->count(1))
+        << "Static input size incompatible with LSTM parameters.";
+  }
+  vector<int> shape(3);
+  shape[0] = this->T_;
+  shape[1] = this->N_;
+  shape[2] = 4 * hidden_dim_;
+  gates_.Reshape(shape);
+  shape[2] = hidden_dim_;
+  top[0]->Reshape(shape);
+  h_conted_.Reshape(shape);
+  shape[0] = this->T_ + 1;
+  cell_.Reshape(shape);
+  shape[0] = 1;
+  h_T_.Reshape(shape);
+  c_T_.Reshape(shape);
+  if (this->expose_hidden_) {
+    const int bottom_offset = 2 + this->static_input_;
+    for (int i = bottom_offset; i < bottom.size(); ++i) {
+      CHECK(bottom[i]->shape() == shape)
+          << "shape mismatch - bottom[" << i << "]: "
+          << bottom[i]->shape_string() << " vs. " << h_T_.shape_string();
+    }
+    top[1]->Reshape(shape);
+    top[2]->Reshape(shape);
+  }
+  if (this->static_input_) {
+    shape.resize(2);
+    shape[0] = this->N_;
+    shape[1] = 4 * hidden_dim_;
+    static_gates_.Reshape(shape);
+  }
+  vector<int> bias_multiplier_shape(1, this->T_ * this->N_);
+  if (bias_multiplier_.shape() != bias_multiplier_shape) {
+    bias_multiplier_.Reshape(bias_multiplier_shape);
+    caffe_set(bias_multiplier_.count(), Dtype(1),
+        bias_multiplier_.mutable_cpu_data());
+  }
+}
+
+template <typename Dtype>
+void LSTMLayer<Dtype>::Reset() {
+  if (!fused_) {
+    RecurrentLayer<Dtype>::Reset();
+    return;
+  }
+  caffe_set(h_T_.count(), Dtype(0), h_T_.mutable_cpu_data());
+  caffe_set(c_T_.count(), Dtype(0), c_T_.mutable_cpu_data());
+}
+
+template <typename Dtype>
+void LSTMLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
+    const vector<Blob<Dtype>*>& top) {
+  if (!fused_) {
+    RecurrentLayer<Dtype>::Forward_cpu(bottom, top);
+    return;
+  }
+  const int T = this->T_;
+  const int N = this->N_;
+  const int D = hidden_dim_;
+  const int gate_dim = 4 * D;
+  const Dtype* cont = bottom[1]->cpu_data();
+  const Dtype* W_hc = this->blobs_.back()->cpu_data();
+  Dtype* gates = gates_.mutable_cpu_data();
+  Dtype* cell = cell_.mutable_cpu_data();
+  Dtype* h_conted = h_conted_.mutable_cpu_data();
+  Dtype* h = top[0]->mutable_cpu_data();
+
+  // W_xc * x_t + b_c for all timesteps at once.
+  caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasTrans, T * N, gate_dim, input_dim_,
+      (Dtype)1., bottom[0]->cpu_data(), this->blobs_[0]->cpu_data(),
+      (Dtype)0., gates);
+  caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, T * N, gate_dim, 1,
+      (Dtype)1., bias_multiplier_.cpu_data(), this->blobs_[1]->cpu_data(),
+      (Dtype)1., gates);
+  if (this->static_input_) {
+    caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasTrans, N, gate_dim, static_dim_,
+        (Dtype)1., bottom[2]->cpu_data(), this->blobs_[2]->cpu_data(),
+        (Dtype)0., static_gates_.mutable_cpu_data());
+    for (int t = 0; t < T; ++t) {
+      caffe_axpy<Dtype>(N * gate_dim, 1, static_gates_.cpu_data(),
+          gates + t * N * gate_dim);
+    }
+  }
+
+  // Start from the exposed hidden state, or else from the last timestep of
+  // the previous batch.
+  const Dtype* h_prev = h_T_.cpu_data();
+  const Dtype* c_0 = c_T_.cpu_data();
+  if (this->expose_hidden_) {
+    h_prev = bottom[2 + this->static_input_]->cpu_data();
+    c_0 = bottom[3 + this->static_input_]->cpu_data();
+  }
+  caffe_copy(N * D, c_0, cell);
+  for (int t = 0; t < T; ++t) {
+    const Dtype* cont_t = cont + t * N;
+    Dtype* h_conted_t = h_conted + t * N * D;
+    Dtype* gates_t = gates + t * N * gate_dim;
+    for (int n = 0; n < N; ++n) {
+      caffe_cpu_scale(D, cont_t[n], h_prev + n * D, h_conted_t + n * D);
+    }
+    caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasTrans, N, gate_dim, D,
+        (Dtype)1., h_conted_t, W_hc, (Dtype)1., gates_t);
+    lstm_step_forward(N, D, cont_t, cell + t * N * D, gates_t,
+        cell + (t + 1) * N * D, h + t * N * D);
+    h_prev = h + t * N * D;
+  }
+  caffe_copy(N * D, h_prev, h_T_.mutable_cpu_data());
+  caffe_copy(N * D, cell + T * N * D, c_T_.mutable_cpu_data());
+  if (this->expose_hidden_) {
+    caffe_copy(N * D, h_T_.cpu_data(), top[1]->mutable_cpu_data());
+    caffe_copy(N * D, c_T_.cpu_data(), top[2]->mutable_cpu_data());
+  }
+}
+
+template <typename Dtype>
+void LSTMLayer<Dtype>::Forward_gpu(const vector<Blob<Dtype>*>& bottom,
+    const vector<Blob<Dtype>*>& top) {
+  if (fused_) {
+    Forward_cpu(bottom, top);
+  } else {
+    RecurrentLayer<Dtype>::Forward_gpu(bottom, top);
+  }
+}
+
+template <typename Dtype>
+void LSTMLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
+    const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom) {
+  if (!fused_) {
+    RecurrentLayer<Dtype>::Backward_cpu(top, propagate_down, bottom);
+    return;
+  }
+  CHECK(!this->streaming_)
+      << "Cannot backpropagate through a streaming layer.";
+  CHECK(!propagate_down[1]) << "Cannot backpropagate to sequence indicators.";
+  const int T = this->T_;
+  const int N = this->N_;
+  const int D = hidden_dim_;
+  const int gate_dim = 4 * D;
+  const Dtype* cont = bottom[1]->cpu_data();
+  const Dtype* W_hc = this->blobs_.back()->cpu_data();
+  const Dtype* gates = gates_.cpu_data();
+  const Dtype* cell = cell_.cpu_data();
+  const Dtype* top_diff = top[0]->cpu_diff();
+  Dtype* gates_diff = gates_.mutable_cpu_diff();
+  Dtype* h_conted_diff = h_conted_.mutable_cpu_diff();
+
+  // The diffs of h_T_ and c_T_ hold the gradient w.r.t. the hidden and cell
+  // state of the current timestep, starting from 0 -- as in the unrolled net,
+  // we can't backpropagate across batches (nor to exposed hidden inputs).
+  Dtype* h_diff = h_T_.mutable_cpu_diff();
+  Dtype* c_diff = c_T_.mutable_cpu_diff();
+  caffe_set(N * D, Dtype(0), h_diff);
+  caffe_set(N * D, Dtype(0), c_diff);
+  for (int t = T - 1; t >= 0; --t) {
+    const Dtype* cont_t = cont + t * N;
+    Dtype* gates_diff_t = gates_diff + t * N * gate_dim;
+    Dtype* h_conted_diff_t = h_conted_diff + t * N * D;
+    caffe_axpy<Dtype>(N * D, 1, top_diff + t * N * D, h_diff);
+    lstm_step_backward(N, D, gates + t * N * gate_dim, cell + t * N * D,
+        cell + (t + 1) * N * D, h_diff, c_diff, gates_diff_t);
+    caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, N, D, gate_dim,
+        (Dtype)1., gates_diff_t, W_hc, (Dtype)0., h_conted_diff_t);
+    for (int n = 0; n < N; ++n) {
+      caffe_cpu_scale(D, cont_t[n], h_conted_diff_t + n * D, h_diff + n * D);
+    }
+  }
+
+  // Gradients w.r.t. the parameters and inputs, for all timesteps at once.
+  if (this->param_propagate_down_[0]) {
+    caffe_cpu_gemm<Dtype>(CblasTrans, CblasNoTrans, gate_dim, input_dim_,
+        T * N, (Dtype)1., gates_diff, bottom[0]->cpu_data(), (Dtype)1.,
+        this->blobs_[0]->mutable_cpu_diff());
+  }
+  if (this->param_propagate_down_[1]) {
+    caffe_cpu_gemv<Dtype>(CblasTrans, T * N, gate_dim, (Dtype)1., gates_diff,
+        bias_multiplier_.cpu_data(), (Dtype)1.,
+        this->blobs_[1]->mutable_cpu_diff());
+  }
+  if (this->param_propagate_down_.back()) {
+    caffe_cpu_gemm<Dtype>(CblasTrans, CblasNoTrans, gate_dim, D, T * N,
+        (Dtype)1., gates_diff, h_conted_.cpu_data(), (Dtype)1.,
+        this->blobs_.back()->mutable_cpu_diff());
+  }
+  if (propagate_down[0]) {
+    caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, T * N, input_dim_,
+        gate_dim, (Dtype)1., gates_diff, this->blobs_[0]->cpu_data(),
+        (Dtype)0., bottom[0]->mutable_cpu_diff());
+  }
+  if (this->static_input_ &&
+      (this->param_propagate_down_[2] || propagate_down[2])) {
+    // x_static feeds every timestep, so its gradient sums over them.
+    Dtype* static_gates_diff = static_gates_.mutable_cpu_diff();
+    caffe_copy(N * gate_dim, gates_diff, static_gates_diff);
+    for (int t = 1; t < T; ++t) {
+      caffe_axpy<Dtype>(N * gate_dim, 1, gates_diff + t * N * gate_dim,
+          static_gates_diff);
+    }
+    if (this->param_propagate_down_[2]) {
+      caffe_cpu_gemm<Dtype>(CblasTrans, CblasNoTrans, gate_dim, static_dim_,
+          N, (Dtype)1., static_gates_diff, bottom[2]->cpu_data(), (Dtype)1.,
+          this->blobs_[2]->mutable_cpu_diff());
+    }
+    if (propagate_down[2]) {
+      caffe_cpu_gemm<Dtype>(CblasNoTrans, CblasNoTrans, N, static_dim_,
+          gate_dim, (Dtype)1., static_gates_diff, this->blobs_[2]->cpu_data(),
+          (Dtype)0., bottom[2]->mutable_cpu_diff());
+    }
+  }
+}
+
 template <typename Dtype>
 void LSTMLayer<Dtype>::RecurrentInputBlobNames(vector<string>* names) const {
   names->resize(2);
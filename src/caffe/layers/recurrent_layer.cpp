@@ -29,6 +29,13 @@ void RecurrentLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
   // the hidden state blobs at the first and last timesteps.
   expose_hidden_ = this->layer_param_.recurrent_param().expose_hidden();
 
+  // A streaming layer unrolls a single timestep, whatever its input.
+  streaming_ = this->layer_param_.recurrent_param().streaming();
+  if (streaming_) {
+    CHECK(!expose_hidden_) << "A streaming layer keeps its hidden state.";
+    T_ = 1;
+  }
+
   // Get (recurrent) input/output names.
   vector<string> output_names;
   OutputBlobNames(&output_names);
@@ -56,15 +63,15 @@ void RecurrentLayer<Dtype>::LayerSetUp(const vector<Blob<Dtype>*>& bottom,
   InputParameter* input_param = input_layer_param->mutable_input_param();
   input_layer_param->add_top("x");
   BlobShape input_shape;
-  for (int i = 0; i < bottom[0]->num_axes(); ++i) {
+  input_shape.add_dim(T_);
+  for (int i = 1; i < bottom[0]->num_axes(); ++i) {
     input_shape.add_dim(bottom[0]->shape(i));
   }
   input_param->add_shape()->CopyFrom(input_shape);
 
   input_shape.Clear();
-  for (int i = 0; i < bottom[1]->num_axes(); ++i) {
-    input_shape.add_dim(bottom[1]->shape(i));
-  }
+  input_shape.add_dim(T_);
+  input_shape.add_dim(N_);
   input_layer_param->add_top("cont");
   input_param->add_shape()->CopyFrom(input_shape);
 
@@ -184,6 +191,44 @@ void RecurrentLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom,
       const vector<Blob<Dtype>*>& top) {
   CHECK_GE(bottom[0]->num_axes(), 2)
       << "bottom[0] must have at least 2 axes -- (#timesteps, #streams, ...)";
+  if (streaming_) {
+    // Only reshape the unrolled net when the timestep shape changes; Forward
+    // points its inputs at one timestep of the bottoms at a time.
+    const int num_timesteps = bottom[0]->shape(0);
+    CHECK_EQ(bottom[1]->num_axes(), 2)
+        << "bottom[1] must have exactly 2 axes -- (#timesteps, #streams)";
+    CHECK_EQ(num_timesteps, bottom[1]->shape(0));
+    CHECK_EQ(bottom[0]->shape(1), bottom[1]->shape(1));
+    vector<int> x_shape = bottom[0]->shape();
+    x_shape[0] = 1;
+    if (x_input_blob_->shape() != x_shape || (static_input_ &&
+        x_static_input_blob_->shape() != bottom[2]->shape())) {
+      N_ = bottom[0]->shape(1);
+      x_input_blob_->Reshape(x_shape);
+      vector<int> cont_shape(2);
+      cont_shape[0] = 1;
+      cont_shape[1] = N_;
+      cont_input_blob_->Reshape(cont_shape);
+      if (static_input_) {
+        x_static_input_blob_->ReshapeLike(*bottom[2]);
+      }
+      vector<BlobShape> recur_input_shapes;
+      RecurrentInputShapes(&recur_input_shapes);
+      for (int i = 0; i < recur_input_shapes.size(); ++i) {
+        recur_input_blobs_[i]->Reshape(recur_input_shapes[i]);
+      }
+      unrolled_net_->Reshape();
+    }
+    if (static_input_) {
+      x_static_input_blob_->ShareData(*bottom[2]);
+    }
+    for (int i = 0; i < output_blobs_.size(); ++i) {
+      vector<int> top_shape = output_blobs_[i]->shape();
+      top_shape[0] = num_timesteps;
+      top[i]->Reshape(top_shape);
+    }
+    return;
+  }
   CHECK_EQ(T_, bottom[0]->shape(0)) << "input number of timesteps changed";
   N_ = bottom[0]->shape(1);
   CHECK_EQ(bottom[1]->num_axes(), 2)
@@ -254,17 +299,34 @@ void RecurrentLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
   }
 
   DCHECK_EQ(recur_input_blobs_.size(), recur_output_blobs_.size());
-  if (!expose_hidden_) {
-    for (int i = 0; i < recur_input_blobs_.size(); ++i) {
-      const int count = recur_input_blobs_[i]->count();
-      DCHECK_EQ(count, recur_output_blobs_[i]->count());
-      const Dtype* timestep_T_data = recur_output_blobs_[i]->cpu_data();
-      Dtype* timestep_0_data = recur_input_blobs_[i]->mutable_cpu_data();
-      caffe_copy(count, timestep_T_data, timestep_0_data);
+  // A streaming layer runs its net once per timestep; otherwise the net covers
+  // all timesteps at once.
+  const int num_steps = streaming_ ? bottom[0]->shape(0) : 1;
+  for (int t = 0; t < num_steps; ++t) {
+    if (streaming_) {
+      x_input_blob_->ShareData(*bottom[0], t * x_input_blob_->count());
+      cont_input_blob_->ShareData(*bottom[1], t * N_);
+    }
+    if (!expose_hidden_) {
+      for (int i = 0; i < recur_input_blobs_.size(); ++i) {
+        const int count = recur_input_blobs_[i]->count();
+        DCHECK_EQ(count, recur_output_blobs_[i]->count());
+        const Dtype* timestep_T_data = recur_output_blobs_[i]->cpu_data();
+        Dtype* timestep_0_data = recur_input_blobs_[i]->mutable_cpu_data();
+        caffe_copy(count, timestep_T_data, timestep_0_data);
+      }
     }
-  }
 
-  unrolled_net_->ForwardTo(last_layer_index_);
+    unrolled_net_->ForwardTo(last_layer_index_);
+
+    if (streaming_) {
+      for (int i = 0; i < output_blobs_.size(); ++i) {
+        const int count = output_blobs_[i]->count();
+        caffe_copy(count, output_blobs_[i]->cpu_data(),
+                   top[i]->mutable_cpu_data() + t * count);
+      }
+    }
+  }
 
   if (expose_hidden_) {
     const int top_offset = output_blobs_.size();
@@ -277,6 +339,7 @@ void RecurrentLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
 template <typename Dtype>
 void RecurrentLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
     const vector<bool>& propagate_down, const vector<Blob<Dtype>*>& bottom) {
+  CHECK(!streaming_) << "Cannot backpropagate through a streaming layer.";
   CHECK(!propagate_down[1]) << "Cannot backpropagate to sequence indicators.";
 
   // TODO: skip backpropagation to inputs and parameters inside the unrolled
@@ -19,17 +19,34 @@ void RecurrentLayer<Dtype>::Forward_gpu(const vector<Blob<Dtype>*>& bottom,
   }
 
   DCHECK_EQ(recur_input_blobs_.size(), recur_output_blobs_.size());
-  if (!expose_hidden_) {
-    for (int i = 0; i < recur_input_blobs_.size(); ++i) {
-      const int count = recur_input_blobs_[i]->count();
-      DCHECK_EQ(count, recur_output_blobs_[i]->count());
-      const Dtype* timestep_T_data = recur_output_blobs_[i]->gpu_data();
-      Dtype* timestep_0_data = recur_input_blobs_[i]->mutable_gpu_data();
-      caffe_copy(count, timestep_T_data, timestep_0_data);
+  // A streaming layer runs its net once per timestep; otherwise the net covers
+  // all timesteps at once.
+  const int num_steps = streaming_ ? bottom[0]->shape(0) : 1;
+  for (int t = 0; t < num_steps; ++t) {
+    if (streaming_) {
+      x_input_blob_->ShareData(*bottom[0], t * x_input_blob_->count());
+      cont_input_blob_->ShareData(*bottom[1], t * N_);
     }
-  }
+    if (!expose_hidden_) {
+      for (int i = 0; i < recur_input_blobs_.size(); ++i) {
+        const int count = recur_input_blobs_[i]->count();
+        DCHECK_EQ(count, recur_output_blobs_[i]->count());
+        const Dtype* timestep_T_data = recur_output_blobs_[i]->gpu_data();
+        Dtype* timestep_0_data = recur_input_blobs_[i]->mutable_gpu_data();
+        caffe_copy(count, timestep_T_data, timestep_0_data);
+      }
+    }
+
+    unrolled_net_->ForwardTo(last_layer_index_);
 
-  unrolled_net_->ForwardTo(last_layer_index_);
+    if (streaming_) {
+      for (int i = 0; i < output_blobs_.size(); ++i) {
+        const int count = output_blobs_[i]->count();
+        caffe_copy(count, output_blobs_[i]->gpu_data(),
+                   top[i]->mutable_gpu_data() + t * count);
+      }
+    }
+  }
 
   if (expose_hidden_) {
     const int top_offset = output_blobs_.size();
@@ -29,8 +29,10 @@ void ReductionLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom,
   if (op_ == ReductionParameter_ReductionOp_SUM ||
       op_ == ReductionParameter_ReductionOp_MEAN) {
     vector<int> sum_mult_shape(1, dim_);
-    sum_multiplier_.Reshape(sum_mult_shape);
-    caffe_set(dim_, Dtype(1), sum_multiplier_.mutable_cpu_data());
+    if (sum_multiplier_.shape() != sum_mult_shape) {
+      sum_multiplier_.Reshape(sum_mult_shape);
+      caffe_set(dim_, Dtype(1), sum_multiplier_.mutable_cpu_data());
+    }
   }
   coeff_ = this->layer_param().reduction_param().coeff();
   if (op_ == ReductionParameter_ReductionOp_MEAN) {
@@ -71,7 +71,31 @@ void SliceLayer<Dtype>::Reshape(const vector<Blob<Dtype>*>& bottom,
   if (top.size() == 1) {
     top[0]->ShareData(*bottom[0]);
     top[0]->ShareDiff(*bottom[0]);
+    return;
   }
+  // Outputs keep their place in the input as long as their counts, and so
+  // their offsets, do not change.
+  int offset = 0;
+  in_place_.resize(top.size());
+  for (int i = 0; i < top.size(); ++i) {
+    in_place_[i] = InPlace(*top[i], *bottom[0], offset);
+    offset += top[i]->count();
+  }
+}
+
+template <typename Dtype>
+bool SliceLayer<Dtype>::InPlace(const Blob<Dtype>& top,
+    const Blob<Dtype>& bottom, int offset) const {
+  if (num_slices_ != 1 || !top.data() || !bottom.data()) {
+    return false;
+  }
+  if (!top.data()->is_view_of(*bottom.data(), offset * sizeof(Dtype)) ||
+      top.has_diff() != bottom.has_diff()) {
+    return false;
+  }
+  // The diffs of forward only nets may have been dropped.
+  return !top.has_diff() ||
+      top.diff()->is_view_of(*bottom.diff(), offset * sizeof(Dtype));
 }
 
 template <typename Dtype>
@@ -82,14 +106,16 @@ void SliceLayer<Dtype>::Forward_cpu(const vector<Blob<Dtype>*>& bottom,
   const Dtype* bottom_data = bottom[0]->cpu_data();
   const int bottom_slice_axis = bottom[0]->shape(slice_axis_);
   for (int i = 0; i < top.size(); ++i) {
-    Dtype* top_data = top[i]->mutable_cpu_data();
     const int top_slice_axis = top[i]->shape(slice_axis_);
-    for (int n = 0; n < num_slices_; ++n) {
-      const int top_offset = n * top_slice_axis * slice_size_;
-      const int bottom_offset =
-          (n * bottom_slice_axis + offset_slice_axis) * slice_size_;
-      caffe_copy(top_slice_axis * slice_size_,
-          bottom_data + bottom_offset, top_data + top_offset);
+    if (!in_place_[i]) {
+      Dtype* top_data = top[i]->mutable_cpu_data();
+      for (int n = 0; n < num_slices_; ++n) {
+        const int top_offset = n * top_slice_axis * slice_size_;
+        const int bottom_offset =
+            (n * bottom_slice_axis + offset_slice_axis) * slice_size_;
+        caffe_copy(top_slice_axis * slice_size_,
+            bottom_data + bottom_offset, top_data + top_offset);
+      }
     }
     offset_slice_axis += top_slice_axis;
   }
@@ -103,14 +129,16 @@ void SliceLayer<Dtype>::Backward_cpu(const vector<Blob<Dtype>*>& top,
   Dtype* bottom_diff = bottom[0]->mutable_cpu_diff();
   const int bottom_slice_axis = bottom[0]->shape(slice_axis_);
   for (int i = 0; i < top.size(); ++i) {
-    const Dtype* top_diff = top[i]->cpu_diff();
     const int top_slice_axis = top[i]->shape(slice_axis_);
-    for (int n = 0; n < num_slices_; ++n) {
-      const int top_offset = n * top_slice_axis * slice_size_;
-      const int bottom_offset =
-          (n * bottom_slice_axis + offset_slice_axis) * slice_size_;
-      caffe_copy(top_slice_axis * slice_size_,
-          top_diff + top_offset, bottom_diff + bottom_offset);
+    if (!in_place_[i]) {
+      const Dtype* top_diff = top[i]->cpu_diff();
+      for (int n = 0; n < num_slices_; ++n) {
+        const int top_offset = n * top_slice_axis * slice_size_;
+        const int bottom_offset =
+            (n * bottom_slice_axis + offset_slice_axis) * slice_size_;
+        caffe_copy(top_slice_axis * slice_size_,
+            top_diff + top_offset, bottom_diff + bottom_offset);
+      }
     }
     offset_slice_axis += top_slice_axis;
   }
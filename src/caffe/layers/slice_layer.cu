@@ -33,14 +33,16 @@ void SliceLayer<Dtype>::Forward_gpu(const vector<Blob<Dtype>*>& bottom,
   const int bottom_slice_axis = bottom[0]->shape(slice_axis_);
   const bool kForward = true;
   for (int i = 0; i < top.size(); ++i) {
-    Dtype* top_data = top[i]->mutable_gpu_data();
     const int top_slice_axis = top[i]->shape(slice_axis_);
-    const int top_slice_size = top_slice_axis * slice_size_;
-    const int nthreads = top_slice_size * num_slices_;
-    Slice<Dtype>  // NOLINT_NEXT_LINE(whitespace/operators)
-        <<<CAFFE_GET_BLOCKS(nthreads), CAFFE_CUDA_NUM_THREADS>>>(
-        nthreads, bottom_data, kForward, num_slices_, slice_size_,
-        bottom_slice_axis, top_slice_axis, offset_slice_axis, top_data);
+    if (!in_place_[i]) {
+      Dtype* top_data = top[i]->mutable_gpu_data();
+      const int top_slice_size = top_slice_axis * slice_size_;
+      const int nthreads = top_slice_size * num_slices_;
+      Slice<Dtype>  // NOLINT_NEXT_LINE(whitespace/operators)
+          <<<CAFFE_GET_BLOCKS(nthreads), CAFFE_CUDA_NUM_THREADS>>>(
+          nthreads, bottom_data, kForward, num_slices_, slice_size_,
+          bottom_slice_axis, top_slice_axis, offset_slice_axis, top_data);
+    }
     offset_slice_axis += top_slice_axis;
   }
 }
@@ -54,14 +56,16 @@ void SliceLayer<Dtype>::Backward_gpu(const vector<Blob<Dtype>*>& top,
   const int bottom_slice_axis = bottom[0]->shape(slice_axis_);
   const bool kForward = false;
   for (int i = 0; i < top.size(); ++i) {
-    const Dtype* top_diff = top[i]->gpu_diff();
     const int top_slice_axis = top[i]->shape(slice_axis_);
-    const int top_slice_size = top_slice_axis * slice_size_;
-    const int nthreads = top_slice_size * num_slices_;
-    Slice<Dtype>  // NOLINT_NEXT_LINE(whitespace/operators)
-        <<<CAFFE_GET_BLOCKS(nthreads), CAFFE_CUDA_NUM_THREADS>>>(
-        nthreads, top_diff, kForward, num_slices_, slice_size_,
-        bottom_slice_axis, top_slice_axis, offset_slice_axis, bottom_diff);
+    if (!in_place_[i]) {
+      const Dtype* top_diff = top[i]->gpu_diff();
+      const int top_slice_size = top_slice_axis * slice_size_;
+      const int nthreads = top_slice_size * num_slices_;
+      Slice<Dtype>  // NOLINT_NEXT_LINE(whitespace/operators)
+          <<<CAFFE_GET_BLOCKS(nthreads), CAFFE_CUDA_NUM_THREADS>>>(
+          nthreads, top_diff, kForward, num_slices_, slice_size_,
+          bottom_slice_axis, top_slice_axis, offset_slice_axis, bottom_diff);
+    }
     offset_slice_axis += top_slice_axis;
   }
 }
@@ -1,3 +1,4 @@
+#include <boost/thread/mutex.hpp>
 #include <algorithm>
 #include <map>
 #include <set>
@@ -52,8 +53,15 @@ void Net<Dtype>::Init(const NetParameter& in_param) {
       << "Initializing net from parameters: " << std::endl
       << filtered_param.DebugString();
   // Create a copy of filtered_param with splits added where necessary.
+  // Nets that only run forward share blobs between their consumers instead.
+  forward_only_ = phase_ == TEST && filtered_param.forward_only() &&
+      !filtered_param.force_backward();
   NetParameter param;
-  InsertSplits(filtered_param, &param);
+  if (forward_only_) {
+    param.CopyFrom(filtered_param);
+  } else {
+    InsertSplits(filtered_param, &param);
+  }
   // Basically, build all the layers and set up their connections.
   name_ = param.name();
   map<string, int> blob_name_to_idx;
@@ -119,6 +127,7 @@ void Net<Dtype>::Init(const NetParameter& in_param) {
     }
     // After this layer is connected, set it up.
     layers_[layer_id]->SetUp(bottom_vecs_[layer_id], top_vecs_[layer_id]);
+    RecordBottomShapes(layer_id);
     LOG_IF(INFO, Caffe::root_solver())
         << "Setting up " << layer_names_[layer_id];
     for (int top_id = 0; top_id < top_vecs_[layer_id].size(); ++top_id) {
@@ -251,7 +260,22 @@ void Net<Dtype>::Init(const NetParameter& in_param) {
     layer_names_index_[layer_names_[layer_id]] = layer_id;
   }
   ShareWeights();
+  if (forward_only_) {
+    LOG_IF(INFO, Caffe::root_solver())
+        << "Memory saved without diffs: " << DropDiffs();
+  }
   debug_info_ = param.debug_info();
+  share_concat_inputs_ = param.share_concat_inputs();
+  if (share_concat_inputs_) {
+    const int placed = ShareConcatInputs();
+    LOG_IF(INFO, Caffe::root_solver() && placed)
+        << "Placed " << placed << " concat inputs in their outputs.";
+  }
+  if (forward_only_) {
+    const int placed = ShareSliceOutputs();
+    LOG_IF(INFO, Caffe::root_solver() && placed)
+        << "Placed " << placed << " slice outputs in their inputs.";
+  }
   LOG_IF(INFO, Caffe::root_solver()) << "Network initialization done.";
 }
 
@@ -398,7 +422,10 @@ int Net<Dtype>::AppendBottom(const NetParameter& param, const int layer_id,
     map<string, int>* blob_name_to_idx) {
   const LayerParameter& layer_param = param.layer(layer_id);
   const string& blob_name = layer_param.bottom(bottom_id);
-  if (available_blobs->find(blob_name) == available_blobs->end()) {
+  // Without splits a blob may feed several layers, after the first of which
+  // it is no longer available.
+  if (available_blobs->find(blob_name) == available_blobs->end() &&
+      !(forward_only_ && blob_name_to_idx->count(blob_name))) {
     LOG(FATAL) << "Unknown bottom blob '" << blob_name << "' (layer '"
                << layer_param.name() << "', bottom index " << bottom_id << ")";
   }
@@ -522,6 +549,8 @@ Dtype Net<Dtype>::ForwardFromTo(int start, int end) {
       before_forward_[c]->run(i);
     }
     Dtype layer_loss = layers_[i]->Forward(bottom_vecs_[i], top_vecs_[i]);
+    // Forward reshaped the layer, so Reshape can skip it for these shapes.
+    RecordBottomShapes(i);
     loss += layer_loss;
     if (debug_info_) { ForwardDebugInfo(i); }
     for (int c = 0; c < after_forward_.size(); ++c) {
@@ -565,6 +594,7 @@ const vector<Blob<Dtype>*>& Net<Dtype>::Forward(
 
 template <typename Dtype>
 void Net<Dtype>::BackwardFromTo(int start, int end) {
+  CHECK(!forward_only_) << "Cannot run backward on a forward_only net.";
   CHECK_GE(end, 0);
   CHECK_LT(start, layers_.size());
   for (int i = start; i >= end; --i) {
@@ -724,9 +754,220 @@ void Net<Dtype>::Backward() {
 
 template <typename Dtype>
 void Net<Dtype>::Reshape() {
+  // Layers without bottoms are always reshaped; the others only when the
+  // shape of a bottom changed since they were last reshaped.
+  bool reshaped = false;
+  for (int i = 0; i < layers_.size(); ++i) {
+    const vector<Blob<Dtype>*>& bottom = bottom_vecs_[i];
+    const vector<vector<int> >& bottom_shapes = layer_bottom_shapes_[i];
+    bool changed = bottom.empty() || bottom.size() != bottom_shapes.size();
+    for (int j = 0; j < bottom.size() && !changed; ++j) {
+      changed = bottom[j]->shape() != bottom_shapes[j];
+    }
+    if (!changed) { continue; }
+    layers_[i]->Reshape(bottom, top_vecs_[i]);
+    RecordBottomShapes(i);
+    reshaped = reshaped || !bottom.empty();
+  }
+  if (!reshaped) { return; }
+  if (share_concat_inputs_) {
+    ShareConcatInputs();
+  }
+  if (forward_only_) {
+    ShareSliceOutputs();
+  }
+}
+
+template <typename Dtype>
+void Net<Dtype>::RecordBottomShapes(int layer_id) {
+  if (layer_bottom_shapes_.size() <= layer_id) {
+    layer_bottom_shapes_.resize(layer_id + 1);
+  }
+  const vector<Blob<Dtype>*>& bottom = bottom_vecs_[layer_id];
+  layer_bottom_shapes_[layer_id].resize(bottom.size());
+  for (int i = 0; i < bottom.size(); ++i) {
+    layer_bottom_shapes_[layer_id][i] = bottom[i]->shape();
+  }
+}
+
+template <typename Dtype>
+size_t Net<Dtype>::DropDiffs() {
+  // Keep the diffs holding loss weights or used by Forward as scratch, and
+  // whatever shares their storage, e.g. the input of a flatten layer.
+  // Empty blobs have not allocated a diff yet, so are kept by themselves.
+  set<SyncedMemory*> kept;
+  set<Blob<Dtype>*> kept_empty;
+  for (int i = 0; i < blobs_.size(); ++i) {
+    if (!blob_loss_weights_[i]) { continue; }
+    if (blobs_[i]->has_diff()) {
+      kept.insert(blobs_[i]->diff().get());
+    } else {
+      kept_empty.insert(blobs_[i].get());
+    }
+  }
+  for (int i = 0; i < layers_.size(); ++i) {
+    for (int j = 0; j < bottom_vecs_[i].size(); ++j) {
+      if (!layers_[i]->ForwardUsesBottomDiff(j)) { continue; }
+      if (bottom_vecs_[i][j]->has_diff()) {
+        kept.insert(bottom_vecs_[i][j]->diff().get());
+      } else {
+        kept_empty.insert(bottom_vecs_[i][j]);
+      }
+    }
+  }
+  vector<Blob<Dtype>*> blobs;
+  for (int i = 0; i < blobs_.size(); ++i) {
+    blobs.push_back(blobs_[i].get());
+  }
+  for (int i = 0; i < params_.size(); ++i) {
+    blobs.push_back(params_[i].get());
+  }
+  set<SyncedMemory*> dropped;
+  size_t bytes = 0;
+  for (int i = 0; i < blobs.size(); ++i) {
+    if (!blobs[i]->has_diff()) {
+      if (!kept_empty.count(blobs[i])) { blobs[i]->set_inference_only(true); }
+      continue;
+    }
+    SyncedMemory* diff = blobs[i]->diff().get();
+    if (kept.count(diff)) { continue; }
+    if (dropped.insert(diff).second) { bytes += diff->size(); }
+    blobs[i]->set_inference_only(true);
+  }
+  return bytes;
+}
+
+template <typename Dtype>
+bool Net<Dtype>::WrittenAfter(int layer_id, int blob_id) const {
+  for (int i = layer_id + 1; i < layers_.size(); ++i) {
+    if (std::find(top_id_vecs_[i].begin(), top_id_vecs_[i].end(), blob_id) !=
+        top_id_vecs_[i].end()) {
+      return true;
+    }
+  }
+  return false;
+}
+
+template <typename Dtype>
+int Net<Dtype>::ProducerOf(int layer_id, int blob_id) const {
+  for (int i = layer_id - 1; i >= 0; --i) {
+    if (std::find(top_id_vecs_[i].begin(), top_id_vecs_[i].end(), blob_id) !=
+        top_id_vecs_[i].end()) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+template <typename Dtype>
+int Net<Dtype>::ShareConcatInputs() {
+  int placed = 0;
+  // From the last concat back, so that the inputs of a concat whose output
+  // is itself placed go straight to the memory of the outermost one.
+  for (int i = layers_.size() - 1; i >= 0; --i) {
+    const LayerParameter& layer_param = layers_[i]->layer_param();
+    const vector<Blob<Dtype>*>& bottom = bottom_vecs_[i];
+    if (layer_param.type() != "Concat" || bottom.size() < 2) {
+      continue;
+    }
+    // The inputs are contiguous parts of the output only if nothing but
+    // singleton axes precede the concat axis. Layers computing in place on
+    // the output would overwrite the inputs, needed by the backward pass of
+    // their producers, and those computing in place on an input after the
+    // concat would overwrite the output.
+    Blob<Dtype>* top = top_vecs_[i][0];
+    const ConcatParameter& concat_param = layer_param.concat_param();
+    const int axis = concat_param.has_concat_dim() ?
+        static_cast<int>(concat_param.concat_dim()) :
+        top->CanonicalAxisIndex(concat_param.axis());
+    if (top->count(0, axis) != 1 || WrittenAfter(i, top_id_vecs_[i][0])) {
+      continue;
+    }
+    set<int> seen_ids;
+    int offset = 0;
+    for (int j = 0; j < bottom.size(); ++j) {
+      const int blob_id = bottom_id_vecs_[i][j];
+      const bool net_input = std::find(net_input_blob_indices_.begin(),
+          net_input_blob_indices_.end(), blob_id) !=
+          net_input_blob_indices_.end();
+      // Leave inputs given by the user, inputs whose diff holds a loss
+      // weight, and memory already shared with other blobs (by split or
+      // reshaping layers, or weight sharing) where they are. Split outputs
+      // only share the memory of their input once forwarded.
+      const int producer = ProducerOf(i, blob_id);
+      const bool placeable = bottom[j] != top && !net_input &&
+          !WrittenAfter(i, blob_id) && producer >= 0 &&
+          layers_[producer]->layer_param().type() != "Split" &&
+          seen_ids.insert(blob_id).second && !blob_loss_weights_[blob_id] &&
+          bottom[j]->count() && bottom[j]->data().use_count() == 1 &&
+          bottom[j]->inference_only() == top->inference_only() &&
+          (bottom[j]->inference_only() || bottom[j]->diff().use_count() == 1);
+      if (placeable) {
+        // Keep what the producer wrote at setup, e.g. constant fillers.
+        Blob<Dtype> saved;
+        const bool written =
+            bottom[j]->data()->head() != SyncedMemory::UNINITIALIZED;
+        if (written) {
+          saved.ReshapeLike(*bottom[j]);
+          saved.ShareData(*bottom[j]);
+        }
+        bottom[j]->ShareData(*top, offset);
+        bottom[j]->ShareDiff(*top, offset);
+        if (written) {
+          bottom[j]->CopyFrom(saved);
+        }
+        ++placed;
+      }
+      offset += bottom[j]->count();
+    }
+    // Let the layer see which of its inputs are in place.
+    layers_[i]->Reshape(bottom, top_vecs_[i]);
+  }
+  return placed;
+}
+
+template <typename Dtype>
+int Net<Dtype>::ShareSliceOutputs() {
+  int placed = 0;
   for (int i = 0; i < layers_.size(); ++i) {
-    layers_[i]->Reshape(bottom_vecs_[i], top_vecs_[i]);
+    const LayerParameter& layer_param = layers_[i]->layer_param();
+    const vector<Blob<Dtype>*>& top = top_vecs_[i];
+    if (layer_param.type() != "Slice" || top.size() < 2) {
+      continue;
+    }
+    // As for concats, the outputs are contiguous parts of the input only if
+    // nothing but singleton axes precede the slice axis, and the input must
+    // not be computed in place after the slice.
+    Blob<Dtype>* bottom = bottom_vecs_[i][0];
+    const SliceParameter& slice_param = layer_param.slice_param();
+    const int axis = slice_param.has_slice_dim() ?
+        static_cast<int>(slice_param.slice_dim()) :
+        bottom->CanonicalAxisIndex(slice_param.axis());
+    if (bottom->count(0, axis) != 1 || WrittenAfter(i, bottom_id_vecs_[i][0])) {
+      continue;
+    }
+    int offset = 0;
+    for (int j = 0; j < top.size(); ++j) {
+      const int blob_id = top_id_vecs_[i][j];
+      // Outputs computed in place would overwrite the input, read by other
+      // layers now that there are no splits. Outputs already placed in a
+      // concat stay there.
+      const bool placeable = top[j] != bottom && !WrittenAfter(i, blob_id) &&
+          !blob_loss_weights_[blob_id] && top[j]->count() &&
+          top[j]->data().use_count() == 1 && !top[j]->data()->base() &&
+          top[j]->inference_only() == bottom->inference_only() &&
+          (top[j]->inference_only() || top[j]->diff().use_count() == 1);
+      if (placeable) {
+        top[j]->ShareData(*bottom, offset);
+        top[j]->ShareDiff(*bottom, offset);
+        ++placed;
+      }
+      offset += top[j]->count();
+    }
+    // Let the layer see which of its outputs are in place.
+    layers_[i]->Reshape(bottom_vecs_[i], top);
   }
+  return placed;
 }
 
 template <typename Dtype>
@@ -769,7 +1010,12 @@ void Net<Dtype>::CopyTrainedLayersFrom(const NetParameter& param) {
 
 template <typename Dtype>
 void Net<Dtype>::CopyTrainedLayersFrom(const string trained_filename) {
-  if (H5Fis_hdf5(trained_filename.c_str())) {
+  bool is_hdf5;
+  {
+    boost::mutex::scoped_lock lock(hdf5_mutex());
+    is_hdf5 = H5Fis_hdf5(trained_filename.c_str()) > 0;
+  }
+  if (is_hdf5) {
     CopyTrainedLayersFromHDF5(trained_filename);
   } else {
     CopyTrainedLayersFromBinaryProto(trained_filename);
@@ -786,6 +1032,7 @@ void Net<Dtype>::CopyTrainedLayersFromBinaryProto(
 
 template <typename Dtype>
 void Net<Dtype>::CopyTrainedLayersFromHDF5(const string trained_filename) {
+  boost::mutex::scoped_lock lock(hdf5_mutex());
   hid_t file_hid = H5Fopen(trained_filename.c_str(), H5F_ACC_RDONLY,
                            H5P_DEFAULT);
   CHECK_GE(file_hid, 0) << "Couldn't open " << trained_filename;
@@ -848,6 +1095,7 @@ void Net<Dtype>::ToProto(NetParameter* param, bool write_diff) const {
 
 template <typename Dtype>
 void Net<Dtype>::ToHDF5(const string& filename, bool write_diff) const {
+  boost::mutex::scoped_lock lock(hdf5_mutex());
   hid_t file_hid = H5Fcreate(filename.c_str(), H5F_ACC_TRUNC, H5P_DEFAULT,
       H5P_DEFAULT);
   CHECK_GE(file_hid, 0)
@@ -905,6 +1153,7 @@ void Net<Dtype>::ToHDF5(const string& filename, bool write_diff) const {
 
 template <typename Dtype>
 void Net<Dtype>::Update() {
+  CHECK(!forward_only_) << "Cannot update a forward_only net.";
   for (int i = 0; i < learnable_params_.size(); ++i) {
     learnable_params_[i]->Update();
   }
@@ -913,30 +1162,27 @@ void Net<Dtype>::Update() {
 template <typename Dtype>
 void Net<Dtype>::ClearParamDiffs() {
   for (int i = 0; i < learnable_params_.size(); ++i) {
-    Blob<Dtype>* blob = learnable_params_[i];
-    switch (Caffe::mode()) {
-    case Caffe::CPU:
-      caffe_set(blob->count(), static_cast<Dtype>(0),
-                blob->mutable_cpu_diff());
-      break;
-    case Caffe::GPU:
-#ifndef CPU_ONLY
-      caffe_gpu_set(blob->count(), static_cast<Dtype>(0),
-                    blob->mutable_gpu_diff());
-#else
-      NO_GPU;
-#endif
-      break;
-    }
+    learnable_params_[i]->ClearDiff();
   }
 }
 
 template <typename Dtype>
 void Net<Dtype>::ShareWeights() {
   for (int i = 0; i < params_.size(); ++i) {
-    if (param_owners_[i] < 0) { continue; }
-    params_[i]->ShareData(*params_[param_owners_[i]]);
-    params_[i]->ShareDiff(*params_[param_owners_[i]]);
+    if (param_owners_[i] >= 0) {
+      params_[i]->ShareData(*params_[param_owners_[i]]);
+      params_[i]->ShareDiff(*params_[param_owners_[i]]);
+    }
+    // A row-sparse diff drops the gradient of any row not recorded, so every
+    // layer writing to it must record its rows.
+    const int layer_id = param_layer_indices_[i].first;
+    const int param_id = param_layer_indices_[i].second;
+    CHECK(!params_[i]->sparse_diff() ||
+          layers_[layer_id]->RecordsDiffRows(param_id))
+        << "Param " << param_display_names_[i] << " of layer "
+        << layer_names_[layer_id] << " has a row-sparse diff, but "
+        << layers_[layer_id]->type() << " layers do not record the rows "
+        << "they write to it.";
   }
 }
 
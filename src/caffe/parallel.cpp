@@ -1,8 +1,11 @@
 #ifdef USE_NCCL
-
 #include <cuda_runtime.h>
+#endif
+#include <boost/bind.hpp>
+#include <boost/thread.hpp>
 #include <glog/logging.h>
 #include <stdio.h>
+#include <algorithm>
 #include <sstream>
 #include <string>
 #include <vector>
@@ -72,6 +75,401 @@ Params<Dtype>::Params(shared_ptr<Solver<Dtype> > root_solver)
     diff_() {
 }
 
+template<typename Dtype>
+CPUParams<Dtype>::CPUParams(shared_ptr<Solver<Dtype> > root_solver)
+  : Params<Dtype>(root_solver) {
+  data_ = new Dtype[size_];
+
+  // Copy blob values
+  const vector<Blob<Dtype>*>& net =
+    root_solver->net()->learnable_params();
+  apply_buffers(net, data_, size_, copy);
+
+  diff_ = new Dtype[size_];
+  caffe_set(size_, Dtype(0), diff_);
+}
+
+template<typename Dtype>
+CPUParams<Dtype>::~CPUParams() {
+  delete [] data_;
+  delete [] diff_;
+}
+
+template<typename Dtype>
+void CPUParams<Dtype>::Configure(Solver<Dtype>* solver) const {
+  const vector<Blob<Dtype>*>& net =
+    solver->net()->learnable_params();
+  apply_buffers(net, data_, size_, replace_cpu);
+  apply_buffers(net, diff_, size_, replace_cpu_diff);
+  // The reductions sum the whole diffs, but each replica only knows the rows
+  // of a row-sparse diff it wrote itself, so make the diffs dense.
+  const vector<shared_ptr<Blob<Dtype> > >& params = solver->net()->params();
+  for (int i = 0; i < params.size(); ++i) {
+    if (params[i]->sparse_diff()) {
+      LOG_IF(INFO, Caffe::root_solver())
+          << "Param " << solver->net()->param_display_names()[i]
+          << " is updated densely across solvers.";
+      params[i]->set_sparse_diff(false);
+    }
+  }
+}
+
+template<typename Dtype>
+CPUSync<Dtype>::CPUSync(shared_ptr<Solver<Dtype> > solver)
+  : CPUParams<Dtype>(solver),
+    solver_(solver), barrier_(), syncs_() {
+  this->Configure(solver.get());
+}
+
+template<typename Dtype>
+void CPUSync<Dtype>::Broadcast() {
+  barrier_->wait();
+  if (Caffe::solver_rank() != 0) {
+    caffe_copy(size_, (*syncs_)[0]->data_, data_);
+  }
+  barrier_->wait();
+}
+
+template<typename Dtype>
+void CPUSync<Dtype>::Reduce(size_t offset, size_t size) {
+  const int count = syncs_->size();
+  const int rank = Caffe::solver_rank();
+  const size_t begin = offset + size * rank / count;
+  const int slice = offset + size * (rank + 1) / count - begin;
+  if (slice == 0) {
+    return;
+  }
+  Dtype* sum = diff_ + begin;
+  for (int i = 0; i < count; ++i) {
+    if (i != rank) {
+      caffe_axpy(slice, Dtype(1), (*syncs_)[i]->diff_ + begin, sum);
+    }
+  }
+  caffe_scal(slice, Dtype(1) / count, sum);
+  for (int i = 0; i < count; ++i) {
+    if (i != rank) {
+      caffe_copy(slice, sum, (*syncs_)[i]->diff_ + begin);
+    }
+  }
+}
+
+template<typename Dtype>
+void CPUSync<Dtype>::run(int layer) {
+  CHECK(solver_->param().layer_wise_reduce());
+  vector<shared_ptr<Blob<Dtype> > >& blobs =
+    solver_->net()->layers()[layer]->blobs();
+  if (blobs.size() > 0) {
+    size_t size = 0;
+    for (int i = 0; i < blobs.size(); ++i) {
+      size += blobs[i]->count();
+    }
+    // Wait for all solvers to be done with the backward of this layer. The
+    // reduced slices are only read once every solver reaches
+    // on_gradients_ready, so there is no need to wait again here.
+    barrier_->wait();
+    Reduce(blobs[0]->cpu_diff() - diff_, size);
+  }
+}
+
+template<typename Dtype>
+void CPUSync<Dtype>::on_gradients_ready() {
+  if (solver_->param().layer_wise_reduce()) {
+    // Make sure reduction is done before applying gradients
+    barrier_->wait();
+  } else {
+    barrier_->wait();
+    Reduce(0, size_);
+    barrier_->wait();
+  }
+}
+
+template<typename Dtype>
+class CPUWorker : public InternalThread {
+ public:
+  explicit CPUWorker(shared_ptr<Solver<Dtype> > rank0,
+                     boost::barrier* barrier, vector<CPUSync<Dtype>*>* syncs,
+                     const char* restore)
+    : rank0_(rank0), barrier_(barrier), syncs_(syncs), restore_(restore) {
+  }
+  virtual ~CPUWorker() {}
+
+ protected:
+  void InternalThreadEntry() {
+    // Create solver and install callbacks
+    SolverParameter param(rank0_->param());
+    param.set_type(rank0_->type());
+    shared_ptr<Solver<Dtype> > s(SolverRegistry<Dtype>::CreateSolver(param));
+    CHECK_EQ(s->type(), rank0_->type());
+    if (restore_) {
+      s->Restore(restore_);
+    }
+    CPUSync<Dtype> sync(s);
+    sync.set_barrier(barrier_);
+    sync.set_syncs(syncs_);
+    s->add_callback(&sync);
+    if (s->param().layer_wise_reduce()) {
+      s->net()->add_after_backward(&sync);
+    }
+    (*syncs_)[Caffe::solver_rank()] = &sync;
+    // Wait for other threads
+    barrier_->wait();
+    // Copy rank 0 weights
+    sync.Broadcast();
+    // Solve
+    s->Step(param.max_iter() - s->iter());
+    barrier_->wait();
+  }
+
+  shared_ptr<Solver<Dtype> > rank0_;
+  boost::barrier* barrier_;
+  vector<CPUSync<Dtype>*>* syncs_;
+  const char* restore_;
+};
+
+template<typename Dtype>
+void CPUSync<Dtype>::Run(int threads, const char* restore) {
+  CHECK_EQ(Caffe::mode(), Caffe::CPU);
+  CHECK_EQ(Caffe::solver_count(), threads)
+      << "Set the solver count to the number of threads.";
+  if (solver_->param().layer_wise_reduce()) {
+    CHECK_EQ(solver_->net()->params().size(),
+             solver_->net()->learnable_params().size())
+      << "Layer-wise reduce is not supported for nets with shared weights.";
+  }
+  boost::barrier barrier(threads);
+  vector<CPUSync<Dtype>*> syncs(threads);
+  // Create workers
+  vector<shared_ptr<CPUWorker<Dtype> > > workers(threads);
+  for (int i = 1; i < threads; ++i) {
+    Caffe::set_solver_rank(i);
+    CPUWorker<Dtype>* w = new CPUWorker<Dtype>(solver_, &barrier, &syncs,
+                                               restore);
+    w->StartInternalThread();
+    workers[i].reset(w);
+  }
+  Caffe::set_solver_rank(0);
+  barrier_ = &barrier;
+  syncs_ = &syncs;
+  solver_->add_callback(this);
+  if (solver_->param().layer_wise_reduce()) {
+    solver_->net()->add_after_backward(this);
+  }
+  syncs[0] = this;
+  // Wait for workers
+  barrier.wait();
+  // Run first solver on current thread
+  Broadcast();
+  solver_->Solve();
+  barrier.wait();
+  // Wait for shutdown
+  for (int i = 1; i < threads; ++i) {
+    workers[i]->StopInternalThread();
+  }
+}
+
+template<typename Dtype>
+RingSync<Dtype>::RingSync(shared_ptr<Solver<Dtype> > solver,
+                          const string& uri)
+  : CPUParams<Dtype>(solver),
+    solver_(solver),
+    comm_(uri, Caffe::solver_rank(), Caffe::solver_count()),
+    num_pending_(),
+    backward_passes_(),
+    comm_ms_(),
+    wait_ms_(),
+    sent_bytes_(),
+    raw_bytes_(),
+    total_sent_bytes_(),
+    total_raw_bytes_(),
+    action_(SolverAction::NONE) {
+  this->Configure(solver.get());
+  solver->SetActionFunction(
+      boost::bind(&RingSync<Dtype>::GetRequestedAction, this));
+  codec_.reset(GetGradientCodec<Dtype>(solver->param(), size_));
+  // Group the params into buckets in backward order. Params are laid out in
+  // layer order, so the layers of a bucket form one range of the buffers.
+  const size_t bucket_size = solver->param().reduce_bucket_size();
+  const vector<shared_ptr<Layer<Dtype> > >& layers = solver->net()->layers();
+  layer_buckets_.resize(layers.size(), -1);
+  size_t bucket_offset = size_;
+  size_t bucket_count = 0;
+  int last_layer = -1;
+  for (int i = layers.size() - 1; i >= 0; --i) {
+    const vector<shared_ptr<Blob<Dtype> > >& blobs = layers[i]->blobs();
+    if (blobs.size() == 0) {
+      continue;
+    }
+    size_t count = 0;
+    for (int j = 0; j < blobs.size(); ++j) {
+      count += blobs[j]->count();
+    }
+    const size_t offset = blobs[0]->cpu_diff() - diff_;
+    CHECK(bucket_count == 0 || offset + count == bucket_offset);
+    bucket_offset = offset;
+    bucket_count += count;
+    last_layer = i;
+    if (bucket_count * sizeof(Dtype) >= bucket_size) {
+      AddBucket(last_layer, bucket_offset, bucket_count);
+      bucket_count = 0;
+    }
+  }
+  if (bucket_count > 0) {
+    AddBucket(last_layer, bucket_offset, bucket_count);
+  }
+}
+
+template<typename Dtype>
+void RingSync<Dtype>::AddBucket(int layer, size_t offset, size_t count) {
+  layer_buckets_[layer] = bucket_offsets_.size();
+  bucket_offsets_.push_back(offset);
+  bucket_counts_.push_back(count);
+}
+
+template<typename Dtype>
+RingSync<Dtype>::~RingSync() {
+  StopInternalThread();
+}
+
+template<typename Dtype>
+void RingSync<Dtype>::Reduce(size_t offset, size_t count) {
+  const size_t bytes_sent = comm_.bytes_sent();
+  if (codec_) {
+    comm_.AllReduce(diff_ + offset, count, offset, codec_.get());
+  } else {
+    comm_.AllReduce(diff_ + offset, count);
+  }
+  sent_bytes_ += comm_.bytes_sent() - bytes_sent;
+  // What ring allreduce sends without compression
+  raw_bytes_ += 2. * (comm_.size() - 1) / comm_.size() * count * sizeof(Dtype);
+  caffe_scal(static_cast<int>(count), Dtype(1) / comm_.size(),
+             diff_ + offset);
+}
+
+template<typename Dtype>
+void RingSync<Dtype>::InternalThreadEntry() {
+  CPUTimer timer;
+  try {
+    while (!must_stop()) {
+      const int bucket = pending_.pop();
+      timer.Start();
+      Reduce(bucket_offsets_[bucket], bucket_counts_[bucket]);
+      comm_ms_ += timer.MilliSeconds();
+      reduced_.push(bucket);
+    }
+  } catch (boost::thread_interrupted&) {
+    // Interrupted exception is expected on shutdown
+  }
+}
+
+template<typename Dtype>
+SolverAction::Enum RingSync<Dtype>::GetRequestedAction() {
+  // The request is only acted on once. Snapshots are written by rank 0.
+  const SolverAction::Enum action = action_;
+  action_ = SolverAction::NONE;
+  if (action == SolverAction::SNAPSHOT && !Caffe::root_solver()) {
+    return SolverAction::NONE;
+  }
+  return action;
+}
+
+template<typename Dtype>
+void RingSync<Dtype>::on_start() {
+  backward_passes_ = 0;
+}
+
+template<typename Dtype>
+void RingSync<Dtype>::run(int layer) {
+  CHECK(solver_->param().layer_wise_reduce());
+  // Gradients are accumulated over iter_size passes, only the last one
+  // completes them.
+  if (backward_passes_ < solver_->param().iter_size() - 1) {
+    if (layer == 0) {
+      ++backward_passes_;
+    }
+    return;
+  }
+  const int bucket = layer_buckets_[layer];
+  if (bucket >= 0) {
+    // All ranks run the layers in the same order, so the collectives of
+    // the background thread match.
+    pending_.push(bucket);
+    ++num_pending_;
+  }
+}
+
+template<typename Dtype>
+void RingSync<Dtype>::on_gradients_ready() {
+  CPUTimer timer;
+  timer.Start();
+  if (solver_->param().layer_wise_reduce()) {
+    // Make sure reduction is done before applying gradients
+    for (; num_pending_ > 0; --num_pending_) {
+      reduced_.pop();
+    }
+  } else {
+    Reduce(0, size_);
+    comm_ms_ += timer.MilliSeconds();
+  }
+  wait_ms_ += timer.MilliSeconds();
+  // Only rank 0 polls for requests, the solvers of all ranks read the same
+  // one once this iteration's update is applied. Ranks stopping at different
+  // iterations would block the others in the reduction.
+  Dtype action = SolverAction::NONE;
+  if (Caffe::root_solver() && root_action_) {
+    action = root_action_();
+  }
+  comm_.Broadcast(&action, 1);
+  action_ = static_cast<SolverAction::Enum>(static_cast<int>(action));
+  const int display = solver_->param().display();
+  if (display && solver_->iter() % display == 0) {
+    const float hidden_ms = std::max(comm_ms_ - wait_ms_, 0.f);
+    LOG_IF(INFO, Caffe::root_solver()) << "Gradient reduction: "
+        << comm_ms_ / display << " ms/iter in " << bucket_offsets_.size()
+        << " buckets, " << hidden_ms / display << " ms/iter ("
+        << (comm_ms_ > 0 ? 100 * hidden_ms / comm_ms_ : 0)
+        << "%) hidden behind backward, sent "
+        << sent_bytes_ / display / (1 << 20) << " MB/iter ("
+        << (raw_bytes_ > 0 ? 100 * sent_bytes_ / raw_bytes_ : 0)
+        << "% of uncompressed)";
+    comm_ms_ = 0;
+    wait_ms_ = 0;
+    AccumulateBytes();
+  }
+}
+
+template<typename Dtype>
+void RingSync<Dtype>::AccumulateBytes() {
+  total_sent_bytes_ += sent_bytes_;
+  total_raw_bytes_ += raw_bytes_;
+  sent_bytes_ = 0;
+  raw_bytes_ = 0;
+}
+
+template<typename Dtype>
+void RingSync<Dtype>::Run() {
+  CHECK_EQ(Caffe::mode(), Caffe::CPU);
+  comm_.Broadcast(data_, size_);
+  solver_->add_callback(this);
+  if (solver_->param().layer_wise_reduce()) {
+    CHECK_EQ(solver_->net()->params().size(),
+             solver_->net()->learnable_params().size())
+      << "Layer-wise reduce is not supported for nets with shared weights.";
+    solver_->net()->add_after_backward(this);
+    StartInternalThread();
+  }
+  if (Caffe::root_solver()) {
+    solver_->Solve();
+  } else {
+    solver_->Step(solver_->param().max_iter() - solver_->iter());
+  }
+  AccumulateBytes();
+  LOG_IF(INFO, Caffe::root_solver()) << "Gradient reduction sent "
+      << total_sent_bytes_ / (1 << 20) << " MB instead of "
+      << total_raw_bytes_ / (1 << 20) << " MB uncompressed";
+}
+
+#ifdef USE_NCCL
+
 template<typename Dtype>
 GPUParams<Dtype>::GPUParams(shared_ptr<Solver<Dtype> > root_solver, int device)
   : Params<Dtype>(root_solver) {
@@ -361,11 +759,16 @@ void NCCL<Dtype>::Run(const vector<int>& gpus, const char* restore) {
   }
 }
 
-INSTANTIATE_CLASS(Params);
 INSTANTIATE_CLASS(GPUParams);
 INSTANTIATE_CLASS(Worker);
 INSTANTIATE_CLASS(NCCL);
 
-}  // namespace caffe
-
 #endif  // USE_NCCL
+
+INSTANTIATE_CLASS(Params);
+INSTANTIATE_CLASS(CPUParams);
+INSTANTIATE_CLASS(CPUWorker);
+INSTANTIATE_CLASS(CPUSync);
+INSTANTIATE_CLASS(RingSync);
+
+}  // namespace caffe
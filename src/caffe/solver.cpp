@@ -1,9 +1,11 @@
 #include <cstdio>
 
 #include <string>
+#include <utility>
 #include <vector>
 
 #include "boost/algorithm/string.hpp"
+#include "caffe/layers/data_layer.hpp"
 #include "caffe/solver.hpp"
 #include "caffe/util/format.hpp"
 #include "caffe/util/hdf5.hpp"
@@ -58,6 +60,13 @@ void Solver<Dtype>::Init(const SolverParameter& param) {
   }
   iter_ = 0;
   current_step_ = 0;
+  snapshot_stall_ms_ = 0;
+  if (Caffe::root_solver()) {
+    snapshot_writer_.reset(new SnapshotWriter<Dtype>(param_.snapshot_async()));
+    if (param_.test_async() && test_nets_.size()) {
+      evaluator_.reset(new Evaluator<Dtype>(param_, *net_, test_nets_));
+    }
+  }
 }
 
 // Load weights from the caffemodel(s) specified in "weights" solver parameter
@@ -187,6 +196,10 @@ void Solver<Dtype>::InitTestNets() {
       net_state.MergeFrom(param_.test_state(i));
     }
     net_params[i].mutable_state()->CopyFrom(net_state);
+    // Test nets are only run forward, unless they ask otherwise.
+    if (!net_params[i].has_forward_only()) {
+      net_params[i].set_forward_only(true);
+    }
     LOG(INFO)
         << "Creating test net (#" << i << ") specified by " << sources[i];
     test_nets_[i].reset(new Net<Dtype>(net_params[i]));
@@ -312,6 +325,8 @@ void Solver<Dtype>::Solve(const char* resume_file) {
     Snapshot();
   }
   if (requested_early_exit_) {
+    WaitForSnapshot();
+    WaitForTests();
     LOG(INFO) << "Optimization stopped early.";
     return;
   }
@@ -333,11 +348,19 @@ void Solver<Dtype>::Solve(const char* resume_file) {
   if (param_.test_interval() && iter_ % param_.test_interval() == 0) {
     TestAll();
   }
+  WaitForSnapshot();
+  WaitForTests();
   LOG(INFO) << "Optimization Done.";
 }
 
 template <typename Dtype>
 void Solver<Dtype>::TestAll() {
+  if (evaluator_) {
+    const float wait_ms = evaluator_->Submit(iter_);
+    LOG(INFO) << "Iteration " << iter_ << ", Testing nets in the background"
+        << " (waited " << wait_ms << " ms for the previous test)";
+    return;
+  }
   for (int test_net_id = 0;
        test_net_id < test_nets_.size() && !requested_early_exit_;
        ++test_net_id) {
@@ -352,10 +375,8 @@ void Solver<Dtype>::Test(const int test_net_id) {
             << ", Testing net (#" << test_net_id << ")";
   CHECK_NOTNULL(test_nets_[test_net_id].get())->
       ShareTrainedLayersWith(net_.get());
-  vector<Dtype> test_score;
-  vector<int> test_score_output_id;
   const shared_ptr<Net<Dtype> >& test_net = test_nets_[test_net_id];
-  Dtype loss = 0;
+  TestScores<Dtype> scores;
   for (int i = 0; i < param_.test_iter(test_net_id); ++i) {
     SolverAction::Enum request = GetRequestedAction();
     // Check to see if stoppage of testing/training has been requested.
@@ -371,71 +392,77 @@ void Solver<Dtype>::Test(const int test_net_id) {
       // break out of test loop.
       break;
     }
-
-    Dtype iter_loss;
-    const vector<Blob<Dtype>*>& result =
-        test_net->Forward(&iter_loss);
-    if (param_.test_compute_loss()) {
-      loss += iter_loss;
-    }
-    if (i == 0) {
-      for (int j = 0; j < result.size(); ++j) {
-        const Dtype* result_vec = result[j]->cpu_data();
-        for (int k = 0; k < result[j]->count(); ++k) {
-          test_score.push_back(result_vec[k]);
-          test_score_output_id.push_back(j);
-        }
-      }
-    } else {
-      int idx = 0;
-      for (int j = 0; j < result.size(); ++j) {
-        const Dtype* result_vec = result[j]->cpu_data();
-        for (int k = 0; k < result[j]->count(); ++k) {
-          test_score[idx++] += result_vec[k];
-        }
-      }
-    }
+    scores.Forward(test_net.get());
   }
   if (requested_early_exit_) {
     LOG(INFO)     << "Test interrupted.";
     return;
   }
-  if (param_.test_compute_loss()) {
-    loss /= param_.test_iter(test_net_id);
-    LOG(INFO) << "Test loss: " << loss;
-  }
-  for (int i = 0; i < test_score.size(); ++i) {
-    const int output_blob_index =
-        test_net->output_blob_indices()[test_score_output_id[i]];
-    const string& output_name = test_net->blob_names()[output_blob_index];
-    const Dtype loss_weight = test_net->blob_loss_weights()[output_blob_index];
-    ostringstream loss_msg_stream;
-    const Dtype mean_score = test_score[i] / param_.test_iter(test_net_id);
-    if (loss_weight) {
-      loss_msg_stream << " (* " << loss_weight
-                      << " = " << loss_weight * mean_score << " loss)";
-    }
-    LOG(INFO) << "    Test net output #" << i << ": " << output_name << " = "
-              << mean_score << loss_msg_stream.str();
+  scores.Log(*test_net, param_.test_compute_loss());
+}
+
+template <typename Dtype>
+void Solver<Dtype>::WaitForTests() {
+  if (evaluator_) {
+    evaluator_->Wait();
   }
 }
 
 template <typename Dtype>
 void Solver<Dtype>::Snapshot() {
   CHECK(Caffe::root_solver());
-  string model_filename;
+  CPUTimer timer;
+  timer.Start();
+  // Only copy the net and the state here; the writer serializes them, in the
+  // background if snapshot_async is set.
+  SnapshotData* data = snapshot_writer_->Acquire();
+  data->format = param_.snapshot_format();
+  data->write_diff = param_.snapshot_diff();
   switch (param_.snapshot_format()) {
   case caffe::SolverParameter_SnapshotFormat_BINARYPROTO:
-    model_filename = SnapshotToBinaryProto();
+    data->model_filename = SnapshotFilename(".caffemodel");
+    data->state_filename = SnapshotFilename(".solverstate");
     break;
   case caffe::SolverParameter_SnapshotFormat_HDF5:
-    model_filename = SnapshotToHDF5();
+    data->model_filename = SnapshotFilename(".caffemodel.h5");
+    data->state_filename = SnapshotFilename(".solverstate.h5");
     break;
   default:
     LOG(FATAL) << "Unsupported snapshot format.";
   }
+  data->net.Clear();
+  net_->ToProto(&data->net, param_.snapshot_diff());
+  if (param_.snapshot_format() == caffe::SolverParameter_SnapshotFormat_HDF5) {
+    // Like Net::ToHDF5, only save the data of params that own themselves.
+    const vector<int>& owners = net_->param_owners();
+    for (int i = 0; i < owners.size(); ++i) {
+      if (owners[i] != -1) {
+        const pair<int, int>& index = net_->param_layer_indices()[i];
+        BlobProto* blob =
+            data->net.mutable_layer(index.first)->mutable_blobs(index.second);
+        blob->clear_data();
+        blob->clear_double_data();
+      }
+    }
+  }
+  data->state.Clear();
+  data->state.set_iter(iter_);
+  data->state.set_learned_net(data->model_filename);
+  data->state.set_current_step(current_step_);
+  SnapshotSolverState(&data->state);
+  GetDataReaderState(&data->state);
+  snapshot_writer_->Submit(data);
+  const float stall_ms = timer.MilliSeconds();
+  snapshot_stall_ms_ += stall_ms;
+  LOG(INFO) << "Snapshot stalled training for " << stall_ms << " ms ("
+      << snapshot_stall_ms_ << " ms in total).";
+}
 
-  SnapshotSolverState(model_filename);
+template <typename Dtype>
+void Solver<Dtype>::WaitForSnapshot() {
+  if (snapshot_writer_) {
+    snapshot_writer_->Wait();
+  }
 }
 
 template <typename Dtype>
@@ -462,24 +489,6 @@ string Solver<Dtype>::SnapshotFilename(const string extension) {
     + extension;
 }
 
-template <typename Dtype>
-string Solver<Dtype>::SnapshotToBinaryProto() {
-  string model_filename = SnapshotFilename(".caffemodel");
-  LOG(INFO) << "Snapshotting to binary proto file " << model_filename;
-  NetParameter net_param;
-  net_->ToProto(&net_param, param_.snapshot_diff());
-  WriteProtoToBinaryFile(net_param, model_filename);
-  return model_filename;
-}
-
-template <typename Dtype>
-string Solver<Dtype>::SnapshotToHDF5() {
-  string model_filename = SnapshotFilename(".caffemodel.h5");
-  LOG(INFO) << "Snapshotting to HDF5 file " << model_filename;
-  net_->ToHDF5(model_filename, param_.snapshot_diff());
-  return model_filename;
-}
-
 template <typename Dtype>
 void Solver<Dtype>::Restore(const char* state_file) {
   string state_filename(state_file);
@@ -491,6 +500,33 @@ void Solver<Dtype>::Restore(const char* state_file) {
   }
 }
 
+template <typename Dtype>
+void Solver<Dtype>::GetDataReaderState(SolverState* state) const {
+  const vector<shared_ptr<Layer<Dtype> > >& layers = net_->layers();
+  for (int i = 0; i < layers.size(); ++i) {
+    const DataLayer<Dtype>* data_layer =
+        dynamic_cast<const DataLayer<Dtype>*>(layers[i].get());
+    if (data_layer && data_layer->shuffle()) {
+      data_layer->GetState(state->add_data_reader());
+    }
+  }
+}
+
+template <typename Dtype>
+void Solver<Dtype>::SetDataReaderState(const SolverState& state) {
+  for (int i = 0; i < state.data_reader_size(); ++i) {
+    const DataReaderState& reader = state.data_reader(i);
+    const shared_ptr<Layer<Dtype> > layer = net_->layer_by_name(reader.layer());
+    DataLayer<Dtype>* data_layer = dynamic_cast<DataLayer<Dtype>*>(layer.get());
+    if (data_layer && data_layer->shuffle()) {
+      data_layer->SetState(reader);
+    } else {
+      LOG(WARNING) << "Ignoring read position of data layer "
+          << reader.layer() << " not found in the train net";
+    }
+  }
+}
+
 template <typename Dtype>
 void Solver<Dtype>::UpdateSmoothedLoss(Dtype loss, int start_iter,
     int average_loss) {
@@ -16,6 +16,19 @@ void AdaDeltaSolver<Dtype>::AdaDeltaPreSolve() {
   }
 }
 
+template <typename Dtype>
+void adadelta_update_cpu(int N, const Dtype* w, Dtype* g, Dtype* h, Dtype* h2,
+    Dtype momentum, Dtype delta, Dtype local_rate,
+    const GradientPrep<Dtype>& prep) {
+  for (int i = 0; i < N; ++i) {
+    Dtype gi = prep(g[i], w[i]);
+    const Dtype hi = h[i] = momentum * h[i] + (1 - momentum) * gi * gi;
+    gi = gi * std::sqrt((h2[i] + delta) / (hi + delta));
+    h2[i] = momentum * h2[i] + (1 - momentum) * gi * gi;
+    g[i] = local_rate * gi;
+  }
+}
+
 #ifndef CPU_ONLY
 template <typename Dtype>
 void adadelta_update_gpu(int N, Dtype* g, Dtype* h, Dtype* h2, Dtype momentum,
@@ -23,74 +36,39 @@ void adadelta_update_gpu(int N, Dtype* g, Dtype* h, Dtype* h2, Dtype momentum,
 #endif
 
 template <typename Dtype>
-void AdaDeltaSolver<Dtype>::ComputeUpdateValue(int param_id, Dtype rate) {
+void AdaDeltaSolver<Dtype>::ComputeUpdateValueCPU(int param_id, Dtype rate,
+    const GradientPrep<Dtype>& prep, int offset, int count) {
   const vector<Blob<Dtype>*>& net_params = this->net_->learnable_params();
   const vector<float>& net_params_lr = this->net_->params_lr();
   Dtype delta = this->param_.delta();
   Dtype momentum = this->param_.momentum();
   Dtype local_rate = rate * net_params_lr[param_id];
   size_t update_history_offset = net_params.size();
+  adadelta_update_cpu(count,
+      net_params[param_id]->cpu_data() + offset,
+      net_params[param_id]->mutable_cpu_diff() + offset,
+      this->history_[param_id]->mutable_cpu_data() + offset,
+      this->history_[update_history_offset + param_id]->mutable_cpu_data() +
+          offset,
+      momentum, delta, local_rate, prep);
+}
+
+template <typename Dtype>
+void AdaDeltaSolver<Dtype>::ComputeUpdateValue(int param_id, Dtype rate) {
   switch (Caffe::mode()) {
   case Caffe::CPU: {
-    // compute square of gradient in update
-    caffe_powx(net_params[param_id]->count(),
-        net_params[param_id]->cpu_diff(), Dtype(2),
-        this->update_[param_id]->mutable_cpu_data());
-
-    // update history of gradients
-    caffe_cpu_axpby(net_params[param_id]->count(), Dtype(1) - momentum,
-        this->update_[param_id]->cpu_data(), momentum,
-        this->history_[param_id]->mutable_cpu_data());
-
-    // add delta to history to guard against dividing by zero later
-    caffe_set(net_params[param_id]->count(), delta,
-        this->temp_[param_id]->mutable_cpu_data());
-
-    caffe_add(net_params[param_id]->count(),
-        this->temp_[param_id]->cpu_data(),
-        this->history_[update_history_offset + param_id]->cpu_data(),
-        this->update_[param_id]->mutable_cpu_data());
-
-    caffe_add(net_params[param_id]->count(),
-        this->temp_[param_id]->cpu_data(),
-        this->history_[param_id]->cpu_data(),
-        this->temp_[param_id]->mutable_cpu_data());
-
-    // divide history of updates by history of gradients
-    caffe_div(net_params[param_id]->count(),
-        this->update_[param_id]->cpu_data(),
-        this->temp_[param_id]->cpu_data(),
-        this->update_[param_id]->mutable_cpu_data());
-
-    // jointly compute the RMS of both for update and gradient history
-    caffe_powx(net_params[param_id]->count(),
-        this->update_[param_id]->cpu_data(), Dtype(0.5),
-        this->update_[param_id]->mutable_cpu_data());
-
-    // compute the update
-    caffe_mul(net_params[param_id]->count(),
-        net_params[param_id]->cpu_diff(),
-        this->update_[param_id]->cpu_data(),
-        net_params[param_id]->mutable_cpu_diff());
-
-    // compute square of update
-    caffe_powx(net_params[param_id]->count(),
-        net_params[param_id]->cpu_diff(), Dtype(2),
-        this->update_[param_id]->mutable_cpu_data());
-
-    // update history of updates
-    caffe_cpu_axpby(net_params[param_id]->count(), Dtype(1) - momentum,
-        this->update_[param_id]->cpu_data(), momentum,
-        this->history_[update_history_offset + param_id]->mutable_cpu_data());
-
-    // apply learning rate
-    caffe_cpu_scale(net_params[param_id]->count(), local_rate,
-        net_params[param_id]->cpu_diff(),
-        net_params[param_id]->mutable_cpu_diff());
+    this->ComputeUpdateValueCPU(param_id, rate, GradientPrep<Dtype>(), 0,
+        this->net_->learnable_params()[param_id]->count());
     break;
   }
   case Caffe::GPU: {
 #ifndef CPU_ONLY
+    const vector<Blob<Dtype>*>& net_params = this->net_->learnable_params();
+    const vector<float>& net_params_lr = this->net_->params_lr();
+    Dtype delta = this->param_.delta();
+    Dtype momentum = this->param_.momentum();
+    Dtype local_rate = rate * net_params_lr[param_id];
+    size_t update_history_offset = net_params.size();
     adadelta_update_gpu(net_params[param_id]->count(),
         net_params[param_id]->mutable_gpu_diff(),
         this->history_[param_id]->mutable_gpu_data(),
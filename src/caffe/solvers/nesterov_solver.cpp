@@ -4,6 +4,16 @@
 
 namespace caffe {
 
+template <typename Dtype>
+void nesterov_update_cpu(int N, const Dtype* w, Dtype* g, Dtype* h,
+    Dtype momentum, Dtype local_rate, const GradientPrep<Dtype>& prep) {
+  for (int i = 0; i < N; ++i) {
+    const Dtype hi = h[i];
+    const Dtype hi_new = h[i] = momentum * hi + local_rate * prep(g[i], w[i]);
+    g[i] = (1 + momentum) * hi_new - momentum * hi;
+  }
+}
+
 #ifndef CPU_ONLY
 template <typename Dtype>
 void nesterov_update_gpu(int N, Dtype* g, Dtype* h, Dtype momentum,
@@ -11,36 +21,33 @@ void nesterov_update_gpu(int N, Dtype* g, Dtype* h, Dtype momentum,
 #endif
 
 template <typename Dtype>
-void NesterovSolver<Dtype>::ComputeUpdateValue(int param_id, Dtype rate) {
+void NesterovSolver<Dtype>::ComputeUpdateValueCPU(int param_id, Dtype rate,
+    const GradientPrep<Dtype>& prep, int offset, int count) {
   const vector<Blob<Dtype>*>& net_params = this->net_->learnable_params();
   const vector<float>& net_params_lr = this->net_->params_lr();
   Dtype momentum = this->param_.momentum();
   Dtype local_rate = rate * net_params_lr[param_id];
+  nesterov_update_cpu(count,
+      net_params[param_id]->cpu_data() + offset,
+      net_params[param_id]->mutable_cpu_diff() + offset,
+      this->history_[param_id]->mutable_cpu_data() + offset, momentum,
+      local_rate, prep);
+}
+
+template <typename Dtype>
+void NesterovSolver<Dtype>::ComputeUpdateValue(int param_id, Dtype rate) {
   switch (Caffe::mode()) {
   case Caffe::CPU: {
-    // save history momentum for stepping back
-    caffe_copy(net_params[param_id]->count(),
-        this->history_[param_id]->cpu_data(),
-        this->update_[param_id]->mutable_cpu_data());
-
-    // update history
-    caffe_cpu_axpby(net_params[param_id]->count(), local_rate,
-              net_params[param_id]->cpu_diff(), momentum,
-              this->history_[param_id]->mutable_cpu_data());
-
-    // compute update: step back then over step
-    caffe_cpu_axpby(net_params[param_id]->count(), Dtype(1) + momentum,
-        this->history_[param_id]->cpu_data(), -momentum,
-        this->update_[param_id]->mutable_cpu_data());
-
-    // copy
-    caffe_copy(net_params[param_id]->count(),
-        this->update_[param_id]->cpu_data(),
-        net_params[param_id]->mutable_cpu_diff());
+    this->ComputeUpdateValueCPU(param_id, rate, GradientPrep<Dtype>(), 0,
+        this->net_->learnable_params()[param_id]->count());
     break;
   }
   case Caffe::GPU: {
 #ifndef CPU_ONLY
+    const vector<Blob<Dtype>*>& net_params = this->net_->learnable_params();
+    const vector<float>& net_params_lr = this->net_->params_lr();
+    Dtype momentum = this->param_.momentum();
+    Dtype local_rate = rate * net_params_lr[param_id];
     nesterov_update_gpu(net_params[param_id]->count(),
         net_params[param_id]->mutable_gpu_diff(),
         this->history_[param_id]->mutable_gpu_data(),
@@ -4,6 +4,17 @@
 
 namespace caffe {
 
+template <typename Dtype>
+void rmsprop_update_cpu(int N, const Dtype* w, Dtype* g, Dtype* h,
+    Dtype rms_decay, Dtype delta, Dtype local_rate,
+    const GradientPrep<Dtype>& prep) {
+  for (int i = 0; i < N; ++i) {
+    const Dtype gi = prep(g[i], w[i]);
+    const Dtype hi = h[i] = rms_decay * h[i] + (1 - rms_decay) * gi * gi;
+    g[i] = local_rate * gi / (std::sqrt(hi) + delta);
+  }
+}
+
 #ifndef CPU_ONLY
 template <typename Dtype>
 void rmsprop_update_gpu(int N, Dtype* g, Dtype* h, Dtype rms_decay,
@@ -11,46 +22,37 @@ void rmsprop_update_gpu(int N, Dtype* g, Dtype* h, Dtype rms_decay,
 #endif
 
 template <typename Dtype>
-void RMSPropSolver<Dtype>::ComputeUpdateValue(int param_id, Dtype rate) {
+void RMSPropSolver<Dtype>::ComputeUpdateValueCPU(int param_id, Dtype rate,
+    const GradientPrep<Dtype>& prep, int offset, int count) {
   const vector<Blob<Dtype>*>& net_params = this->net_->learnable_params();
   const vector<float>& net_params_lr = this->net_->params_lr();
-
-  // get the learning rate
   Dtype delta = this->param_.delta();
   Dtype rms_decay = this->param_.rms_decay();
   Dtype local_rate = rate * net_params_lr[param_id];
+  rmsprop_update_cpu(count,
+      net_params[param_id]->cpu_data() + offset,
+      net_params[param_id]->mutable_cpu_diff() + offset,
+      this->history_[param_id]->mutable_cpu_data() + offset, rms_decay, delta,
+      local_rate, prep);
+}
 
+template <typename Dtype>
+void RMSPropSolver<Dtype>::ComputeUpdateValue(int param_id, Dtype rate) {
   switch (Caffe::mode()) {
   case Caffe::CPU:
-    // compute square of gradient in update
-    caffe_powx(net_params[param_id]->count(),
-        net_params[param_id]->cpu_diff(), Dtype(2),
-        this->update_[param_id]->mutable_cpu_data());
-
-    // update history
-    caffe_cpu_axpby(net_params[param_id] -> count(),
-        Dtype(1-rms_decay), this->update_[param_id]->cpu_data(),
-        rms_decay, this->history_[param_id]-> mutable_cpu_data());
-
-    // prepare update
-    caffe_powx(net_params[param_id]->count(),
-        this->history_[param_id]->cpu_data(), Dtype(0.5),
-        this->update_[param_id]->mutable_cpu_data());
-
-    caffe_add_scalar(net_params[param_id]->count(),
-        delta, this->update_[param_id]->mutable_cpu_data());
-
-    caffe_div(net_params[param_id]->count(),
-        net_params[param_id]->cpu_diff(), this->update_[param_id]->cpu_data(),
-        this->update_[param_id]->mutable_cpu_data());
-
-    // scale and copy
-    caffe_cpu_axpby(net_params[param_id]->count(), local_rate,
-        this->update_[param_id]->cpu_data(), Dtype(0),
-        net_params[param_id]->mutable_cpu_diff());
+    this->ComputeUpdateValueCPU(param_id, rate, GradientPrep<Dtype>(), 0,
+        this->net_->learnable_params()[param_id]->count());
     break;
-  case Caffe::GPU:
+  case Caffe::GPU: {
 #ifndef CPU_ONLY
+    const vector<Blob<Dtype>*>& net_params = this->net_->learnable_params();
+    const vector<float>& net_params_lr = this->net_->params_lr();
+
+    // get the learning rate
+    Dtype delta = this->param_.delta();
+    Dtype rms_decay = this->param_.rms_decay();
+    Dtype local_rate = rate * net_params_lr[param_id];
+
     rmsprop_update_gpu(net_params[param_id]->count(),
         net_params[param_id]->mutable_gpu_diff(),
         this->history_[param_id]->mutable_gpu_data(),
@@ -59,6 +61,7 @@ void RMSPropSolver<Dtype>::ComputeUpdateValue(int param_id, Dtype rate) {
     NO_GPU;
 #endif
     break;
+  }
   default:
     LOG(FATAL) << "Unknown caffe mode: " << Caffe::mode();
   }
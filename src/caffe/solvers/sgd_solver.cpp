@@ -1,6 +1,13 @@
+#include <boost/bind.hpp>
+#include <boost/thread.hpp>
+#include <algorithm>
 #include <string>
+#include <typeinfo>
+#include <utility>
 #include <vector>
 
+#include "google/protobuf/text_format.h"
+
 #include "caffe/sgd_solvers.hpp"
 #include "caffe/util/hdf5.hpp"
 #include "caffe/util/io.hpp"
@@ -82,12 +89,34 @@ void SGDSolver<Dtype>::PreSolve() {
     update_.push_back(shared_ptr<Blob<Dtype> >(new Blob<Dtype>(shape)));
     temp_.push_back(shared_ptr<Blob<Dtype> >(new Blob<Dtype>(shape)));
   }
+  // Split the params among the CPU update threads, largest first, each one
+  // going to the least loaded thread.
+  int num_threads = this->param_.update_threads();
+  CHECK_GE(num_threads, 0);
+  if (num_threads == 0) {
+    num_threads = std::max(1u, boost::thread::hardware_concurrency());
+  }
+  num_threads = std::max(1, std::min<int>(num_threads, net_params.size()));
+  vector<std::pair<int, int> > by_size;
+  for (int i = 0; i < net_params.size(); ++i) {
+    by_size.push_back(std::make_pair(-net_params[i]->count(), i));
+  }
+  std::sort(by_size.begin(), by_size.end());
+  update_parts_.clear();
+  update_parts_.resize(num_threads);
+  vector<int64_t> load(num_threads, 0);
+  for (int i = 0; i < by_size.size(); ++i) {
+    const int part = std::min_element(load.begin(), load.end()) - load.begin();
+    update_parts_[part].push_back(by_size[i].second);
+    load[part] -= by_size[i].first;
+  }
+  update_pool_.reset(new WorkerPool(num_threads));
 }
 
 template <typename Dtype>
-void SGDSolver<Dtype>::ClipGradients() {
+Dtype SGDSolver<Dtype>::GetClipScale() {
   const Dtype clip_gradients = this->param_.clip_gradients();
-  if (clip_gradients < 0) { return; }
+  if (clip_gradients < 0) { return Dtype(1); }
   const vector<Blob<Dtype>*>& net_params = this->net_->learnable_params();
   Dtype sumsq_diff = 0;
   for (int i = 0; i < net_params.size(); ++i) {
@@ -99,9 +128,18 @@ void SGDSolver<Dtype>::ClipGradients() {
     LOG(INFO) << "Gradient clipping: scaling down gradients (L2 norm "
         << l2norm_diff << " > " << clip_gradients << ") "
         << "by scale factor " << scale_factor;
-    for (int i = 0; i < net_params.size(); ++i) {
-      net_params[i]->scale_diff(scale_factor);
-    }
+    return scale_factor;
+  }
+  return Dtype(1);
+}
+
+template <typename Dtype>
+void SGDSolver<Dtype>::ClipGradients() {
+  const Dtype scale_factor = GetClipScale();
+  if (scale_factor == Dtype(1)) { return; }
+  const vector<Blob<Dtype>*>& net_params = this->net_->learnable_params();
+  for (int i = 0; i < net_params.size(); ++i) {
+    net_params[i]->scale_diff(scale_factor);
   }
 }
 
@@ -112,16 +150,66 @@ void SGDSolver<Dtype>::ApplyUpdate() {
     LOG_IF(INFO, Caffe::root_solver()) << "Iteration " << this->iter_
         << ", lr = " << rate;
   }
-  ClipGradients();
-  for (int param_id = 0; param_id < this->net_->learnable_params().size();
-       ++param_id) {
-    Normalize(param_id);
-    Regularize(param_id);
-    ComputeUpdateValue(param_id, rate);
+  if (Caffe::mode() == Caffe::CPU && FuseUpdateCPU()) {
+    // Clipping and normalization are folded into the fused updates.
+    const string& regularization_type = this->param_.regularization_type();
+    CHECK(regularization_type == "L2" || regularization_type == "L1")
+        << "Unknown regularization type: " << regularization_type;
+    const Dtype diff_scale = GetClipScale() / this->param_.iter_size();
+    update_pool_->Run(boost::bind(&SGDSolver<Dtype>::ApplyUpdateCPU, this,
+        _1, rate, diff_scale));
+  } else {
+    ClipGradients();
+    for (int param_id = 0; param_id < this->net_->learnable_params().size();
+         ++param_id) {
+      Normalize(param_id);
+      Regularize(param_id);
+      ComputeUpdateValue(param_id, rate);
+    }
   }
   this->net_->Update();
 }
 
+template <typename Dtype>
+bool SGDSolver<Dtype>::FuseUpdateCPU() const {
+  const std::type_info& type = typeid(*this);
+  return type == typeid(SGDSolver<Dtype>) ||
+      type == typeid(NesterovSolver<Dtype>) ||
+      type == typeid(AdaGradSolver<Dtype>) ||
+      type == typeid(RMSPropSolver<Dtype>) ||
+      type == typeid(AdaDeltaSolver<Dtype>) ||
+      type == typeid(AdamSolver<Dtype>);
+}
+
+template <typename Dtype>
+void SGDSolver<Dtype>::ApplyUpdateCPU(int part, Dtype rate,
+    Dtype diff_scale) {
+  const vector<Blob<Dtype>*>& net_params = this->net_->learnable_params();
+  const vector<float>& net_params_weight_decay =
+      this->net_->params_weight_decay();
+  GradientPrep<Dtype> prep;
+  prep.scale = diff_scale;
+  prep.l1 = this->param_.regularization_type() == "L1";
+  for (int i = 0; i < update_parts_[part].size(); ++i) {
+    const int param_id = update_parts_[part][i];
+    prep.decay = this->param_.weight_decay() *
+        net_params_weight_decay[param_id];
+    const Blob<Dtype>* param = net_params[param_id];
+    if (param->sparse_diff()) {
+      // Update only the rows with a gradient: the other rows skip their
+      // momentum and weight decay until they are used again.
+      const int row_size = param->count(1);
+      const vector<int>& rows = param->diff_rows();
+      for (int j = 0; j < rows.size(); ++j) {
+        ComputeUpdateValueCPU(param_id, rate, prep, rows[j] * row_size,
+            row_size);
+      }
+    } else {
+      ComputeUpdateValueCPU(param_id, rate, prep, 0, param->count());
+    }
+  }
+}
+
 template <typename Dtype>
 void SGDSolver<Dtype>::Normalize(int param_id) {
   if (this->param_.iter_size() == 1) { return; }
@@ -210,6 +298,14 @@ void SGDSolver<Dtype>::Regularize(int param_id) {
   }
 }
 
+template <typename Dtype>
+void sgd_update_cpu(int N, const Dtype* w, Dtype* g, Dtype* h,
+    Dtype momentum, Dtype local_rate, const GradientPrep<Dtype>& prep) {
+  for (int i = 0; i < N; ++i) {
+    g[i] = h[i] = momentum * h[i] + local_rate * prep(g[i], w[i]);
+  }
+}
+
 #ifndef CPU_ONLY
 template <typename Dtype>
 void sgd_update_gpu(int N, Dtype* g, Dtype* h, Dtype momentum,
@@ -217,24 +313,34 @@ void sgd_update_gpu(int N, Dtype* g, Dtype* h, Dtype momentum,
 #endif
 
 template <typename Dtype>
-void SGDSolver<Dtype>::ComputeUpdateValue(int param_id, Dtype rate) {
+void SGDSolver<Dtype>::ComputeUpdateValueCPU(int param_id, Dtype rate,
+    const GradientPrep<Dtype>& prep, int offset, int count) {
   const vector<Blob<Dtype>*>& net_params = this->net_->learnable_params();
   const vector<float>& net_params_lr = this->net_->params_lr();
   Dtype momentum = this->param_.momentum();
   Dtype local_rate = rate * net_params_lr[param_id];
-  // Compute the update to history, then copy it to the parameter diff.
+  sgd_update_cpu(count,
+      net_params[param_id]->cpu_data() + offset,
+      net_params[param_id]->mutable_cpu_diff() + offset,
+      history_[param_id]->mutable_cpu_data() + offset, momentum, local_rate,
+      prep);
+}
+
+template <typename Dtype>
+void SGDSolver<Dtype>::ComputeUpdateValue(int param_id, Dtype rate) {
   switch (Caffe::mode()) {
   case Caffe::CPU: {
-    caffe_cpu_axpby(net_params[param_id]->count(), local_rate,
-              net_params[param_id]->cpu_diff(), momentum,
-              history_[param_id]->mutable_cpu_data());
-    caffe_copy(net_params[param_id]->count(),
-        history_[param_id]->cpu_data(),
-        net_params[param_id]->mutable_cpu_diff());
+    ComputeUpdateValueCPU(param_id, rate, GradientPrep<Dtype>(), 0,
+        this->net_->learnable_params()[param_id]->count());
     break;
   }
   case Caffe::GPU: {
 #ifndef CPU_ONLY
+    const vector<Blob<Dtype>*>& net_params = this->net_->learnable_params();
+    const vector<float>& net_params_lr = this->net_->params_lr();
+    Dtype momentum = this->param_.momentum();
+    Dtype local_rate = rate * net_params_lr[param_id];
+    // Compute the update to history, then copy it to the parameter diff.
     sgd_update_gpu(net_params[param_id]->count(),
         net_params[param_id]->mutable_gpu_diff(),
         history_[param_id]->mutable_gpu_data(),
@@ -250,62 +356,13 @@ void SGDSolver<Dtype>::ComputeUpdateValue(int param_id, Dtype rate) {
 }
 
 template <typename Dtype>
-void SGDSolver<Dtype>::SnapshotSolverState(const string& model_filename) {
-  switch (this->param_.snapshot_format()) {
-    case caffe::SolverParameter_SnapshotFormat_BINARYPROTO:
-      SnapshotSolverStateToBinaryProto(model_filename);
-      break;
-    case caffe::SolverParameter_SnapshotFormat_HDF5:
-      SnapshotSolverStateToHDF5(model_filename);
-      break;
-    default:
-      LOG(FATAL) << "Unsupported snapshot format.";
-  }
-}
-
-template <typename Dtype>
-void SGDSolver<Dtype>::SnapshotSolverStateToBinaryProto(
-    const string& model_filename) {
-  SolverState state;
-  state.set_iter(this->iter_);
-  state.set_learned_net(model_filename);
-  state.set_current_step(this->current_step_);
-  state.clear_history();
+void SGDSolver<Dtype>::SnapshotSolverState(SolverState* state) {
+  state->clear_history();
   for (int i = 0; i < history_.size(); ++i) {
     // Add history
-    BlobProto* history_blob = state.add_history();
+    BlobProto* history_blob = state->add_history();
     history_[i]->ToProto(history_blob);
   }
-  string snapshot_filename = Solver<Dtype>::SnapshotFilename(".solverstate");
-  LOG(INFO)
-    << "Snapshotting solver state to binary proto file " << snapshot_filename;
-  WriteProtoToBinaryFile(state, snapshot_filename.c_str());
-}
-
-template <typename Dtype>
-void SGDSolver<Dtype>::SnapshotSolverStateToHDF5(
-    const string& model_filename) {
-  string snapshot_filename =
-      Solver<Dtype>::SnapshotFilename(".solverstate.h5");
-  LOG(INFO) << "Snapshotting solver state to HDF5 file " << snapshot_filename;
-  hid_t file_hid = H5Fcreate(snapshot_filename.c_str(), H5F_ACC_TRUNC,
-      H5P_DEFAULT, H5P_DEFAULT);
-  CHECK_GE(file_hid, 0)
-      << "Couldn't open " << snapshot_filename << " to save solver state.";
-  hdf5_save_int(file_hid, "iter", this->iter_);
-  hdf5_save_string(file_hid, "learned_net", model_filename);
-  hdf5_save_int(file_hid, "current_step", this->current_step_);
-  hid_t history_hid = H5Gcreate2(file_hid, "history", H5P_DEFAULT, H5P_DEFAULT,
-      H5P_DEFAULT);
-  CHECK_GE(history_hid, 0)
-      << "Error saving solver state to " << snapshot_filename << ".";
-  for (int i = 0; i < history_.size(); ++i) {
-    ostringstream oss;
-    oss << i;
-    hdf5_save_nd_dataset<Dtype>(history_hid, oss.str(), *history_[i]);
-  }
-  H5Gclose(history_hid);
-  H5Fclose(file_hid);
 }
 
 template <typename Dtype>
@@ -326,31 +383,50 @@ void SGDSolver<Dtype>::RestoreSolverStateFromBinaryProto(
   for (int i = 0; i < history_.size(); ++i) {
     history_[i]->FromProto(state.history(i));
   }
+  this->SetDataReaderState(state);
 }
 
 template <typename Dtype>
 void SGDSolver<Dtype>::RestoreSolverStateFromHDF5(const string& state_file) {
-  hid_t file_hid = H5Fopen(state_file.c_str(), H5F_ACC_RDONLY, H5P_DEFAULT);
-  CHECK_GE(file_hid, 0) << "Couldn't open solver state file " << state_file;
-  this->iter_ = hdf5_load_int(file_hid, "iter");
-  if (H5LTfind_dataset(file_hid, "learned_net")) {
-    string learned_net = hdf5_load_string(file_hid, "learned_net");
+  // Read everything under the HDF5 lock, then apply the weights and reader
+  // state after releasing it, as both may make HDF5 calls of their own.
+  string learned_net;
+  string data_reader;
+  {
+    boost::mutex::scoped_lock lock(hdf5_mutex());
+    hid_t file_hid = H5Fopen(state_file.c_str(), H5F_ACC_RDONLY, H5P_DEFAULT);
+    CHECK_GE(file_hid, 0) << "Couldn't open solver state file " << state_file;
+    this->iter_ = hdf5_load_int(file_hid, "iter");
+    if (H5LTfind_dataset(file_hid, "learned_net")) {
+      learned_net = hdf5_load_string(file_hid, "learned_net");
+    }
+    this->current_step_ = hdf5_load_int(file_hid, "current_step");
+    hid_t history_hid = H5Gopen2(file_hid, "history", H5P_DEFAULT);
+    CHECK_GE(history_hid, 0) << "Error reading history from " << state_file;
+    int state_history_size = hdf5_get_num_links(history_hid);
+    CHECK_EQ(state_history_size, history_.size())
+        << "Incorrect length of history blobs.";
+    for (int i = 0; i < history_.size(); ++i) {
+      ostringstream oss;
+      oss << i;
+      hdf5_load_nd_dataset<Dtype>(history_hid, oss.str().c_str(), 0,
+                                  kMaxBlobAxes, history_[i].get());
+    }
+    H5Gclose(history_hid);
+    if (H5LTfind_dataset(file_hid, "data_reader")) {
+      data_reader = hdf5_load_string(file_hid, "data_reader");
+    }
+    H5Fclose(file_hid);
+  }
+  if (!learned_net.empty()) {
     this->net_->CopyTrainedLayersFrom(learned_net);
   }
-  this->current_step_ = hdf5_load_int(file_hid, "current_step");
-  hid_t history_hid = H5Gopen2(file_hid, "history", H5P_DEFAULT);
-  CHECK_GE(history_hid, 0) << "Error reading history from " << state_file;
-  int state_history_size = hdf5_get_num_links(history_hid);
-  CHECK_EQ(state_history_size, history_.size())
-      << "Incorrect length of history blobs.";
-  for (int i = 0; i < history_.size(); ++i) {
-    ostringstream oss;
-    oss << i;
-    hdf5_load_nd_dataset<Dtype>(history_hid, oss.str().c_str(), 0,
-                                kMaxBlobAxes, history_[i].get());
+  if (!data_reader.empty()) {
+    SolverState readers;
+    CHECK(google::protobuf::TextFormat::ParseFromString(data_reader, &readers))
+        << "Error reading data reader state from " << state_file;
+    this->SetDataReaderState(readers);
   }
-  H5Gclose(history_hid);
-  H5Fclose(file_hid);
 }
 
 INSTANTIATE_CLASS(SGDSolver);
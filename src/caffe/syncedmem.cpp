@@ -5,7 +5,8 @@
 namespace caffe {
 SyncedMemory::SyncedMemory()
   : cpu_ptr_(NULL), gpu_ptr_(NULL), size_(0), head_(UNINITIALIZED),
-    own_cpu_data_(false), cpu_malloc_use_cuda_(false), own_gpu_data_(false) {
+    own_cpu_data_(false), cpu_malloc_use_cuda_(false), own_gpu_data_(false),
+    offset_(0) {
 #ifndef CPU_ONLY
 #ifdef DEBUG
   CUDA_CHECK(cudaGetDevice(&device_));
@@ -15,7 +16,27 @@ SyncedMemory::SyncedMemory()
 
 SyncedMemory::SyncedMemory(size_t size)
   : cpu_ptr_(NULL), gpu_ptr_(NULL), size_(size), head_(UNINITIALIZED),
-    own_cpu_data_(false), cpu_malloc_use_cuda_(false), own_gpu_data_(false) {
+    own_cpu_data_(false), cpu_malloc_use_cuda_(false), own_gpu_data_(false),
+    offset_(0) {
+#ifndef CPU_ONLY
+#ifdef DEBUG
+  CUDA_CHECK(cudaGetDevice(&device_));
+#endif
+#endif
+}
+
+SyncedMemory::SyncedMemory(const shared_ptr<SyncedMemory>& base,
+    size_t offset, size_t size)
+  : cpu_ptr_(NULL), gpu_ptr_(NULL), size_(size), head_(UNINITIALIZED),
+    own_cpu_data_(false), cpu_malloc_use_cuda_(false), own_gpu_data_(false),
+    base_(base), offset_(offset) {
+  CHECK(base_);
+  // Views of views look directly into the memory at the bottom.
+  if (base_->base_) {
+    offset_ += base_->offset_;
+    base_ = base_->base_;
+  }
+  CHECK_LE(offset_ + size_, base_->size_) << "view exceeds its base";
 #ifndef CPU_ONLY
 #ifdef DEBUG
   CUDA_CHECK(cudaGetDevice(&device_));
@@ -92,6 +113,9 @@ inline void SyncedMemory::to_gpu() {
 
 const void* SyncedMemory::cpu_data() {
   check_device();
+  if (base_) {
+    return static_cast<const char*>(base_->cpu_data()) + offset_;
+  }
   to_cpu();
   return (const void*)cpu_ptr_;
 }
@@ -99,6 +123,7 @@ const void* SyncedMemory::cpu_data() {
 void SyncedMemory::set_cpu_data(void* data) {
   check_device();
   CHECK(data);
+  CHECK(!base_) << "Cannot set the data of a view";
   if (own_cpu_data_) {
     CaffeFreeHost(cpu_ptr_, cpu_malloc_use_cuda_);
   }
@@ -110,6 +135,9 @@ void SyncedMemory::set_cpu_data(void* data) {
 const void* SyncedMemory::gpu_data() {
   check_device();
 #ifndef CPU_ONLY
+  if (base_) {
+    return static_cast<const char*>(base_->gpu_data()) + offset_;
+  }
   to_gpu();
   return (const void*)gpu_ptr_;
 #else
@@ -122,6 +150,7 @@ void SyncedMemory::set_gpu_data(void* data) {
   check_device();
 #ifndef CPU_ONLY
   CHECK(data);
+  CHECK(!base_) << "Cannot set the data of a view";
   if (own_gpu_data_) {
     CUDA_CHECK(cudaFree(gpu_ptr_));
   }
@@ -135,6 +164,9 @@ void SyncedMemory::set_gpu_data(void* data) {
 
 void* SyncedMemory::mutable_cpu_data() {
   check_device();
+  if (base_) {
+    return static_cast<char*>(base_->mutable_cpu_data()) + offset_;
+  }
   to_cpu();
   head_ = HEAD_AT_CPU;
   return cpu_ptr_;
@@ -143,6 +175,9 @@ void* SyncedMemory::mutable_cpu_data() {
 void* SyncedMemory::mutable_gpu_data() {
   check_device();
 #ifndef CPU_ONLY
+  if (base_) {
+    return static_cast<char*>(base_->mutable_gpu_data()) + offset_;
+  }
   to_gpu();
   head_ = HEAD_AT_GPU;
   return gpu_ptr_;
@@ -155,6 +190,7 @@ void* SyncedMemory::mutable_gpu_data() {
 #ifndef CPU_ONLY
 void SyncedMemory::async_gpu_push(const cudaStream_t& stream) {
   check_device();
+  CHECK(!base_) << "Cannot push a view";
   CHECK(head_ == HEAD_AT_CPU);
   if (gpu_ptr_ == NULL) {
     CUDA_CHECK(cudaMalloc(&gpu_ptr_, size_));
@@ -167,6 +203,14 @@ void SyncedMemory::async_gpu_push(const cudaStream_t& stream) {
 }
 #endif
 
+bool SyncedMemory::is_view_of(const SyncedMemory& memory,
+    size_t offset) const {
+  if (memory.base_) {
+    return is_view_of(*memory.base_, memory.offset_ + offset);
+  }
+  return base_.get() == &memory && offset_ == offset;
+}
+
 void SyncedMemory::check_device() {
 #ifndef CPU_ONLY
 #ifdef DEBUG
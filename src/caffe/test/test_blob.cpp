@@ -5,6 +5,7 @@
 #include "caffe/blob.hpp"
 #include "caffe/common.hpp"
 #include "caffe/filler.hpp"
+#include "caffe/util/math_functions.hpp"
 
 #include "caffe/test/test_caffe_main.hpp"
 
@@ -59,6 +60,48 @@ TYPED_TEST(BlobSimpleTest, TestReshapeZero) {
   EXPECT_EQ(this->blob_->count(), 0);
 }
 
+TYPED_TEST(BlobSimpleTest, TestShareDataOffset) {
+  typedef TypeParam Dtype;
+  Blob<Dtype> part(1, 3, 4, 5);
+  part.ShareData(*this->blob_preshaped_, 60);
+  part.ShareDiff(*this->blob_preshaped_, 60);
+  caffe_set(part.count(), Dtype(1), part.mutable_cpu_data());
+  caffe_set(part.count(), Dtype(2), part.mutable_cpu_diff());
+  for (int i = 0; i < part.count(); ++i) {
+    EXPECT_EQ(this->blob_preshaped_->cpu_data()[60 + i], 1);
+    EXPECT_EQ(this->blob_preshaped_->cpu_diff()[60 + i], 2);
+  }
+  // The same count keeps the view, a different one gives own memory back.
+  part.Reshape(3, 1, 4, 5);
+  EXPECT_TRUE(part.data()->is_view_of(*this->blob_preshaped_->data(),
+      60 * sizeof(Dtype)));
+  part.Reshape(1, 1, 4, 5);
+  EXPECT_FALSE(part.data()->base());
+  EXPECT_FALSE(part.diff()->base());
+}
+
+TYPED_TEST(BlobSimpleTest, TestInferenceOnly) {
+  typedef TypeParam Dtype;
+  Blob<Dtype>* blob = this->blob_preshaped_;
+  blob->set_inference_only(true);
+  EXPECT_TRUE(blob->inference_only());
+  // Growing, sharing and clearing leave it without a diff.
+  blob->Reshape(4, 3, 4, 5);
+  Blob<Dtype> other(4, 3, 4, 5);
+  blob->ShareDiff(other);
+  blob->ShareDiff(other, 0);
+  blob->ClearDiff();
+  EXPECT_EQ(0, blob->asum_diff());
+  caffe_set(blob->count(), Dtype(1), blob->mutable_cpu_data());
+  EXPECT_EQ(blob->count(), blob->asum_data());
+  // Blobs sharing its diff are left without one as well.
+  other.ShareDiff(*blob);
+  EXPECT_EQ(0, other.asum_diff());
+  blob->set_inference_only(false);
+  caffe_set(blob->count(), Dtype(2), blob->mutable_cpu_diff());
+  EXPECT_EQ(2 * blob->count(), blob->asum_diff());
+}
+
 TYPED_TEST(BlobSimpleTest, TestLegacyBlobProtoShapeEquals) {
   BlobProto blob_proto;
 
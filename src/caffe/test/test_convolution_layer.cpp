@@ -1048,6 +1048,43 @@ TYPED_TEST(CuDNNConvolutionLayerTest, TestSobelConvolutionCuDNN) {
   }
 }
 
+TYPED_TEST(CuDNNConvolutionLayerTest, TestReshapeCachedPlanCuDNN) {
+  // Alternate between input sizes, so that the last one reuses the
+  // algorithms chosen for the first.
+  LayerParameter layer_param;
+  ConvolutionParameter* convolution_param =
+      layer_param.mutable_convolution_param();
+  convolution_param->add_kernel_size(3);
+  convolution_param->add_stride(2);
+  convolution_param->set_num_output(4);
+  convolution_param->set_plan_cache_size(3);
+  convolution_param->mutable_weight_filler()->set_type("gaussian");
+  convolution_param->mutable_bias_filler()->set_type("constant");
+  convolution_param->mutable_bias_filler()->set_value(0.1);
+  shared_ptr<CuDNNConvolutionLayer<TypeParam> > layer(
+      new CuDNNConvolutionLayer<TypeParam>(layer_param));
+  layer->SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  FillerParameter filler_param;
+  GaussianFiller<TypeParam> filler(filler_param);
+  // The first shape is the one set up, so it is only searched once.
+  const int num_plans[] = {1, 2, 2};
+  const int heights[] = {6, 9, 6};
+  const int widths[] = {4, 5, 4};
+  for (int i = 0; i < 3; ++i) {
+    this->blob_bottom_->Reshape(2, 3, heights[i], widths[i]);
+    filler.Fill(this->blob_bottom_);
+    layer->Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+    EXPECT_EQ(num_plans[i], layer->num_cached_plans());
+    caffe_conv(this->blob_bottom_, convolution_param, layer->blobs(),
+        this->MakeReferenceTop(this->blob_top_));
+    const TypeParam* top_data = this->blob_top_->cpu_data();
+    const TypeParam* ref_top_data = this->ref_blob_top_->cpu_data();
+    for (int j = 0; j < this->blob_top_->count(); ++j) {
+      EXPECT_NEAR(top_data[j], ref_top_data[j], 1e-4);
+    }
+  }
+}
+
 TYPED_TEST(CuDNNConvolutionLayerTest, TestGradientCuDNN) {
   LayerParameter layer_param;
   ConvolutionParameter* convolution_param =
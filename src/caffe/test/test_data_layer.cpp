@@ -1,4 +1,8 @@
 #ifdef USE_OPENCV
+#include <opencv2/core/core.hpp>
+#include <opencv2/highgui/highgui.hpp>
+
+#include <algorithm>
 #include <string>
 #include <vector>
 
@@ -11,6 +15,7 @@
 #include "caffe/layers/data_layer.hpp"
 #include "caffe/proto/caffe.pb.h"
 #include "caffe/util/db.hpp"
+#include "caffe/util/image_cache.hpp"
 #include "caffe/util/io.hpp"
 
 #include "caffe/test/test_caffe_main.hpp"
@@ -67,6 +72,77 @@ class DataLayerTest : public MultiDeviceTest<TypeParam> {
     db->Close();
   }
 
+  // Fill the DB with PNG encoded color images, each of one value: its index.
+  void FillEncoded(DataParameter_DB backend) {
+    backend_ = backend;
+    LOG(INFO) << "Using temporary dataset " << *filename_;
+    scoped_ptr<db::DB> db(db::GetDB(backend));
+    db->Open(*filename_, db::NEW);
+    scoped_ptr<db::Transaction> txn(db->NewTransaction());
+    for (int i = 0; i < 5; ++i) {
+      cv::Mat image(3, 4, CV_8UC3, cv::Scalar(i, i, i));
+      vector<uchar> buffer;
+      CHECK(cv::imencode(".png", image, buffer));
+      Datum datum;
+      datum.set_label(i);
+      datum.set_encoded(true);
+      datum.set_data(string(buffer.begin(), buffer.end()));
+      stringstream ss;
+      ss << i;
+      string out;
+      CHECK(datum.SerializeToString(&out));
+      txn->Put(ss.str(), out);
+    }
+    txn->Commit();
+    db->Close();
+  }
+
+  void TestReadCached() {
+    LayerParameter param;
+    param.set_phase(TRAIN);
+    DataParameter* data_param = param.mutable_data_param();
+    data_param->set_batch_size(5);
+    data_param->set_source(filename_->c_str());
+    data_param->set_backend(backend_);
+    data_param->set_decoded_cache_bytes(1 << 20);
+
+    DataLayer<Dtype> layer(param);
+    layer.SetUp(blob_bottom_vec_, blob_top_vec_);
+    EXPECT_EQ(blob_top_data_->num(), 5);
+    EXPECT_EQ(blob_top_data_->channels(), 3);
+    EXPECT_EQ(blob_top_data_->height(), 3);
+    EXPECT_EQ(blob_top_data_->width(), 4);
+    size_t cache_size = 0;
+    for (int iter = 0; iter < 3; ++iter) {
+      layer.Forward(blob_bottom_vec_, blob_top_vec_);
+      for (int i = 0; i < 5; ++i) {
+        EXPECT_EQ(i, blob_top_label_->cpu_data()[i]);
+        for (int j = 0; j < 36; ++j) {
+          EXPECT_EQ(i, blob_top_data_->cpu_data()[i * 36 + j])
+              << "debug: iter " << iter << " i " << i << " j " << j;
+        }
+      }
+      // Later epochs are served from the cache without growing it.
+      if (iter == 1) {
+        cache_size = ImageCache::Get().size();
+      } else if (iter == 2) {
+        EXPECT_EQ(cache_size, ImageCache::Get().size());
+      }
+    }
+    // The decoded images are cached under the source and the record key.
+    for (int i = 0; i < 5; ++i) {
+      stringstream key;
+      key << *filename_ << "\n\n" << i;
+      cv::Mat image;
+      int label;
+      ASSERT_TRUE(ImageCache::Get().Lookup(key.str(), &image, &label));
+      EXPECT_EQ(i, label);
+      EXPECT_EQ(3, image.rows);
+      EXPECT_EQ(4, image.cols);
+      EXPECT_EQ(i, image.at<cv::Vec3b>(0, 0)[0]);
+    }
+  }
+
   void TestRead() {
     const Dtype scale = 3;
     LayerParameter param;
@@ -131,6 +207,62 @@ class DataLayerTest : public MultiDeviceTest<TypeParam> {
     Caffe::set_solver_rank(0);
   }
 
+  void TestShuffle() {
+    LayerParameter param;
+    param.set_phase(TRAIN);
+    param.set_name("data");
+    DataParameter* data_param = param.mutable_data_param();
+    const int batch_size = 5;
+    data_param->set_batch_size(batch_size);
+    data_param->set_source(filename_->c_str());
+    data_param->set_backend(backend_);
+    data_param->set_shuffle(true);
+    data_param->set_shuffle_block(2);
+    data_param->set_shuffle_buffer(2);
+    data_param->set_shuffle_seed(seed_);
+
+    // Each batch covers exactly one epoch, so it must be a permutation.
+    DataLayer<Dtype> layer(param);
+    layer.SetUp(blob_bottom_vec_, blob_top_vec_);
+    vector<vector<int> > epochs;
+    for (int iter = 0; iter < 10; ++iter) {
+      layer.Forward(blob_bottom_vec_, blob_top_vec_);
+      vector<int> labels(blob_top_label_->cpu_data(),
+          blob_top_label_->cpu_data() + batch_size);
+      epochs.push_back(labels);
+      std::sort(labels.begin(), labels.end());
+      for (int i = 0; i < batch_size; ++i) {
+        EXPECT_EQ(i, labels[i]);
+      }
+    }
+    bool reshuffled = false;
+    for (int iter = 1; iter < epochs.size(); ++iter) {
+      reshuffled |= (epochs[iter] != epochs[0]);
+    }
+    EXPECT_TRUE(reshuffled);
+
+    // A second layer restored from the first one's state continues the same
+    // record order.
+    DataReaderState state;
+    layer.GetState(&state);
+    EXPECT_EQ(state.position(), 10 * batch_size);
+    data_param->set_shuffle_seed(seed_ + 1);
+    DataLayer<Dtype> resumed(param);
+    vector<Blob<Dtype>*> resumed_top_vec;
+    Blob<Dtype> resumed_data, resumed_label;
+    resumed_top_vec.push_back(&resumed_data);
+    resumed_top_vec.push_back(&resumed_label);
+    resumed.SetUp(blob_bottom_vec_, resumed_top_vec);
+    resumed.SetState(state);
+    for (int iter = 0; iter < 3; ++iter) {
+      layer.Forward(blob_bottom_vec_, blob_top_vec_);
+      resumed.Forward(blob_bottom_vec_, resumed_top_vec);
+      for (int i = 0; i < batch_size; ++i) {
+        EXPECT_EQ(blob_top_label_->cpu_data()[i], resumed_label.cpu_data()[i]);
+      }
+    }
+  }
+
   void TestReshape(DataParameter_DB backend) {
     const int num_inputs = 5;
     // Save data of varying shapes.
@@ -387,6 +519,11 @@ TYPED_TEST(DataLayerTest, TestSkipLevelDB) {
   this->TestSkip();
 }
 
+TYPED_TEST(DataLayerTest, TestShuffleLevelDB) {
+  this->Fill(false, DataParameter_DB_LEVELDB);
+  this->TestShuffle();
+}
+
 TYPED_TEST(DataLayerTest, TestReshapeLevelDB) {
   this->TestReshape(DataParameter_DB_LEVELDB);
 }
@@ -432,6 +569,11 @@ TYPED_TEST(DataLayerTest, TestSkipLMDB) {
   this->TestSkip();
 }
 
+TYPED_TEST(DataLayerTest, TestShuffleLMDB) {
+  this->Fill(false, DataParameter_DB_LMDB);
+  this->TestShuffle();
+}
+
 TYPED_TEST(DataLayerTest, TestReshapeLMDB) {
   this->TestReshape(DataParameter_DB_LMDB);
 }
@@ -465,5 +607,27 @@ TYPED_TEST(DataLayerTest, TestReadCropTestLMDB) {
 }
 
 #endif  // USE_LMDB
+
+TYPED_TEST(DataLayerTest, TestReadCachedPacked) {
+  this->FillEncoded(DataParameter_DB_PACKED);
+  this->TestReadCached();
+}
+
+TYPED_TEST(DataLayerTest, TestReadPacked) {
+  const bool unique_pixels = false;  // all pixels the same; images different
+  this->Fill(unique_pixels, DataParameter_DB_PACKED);
+  this->TestRead();
+}
+
+TYPED_TEST(DataLayerTest, TestSkipPacked) {
+  this->Fill(false, DataParameter_DB_PACKED);
+  this->TestSkip();
+}
+
+TYPED_TEST(DataLayerTest, TestShufflePacked) {
+  this->Fill(false, DataParameter_DB_PACKED);
+  this->TestShuffle();
+}
+
 }  // namespace caffe
 #endif  // USE_OPENCV
@@ -1,4 +1,6 @@
 #ifdef USE_OPENCV
+#include <opencv2/core/core.hpp>
+
 #include <string>
 #include <vector>
 
@@ -340,5 +342,173 @@ TYPED_TEST(DataTransformTest, TestMeanFile) {
   }
 }
 
+TYPED_TEST(DataTransformTest, TestTransformIntoBatch) {
+  TransformationParameter transform_param;
+  const int label = 0;
+  const int channels = 3;
+  const int height = 4;
+  const int width = 5;
+  const int crop_size = 3;
+  const TypeParam scale = 0.5;
+
+  transform_param.set_crop_size(crop_size);
+  transform_param.set_scale(scale);
+  for (int c = 0; c < channels; ++c) {
+    transform_param.add_mean_value(c);
+  }
+  Datum datum;
+  FillDatum(label, channels, height, width, true, &datum);
+  // The same pixels stored as float_data must transform identically.
+  Datum float_datum(datum);
+  float_datum.clear_data();
+  for (int j = 0; j < datum.data().size(); ++j) {
+    float_datum.add_float_data(static_cast<uint8_t>(datum.data()[j]));
+  }
+  Blob<TypeParam> blob(2, channels, crop_size, crop_size);
+  caffe_set(blob.count(), TypeParam(-1), blob.mutable_cpu_data());
+  DataTransformer<TypeParam> transformer(transform_param, TEST);
+  transformer.InitRand();
+  transformer.Transform(datum, &blob, 1);
+  for (int j = 0; j < blob.count(1); ++j) {
+    EXPECT_EQ(blob.cpu_data()[j], -1) << "Item 0 must be left untouched";
+  }
+  const int h_off = (height - crop_size) / 2;
+  const int w_off = (width - crop_size) / 2;
+  for (int c = 0; c < channels; ++c) {
+    for (int h = 0; h < crop_size; ++h) {
+      for (int w = 0; w < crop_size; ++w) {
+        const int pixel = (c * height + h_off + h) * width + w_off + w;
+        EXPECT_EQ(blob.data_at(1, c, h, w), (pixel - c) * scale);
+      }
+    }
+  }
+  Blob<TypeParam> float_blob(1, channels, crop_size, crop_size);
+  transformer.Transform(float_datum, &float_blob);
+  for (int j = 0; j < float_blob.count(); ++j) {
+    EXPECT_EQ(float_blob.cpu_data()[j], blob.cpu_data()[blob.offset(1) + j]);
+  }
+}
+
+TYPED_TEST(DataTransformTest, TestMatMatchesDatum) {
+  TransformationParameter transform_param;
+  const int label = 0;
+  const int channels = 3;
+  const int height = 6;
+  const int width = 7;
+  const int crop_size = 4;
+
+  transform_param.set_crop_size(crop_size);
+  transform_param.set_mirror(true);
+  transform_param.set_scale(0.25);
+  transform_param.add_mean_value(10);
+  Datum datum;
+  FillDatum(label, channels, height, width, true, &datum);
+  // The same image, interleaved as OpenCV stores it.
+  cv::Mat cv_img(height, width, CV_8UC3);
+  for (int h = 0; h < height; ++h) {
+    uchar* ptr = cv_img.ptr<uchar>(h);
+    for (int w = 0; w < width; ++w) {
+      for (int c = 0; c < channels; ++c) {
+        ptr[w * channels + c] = datum.data()[(c * height + h) * width + w];
+      }
+    }
+  }
+  DataTransformer<TypeParam> datum_transformer(transform_param, TRAIN);
+  DataTransformer<TypeParam> mat_transformer(transform_param, TRAIN);
+  Caffe::set_random_seed(this->seed_);
+  datum_transformer.InitRand();
+  Caffe::set_random_seed(this->seed_);
+  mat_transformer.InitRand();
+  Blob<TypeParam> datum_blob(1, channels, crop_size, crop_size);
+  Blob<TypeParam> mat_blob(1, channels, crop_size, crop_size);
+  // Random crops and mirrors are drawn in the same order for both inputs.
+  for (int iter = 0; iter < this->num_iter_; ++iter) {
+    datum_transformer.Transform(datum, &datum_blob);
+    mat_transformer.Transform(cv_img, &mat_blob);
+    for (int j = 0; j < datum_blob.count(); ++j) {
+      EXPECT_EQ(datum_blob.cpu_data()[j], mat_blob.cpu_data()[j]);
+    }
+  }
+}
+
+TYPED_TEST(DataTransformTest, TestColorJitter) {
+  TransformationParameter transform_param;
+  const int label = 100;
+  const int channels = 3;
+  const int height = 4;
+  const int width = 5;
+  const float brightness = 10;
+  const float color_gain = 0.1;
+
+  transform_param.set_brightness(brightness);
+  transform_param.set_color_gain(color_gain);
+  Datum datum;
+  FillDatum(label, channels, height, width, false, &datum);
+  Blob<TypeParam> blob(1, channels, height, width);
+  // Jitter is only applied to training data.
+  DataTransformer<TypeParam> test_transformer(transform_param, TEST);
+  test_transformer.InitRand();
+  test_transformer.Transform(datum, &blob);
+  for (int j = 0; j < blob.count(); ++j) {
+    EXPECT_EQ(blob.cpu_data()[j], label);
+  }
+  DataTransformer<TypeParam> transformer(transform_param, TRAIN);
+  transformer.InitRand();
+  int num_changed = 0;
+  for (int iter = 0; iter < this->num_iter_; ++iter) {
+    transformer.Transform(datum, &blob);
+    for (int c = 0; c < channels; ++c) {
+      // A whole channel shares its gain and the image its brightness.
+      const TypeParam value = blob.data_at(0, c, 0, 0);
+      EXPECT_GE(value, label * (1 - color_gain) - brightness);
+      EXPECT_LE(value, label * (1 + color_gain) + brightness);
+      num_changed += (value != label);
+      for (int j = 0; j < height * width; ++j) {
+        EXPECT_EQ(blob.cpu_data()[blob.offset(0, c) + j], value);
+      }
+    }
+  }
+  EXPECT_GT(num_changed, 0);
+}
+
+TYPED_TEST(DataTransformTest, TestRandomResizedCrop) {
+  TransformationParameter transform_param;
+  const int label = 7;
+  const int channels = 3;
+  const int height = 12;
+  const int width = 16;
+  const int crop_size = 6;
+
+  transform_param.set_crop_size(crop_size);
+  transform_param.set_min_crop_area(0.25);
+  transform_param.set_max_aspect_ratio(2);
+  transform_param.set_min_resize_ratio(0.5);
+  transform_param.set_max_resize_ratio(1.5);
+  transform_param.set_rand_seed(this->seed_);
+  Datum datum, unique_datum;
+  FillDatum(label, channels, height, width, false, &datum);
+  FillDatum(label, channels, height, width, true, &unique_datum);
+  Blob<TypeParam> blob(1, channels, crop_size, crop_size);
+  Blob<TypeParam> replay_blob(1, channels, crop_size, crop_size);
+  // A fixed rand_seed replays the same augmentations.
+  DataTransformer<TypeParam> transformer(transform_param, TRAIN);
+  DataTransformer<TypeParam> replay(transform_param, TRAIN);
+  transformer.InitRand();
+  replay.InitRand();
+  for (int iter = 0; iter < this->num_iter_; ++iter) {
+    transformer.Transform(datum, &blob);
+    for (int j = 0; j < blob.count(); ++j) {
+      // Resizing a constant image keeps it constant.
+      EXPECT_EQ(blob.cpu_data()[j], label);
+    }
+    transformer.Transform(unique_datum, &blob);
+    replay.Transform(datum, &replay_blob);
+    replay.Transform(unique_datum, &replay_blob);
+    for (int j = 0; j < blob.count(); ++j) {
+      EXPECT_EQ(blob.cpu_data()[j], replay_blob.cpu_data()[j]);
+    }
+  }
+}
+
 }  // namespace caffe
 #endif  // USE_OPENCV
@@ -7,6 +7,7 @@
 #include "caffe/common.hpp"
 #include "caffe/proto/caffe.pb.h"
 #include "caffe/util/db.hpp"
+#include "caffe/util/db_packed.hpp"
 #include "caffe/util/io.hpp"
 
 #include "caffe/test/test_caffe_main.hpp"
@@ -57,8 +58,13 @@ struct TypeLMDB {
 };
 DataParameter_DB TypeLMDB::backend = DataParameter_DB_LMDB;
 
+struct TypePacked {
+  static DataParameter_DB backend;
+};
+DataParameter_DB TypePacked::backend = DataParameter_DB_PACKED;
+
 // typedef ::testing::Types<TypeLmdb> TestTypes;
-typedef ::testing::Types<TypeLevelDB, TypeLMDB> TestTypes;
+typedef ::testing::Types<TypeLevelDB, TypeLMDB, TypePacked> TestTypes;
 
 TYPED_TEST_CASE(DBTest, TestTypes);
 
@@ -132,5 +138,53 @@ TYPED_TEST(DBTest, TestWrite) {
   txn->Commit();
 }
 
+class PackedDBTest : public DBTest<TypePacked> {};
+
+TEST_F(PackedDBTest, TestSeek) {
+  db::PackedDB db;
+  db.Open(this->source_, db::READ);
+  EXPECT_EQ(db.num_records(), 2);
+  scoped_ptr<db::PackedCursor> cursor(db.NewCursor());
+  EXPECT_EQ(cursor->size(), 2);
+  cursor->Seek(1);
+  EXPECT_TRUE(cursor->valid());
+  EXPECT_EQ(cursor->position(), 1);
+  EXPECT_EQ(cursor->key(), "fish-bike.jpg");
+  cursor->Seek(0);
+  EXPECT_EQ(cursor->key(), "cat.jpg");
+  cursor->Seek(2);
+  EXPECT_FALSE(cursor->valid());
+}
+
+TEST_F(PackedDBTest, TestShardCursor) {
+  db::PackedDB db;
+  db.Open(this->source_, db::READ);
+  scoped_ptr<db::PackedCursor> first(db.NewShardCursor(0, 2));
+  scoped_ptr<db::PackedCursor> second(db.NewShardCursor(1, 2));
+  EXPECT_EQ(first->size(), 1);
+  EXPECT_EQ(second->size(), 1);
+  EXPECT_EQ(first->key(), "cat.jpg");
+  EXPECT_EQ(second->key(), "fish-bike.jpg");
+  second->Next();
+  EXPECT_FALSE(second->valid());
+}
+
+TEST_F(PackedDBTest, TestAppend) {
+  {
+    db::PackedDB db;
+    db.Open(this->source_, db::WRITE);
+    scoped_ptr<db::Transaction> txn(db.NewTransaction());
+    txn->Put("extra", "value");
+    txn->Commit();
+  }
+  db::PackedDB db;
+  db.Open(this->source_, db::READ);
+  EXPECT_EQ(db.num_records(), 3);
+  scoped_ptr<db::PackedCursor> cursor(db.NewCursor());
+  cursor->Seek(2);
+  EXPECT_EQ(cursor->key(), "extra");
+  EXPECT_EQ(cursor->value(), "value");
+}
+
 }  // namespace caffe
 #endif  // USE_LEVELDB, USE_LMDB and USE_OPENCV
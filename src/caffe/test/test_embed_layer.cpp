@@ -175,4 +175,60 @@ TYPED_TEST(EmbedLayerTest, TestGradientWithBias) {
       this->blob_top_vec_, -2);
 }
 
+TYPED_TEST(EmbedLayerTest, TestSparseUpdate) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter layer_param;
+  EmbedParameter* embed_param = layer_param.mutable_embed_param();
+  const int kNumOutput = 10;
+  const int kInputDim = 5;
+  embed_param->set_num_output(kNumOutput);
+  embed_param->set_input_dim(kInputDim);
+  embed_param->mutable_weight_filler()->set_type("uniform");
+  embed_param->mutable_weight_filler()->set_min(-10);
+  embed_param->mutable_weight_filler()->set_max(10);
+  embed_param->set_bias_term(false);
+  embed_param->set_sparse_update(true);
+  embed_param->set_gather_threads(3);
+  EmbedLayer<Dtype> layer(layer_param);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  Blob<Dtype>* weight = layer.blobs()[0].get();
+  ASSERT_TRUE(weight->sparse_diff());
+  const int kIndices[] = {3, 1, 3, 0};
+  for (int i = 0; i < this->blob_bottom_->count(); ++i) {
+    this->blob_bottom_->mutable_cpu_data()[i] = kIndices[i];
+  }
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  for (int i = 0; i < this->blob_bottom_->count(); ++i) {
+    for (int j = 0; j < kNumOutput; ++j) {
+      EXPECT_EQ(weight->cpu_data()[kIndices[i] * kNumOutput + j],
+                this->blob_top_->cpu_data()[i * kNumOutput + j]);
+    }
+  }
+  if (Caffe::mode() != Caffe::CPU) { return; }
+  // Only the rows that were used are recorded, cleared and updated.
+  caffe_set(this->blob_top_->count(), Dtype(1),
+            this->blob_top_->mutable_cpu_diff());
+  layer.Backward(this->blob_top_vec_, vector<bool>(1, false),
+                 this->blob_bottom_vec_);
+  ASSERT_EQ(3, weight->diff_rows().size());
+  EXPECT_EQ(3, weight->diff_rows()[0]);
+  EXPECT_EQ(1, weight->diff_rows()[1]);
+  EXPECT_EQ(0, weight->diff_rows()[2]);
+  Blob<Dtype> weight_copy(weight->shape());
+  weight_copy.CopyFrom(*weight);
+  weight->Update();
+  for (int i = 0; i < weight->count(); ++i) {
+    const int row = i / kNumOutput;
+    const Dtype expected_diff = row == 3 ? 2 : (row < 2 ? 1 : 0);
+    EXPECT_EQ(expected_diff, weight->cpu_diff()[i]);
+    EXPECT_EQ(weight_copy.cpu_data()[i] - expected_diff,
+              weight->cpu_data()[i]);
+  }
+  weight->ClearDiff();
+  EXPECT_EQ(0, weight->diff_rows().size());
+  for (int i = 0; i < weight->count(); ++i) {
+    EXPECT_EQ(0, weight->cpu_diff()[i]);
+  }
+}
+
 }  // namespace caffe
@@ -1,4 +1,5 @@
 #include <algorithm>
+#include <fstream>  // NOLINT(readability/streams)
 #include <string>
 #include <utility>
 #include <vector>
@@ -7,10 +8,13 @@
 
 #include "gtest/gtest.h"
 
+#include "hdf5.h"
+
 #include "caffe/common.hpp"
 #include "caffe/parallel.hpp"
 #include "caffe/proto/caffe.pb.h"
 #include "caffe/sgd_solvers.hpp"
+#include "caffe/util/hdf5.hpp"
 #include "caffe/util/io.hpp"
 
 #include "caffe/test/test_caffe_main.hpp"
@@ -26,7 +30,8 @@ class GradientBasedSolverTest : public MultiDeviceTest<TypeParam> {
  protected:
   GradientBasedSolverTest() :
       seed_(1701), num_(4), channels_(3), height_(10), width_(10),
-      share_(false) {
+      share_(false), update_threads_(1), snapshot_async_(false),
+      snapshot_hdf5_(false) {
         input_file_ = new string(
         ABS_TEST_DATA_DIR "/solver_data_list.txt");
       }
@@ -44,6 +49,9 @@ class GradientBasedSolverTest : public MultiDeviceTest<TypeParam> {
   // TODO this is brittle and the hdf5 file should be checked instead.
   int num_, channels_, height_, width_;
   bool share_;
+  int update_threads_;
+  bool snapshot_async_;
+  bool snapshot_hdf5_;
   Dtype delta_;  // Stability constant for RMSProp, AdaGrad, AdaDelta and Adam
 
   // Test data: check out generate_sample_data.py in the same directory.
@@ -179,11 +187,20 @@ class GradientBasedSolverTest : public MultiDeviceTest<TypeParam> {
     if (momentum != 0) {
       proto << "momentum: " << momentum << " ";
     }
+    if (update_threads_ != 1) {
+      proto << "update_threads: " << update_threads_ << " ";
+    }
     MakeTempDir(&snapshot_prefix_);
     proto << "snapshot_prefix: '" << snapshot_prefix_ << "/' ";
     if (snapshot) {
       proto << "snapshot: " << num_iters << " ";
     }
+    if (snapshot_async_) {
+      proto << "snapshot_async: true ";
+    }
+    if (snapshot_hdf5_) {
+      proto << "snapshot_format: HDF5 ";
+    }
     Caffe::set_random_seed(this->seed_);
     this->InitSolverFromProtoString(proto.str());
     if (from_snapshot) {
@@ -194,6 +211,12 @@ class GradientBasedSolverTest : public MultiDeviceTest<TypeParam> {
     }
     if (devices == 1) {
       this->solver_->Solve();
+    } else if (Caffe::mode() == Caffe::CPU) {
+      LOG(INFO) << "Multi-thread test on " << devices << " threads";
+      Caffe::set_solver_count(devices);
+      CPUSync<Dtype> sync(this->solver_);
+      sync.Run(devices, from_snapshot);
+      Caffe::set_solver_count(1);
     } else {
       LOG(INFO) << "Multi-GPU test on " << devices << " devices";
       vector<int> gpus;
@@ -214,7 +237,7 @@ class GradientBasedSolverTest : public MultiDeviceTest<TypeParam> {
     if (snapshot) {
       ostringstream resume_file;
       resume_file << snapshot_prefix_ << "/_iter_" << num_iters
-                  << ".solverstate";
+                  << ".solverstate" << (snapshot_hdf5_ ? ".h5" : "");
       string resume_filename = resume_file.str();
       return resume_filename;
     }
@@ -466,6 +489,10 @@ class GradientBasedSolverTest : public MultiDeviceTest<TypeParam> {
       CUDA_CHECK(cudaGetDeviceCount(&available_devices));
     }
 #endif
+    if (Caffe::mode() == Caffe::CPU) {
+      // Solvers run on threads, check the sizes that split the batch unevenly.
+      available_devices = 3;
+    }
     // Takes a while to test all sizes for each test so sparse
     vector<int> sizes;
     sizes.push_back(1);
@@ -672,6 +699,18 @@ TYPED_TEST(SGDSolverTest, TestLeastSquaresUpdateWithEverythingShare) {
   }
 }
 
+TYPED_TEST(SGDSolverTest, TestLeastSquaresUpdateWithEverythingThreads) {
+  typedef typename TypeParam::Dtype Dtype;
+  const Dtype kLearningRate = 0.01;
+  const Dtype kWeightDecay = 0.5;
+  const Dtype kMomentum = 0.5;
+  const int kNumIters = 4;
+  this->update_threads_ = 2;
+  for (int i = 0; i <= kNumIters; ++i) {
+    this->TestLeastSquaresUpdate(kLearningRate, kWeightDecay, kMomentum, i);
+  }
+}
+
 TYPED_TEST(SGDSolverTest, TestLeastSquaresUpdateWithEverythingAccum) {
   typedef typename TypeParam::Dtype Dtype;
   const Dtype kLearningRate = 0.01;
@@ -718,6 +757,32 @@ TYPED_TEST(SGDSolverTest, TestSnapshotShare) {
   }
 }
 
+TYPED_TEST(SGDSolverTest, TestSnapshotAsync) {
+  typedef typename TypeParam::Dtype Dtype;
+  const Dtype kLearningRate = 0.01;
+  const Dtype kWeightDecay = 0.5;
+  const Dtype kMomentum = 0.9;
+  const int kNumIters = 4;
+  this->snapshot_async_ = true;
+  for (int i = 1; i <= kNumIters; ++i) {
+    this->TestSnapshot(kLearningRate, kWeightDecay, kMomentum, i);
+  }
+}
+
+TYPED_TEST(SGDSolverTest, TestSnapshotAsyncHDF5Share) {
+  typedef typename TypeParam::Dtype Dtype;
+  const Dtype kLearningRate = 0.01;
+  const Dtype kWeightDecay = 0.5;
+  const Dtype kMomentum = 0.9;
+  const int kNumIters = 4;
+  this->share_ = true;
+  this->snapshot_async_ = true;
+  this->snapshot_hdf5_ = true;
+  for (int i = 1; i <= kNumIters; ++i) {
+    this->TestSnapshot(kLearningRate, kWeightDecay, kMomentum, i);
+  }
+}
+
 
 template <typename TypeParam>
 class AdaGradSolverTest : public GradientBasedSolverTest<TypeParam> {
@@ -1137,6 +1202,18 @@ TYPED_TEST(AdamSolverTest, TestAdamLeastSquaresUpdateWithEverythingShare) {
   }
 }
 
+TYPED_TEST(AdamSolverTest, TestAdamLeastSquaresUpdateWithEverythingThreads) {
+  typedef typename TypeParam::Dtype Dtype;
+  const Dtype kLearningRate = 0.01;
+  const Dtype kWeightDecay = 0.5;
+  const Dtype kMomentum = 0.9;
+  const int kNumIters = 4;
+  this->update_threads_ = 2;
+  for (int i = 0; i <= kNumIters; ++i) {
+    this->TestLeastSquaresUpdate(kLearningRate, kWeightDecay, kMomentum, i);
+  }
+}
+
 TYPED_TEST(AdamSolverTest, TestLeastSquaresUpdateWithEverythingAccum) {
   typedef typename TypeParam::Dtype Dtype;
   const Dtype kLearningRate = 0.01;
@@ -1286,4 +1363,187 @@ TYPED_TEST(RMSPropSolverTest, TestSnapshotShare) {
   }
 }
 
+// Trains an Embed layer with a row-sparse diff, fed the rows it looks up
+// through an HDF5 file.
+template <typename Dtype>
+class SparseUpdateSolverTest : public CPUDeviceTest<Dtype> {
+ protected:
+  SparseUpdateSolverTest() : seed_(1701), input_dim_(6), num_output_(3) {}
+
+  // Writes the indices to an HDF5 file, and returns the name of a file
+  // listing it for an HDF5Data layer.
+  string WriteIndices(const vector<int>& indices) {
+    string filename;
+    MakeTempFilename(&filename);
+    filename += ".h5";
+    Blob<Dtype> blob(vector<int>(1, indices.size()));
+    for (int i = 0; i < indices.size(); ++i) {
+      blob.mutable_cpu_data()[i] = indices[i];
+    }
+    hid_t file_id = H5Fcreate(filename.c_str(), H5F_ACC_TRUNC, H5P_DEFAULT,
+        H5P_DEFAULT);
+    CHECK_GE(file_id, 0) << "Failed to create " << filename;
+    hdf5_save_nd_dataset(file_id, "index", blob);
+    H5Fclose(file_id);
+    string list_filename;
+    MakeTempFilename(&list_filename);
+    std::ofstream list_file(list_filename.c_str());
+    list_file << filename << std::endl;
+    return list_filename;
+  }
+
+  // The loss is the sum of squares of the looked up rows.
+  void InitSolver(const string& type, const string& source, int batch_size,
+      Dtype momentum, bool sparse_update, int num_iters) {
+    ostringstream proto;
+    proto <<
+       "type: '" << type << "' "
+       "base_lr: 0.1 "
+       "lr_policy: 'fixed' "
+       "weight_decay: 0.1 "
+       "momentum: " << momentum << " "
+       "max_iter: " << num_iters << " "
+       "snapshot_after_train: false "
+       "solver_mode: CPU "
+       "net_param { "
+       "  name: 'SparseNetwork' "
+       "  layer { "
+       "    name: 'data' "
+       "    type: 'HDF5Data' "
+       "    hdf5_data_param { "
+       "      source: '" << source << "' "
+       "      batch_size: " << batch_size << " "
+       "    } "
+       "    top: 'index' "
+       "  } "
+       "  layer { "
+       "    name: 'embed' "
+       "    type: 'Embed' "
+       "    embed_param { "
+       "      num_output: " << num_output_ << " "
+       "      input_dim: " << input_dim_ << " "
+       "      bias_term: false "
+       "      sparse_update: " << sparse_update << " "
+       "      weight_filler { type: 'gaussian' std: 1.0 } "
+       "    } "
+       "    bottom: 'index' "
+       "    top: 'embed' "
+       "  } "
+       "  layer { "
+       "    name: 'loss' "
+       "    type: 'Reduction' "
+       "    reduction_param { operation: SUMSQ } "
+       "    bottom: 'embed' "
+       "    top: 'loss' "
+       "    loss_weight: 1 "
+       "  } "
+       "} ";
+    SolverParameter param;
+    CHECK(google::protobuf::TextFormat::ParseFromString(proto.str(), &param));
+    Caffe::set_random_seed(seed_);
+    solver_.reset(SolverRegistry<Dtype>::CreateSolver(param));
+  }
+
+  Blob<Dtype>* weights() {
+    return solver_->net()->layer_by_name("embed")->blobs()[0].get();
+  }
+
+  // Trains with and without sparse_update on batches that look up the same
+  // rows every iteration. The sparse updates of those rows must match the
+  // dense ones, while the other rows and their history stay untouched.
+  void CheckSparseUpdate(const string& type, Dtype momentum) {
+    const int kIndices[] = {0, 2, 0, 2};
+    const int kBatchSize = 2;
+    const int kNumIters = 3;
+    const string source =
+        WriteIndices(vector<int>(kIndices, kIndices + 4));
+    InitSolver(type, source, kBatchSize, momentum, false, kNumIters);
+    solver_->Solve();
+    Blob<Dtype> dense;
+    dense.CopyFrom(*weights(), false, true);
+    InitSolver(type, source, kBatchSize, momentum, true, kNumIters);
+    ASSERT_TRUE(weights()->sparse_diff());
+    Blob<Dtype> initial;
+    initial.CopyFrom(*weights(), false, true);
+    solver_->Solve();
+    const vector<shared_ptr<Blob<Dtype> > >& history =
+        static_cast<SGDSolver<Dtype>*>(solver_.get())->history();
+    const int N = num_output_;
+    for (int row = 0; row < input_dim_; ++row) {
+      const bool used = row == 0 || row == 2;
+      for (int i = 0; i < N; ++i) {
+        const int index = row * N + i;
+        if (used) {
+          EXPECT_NEAR(dense.cpu_data()[index], weights()->cpu_data()[index],
+              1e-5) << "row " << row;
+        } else {
+          EXPECT_EQ(initial.cpu_data()[index], weights()->cpu_data()[index])
+              << "row " << row;
+          for (int h = 0; h < history.size(); ++h) {
+            EXPECT_EQ(0, history[h]->cpu_data()[index]) << "row " << row;
+          }
+        }
+      }
+    }
+  }
+
+  int seed_;
+  int input_dim_;
+  int num_output_;
+  shared_ptr<Solver<Dtype> > solver_;
+};
+
+TYPED_TEST_CASE(SparseUpdateSolverTest, TestDtypes);
+
+TYPED_TEST(SparseUpdateSolverTest, TestSGDSparseUpdate) {
+  this->CheckSparseUpdate("SGD", 0.9);
+}
+
+TYPED_TEST(SparseUpdateSolverTest, TestNesterovSparseUpdate) {
+  this->CheckSparseUpdate("Nesterov", 0.9);
+}
+
+TYPED_TEST(SparseUpdateSolverTest, TestAdaGradSparseUpdate) {
+  this->CheckSparseUpdate("AdaGrad", 0);
+}
+
+TYPED_TEST(SparseUpdateSolverTest, TestRMSPropSparseUpdate) {
+  this->CheckSparseUpdate("RMSProp", 0);
+}
+
+TYPED_TEST(SparseUpdateSolverTest, TestAdaDeltaSparseUpdate) {
+  this->CheckSparseUpdate("AdaDelta", 0.95);
+}
+
+TYPED_TEST(SparseUpdateSolverTest, TestAdamSparseUpdate) {
+  this->CheckSparseUpdate("Adam", 0.9);
+}
+
+TYPED_TEST(SparseUpdateSolverTest, TestDisjointRowsAcrossSolvers) {
+  typedef TypeParam Dtype;
+  // Each of the two solvers reads one index, so they write disjoint rows.
+  const int kIndices[] = {0, 1};
+  const string source =
+      this->WriteIndices(vector<int>(kIndices, kIndices + 2));
+  this->InitSolver("SGD", source, 1, 0, true, 1);
+  Blob<Dtype> initial;
+  initial.CopyFrom(*this->weights(), false, true);
+  Caffe::set_solver_count(2);
+  CPUSync<Dtype> sync(this->solver_);
+  sync.Run(2, NULL);
+  Caffe::set_solver_count(1);
+  EXPECT_FALSE(this->weights()->sparse_diff());
+  // The rows looked up by either solver get the averaged gradient 2 w / 2,
+  // plus the weight decay, from every solver alike.
+  const int N = this->num_output_;
+  for (int row = 0; row < this->input_dim_; ++row) {
+    const Dtype decay = 1 - Dtype(0.1) * Dtype(0.1);
+    const Dtype scale = row < 2 ? decay - Dtype(0.1) : decay;
+    for (int i = 0; i < N; ++i) {
+      EXPECT_NEAR(initial.cpu_data()[row * N + i] * scale,
+          this->weights()->cpu_data()[row * N + i], 1e-5);
+    }
+  }
+}
+
 }  // namespace caffe
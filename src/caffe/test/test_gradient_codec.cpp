@@ -0,0 +1,103 @@
+#include <cmath>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "caffe/common.hpp"
+#include "caffe/util/gradient_codec.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+template <typename Dtype>
+class GradientCodecTest : public ::testing::Test {
+ protected:
+  GradientCodecTest() {
+    const Dtype values[] = {0.1, -5, 0.25, 3, -0.5, 1.5};
+    data_.assign(values, values + sizeof(values) / sizeof(values[0]));
+  }
+
+  // Encodes data, at an offset of 2 in the codec buffer, and returns the
+  // decoded values.
+  vector<Dtype> RoundTrip(GradientCodec<Dtype>* codec,
+      const vector<Dtype>& data) {
+    vector<char> message;
+    codec->Encode(&data[0], 2, data.size(), &message);
+    vector<Dtype> decoded(data.size(), Dtype(0));
+    codec->DecodeAdd(&message[0], decoded.size(), &decoded[0]);
+    return decoded;
+  }
+
+  // Checks that what a codec with error feedback sends over several
+  // iterations adds up to the gradients, up to what it still holds back.
+  void TestErrorFeedback(GradientCodec<Dtype>* codec, int iterations,
+      int flush_iterations, Dtype tolerance) {
+    vector<Dtype> sum(data_.size(), Dtype(0));
+    const vector<Dtype> zeros(data_.size(), Dtype(0));
+    for (int i = 0; i < iterations + flush_iterations; ++i) {
+      vector<Dtype> decoded = RoundTrip(codec, i < iterations ? data_ : zeros);
+      for (int j = 0; j < sum.size(); ++j) {
+        sum[j] += decoded[j];
+      }
+    }
+    for (int j = 0; j < sum.size(); ++j) {
+      EXPECT_NEAR(iterations * data_[j], sum[j], tolerance);
+    }
+  }
+
+  vector<Dtype> data_;
+};
+
+TYPED_TEST_CASE(GradientCodecTest, TestDtypes);
+
+TYPED_TEST(GradientCodecTest, TestFP16) {
+  FP16GradientCodec<TypeParam> codec;
+  EXPECT_EQ(2, codec.value_size());
+  const TypeParam values[] = {1, -2.5, 65504, 0.1, 1e-6, 1e6, 0};
+  vector<TypeParam> data(values, values + sizeof(values) / sizeof(values[0]));
+  vector<TypeParam> decoded = this->RoundTrip(&codec, data);
+  EXPECT_EQ(1, decoded[0]);
+  EXPECT_EQ(-2.5, decoded[1]);
+  EXPECT_EQ(65504, decoded[2]);
+  EXPECT_NEAR(0.1, decoded[3], 1e-4);
+  // Subnormal half
+  EXPECT_NEAR(1e-6, decoded[4], 6e-8);
+  EXPECT_TRUE(std::isinf(decoded[5]));
+  EXPECT_EQ(0, decoded[6]);
+}
+
+TYPED_TEST(GradientCodecTest, TestTopKSendsLargest) {
+  TopKGradientCodec<TypeParam> codec(10, 1. / 3);
+  vector<TypeParam> decoded = this->RoundTrip(&codec, this->data_);
+  for (int i = 0; i < decoded.size(); ++i) {
+    const bool sent = std::fabs(this->data_[i]) >= 3;
+    EXPECT_EQ(sent ? this->data_[i] : 0, decoded[i]);
+  }
+}
+
+TYPED_TEST(GradientCodecTest, TestTopKErrorFeedback) {
+  // Two values are sent per iteration, so everything held back is sent
+  // after three iterations without new gradients.
+  TopKGradientCodec<TypeParam> codec(10, 1. / 3);
+  this->TestErrorFeedback(&codec, 4, 3, 1e-5);
+}
+
+TYPED_TEST(GradientCodecTest, TestSign) {
+  SignGradientCodec<TypeParam> codec(10);
+  const TypeParam values[] = {2, -2, -2, 2, 2};
+  vector<TypeParam> data(values, values + sizeof(values) / sizeof(values[0]));
+  vector<TypeParam> decoded = this->RoundTrip(&codec, data);
+  for (int i = 0; i < data.size(); ++i) {
+    EXPECT_EQ(data[i], decoded[i]);
+  }
+}
+
+TYPED_TEST(GradientCodecTest, TestSignErrorFeedback) {
+  // What is held back stays bounded, within twice the total magnitude of
+  // the gradients, however many iterations run.
+  SignGradientCodec<TypeParam> codec(10);
+  this->TestErrorFeedback(&codec, 10000, 0, 20);
+}
+
+}  // namespace caffe
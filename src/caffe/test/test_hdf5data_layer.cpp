@@ -1,3 +1,4 @@
+#include <set>
 #include <string>
 #include <vector>
 
@@ -132,6 +133,88 @@ TYPED_TEST(HDF5DataLayerTest, TestRead) {
   }
 }
 
+TYPED_TEST(HDF5DataLayerTest, TestReadChunked) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter param;
+  param.add_top("data");
+  param.add_top("label");
+  param.add_top("label2");
+
+  HDF5DataParameter* hdf5_data_param = param.mutable_hdf5_data_param();
+  int batch_size = 5;
+  hdf5_data_param->set_batch_size(batch_size);
+  hdf5_data_param->set_source(*(this->filename));
+  HDF5DataLayer<Dtype> whole_layer(param);
+  vector<Blob<Dtype>*> whole_top_vec;
+  for (int i = 0; i < this->blob_top_vec_.size(); ++i) {
+    whole_top_vec.push_back(new Blob<Dtype>());
+  }
+  whole_layer.SetUp(this->blob_bottom_vec_, whole_top_vec);
+
+  // Chunks of 3 rows do not divide the 10 rows of each file or the batches.
+  hdf5_data_param->set_chunk_size(3);
+  HDF5DataLayer<Dtype> layer(param);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  for (int i = 0; i < this->blob_top_vec_.size(); ++i) {
+    EXPECT_TRUE(this->blob_top_vec_[i]->shape() == whole_top_vec[i]->shape());
+  }
+  // Setting up again restarts the stream from the first row.
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+
+  // Streaming in order gives the same rows as loading whole files.
+  for (int iter = 0; iter < 10; ++iter) {
+    whole_layer.Forward(this->blob_bottom_vec_, whole_top_vec);
+    layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+    for (int i = 0; i < this->blob_top_vec_.size(); ++i) {
+      for (int j = 0; j < whole_top_vec[i]->count(); ++j) {
+        EXPECT_EQ(whole_top_vec[i]->cpu_data()[j],
+            this->blob_top_vec_[i]->cpu_data()[j])
+            << "debug: top " << i << " iter " << iter;
+      }
+    }
+  }
+  for (int i = 0; i < whole_top_vec.size(); ++i) {
+    delete whole_top_vec[i];
+  }
+}
+
+TYPED_TEST(HDF5DataLayerTest, TestShuffleChunked) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter param;
+  param.add_top("data");
+  param.add_top("label");
+
+  HDF5DataParameter* hdf5_data_param = param.mutable_hdf5_data_param();
+  int batch_size = 5;
+  hdf5_data_param->set_batch_size(batch_size);
+  hdf5_data_param->set_source(*(this->filename));
+  hdf5_data_param->set_chunk_size(4);
+  hdf5_data_param->set_shuffle(true);
+  hdf5_data_param->set_prefetch(1);
+
+  HDF5DataLayer<Dtype> layer(param);
+  vector<Blob<Dtype>*> top_vec(this->blob_top_vec_.begin(),
+      this->blob_top_vec_.begin() + 2);
+  layer.SetUp(this->blob_bottom_vec_, top_vec);
+  // Each pass serves every row of both files exactly once: the first value
+  // of a row identifies it (see generate_sample_data).
+  const int data_dim = this->blob_top_data_->count(1);
+  for (int pass = 0; pass < 2; ++pass) {
+    std::set<int> rows;
+    for (int iter = 0; iter < 4; ++iter) {
+      layer.Forward(this->blob_bottom_vec_, top_vec);
+      for (int i = 0; i < batch_size; ++i) {
+        const int value = this->blob_top_data_->cpu_data()[i * data_dim];
+        const int row = (value % 2400) / data_dim;
+        EXPECT_EQ(row + 1, this->blob_top_label_->cpu_data()[i]);
+        rows.insert(value);
+      }
+    }
+    EXPECT_EQ(20, rows.size());
+  }
+}
+
 TYPED_TEST(HDF5DataLayerTest, TestSkip) {
   typedef typename TypeParam::Dtype Dtype;
   LayerParameter param;
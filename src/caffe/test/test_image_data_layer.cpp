@@ -10,6 +10,7 @@
 #include "caffe/filler.hpp"
 #include "caffe/layers/image_data_layer.hpp"
 #include "caffe/proto/caffe.pb.h"
+#include "caffe/util/image_cache.hpp"
 #include "caffe/util/io.hpp"
 
 #include "caffe/test/test_caffe_main.hpp"
@@ -97,6 +98,38 @@ TYPED_TEST(ImageDataLayerTest, TestRead) {
   }
 }
 
+TYPED_TEST(ImageDataLayerTest, TestDecodedCache) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter param;
+  ImageDataParameter* image_data_param = param.mutable_image_data_param();
+  image_data_param->set_batch_size(2);
+  image_data_param->set_source(this->filename_reshape_.c_str());
+  image_data_param->set_new_height(32);
+  image_data_param->set_new_width(48);
+  image_data_param->set_shuffle(false);
+  ImageDataLayer<Dtype> uncached_layer(param);
+  uncached_layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  uncached_layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  Blob<Dtype> expected;
+  expected.CopyFrom(*this->blob_top_data_, false, true);
+
+  image_data_param->set_decoded_cache_bytes(1 << 20);
+  ImageDataLayer<Dtype> layer(param);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  EXPECT_GE(ImageCache::Get().capacity(), 1 << 20);
+  EXPECT_GT(ImageCache::Get().size(), 0);
+  // The second pass is served from the cache and must match the first.
+  for (int iter = 0; iter < 2; ++iter) {
+    layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+    for (int i = 0; i < expected.count(); ++i) {
+      EXPECT_EQ(expected.cpu_data()[i], this->blob_top_data_->cpu_data()[i]);
+    }
+    for (int i = 0; i < 2; ++i) {
+      EXPECT_EQ(i, this->blob_top_label_->cpu_data()[i]);
+    }
+  }
+}
+
 TYPED_TEST(ImageDataLayerTest, TestResize) {
   typedef typename TypeParam::Dtype Dtype;
   LayerParameter param;
@@ -0,0 +1,84 @@
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "caffe/blob.hpp"
+#include "caffe/common.hpp"
+#include "caffe/layers/conv_layer.hpp"
+#include "caffe/layers/inner_product_layer.hpp"
+#include "caffe/layers/relu_layer.hpp"
+#include "caffe/util/layer_cost.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+template <typename Dtype>
+class LayerCostTest : public ::testing::Test {
+ protected:
+  LayerCostTest()
+      : blob_bottom_(new Blob<Dtype>(2, 3, 6, 5)),
+        blob_top_(new Blob<Dtype>()) {
+    blob_bottom_vec_.push_back(blob_bottom_);
+    blob_top_vec_.push_back(blob_top_);
+  }
+  virtual ~LayerCostTest() {
+    delete blob_bottom_;
+    delete blob_top_;
+  }
+
+  Blob<Dtype>* const blob_bottom_;
+  Blob<Dtype>* const blob_top_;
+  vector<Blob<Dtype>*> blob_bottom_vec_;
+  vector<Blob<Dtype>*> blob_top_vec_;
+};
+
+TYPED_TEST_CASE(LayerCostTest, TestDtypes);
+
+TYPED_TEST(LayerCostTest, TestConvolution) {
+  LayerParameter layer_param;
+  ConvolutionParameter* convolution_param =
+      layer_param.mutable_convolution_param();
+  convolution_param->add_kernel_size(3);
+  convolution_param->set_num_output(4);
+  ConvolutionLayer<TypeParam> layer(layer_param);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  LayerCost cost = EstimateLayerCost(&layer, this->blob_bottom_vec_,
+      this->blob_top_vec_, vector<bool>(1, true));
+  // 2 * 4 * 4 * 3 outputs, each of a 3 * 3 * 3 filter and a bias
+  const double outputs = 2 * 4 * 4 * 3;
+  EXPECT_EQ(outputs * (2 * 27 + 1), cost.forward_flops);
+  // Gradients of the bottom and of the params
+  EXPECT_EQ(2 * cost.forward_flops, cost.backward_flops);
+  const double params = 4 * 27 + 4;
+  EXPECT_EQ(sizeof(TypeParam) * (2 * 3 * 6 * 5 + outputs + params),
+      cost.forward_bytes);
+}
+
+TYPED_TEST(LayerCostTest, TestInnerProductWithoutBackward) {
+  LayerParameter layer_param;
+  layer_param.mutable_inner_product_param()->set_num_output(10);
+  layer_param.mutable_inner_product_param()->set_bias_term(false);
+  InnerProductLayer<TypeParam> layer(layer_param);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  layer.set_param_propagate_down(0, false);
+  LayerCost cost = EstimateLayerCost(&layer, this->blob_bottom_vec_,
+      this->blob_top_vec_, vector<bool>(1, false));
+  EXPECT_EQ(2. * 2 * 10 * 90, cost.forward_flops);
+  EXPECT_EQ(0, cost.backward_flops);
+  EXPECT_EQ(0, cost.backward_bytes);
+}
+
+TYPED_TEST(LayerCostTest, TestInPlace) {
+  LayerParameter layer_param;
+  ReLULayer<TypeParam> layer(layer_param);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_bottom_vec_);
+  LayerCost cost = EstimateLayerCost(&layer, this->blob_bottom_vec_,
+      this->blob_bottom_vec_, vector<bool>(1, true));
+  const double count = this->blob_bottom_->count();
+  EXPECT_EQ(count, cost.forward_flops);
+  // The top is the bottom
+  EXPECT_EQ(sizeof(TypeParam) * count, cost.forward_bytes);
+}
+
+}  // namespace caffe
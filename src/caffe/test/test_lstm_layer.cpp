@@ -285,4 +285,143 @@ TYPED_TEST(LSTMLayerTest, TestGradientNonZeroContBufferSize2WithStaticInput) {
 }
 
 
+TYPED_TEST(LSTMLayerTest, TestFusedMatchesUnrolled) {
+  typedef typename TypeParam::Dtype Dtype;
+  this->ReshapeBlobs(3, 2);
+  FillerParameter filler_param;
+  UniformFiller<Dtype> filler(filler_param);
+  filler.Fill(&this->blob_bottom_static_);
+  this->blob_bottom_vec_.push_back(&this->blob_bottom_static_);
+  for (int i = 0; i < this->blob_bottom_cont_.count(); ++i) {
+    this->blob_bottom_cont_.mutable_cpu_data()[i] = i > 2;
+  }
+  RecurrentParameter* recurrent_param =
+      this->layer_param_.mutable_recurrent_param();
+  recurrent_param->set_engine(RecurrentParameter_Engine_UNROLLED);
+  LSTMLayer<Dtype> unrolled_layer(this->layer_param_);
+  unrolled_layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  recurrent_param->set_engine(RecurrentParameter_Engine_FUSED);
+  LSTMLayer<Dtype> fused_layer(this->layer_param_);
+  Blob<Dtype> fused_top;
+  vector<Blob<Dtype>*> fused_top_vec(1, &fused_top);
+  fused_layer.SetUp(this->blob_bottom_vec_, fused_top_vec);
+  ASSERT_EQ(unrolled_layer.blobs().size(), fused_layer.blobs().size());
+  for (int i = 0; i < fused_layer.blobs().size(); ++i) {
+    ASSERT_TRUE(unrolled_layer.blobs()[i]->shape() ==
+                fused_layer.blobs()[i]->shape());
+    fused_layer.blobs()[i]->CopyFrom(*unrolled_layer.blobs()[i]);
+  }
+  // Run two batches, so that the second starts from the state left by the
+  // first, and backpropagate through the second.
+  const Dtype kEpsilon = 1e-5;
+  for (int iter = 0; iter < 2; ++iter) {
+    unrolled_layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+    fused_layer.Forward(this->blob_bottom_vec_, fused_top_vec);
+    ASSERT_TRUE(this->blob_top_.shape() == fused_top.shape());
+    for (int i = 0; i < fused_top.count(); ++i) {
+      EXPECT_NEAR(this->blob_top_.cpu_data()[i], fused_top.cpu_data()[i],
+                  kEpsilon) << "iter = " << iter << "; i = " << i;
+    }
+  }
+  filler.Fill(&fused_top);
+  caffe_copy(fused_top.count(), fused_top.cpu_data(),
+             this->blob_top_.mutable_cpu_diff());
+  caffe_copy(fused_top.count(), fused_top.cpu_data(),
+             fused_top.mutable_cpu_diff());
+  vector<bool> propagate_down(this->blob_bottom_vec_.size(), true);
+  propagate_down[1] = false;
+  unrolled_layer.Backward(this->blob_top_vec_, propagate_down,
+                          this->blob_bottom_vec_);
+  Blob<Dtype> unrolled_diff(this->blob_bottom_.shape());
+  unrolled_diff.CopyFrom(this->blob_bottom_, true);
+  Blob<Dtype> unrolled_static_diff(this->blob_bottom_static_.shape());
+  unrolled_static_diff.CopyFrom(this->blob_bottom_static_, true);
+  fused_layer.Backward(fused_top_vec, propagate_down, this->blob_bottom_vec_);
+  for (int i = 0; i < this->blob_bottom_.count(); ++i) {
+    EXPECT_NEAR(unrolled_diff.cpu_data()[i],
+                this->blob_bottom_.cpu_diff()[i], kEpsilon);
+  }
+  for (int i = 0; i < this->blob_bottom_static_.count(); ++i) {
+    EXPECT_NEAR(unrolled_static_diff.cpu_data()[i],
+                this->blob_bottom_static_.cpu_diff()[i], kEpsilon);
+  }
+  for (int j = 0; j < fused_layer.blobs().size(); ++j) {
+    const Blob<Dtype>& unrolled_param = *unrolled_layer.blobs()[j];
+    const Blob<Dtype>& fused_param = *fused_layer.blobs()[j];
+    for (int i = 0; i < fused_param.count(); ++i) {
+      EXPECT_NEAR(unrolled_param.cpu_diff()[i], fused_param.cpu_diff()[i],
+                  kEpsilon) << "param = " << j << "; i = " << i;
+    }
+  }
+}
+
+TYPED_TEST(LSTMLayerTest, TestStreaming) {
+  typedef typename TypeParam::Dtype Dtype;
+  const int kNumTimesteps = 3;
+  const int num = this->blob_bottom_.shape(1);
+  this->ReshapeBlobs(kNumTimesteps, num);
+  // Restart the second stream at the last timestep.
+  for (int t = 0; t < kNumTimesteps; ++t) {
+    for (int n = 0; n < num; ++n) {
+      this->blob_bottom_cont_.mutable_cpu_data()[t * num + n] =
+          t > 0 && !(t == 2 && n == 1);
+    }
+  }
+  RecurrentParameter* recurrent_param =
+      this->layer_param_.mutable_recurrent_param();
+  recurrent_param->set_engine(RecurrentParameter_Engine_UNROLLED);
+  LSTMLayer<Dtype> layer(this->layer_param_);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  Blob<Dtype> bottom_copy(this->blob_bottom_.shape());
+  bottom_copy.CopyFrom(this->blob_bottom_);
+  Blob<Dtype> cont_copy(this->blob_bottom_cont_.shape());
+  cont_copy.CopyFrom(this->blob_bottom_cont_);
+  Blob<Dtype> top_copy(this->blob_top_.shape());
+  top_copy.CopyFrom(this->blob_top_);
+
+  const Dtype kEpsilon = 1e-5;
+  for (int engine = RecurrentParameter_Engine_UNROLLED;
+       engine <= RecurrentParameter_Engine_FUSED; ++engine) {
+    recurrent_param->set_engine(
+        static_cast<RecurrentParameter_Engine>(engine));
+    recurrent_param->set_streaming(true);
+    LSTMLayer<Dtype> streaming_layer(this->layer_param_);
+    streaming_layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+    for (int i = 0; i < layer.blobs().size(); ++i) {
+      streaming_layer.blobs()[i]->CopyFrom(*layer.blobs()[i]);
+    }
+    // The whole sequence in one call...
+    streaming_layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+    ASSERT_TRUE(this->blob_top_.shape() == top_copy.shape());
+    for (int i = 0; i < top_copy.count(); ++i) {
+      EXPECT_NEAR(top_copy.cpu_data()[i], this->blob_top_.cpu_data()[i],
+                  kEpsilon) << "engine = " << engine << "; i = " << i;
+    }
+    // ...and one timestep per call, keeping the hidden state in between.
+    streaming_layer.Reset();
+    this->ReshapeBlobs(1, num);
+    const int bottom_count = this->blob_bottom_.count();
+    const int top_count = num * this->num_output_;
+    for (int t = 0; t < kNumTimesteps; ++t) {
+      caffe_copy(bottom_count, bottom_copy.cpu_data() + t * bottom_count,
+                 this->blob_bottom_.mutable_cpu_data());
+      caffe_copy(num, cont_copy.cpu_data() + t * num,
+                 this->blob_bottom_cont_.mutable_cpu_data());
+      streaming_layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+      ASSERT_EQ(top_count, this->blob_top_.count());
+      for (int i = 0; i < top_count; ++i) {
+        EXPECT_NEAR(top_copy.cpu_data()[t * top_count + i],
+                    this->blob_top_.cpu_data()[i], kEpsilon)
+            << "engine = " << engine << "; t = " << t << "; i = " << i;
+      }
+    }
+    this->ReshapeBlobs(kNumTimesteps, num);
+    caffe_copy(bottom_copy.count(), bottom_copy.cpu_data(),
+               this->blob_bottom_.mutable_cpu_data());
+    caffe_copy(cont_copy.count(), cont_copy.cpu_data(),
+               this->blob_bottom_cont_.mutable_cpu_data());
+  }
+}
+
 }  // namespace caffe
@@ -1,3 +1,4 @@
+#include <algorithm>
 #include <string>
 #include <utility>
 #include <vector>
@@ -629,6 +630,160 @@ class NetTest : public MultiDeviceTest<TypeParam> {
     InitNetFromProtoString(proto);
   }
 
+  virtual void InitConcatNet(const bool share_concat_inputs,
+      const bool forward_only = false) {
+    string proto =
+        "name: 'ConcatNetwork' "
+        "layer { "
+        "  name: 'data' "
+        "  type: 'Input' "
+        "  top: 'data' "
+        "  input_param { "
+        "    shape: { dim: 2 dim: 4 } "
+        "  } "
+        "} ";
+    // Three branches, the outputs of two concatenated and the result
+    // concatenated with the third, along the batch axis.
+    const char* branches[] = {"a", "b", "c"};
+    for (int i = 0; i < 3; ++i) {
+      proto += string(
+        "layer { "
+        "  name: 'ip_") + branches[i] + "' "
+        "  type: 'InnerProduct' "
+        "  bottom: 'data' "
+        "  top: '" + branches[i] + "' "
+        "  inner_product_param { "
+        "    num_output: 3 "
+        "    weight_filler { "
+        "      type: 'gaussian' "
+        "      std: 1 "
+        "    } "
+        "    bias_filler { "
+        "      type: 'constant' "
+        "      value: 0.5 "
+        "    } "
+        "  } "
+        "} "
+        "layer { "
+        "  name: 'tanh_" + branches[i] + "' "
+        "  type: 'TanH' "
+        "  bottom: '" + branches[i] + "' "
+        "  top: '" + branches[i] + "' "
+        "} ";
+    }
+    proto +=
+        "layer { "
+        "  name: 'concat_ab' "
+        "  type: 'Concat' "
+        "  bottom: 'a' "
+        "  bottom: 'b' "
+        "  top: 'ab' "
+        "  concat_param { "
+        "    axis: 0 "
+        "  } "
+        "} "
+        "layer { "
+        "  name: 'concat_abc' "
+        "  type: 'Concat' "
+        "  bottom: 'ab' "
+        "  bottom: 'c' "
+        "  top: 'abc' "
+        "  concat_param { "
+        "    axis: 0 "
+        "  } "
+        "} "
+        "layer { "
+        "  name: 'ip' "
+        "  type: 'InnerProduct' "
+        "  bottom: 'abc' "
+        "  top: 'ip' "
+        "  inner_product_param { "
+        "    num_output: 2 "
+        "    weight_filler { "
+        "      type: 'gaussian' "
+        "      std: 1 "
+        "    } "
+        "  } "
+        "} "
+        "layer { "
+        "  name: 'loss' "
+        "  type: 'Reduction' "
+        "  bottom: 'ip' "
+        "  top: 'loss' "
+        "  reduction_param { "
+        "    operation: SUMSQ "
+        "  } "
+        "  loss_weight: 1 "
+        "} ";
+    if (!share_concat_inputs) {
+      proto += "share_concat_inputs: false ";
+    }
+    if (forward_only) {
+      proto += "forward_only: true ";
+    }
+    InitNetFromProtoString(proto);
+  }
+
+  virtual void InitForwardOnlyNet(const bool forward_only) {
+    string proto =
+        "name: 'ForwardOnlyNetwork' "
+        "layer { "
+        "  name: 'data' "
+        "  type: 'Input' "
+        "  top: 'data' "
+        "  input_param { "
+        "    shape: { dim: 4 dim: 3 } "
+        "  } "
+        "} "
+        "layer { "
+        "  name: 'slice' "
+        "  type: 'Slice' "
+        "  bottom: 'data' "
+        "  top: 'a' "
+        "  top: 'b' "
+        "  slice_param { "
+        "    axis: 0 "
+        "  } "
+        "} "
+        "layer { "
+        "  name: 'ip_a' "
+        "  type: 'InnerProduct' "
+        "  bottom: 'a' "
+        "  top: 'ip_a' "
+        "  inner_product_param { "
+        "    num_output: 2 "
+        "    weight_filler { "
+        "      type: 'gaussian' "
+        "      std: 1 "
+        "    } "
+        "  } "
+        "} "
+        "layer { "
+        "  name: 'tanh_b' "
+        "  type: 'TanH' "
+        "  bottom: 'b' "
+        "  top: 'b' "
+        "} "
+        "layer { "
+        "  name: 'ip_data' "
+        "  type: 'InnerProduct' "
+        "  bottom: 'data' "
+        "  top: 'ip_data' "
+        "  inner_product_param { "
+        "    num_output: 2 "
+        "    weight_filler { "
+        "      type: 'gaussian' "
+        "      std: 1 "
+        "    } "
+        "  } "
+        "} "
+        "state { phase: TEST } ";
+    if (forward_only) {
+      proto += "forward_only: true ";
+    }
+    InitNetFromProtoString(proto);
+  }
+
   virtual void InitSkipPropNet(bool test_skip_true) {
     string proto =
       "name: 'SkipPropTestNetwork' "
@@ -1297,6 +1452,79 @@ TYPED_TEST(NetTest, TestSharedWeightsUpdate) {
   }
 }
 
+TYPED_TEST(NetTest, TestSharedSparseWeightsRecordRows) {
+  typedef typename TypeParam::Dtype Dtype;
+  // Two Embed layers tie a row-sparse weight; only the first asks for it.
+  const string& proto =
+      "name: 'SparseSharedWeights' "
+      "layer { "
+      "  name: 'data' "
+      "  type: 'DummyData' "
+      "  dummy_data_param { "
+      "    shape { dim: 2 } "
+      "    data_filler { type: 'constant' value: 1 } "
+      "    shape { dim: 2 } "
+      "    data_filler { type: 'constant' value: 3 } "
+      "  } "
+      "  top: 'index1' "
+      "  top: 'index2' "
+      "} "
+      "layer { "
+      "  name: 'embed1' "
+      "  type: 'Embed' "
+      "  embed_param { "
+      "    num_output: 2 input_dim: 5 bias_term: false sparse_update: true "
+      "    weight_filler { type: 'gaussian' } "
+      "  } "
+      "  param { name: 'w' } "
+      "  bottom: 'index1' "
+      "  top: 'embed1' "
+      "} "
+      "layer { "
+      "  name: 'embed2' "
+      "  type: 'Embed' "
+      "  embed_param { "
+      "    num_output: 2 input_dim: 5 bias_term: false "
+      "  } "
+      "  param { name: 'w' } "
+      "  bottom: 'index2' "
+      "  top: 'embed2' "
+      "} "
+      "layer { "
+      "  name: 'loss1' "
+      "  type: 'Reduction' "
+      "  bottom: 'embed1' "
+      "  top: 'loss1' "
+      "  loss_weight: 1 "
+      "} "
+      "layer { "
+      "  name: 'loss2' "
+      "  type: 'Reduction' "
+      "  bottom: 'embed2' "
+      "  top: 'loss2' "
+      "  loss_weight: 1 "
+      "} ";
+  this->InitNetFromProtoString(proto);
+  Blob<Dtype>* weights = this->net_->layer_by_name("embed2")->blobs()[0].get();
+  ASSERT_TRUE(weights->sparse_diff());
+  this->net_->ClearParamDiffs();
+  this->net_->Forward();
+  this->net_->Backward();
+  // Both layers record the rows they write to the shared diff; rows are only
+  // tracked on the CPU.
+  if (Caffe::mode() != Caffe::CPU) { return; }
+  vector<int> rows = weights->diff_rows();
+  std::sort(rows.begin(), rows.end());
+  ASSERT_EQ(2, rows.size());
+  EXPECT_EQ(1, rows[0]);
+  EXPECT_EQ(3, rows[1]);
+  // Each row is looked up by both items of its layer's batch.
+  for (int i = 0; i < 2; ++i) {
+    EXPECT_EQ(2, weights->cpu_diff()[1 * 2 + i]);
+    EXPECT_EQ(2, weights->cpu_diff()[3 * 2 + i]);
+  }
+}
+
 TYPED_TEST(NetTest, TestSharedWeightsResume) {
   typedef typename TypeParam::Dtype Dtype;
 
@@ -2446,6 +2674,286 @@ TYPED_TEST(NetTest, TestReshape) {
   EXPECT_FALSE(same_spatial_shape);
 }
 
+TYPED_TEST(NetTest, TestForwardOnlyDropsDiffs) {
+  typedef typename TypeParam::Dtype Dtype;
+  this->InitForwardOnlyNet(true);
+  for (int i = 0; i < this->net_->blobs().size(); ++i) {
+    EXPECT_TRUE(this->net_->blobs()[i]->inference_only())
+        << this->net_->blob_names()[i];
+  }
+  for (int i = 0; i < this->net_->params().size(); ++i) {
+    EXPECT_TRUE(this->net_->params()[i]->inference_only());
+  }
+  this->net_->Forward();
+  this->net_->ClearParamDiffs();
+
+  // Loss weights live in the diff of the loss, which is kept.
+  const string proto =
+      "name: 'ForwardOnlyLossNetwork' "
+      "layer { "
+      "  name: 'data' "
+      "  type: 'Input' "
+      "  top: 'data' "
+      "  top: 'target' "
+      "  input_param { "
+      "    shape: { dim: 4 dim: 3 } "
+      "    shape: { dim: 4 dim: 2 } "
+      "  } "
+      "} "
+      "layer { "
+      "  name: 'ip' "
+      "  type: 'InnerProduct' "
+      "  bottom: 'data' "
+      "  top: 'ip' "
+      "  inner_product_param { "
+      "    num_output: 2 "
+      "    weight_filler { "
+      "      type: 'gaussian' "
+      "      std: 1 "
+      "    } "
+      "  } "
+      "} "
+      "layer { "
+      "  name: 'loss' "
+      "  type: 'EuclideanLoss' "
+      "  bottom: 'ip' "
+      "  bottom: 'target' "
+      "  top: 'loss' "
+      "} "
+      "state { phase: TEST } ";
+  Caffe::set_random_seed(this->seed_);
+  this->InitNetFromProtoString(proto);
+  shared_ptr<Net<Dtype> > full_net = this->net_;
+  Caffe::set_random_seed(this->seed_);
+  this->InitNetFromProtoString(proto + "forward_only: true ");
+  shared_ptr<Net<Dtype> > forward_net = this->net_;
+  EXPECT_FALSE(forward_net->blob_by_name("loss")->inference_only());
+  EXPECT_TRUE(forward_net->blob_by_name("ip")->inference_only());
+  FillerParameter filler_param;
+  filler_param.set_std(1);
+  GaussianFiller<Dtype> filler(filler_param);
+  for (int i = 0; i < 2; ++i) {
+    Blob<Dtype>* input = full_net->input_blobs()[i];
+    filler.Fill(input);
+    forward_net->input_blobs()[i]->CopyFrom(*input);
+  }
+  Dtype full_loss, loss;
+  full_net->Forward(&full_loss);
+  forward_net->Forward(&loss);
+  EXPECT_EQ(full_loss, loss);
+
+  // Empty inputs have not allocated a diff to drop.
+  this->InitNetFromProtoString(
+      "name: 'EmptyInputNetwork' "
+      "layer { "
+      "  name: 'data' "
+      "  type: 'Input' "
+      "  top: 'data' "
+      "  input_param { "
+      "    shape: { dim: 0 dim: 3 } "
+      "  } "
+      "} "
+      "state { phase: TEST } "
+      "forward_only: true ");
+  EXPECT_TRUE(this->net_->blob_by_name("data")->inference_only());
+}
+
+TYPED_TEST(NetTest, TestIncrementalReshape) {
+  typedef typename TypeParam::Dtype Dtype;
+  // Reshape skips the layers whose bottom shapes did not change, and
+  // reshapes everything downstream of an input whose shape did.
+  Caffe::set_random_seed(this->seed_);
+  Caffe::set_mode(Caffe::CPU);
+  this->InitReshapableNet();
+  shared_ptr<Blob<Dtype> > input_blob = this->net_->blob_by_name("data");
+  shared_ptr<Blob<Dtype> > norm_blob = this->net_->blob_by_name("norm1");
+  shared_ptr<Blob<Dtype> > softmax_blob = this->net_->blob_by_name("softmax");
+  input_blob->Reshape(2, 3, 12, 10);
+  this->net_->Forward();
+  EXPECT_EQ(norm_blob->shape(), softmax_blob->shape());
+
+  // Nothing changed, so the softmax layer is not reshaped and its top keeps
+  // the shape it was given by hand.
+  softmax_blob->Reshape(1, 1, 1, 1);
+  this->net_->Reshape();
+  EXPECT_EQ(1, softmax_blob->count());
+
+  // A new input shape reaches every layer.
+  input_blob->Reshape(4, 3, 9, 11);
+  this->net_->Reshape();
+  EXPECT_EQ(4, norm_blob->num());
+  EXPECT_EQ(norm_blob->shape(), softmax_blob->shape());
+
+  // Going there and back without a forward pass leaves the outputs as they
+  // were for the first shape.
+  FillerParameter filler_param;
+  filler_param.set_std(1);
+  GaussianFiller<Dtype> filler(filler_param);
+  input_blob->Reshape(2, 3, 12, 10);
+  filler.Fill(input_blob.get());
+  Blob<Dtype> input_copy;
+  input_copy.CopyFrom(*input_blob, false, true);
+  this->net_->Forward();
+  Blob<Dtype> output;
+  output.CopyFrom(*softmax_blob, false, true);
+  input_blob->Reshape(4, 3, 9, 11);
+  this->net_->Reshape();
+  input_blob->CopyFrom(input_copy, false, true);
+  this->net_->Reshape();
+  this->net_->Forward();
+  ASSERT_EQ(output.shape(), softmax_blob->shape());
+  for (int i = 0; i < output.count(); ++i) {
+    EXPECT_FLOAT_EQ(output.cpu_data()[i], softmax_blob->cpu_data()[i]);
+  }
+}
+
+TYPED_TEST(NetTest, TestForwardOnly) {
+  typedef typename TypeParam::Dtype Dtype;
+  Caffe::set_random_seed(this->seed_);
+  this->InitForwardOnlyNet(false);
+  shared_ptr<Net<Dtype> > full_net = this->net_;
+  Caffe::set_random_seed(this->seed_);
+  this->InitForwardOnlyNet(true);
+  shared_ptr<Net<Dtype> > forward_net = this->net_;
+  // The split of data is left out, and the slice output computed in place
+  // keeps its own memory.
+  EXPECT_EQ(full_net->layers().size(), forward_net->layers().size() + 1);
+  const SyncedMemory& data = *forward_net->blob_by_name("data")->data();
+  EXPECT_TRUE(forward_net->blob_by_name("a")->data()->is_view_of(data, 0));
+  EXPECT_FALSE(forward_net->blob_by_name("b")->data()->base());
+  FillerParameter filler_param;
+  filler_param.set_std(1);
+  GaussianFiller<Dtype> filler(filler_param);
+  Blob<Dtype> input(4, 3, 1, 1);
+  filler.Fill(&input);
+  caffe_copy(input.count(), input.cpu_data(),
+      full_net->input_blobs()[0]->mutable_cpu_data());
+  caffe_copy(input.count(), input.cpu_data(),
+      forward_net->input_blobs()[0]->mutable_cpu_data());
+  full_net->Forward();
+  forward_net->Forward();
+  const char* blob_names[] = {"data", "a", "b", "ip_a", "ip_data"};
+  for (int i = 0; i < 5; ++i) {
+    const Blob<Dtype>& expected = *full_net->blob_by_name(blob_names[i]);
+    const Blob<Dtype>& actual = *forward_net->blob_by_name(blob_names[i]);
+    ASSERT_EQ(expected.count(), actual.count());
+    for (int j = 0; j < expected.count(); ++j) {
+      EXPECT_EQ(expected.cpu_data()[j], actual.cpu_data()[j])
+          << "blob " << blob_names[i];
+    }
+  }
+}
+
+TYPED_TEST(NetTest, TestForwardOnlyViewsWithoutDiffs) {
+  typedef typename TypeParam::Dtype Dtype;
+  // Slice outputs and concat inputs stay views of their blob on every pass
+  // once the diffs are dropped, as each Forward reshapes the layers again.
+  Caffe::set_random_seed(this->seed_);
+  this->InitForwardOnlyNet(false);
+  shared_ptr<Net<Dtype> > slice_net = this->net_;
+  Caffe::set_random_seed(this->seed_);
+  this->InitForwardOnlyNet(true);
+  shared_ptr<Net<Dtype> > forward_slice_net = this->net_;
+  Caffe::set_random_seed(this->seed_);
+  this->InitConcatNet(true);
+  shared_ptr<Net<Dtype> > concat_net = this->net_;
+  Caffe::set_random_seed(this->seed_);
+  this->InitConcatNet(true, true);
+  shared_ptr<Net<Dtype> > forward_concat_net = this->net_;
+  Net<Dtype>* nets[][2] = {
+      {slice_net.get(), forward_slice_net.get()},
+      {concat_net.get(), forward_concat_net.get()}};
+  const char* views[][2] = {{"a", "data"}, {"a", "abc"}};
+  const char* outputs[] = {"ip_data", "loss"};
+  FillerParameter filler_param;
+  filler_param.set_std(1);
+  GaussianFiller<Dtype> filler(filler_param);
+  for (int n = 0; n < 2; ++n) {
+    Net<Dtype>* forward_net = nets[n][1];
+    ASSERT_FALSE(forward_net->blob_by_name(views[n][0])->has_diff());
+    for (int pass = 0; pass < 2; ++pass) {
+      Blob<Dtype>* input = nets[n][0]->input_blobs()[0];
+      filler.Fill(input);
+      forward_net->input_blobs()[0]->CopyFrom(*input);
+      nets[n][0]->Forward();
+      forward_net->Forward();
+      EXPECT_TRUE(forward_net->blob_by_name(views[n][0])->data()->is_view_of(
+          *forward_net->blob_by_name(views[n][1])->data(), 0));
+      const Blob<Dtype>& expected = *nets[n][0]->blob_by_name(outputs[n]);
+      const Blob<Dtype>& actual = *forward_net->blob_by_name(outputs[n]);
+      ASSERT_EQ(expected.count(), actual.count());
+      for (int j = 0; j < expected.count(); ++j) {
+        EXPECT_EQ(expected.cpu_data()[j], actual.cpu_data()[j])
+            << "net " << n << " pass " << pass;
+      }
+    }
+  }
+}
+
+TYPED_TEST(NetTest, TestShareConcatInputs) {
+  typedef typename TypeParam::Dtype Dtype;
+  Caffe::set_random_seed(this->seed_);
+  this->InitConcatNet(false);
+  shared_ptr<Net<Dtype> > copy_net = this->net_;
+  Caffe::set_random_seed(this->seed_);
+  this->InitConcatNet(true);
+  shared_ptr<Net<Dtype> > share_net = this->net_;
+  const SyncedMemory& abc = *share_net->blob_by_name("abc")->data();
+  EXPECT_TRUE(share_net->blob_by_name("a")->data()->is_view_of(abc, 0));
+  EXPECT_TRUE(share_net->blob_by_name("b")->data()->is_view_of(abc,
+      6 * sizeof(Dtype)));
+  EXPECT_TRUE(share_net->blob_by_name("c")->data()->is_view_of(abc,
+      12 * sizeof(Dtype)));
+  EXPECT_FALSE(copy_net->blob_by_name("a")->data()->base());
+  // The nets must agree in every pass, including after the batch size
+  // changes without and with a call to Reshape.
+  FillerParameter filler_param;
+  filler_param.set_std(1);
+  GaussianFiller<Dtype> filler(filler_param);
+  const int batch_sizes[] = {2, 3, 3, 2};
+  for (int pass = 0; pass < 4; ++pass) {
+    vector<int> shape(2, 4);
+    shape[0] = batch_sizes[pass];
+    Blob<Dtype> data(shape);
+    filler.Fill(&data);
+    Net<Dtype>* nets[] = {copy_net.get(), share_net.get()};
+    for (int n = 0; n < 2; ++n) {
+      Blob<Dtype>* input = nets[n]->input_blobs()[0];
+      input->ReshapeLike(data);
+      caffe_copy(data.count(), data.cpu_data(), input->mutable_cpu_data());
+      if (pass == 2) {
+        nets[n]->Reshape();
+      }
+      nets[n]->ClearParamDiffs();
+      nets[n]->Forward();
+      nets[n]->Backward();
+    }
+    const vector<string>& blob_names = copy_net->blob_names();
+    for (int i = 0; i < blob_names.size(); ++i) {
+      const Blob<Dtype>& expected = *copy_net->blob_by_name(blob_names[i]);
+      const Blob<Dtype>& actual = *share_net->blob_by_name(blob_names[i]);
+      ASSERT_EQ(expected.shape(), actual.shape());
+      for (int j = 0; j < expected.count(); ++j) {
+        EXPECT_EQ(expected.cpu_data()[j], actual.cpu_data()[j])
+            << "pass " << pass << ", blob " << blob_names[i];
+        EXPECT_EQ(expected.cpu_diff()[j], actual.cpu_diff()[j])
+            << "pass " << pass << ", blob " << blob_names[i];
+      }
+    }
+    const vector<Blob<Dtype>*>& params = copy_net->learnable_params();
+    for (int i = 0; i < params.size(); ++i) {
+      const Blob<Dtype>& actual = *share_net->learnable_params()[i];
+      for (int j = 0; j < params[i]->count(); ++j) {
+        EXPECT_EQ(params[i]->cpu_diff()[j], actual.cpu_diff()[j]);
+      }
+    }
+  }
+  // Reshape places the inputs again, in the new layout.
+  share_net->Reshape();
+  EXPECT_TRUE(share_net->blob_by_name("c")->data()->is_view_of(
+      *share_net->blob_by_name("abc")->data(), 12 * sizeof(Dtype)));
+}
+
 TYPED_TEST(NetTest, TestSkipPropagateDown) {
   // check bottom_need_backward if propagate_down is true
   this->InitSkipPropNet(false);
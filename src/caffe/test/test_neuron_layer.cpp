@@ -587,6 +587,17 @@ TYPED_TEST(NeuronLayerTest, TestDropoutTestPhase) {
   }
 }
 
+TYPED_TEST(NeuronLayerTest, TestDropoutTestPhaseShares) {
+  typedef typename TypeParam::Dtype Dtype;
+  LayerParameter layer_param;
+  layer_param.set_phase(TEST);
+  DropoutLayer<Dtype> layer(layer_param);
+  layer.SetUp(this->blob_bottom_vec_, this->blob_top_vec_);
+  layer.Forward(this->blob_bottom_vec_, this->blob_top_vec_);
+  EXPECT_EQ(this->blob_top_->cpu_data(), this->blob_bottom_->cpu_data());
+  EXPECT_EQ(this->blob_top_->cpu_diff(), this->blob_bottom_->cpu_diff());
+}
+
 TYPED_TEST(NeuronLayerTest, TestDropoutGradient) {
   typedef typename TypeParam::Dtype Dtype;
   LayerParameter layer_param;
@@ -1,10 +1,12 @@
 #include <cmath>
+#include <vector>
 
 #include "gtest/gtest.h"
 
 #include "caffe/common.hpp"
 #include "caffe/syncedmem.hpp"
 #include "caffe/util/math_functions.hpp"
+#include "caffe/util/philox.hpp"
 
 #include "caffe/test/test_caffe_main.hpp"
 
@@ -395,6 +397,67 @@ TYPED_TEST(RandomNumberGeneratorTest, TestRngBernoulliTimesBernoulli) {
   EXPECT_NEAR(true_mean, sample_p, bound);
 }
 
+TYPED_TEST(RandomNumberGeneratorTest, TestRngThreadsReproducible) {
+  // Enough values to be spread over several threads.
+  const int n = 3 * (1 << 16) + 5;
+  vector<TypeParam> one_thread(n), four_threads(n);
+  vector<int> bernoulli_one(n), bernoulli_four(n);
+  Caffe::set_rng_threads(1);
+  Caffe::set_random_seed(this->seed_);
+  caffe_rng_gaussian(n, TypeParam(0), TypeParam(1), &one_thread[0]);
+  caffe_rng_bernoulli(n, TypeParam(0.3), &bernoulli_one[0]);
+  Caffe::set_rng_threads(4);
+  Caffe::set_random_seed(this->seed_);
+  caffe_rng_gaussian(n, TypeParam(0), TypeParam(1), &four_threads[0]);
+  caffe_rng_bernoulli(n, TypeParam(0.3), &bernoulli_four[0]);
+  Caffe::set_rng_threads(0);
+  for (int i = 0; i < n; ++i) {
+    EXPECT_EQ(one_thread[i], four_threads[i]);
+    EXPECT_EQ(bernoulli_one[i], bernoulli_four[i]);
+  }
+}
+
+TEST(PhiloxTest, TestKnownAnswers) {
+  // Known answers of Philox4x32-10 from the Random123 distribution.
+  const uint32_t keys[][2] = {
+    {0x00000000, 0x00000000},
+    {0xffffffff, 0xffffffff},
+    {0xa4093822, 0x299f31d0},
+  };
+  const uint32_t counters[][4] = {
+    {0x00000000, 0x00000000, 0x00000000, 0x00000000},
+    {0xffffffff, 0xffffffff, 0xffffffff, 0xffffffff},
+    {0x243f6a88, 0x85a308d3, 0x13198a2e, 0x03707344},
+  };
+  const uint32_t expected[][4] = {
+    {0x6627e8d5, 0xe169c58d, 0xbc57ac4c, 0x9b00dbd8},
+    {0x408f276d, 0x41c83b0e, 0xa20bc7c6, 0x6d5451fd},
+    {0xd16cfe09, 0x94fdcceb, 0x5001e420, 0x24126ea1},
+  };
+  for (int i = 0; i < 3; ++i) {
+    uint32_t out[4];
+    philox4x32(keys[i], counters[i], out);
+    for (int j = 0; j < 4; ++j) {
+      EXPECT_EQ(expected[i][j], out[j]);
+    }
+  }
+}
+
+TEST(PhiloxTest, TestBernoulliWord) {
+  const uint32_t key[2] = {1701, 0};
+  const uint32_t threshold = 0xC0000000u;
+  uint32_t r[4];
+  for (uint32_t word = 0; word < 4; ++word) {
+    const uint32_t bits = philox_bernoulli_word(key, word, threshold);
+    for (int b = 0; b < 32; ++b) {
+      const uint32_t element = word * 32 + b;
+      const uint32_t counter[4] = {element / 4, 0, 0, 0};
+      philox4x32(key, counter, r);
+      EXPECT_EQ(r[element % 4] > threshold ? 1u : 0u, (bits >> b) & 1);
+    }
+  }
+}
+
 #ifndef CPU_ONLY
 
 TYPED_TEST(RandomNumberGeneratorTest, TestRngGaussianGPU) {
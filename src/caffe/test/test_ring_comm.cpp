@@ -0,0 +1,173 @@
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <boost/thread.hpp>
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "caffe/common.hpp"
+#include "caffe/proto/caffe.pb.h"
+#include "caffe/util/format.hpp"
+#include "caffe/util/gradient_codec.hpp"
+#include "caffe/util/ring_comm.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+template <typename Dtype>
+class RingCommTest : public ::testing::Test {
+ protected:
+  RingCommTest() : size_(3) {}
+
+  // Returns a port of the loopback interface that nothing listens on.
+  static int FreePort() {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    CHECK_GE(fd, 0);
+    sockaddr_in addr = sockaddr_in();
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    CHECK_EQ(bind(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)), 0);
+    socklen_t length = sizeof(addr);
+    CHECK_EQ(getsockname(fd, reinterpret_cast<sockaddr*>(&addr), &length), 0);
+    close(fd);
+    return ntohs(addr.sin_port);
+  }
+
+  static Dtype Value(int rank, size_t i) {
+    return Dtype((rank + 1) * (i % 7));
+  }
+
+  static void RunRank(const string& uri, int rank, int size, size_t count,
+      vector<Dtype>* reduced, vector<Dtype>* broadcast) {
+    RingComm<Dtype> comm(uri, rank, size);
+    reduced->resize(count);
+    broadcast->resize(count);
+    for (size_t i = 0; i < count; ++i) {
+      (*reduced)[i] = Value(rank, i);
+      (*broadcast)[i] = Value(rank, i);
+    }
+    comm.AllReduce(&(*reduced)[0], count);
+    comm.Broadcast(&(*broadcast)[0], count);
+  }
+
+  // Runs every rank on a thread and checks the results of all of them.
+  void TestCollectives(const string& uri, size_t count) {
+    vector<vector<Dtype> > reduced(size_);
+    vector<vector<Dtype> > broadcast(size_);
+    boost::thread_group threads;
+    for (int rank = 0; rank < size_; ++rank) {
+      threads.create_thread(boost::bind(&RingCommTest::RunRank, uri, rank,
+          size_, count, &reduced[rank], &broadcast[rank]));
+    }
+    threads.join_all();
+    for (int rank = 0; rank < size_; ++rank) {
+      for (size_t i = 0; i < count; ++i) {
+        Dtype sum = 0;
+        for (int r = 0; r < size_; ++r) {
+          sum += Value(r, i);
+        }
+        EXPECT_EQ(sum, reduced[rank][i]);
+        EXPECT_EQ(Value(0, i), broadcast[rank][i]);
+      }
+    }
+  }
+
+  static void RunCompressedRank(const string& uri, int rank, int size,
+      size_t count, SolverParameter_GradientCompression compression,
+      vector<Dtype>* reduced, size_t* bytes_sent) {
+    SolverParameter param;
+    param.set_gradient_compression(compression);
+    param.set_gradient_topk_ratio(1);
+    shared_ptr<GradientCodec<Dtype> > codec(
+        GetGradientCodec<Dtype>(param, count));
+    RingComm<Dtype> comm(uri, rank, size);
+    reduced->resize(count);
+    for (size_t i = 0; i < count; ++i) {
+      // Values every codec encodes exactly
+      (*reduced)[i] = i % 2 ? rank + 1 : -(rank + 1);
+    }
+    comm.AllReduce(&(*reduced)[0], count, 0, codec.get());
+    *bytes_sent = comm.bytes_sent();
+  }
+
+  // Checks the sums of a compressed allreduce, and returns the bytes sent
+  // by rank 0.
+  size_t TestCompressed(SolverParameter_GradientCompression compression,
+      size_t count) {
+    vector<vector<Dtype> > reduced(size_);
+    vector<size_t> bytes_sent(size_);
+    boost::thread_group threads;
+    for (int rank = 0; rank < size_; ++rank) {
+      threads.create_thread(boost::bind(&RingCommTest::RunCompressedRank,
+          ShmUri(), rank, size_, count, compression, &reduced[rank],
+          &bytes_sent[rank]));
+    }
+    threads.join_all();
+    const Dtype sum = size_ * (size_ + 1) / 2;
+    for (int rank = 0; rank < size_; ++rank) {
+      for (size_t i = 0; i < count; ++i) {
+        EXPECT_EQ(i % 2 ? sum : -sum, reduced[rank][i]);
+      }
+    }
+    return bytes_sent[0];
+  }
+
+  string TCPUri() const {
+    return "tcp://127.0.0.1:" + format_int(FreePort());
+  }
+  string ShmUri() const {
+    return "shm:///caffe_test_ring_" + format_int(getpid());
+  }
+
+  int size_;
+};
+
+TYPED_TEST_CASE(RingCommTest, TestDtypes);
+
+TYPED_TEST(RingCommTest, TestTCP) {
+  this->TestCollectives(this->TCPUri(), 1001);
+}
+
+TYPED_TEST(RingCommTest, TestTCPLarge) {
+  this->TestCollectives(this->TCPUri(), 300000);
+}
+
+TYPED_TEST(RingCommTest, TestTCPFewerValuesThanRanks) {
+  this->TestCollectives(this->TCPUri(), 2);
+}
+
+TYPED_TEST(RingCommTest, TestShm) {
+  this->TestCollectives(this->ShmUri(), 1001);
+}
+
+TYPED_TEST(RingCommTest, TestShmLarge) {
+  // Larger than a slot, so sent in several pieces.
+  this->TestCollectives(this->ShmUri(), 300000);
+}
+
+TYPED_TEST(RingCommTest, TestFP16) {
+  const size_t count = 100001;
+  const size_t bytes = this->TestCompressed(
+      SolverParameter_GradientCompression_FP16, count);
+  // Half of the 2 (N - 1) / N * count values of uncompressed ring allreduce
+  EXPECT_LE(bytes, 2 * (this->size_ - 1) * (count / this->size_ + 1) * 2);
+}
+
+TYPED_TEST(RingCommTest, TestTopK) {
+  this->TestCompressed(SolverParameter_GradientCompression_TOPK, 1001);
+}
+
+TYPED_TEST(RingCommTest, TestSign) {
+  const size_t count = 100001;
+  const size_t bytes = this->TestCompressed(
+      SolverParameter_GradientCompression_SIGN, count);
+  // Every rank forwards N - 1 messages of count bits
+  EXPECT_LE(bytes, (this->size_ - 1) * (count / 8 + 32));
+}
+
+}  // namespace caffe
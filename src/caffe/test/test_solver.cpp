@@ -43,6 +43,22 @@ class SolverTest : public MultiDeviceTest<TypeParam> {
 
 TYPED_TEST_CASE(SolverTest, TestDtypesAndDevices);
 
+// Counts the calls to Regularize, which the fused CPU update would bypass.
+template <typename Dtype>
+class RegularizeCountingSolver : public SGDSolver<Dtype> {
+ public:
+  explicit RegularizeCountingSolver(const SolverParameter& param)
+      : SGDSolver<Dtype>(param), num_regularized_(0) {}
+
+  int num_regularized_;
+
+ protected:
+  virtual void Regularize(int param_id) {
+    ++num_regularized_;
+    SGDSolver<Dtype>::Regularize(param_id);
+  }
+};
+
 TYPED_TEST(SolverTest, TestInitTrainTestNets) {
   const string& proto =
      "test_interval: 10 "
@@ -106,4 +122,107 @@ TYPED_TEST(SolverTest, TestInitTrainTestNets) {
   EXPECT_TRUE(this->solver_->test_nets()[1]->has_layer("accuracy"));
 }
 
+TYPED_TEST(SolverTest, TestAsyncTestCopiesWeights) {
+  typedef typename TypeParam::Dtype Dtype;
+  const string& proto =
+     "test_interval: 2 "
+     "test_iter: 3 "
+     "test_async: true "
+     "max_iter: 4 "
+     "base_lr: 0.01 "
+     "lr_policy: 'fixed' "
+     "snapshot_after_train: false "
+     "net_param { "
+     "  name: 'TestNetwork' "
+     "  layer { "
+     "    name: 'data' "
+     "    type: 'DummyData' "
+     "    dummy_data_param { "
+     "      shape { dim: 5 dim: 3 } "
+     "      shape { dim: 5 } "
+     "      data_filler { type: 'gaussian' } "
+     "    } "
+     "    top: 'data' "
+     "    top: 'label' "
+     "  } "
+     "  layer { "
+     "    name: 'innerprod' "
+     "    type: 'InnerProduct' "
+     "    inner_product_param { "
+     "      num_output: 4 "
+     "      weight_filler { type: 'gaussian' } "
+     "    } "
+     "    bottom: 'data' "
+     "    top: 'innerprod' "
+     "  } "
+     "  layer { "
+     "    name: 'loss' "
+     "    type: 'SoftmaxWithLoss' "
+     "    bottom: 'innerprod' "
+     "    bottom: 'label' "
+     "  } "
+     "} ";
+  this->InitSolverFromProtoString(proto);
+  this->solver_->Solve();
+  // The test net holds its own copy of the weights, taken by the last test
+  // after the final update.
+  const Blob<Dtype>& weights =
+      *this->solver_->net()->layer_by_name("innerprod")->blobs()[0];
+  const Blob<Dtype>& test_weights =
+      *this->solver_->test_nets()[0]->layer_by_name("innerprod")->blobs()[0];
+  EXPECT_NE(weights.cpu_data(), test_weights.cpu_data());
+  for (int i = 0; i < weights.count(); ++i) {
+    EXPECT_EQ(weights.cpu_data()[i], test_weights.cpu_data()[i]);
+  }
+}
+
+TYPED_TEST(SolverTest, TestSubclassVirtualsCalled) {
+  typedef typename TypeParam::Dtype Dtype;
+  const string& proto =
+     "max_iter: 2 "
+     "base_lr: 0.01 "
+     "lr_policy: 'fixed' "
+     "weight_decay: 0.1 "
+     "update_threads: 2 "
+     "snapshot_after_train: false "
+     "net_param { "
+     "  name: 'TestNetwork' "
+     "  layer { "
+     "    name: 'data' "
+     "    type: 'DummyData' "
+     "    dummy_data_param { "
+     "      shape { dim: 5 dim: 3 } "
+     "      shape { dim: 5 } "
+     "      data_filler { type: 'gaussian' } "
+     "    } "
+     "    top: 'data' "
+     "    top: 'label' "
+     "  } "
+     "  layer { "
+     "    name: 'innerprod' "
+     "    type: 'InnerProduct' "
+     "    inner_product_param { "
+     "      num_output: 4 "
+     "      weight_filler { type: 'gaussian' } "
+     "    } "
+     "    bottom: 'data' "
+     "    top: 'innerprod' "
+     "  } "
+     "  layer { "
+     "    name: 'loss' "
+     "    type: 'SoftmaxWithLoss' "
+     "    bottom: 'innerprod' "
+     "    bottom: 'label' "
+     "  } "
+     "} ";
+  SolverParameter param;
+  CHECK(google::protobuf::TextFormat::ParseFromString(proto, &param));
+  param.set_solver_mode(Caffe::mode() == Caffe::CPU ?
+      SolverParameter_SolverMode_CPU : SolverParameter_SolverMode_GPU);
+  RegularizeCountingSolver<Dtype> solver(param);
+  solver.Solve();
+  // Two iterations over the weights and the bias.
+  EXPECT_EQ(4, solver.num_regularized_);
+}
+
 }  // namespace caffe
@@ -67,6 +67,29 @@ TEST_F(SyncedMemoryTest, TestCPUWrite) {
   }
 }
 
+TEST_F(SyncedMemoryTest, TestView) {
+  shared_ptr<SyncedMemory> base(new SyncedMemory(10));
+  shared_ptr<SyncedMemory> view(new SyncedMemory(base, 4, 6));
+  EXPECT_EQ(view->size(), 6);
+  EXPECT_EQ(view->base(), base.get());
+  EXPECT_EQ(view->offset(), 4);
+  EXPECT_TRUE(view->is_view_of(*base, 4));
+  EXPECT_FALSE(view->is_view_of(*base, 0));
+  caffe_memset(base->size(), 1, base->mutable_cpu_data());
+  caffe_memset(view->size(), 2, view->mutable_cpu_data());
+  EXPECT_EQ(view->head(), SyncedMemory::HEAD_AT_CPU);
+  const char* data = static_cast<const char*>(base->cpu_data());
+  for (int i = 0; i < base->size(); ++i) {
+    EXPECT_EQ(data[i], i < 4 ? 1 : 2);
+  }
+  // Views of views look into the memory at the bottom.
+  SyncedMemory nested(view, 1, 2);
+  EXPECT_EQ(nested.base(), base.get());
+  EXPECT_EQ(nested.offset(), 5);
+  EXPECT_TRUE(nested.is_view_of(*view, 1));
+  EXPECT_EQ(nested.cpu_data(), data + 5);
+}
+
 #ifndef CPU_ONLY  // GPU test
 
 TEST_F(SyncedMemoryTest, TestGPURead) {
@@ -0,0 +1,39 @@
+#include <boost/bind.hpp>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "caffe/util/worker_pool.hpp"
+
+#include "caffe/test/test_caffe_main.hpp"
+
+namespace caffe {
+
+class WorkerPoolTest : public ::testing::Test {};
+
+void CountPart(vector<int>* counts, int part) {
+  ++(*counts)[part];
+}
+
+TEST_F(WorkerPoolTest, TestRunsEveryPart) {
+  const int kNumThreads = 4;
+  WorkerPool pool(kNumThreads);
+  EXPECT_EQ(kNumThreads, pool.num_threads());
+  vector<int> counts(kNumThreads, 0);
+  // The pool is reused across calls.
+  for (int i = 1; i <= 3; ++i) {
+    pool.Run(boost::bind(&CountPart, &counts, _1));
+    for (int part = 0; part < kNumThreads; ++part) {
+      EXPECT_EQ(i, counts[part]);
+    }
+  }
+}
+
+TEST_F(WorkerPoolTest, TestSingleThread) {
+  WorkerPool pool(1);
+  vector<int> counts(1, 0);
+  pool.Run(boost::bind(&CountPart, &counts, _1));
+  EXPECT_EQ(1, counts[0]);
+}
+
+}  // namespace caffe
@@ -2,8 +2,10 @@
 #include <string>
 
 #include "caffe/layers/base_data_layer.hpp"
+#include "caffe/layers/hdf5_data_layer.hpp"
 #include "caffe/parallel.hpp"
 #include "caffe/util/blocking_queue.hpp"
+#include "caffe/util/snapshot_writer.hpp"
 
 namespace caffe {
 
@@ -85,7 +87,11 @@ size_t BlockingQueue<T>::size() const {
   return queue_.size();
 }
 
+template class BlockingQueue<int>;
 template class BlockingQueue<Batch<float>*>;
 template class BlockingQueue<Batch<double>*>;
+template class BlockingQueue<HDF5Chunk<float>*>;
+template class BlockingQueue<HDF5Chunk<double>*>;
+template class BlockingQueue<SnapshotData*>;
 
 }  // namespace caffe
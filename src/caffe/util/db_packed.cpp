@@ -0,0 +1,151 @@
+#include "caffe/util/db_packed.hpp"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cstring>
+#include <string>
+#include <vector>
+
+namespace caffe { namespace db {
+
+namespace {
+
+const char kDataFile[] = "/data.pack";
+const char kIndexFile[] = "/index.pack";
+
+// Maps a whole file read-only. Empty files are left unmapped.
+const void* MapFile(const string& path, size_t* size) {
+  int fd = open(path.c_str(), O_RDONLY);
+  CHECK_GE(fd, 0) << "Failed to open " << path;
+  struct stat st;
+  CHECK_EQ(fstat(fd, &st), 0) << "Failed to stat " << path;
+  *size = st.st_size;
+  void* addr = NULL;
+  if (*size > 0) {
+    addr = mmap(NULL, *size, PROT_READ, MAP_SHARED, fd, 0);
+    CHECK(addr != MAP_FAILED) << "Failed to mmap " << path;
+  }
+  close(fd);
+  return addr;
+}
+
+void UnmapFile(const void* addr, size_t size) {
+  if (addr != NULL) {
+    munmap(const_cast<void*>(addr), size);
+  }
+}
+
+}  // namespace
+
+void PackedCursor::Header(uint32_t* key_size, uint32_t* value_size) const {
+  DCHECK(pos_ < end_);
+  const char* record = data_ + offsets_[pos_];
+  // Records are not aligned, so the sizes are copied out rather than read.
+  uint32_t header[2];
+  memcpy(header, record, sizeof(header));  // NOLINT(caffe/alt_fn)
+  *key_size = header[0];
+  *value_size = header[1];
+}
+
+string PackedCursor::key() {
+  uint32_t key_size, value_size;
+  Header(&key_size, &value_size);
+  return string(data_ + offsets_[pos_] + 2 * sizeof(uint32_t), key_size);
+}
+
+string PackedCursor::value() {
+  uint32_t key_size, value_size;
+  Header(&key_size, &value_size);
+  return string(data_ + offsets_[pos_] + 2 * sizeof(uint32_t) + key_size,
+      value_size);
+}
+
+void PackedTransaction::Commit() {
+  db_->Append(keys_, values_);
+  keys_.clear();
+  values_.clear();
+}
+
+void PackedDB::Open(const string& source, Mode mode) {
+  const string data_path = source + kDataFile;
+  const string index_path = source + kIndexFile;
+  if (mode == NEW) {
+    CHECK_EQ(mkdir(source.c_str(), 0744), 0) << "mkdir " << source << " failed";
+  }
+  if (mode == READ) {
+    data_ = static_cast<const char*>(MapFile(data_path, &data_size_));
+    offsets_ = static_cast<const uint64_t*>(MapFile(index_path, &index_size_));
+    CHECK_EQ(index_size_ % sizeof(uint64_t), 0)
+        << "Truncated packed index " << index_path;
+  } else {
+    const char* file_mode = (mode == NEW) ? "wb" : "ab";
+    data_file_ = fopen(data_path.c_str(), file_mode);
+    CHECK(data_file_) << "Failed to open " << data_path;
+    index_file_ = fopen(index_path.c_str(), file_mode);
+    CHECK(index_file_) << "Failed to open " << index_path;
+    CHECK_EQ(fseek(data_file_, 0, SEEK_END), 0);
+    write_offset_ = ftell(data_file_);
+  }
+  LOG_IF(INFO, Caffe::root_solver()) << "Opened packed db " << source;
+}
+
+void PackedDB::Close() {
+  UnmapFile(data_, data_size_);
+  UnmapFile(offsets_, index_size_);
+  data_ = NULL;
+  offsets_ = NULL;
+  data_size_ = index_size_ = 0;
+  if (data_file_ != NULL) {
+    fclose(data_file_);
+    data_file_ = NULL;
+  }
+  if (index_file_ != NULL) {
+    fclose(index_file_);
+    index_file_ = NULL;
+  }
+}
+
+PackedCursor* PackedDB::NewCursor(size_t begin, size_t end) {
+  CHECK(offsets_ || num_records() == 0) << "Packed db is not open for reading";
+  CHECK_LE(begin, end);
+  CHECK_LE(end, num_records());
+  return new PackedCursor(data_, offsets_, begin, end);
+}
+
+PackedCursor* PackedDB::NewShardCursor(int shard, int num_shards) {
+  CHECK_GT(num_shards, 0);
+  CHECK_GE(shard, 0);
+  CHECK_LT(shard, num_shards);
+  const size_t count = num_records();
+  return NewCursor(count * shard / num_shards,
+      count * (shard + 1) / num_shards);
+}
+
+void PackedDB::Append(const vector<string>& keys,
+    const vector<string>& values) {
+  CHECK(data_file_ && index_file_) << "Packed db is not open for writing";
+  CHECK_EQ(keys.size(), values.size());
+  for (int i = 0; i < keys.size(); ++i) {
+    const uint32_t header[2] = {
+      static_cast<uint32_t>(keys[i].size()),
+      static_cast<uint32_t>(values[i].size())
+    };
+    CHECK_EQ(fwrite(header, sizeof(header), 1, data_file_), 1);
+    CHECK_EQ(fwrite(keys[i].data(), 1, keys[i].size(), data_file_),
+        keys[i].size());
+    CHECK_EQ(fwrite(values[i].data(), 1, values[i].size(), data_file_),
+        values[i].size());
+    CHECK_EQ(fwrite(&write_offset_, sizeof(write_offset_), 1, index_file_), 1);
+    write_offset_ += sizeof(header) + keys[i].size() + values[i].size();
+  }
+  // Flush data before the index so that a reader never sees an offset
+  // pointing past the end of the data file.
+  CHECK_EQ(fflush(data_file_), 0) << "Failed to write packed data";
+  CHECK_EQ(fflush(index_file_), 0) << "Failed to write packed index";
+}
+
+}  // namespace db
+}  // namespace caffe
@@ -0,0 +1,138 @@
+#include <boost/thread.hpp>
+
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "caffe/util/benchmark.hpp"
+#include "caffe/util/evaluator.hpp"
+
+namespace caffe {
+
+template <typename Dtype>
+void TestScores<Dtype>::Forward(Net<Dtype>* net) {
+  Dtype iter_loss;
+  const vector<Blob<Dtype>*>& result = net->Forward(&iter_loss);
+  loss_ += iter_loss;
+  int idx = 0;
+  for (int j = 0; j < result.size(); ++j) {
+    const Dtype* result_vec = result[j]->cpu_data();
+    for (int k = 0; k < result[j]->count(); ++k) {
+      if (iterations_ == 0) {
+        scores_.push_back(result_vec[k]);
+        output_ids_.push_back(j);
+      } else {
+        scores_[idx++] += result_vec[k];
+      }
+    }
+  }
+  ++iterations_;
+}
+
+template <typename Dtype>
+void TestScores<Dtype>::Log(const Net<Dtype>& net, bool compute_loss) const {
+  if (compute_loss) {
+    LOG(INFO) << "Test loss: " << loss_ / iterations_;
+  }
+  for (int i = 0; i < scores_.size(); ++i) {
+    const int output_blob_index = net.output_blob_indices()[output_ids_[i]];
+    const string& output_name = net.blob_names()[output_blob_index];
+    const Dtype loss_weight = net.blob_loss_weights()[output_blob_index];
+    std::ostringstream loss_msg_stream;
+    const Dtype mean_score = scores_[i] / iterations_;
+    if (loss_weight) {
+      loss_msg_stream << " (* " << loss_weight
+                      << " = " << loss_weight * mean_score << " loss)";
+    }
+    LOG(INFO) << "    Test net output #" << i << ": " << output_name << " = "
+              << mean_score << loss_msg_stream.str();
+  }
+}
+
+template <typename Dtype>
+Evaluator<Dtype>::Evaluator(const SolverParameter& param,
+    const Net<Dtype>& net, const vector<shared_ptr<Net<Dtype> > >& test_nets)
+    : param_(param), test_nets_(test_nets) {
+  // Match the layers by name, as Net::ShareTrainedLayersWith does.
+  const vector<shared_ptr<Layer<Dtype> > >& layers = net.layers();
+  for (int t = 0; t < test_nets_.size(); ++t) {
+    for (int i = 0; i < layers.size(); ++i) {
+      const string& layer_name = net.layer_names()[i];
+      if (!test_nets_[t]->has_layer(layer_name)) {
+        continue;
+      }
+      const vector<shared_ptr<Blob<Dtype> > >& source_blobs =
+          layers[i]->blobs();
+      const vector<shared_ptr<Blob<Dtype> > >& target_blobs =
+          test_nets_[t]->layer_by_name(layer_name)->blobs();
+      CHECK_EQ(target_blobs.size(), source_blobs.size())
+          << "Incompatible number of blobs for layer " << layer_name;
+      for (int j = 0; j < source_blobs.size(); ++j) {
+        CHECK(target_blobs[j]->shape() == source_blobs[j]->shape())
+            << "Cannot copy param " << j << " weights from layer '"
+            << layer_name << "'; shape mismatch.";
+        sources_.push_back(source_blobs[j].get());
+        targets_.push_back(target_blobs[j].get());
+      }
+    }
+  }
+  idle_.push(0);
+  StartInternalThread();
+}
+
+template <typename Dtype>
+Evaluator<Dtype>::~Evaluator() {
+  StopInternalThread();
+}
+
+template <typename Dtype>
+float Evaluator<Dtype>::Submit(int iter) {
+  CPUTimer timer;
+  timer.Start();
+  idle_.pop("Waiting for the previous test to finish");
+  const float wait_ms = timer.MilliSeconds();
+  for (int i = 0; i < sources_.size(); ++i) {
+    targets_[i]->CopyFrom(*sources_[i]);
+  }
+  pending_.push(iter);
+  return wait_ms;
+}
+
+template <typename Dtype>
+void Evaluator<Dtype>::Wait() {
+  idle_.push(idle_.pop());
+}
+
+template <typename Dtype>
+void Evaluator<Dtype>::InternalThreadEntry() {
+  try {
+    while (!must_stop()) {
+      Evaluate(pending_.pop());
+      idle_.push(0);
+    }
+  } catch (boost::thread_interrupted&) {
+    // Interrupted exception is expected on shutdown
+  }
+}
+
+template <typename Dtype>
+void Evaluator<Dtype>::Evaluate(int iter) {
+  for (int t = 0; t < test_nets_.size(); ++t) {
+    TestScores<Dtype> scores;
+    for (int i = 0; i < param_.test_iter(t); ++i) {
+      if (must_stop()) {
+        return;
+      }
+      scores.Forward(test_nets_[t].get());
+    }
+    // Log each net at once, so that its lines are not interleaved with
+    // those of training.
+    LOG(INFO) << "Iteration " << iter << ", Testing net (#" << t << ")";
+    scores.Log(*test_nets_[t], param_.test_compute_loss());
+  }
+}
+
+INSTANTIATE_CLASS(TestScores);
+INSTANTIATE_CLASS(Evaluator);
+
+}  // namespace caffe
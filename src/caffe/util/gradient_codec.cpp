@@ -0,0 +1,222 @@
+#include <stdint.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+#include "caffe/util/gradient_codec.hpp"
+#include "caffe/util/math_functions.hpp"
+
+namespace caffe {
+
+namespace {
+
+uint32_t FloatBits(float value) {
+  uint32_t bits;
+  std::memcpy(&bits, &value, sizeof(bits));  // NOLINT(caffe/alt_fn)
+  return bits;
+}
+
+float BitsFloat(uint32_t bits) {
+  float value;
+  std::memcpy(&value, &bits, sizeof(value));  // NOLINT(caffe/alt_fn)
+  return value;
+}
+
+// Rounds to the nearest half precision value, ties to even.
+uint16_t FloatToHalf(float value) {
+  uint32_t x = FloatBits(value);
+  const uint16_t sign = (x >> 16) & 0x8000;
+  x &= 0x7fffffff;
+  if (x >= 0x7f800000) {  // Infinity or NaN
+    return sign | 0x7c00 | (x > 0x7f800000 ? 0x200 : 0);
+  }
+  if (x >= 0x477ff000) {  // Rounds to 65520 or more
+    return sign | 0x7c00;
+  }
+  uint32_t half, rest, halfway;
+  if (x < 0x38800000) {  // Subnormal half, in units of 2^-24
+    if (x < 0x33000000) {
+      return sign;
+    }
+    const int shift = 126 - static_cast<int>(x >> 23);
+    const uint32_t mantissa = (x & 0x7fffff) | 0x800000;
+    half = mantissa >> shift;
+    rest = mantissa & ((1u << shift) - 1);
+    halfway = 1u << (shift - 1);
+  } else {
+    half = (x - 0x38000000) >> 13;
+    rest = x & 0x1fff;
+    halfway = 0x1000;
+  }
+  if (rest > halfway || (rest == halfway && (half & 1))) {
+    ++half;
+  }
+  return sign | half;
+}
+
+float HalfToFloat(uint16_t half) {
+  const uint32_t sign = static_cast<uint32_t>(half & 0x8000) << 16;
+  const uint32_t exponent = (half >> 10) & 0x1f;
+  const uint32_t mantissa = half & 0x3ff;
+  if (exponent == 0) {
+    const float value = std::ldexp(static_cast<float>(mantissa), -24);
+    return sign ? -value : value;
+  }
+  if (exponent == 0x1f) {
+    return BitsFloat(sign | 0x7f800000 | (mantissa << 13));
+  }
+  return BitsFloat(sign | ((exponent + 112) << 23) | (mantissa << 13));
+}
+
+}  // namespace
+
+template <typename Dtype>
+void FP16GradientCodec<Dtype>::Encode(const Dtype* data, size_t offset,
+    size_t count, vector<char>* message) {
+  message->resize(count * sizeof(uint16_t));
+  uint16_t* values = reinterpret_cast<uint16_t*>(message->data());
+  for (size_t i = 0; i < count; ++i) {
+    values[i] = FloatToHalf(data[i]);
+  }
+}
+
+template <typename Dtype>
+void FP16GradientCodec<Dtype>::DecodeAdd(const char* message, size_t count,
+    Dtype* data) {
+  const uint16_t* values = reinterpret_cast<const uint16_t*>(message);
+  for (size_t i = 0; i < count; ++i) {
+    data[i] += HalfToFloat(values[i]);
+  }
+}
+
+// Messages hold the number k of values sent, the k values, then their k
+// indices, which keeps every field aligned.
+template <typename Dtype>
+TopKGradientCodec<Dtype>::TopKGradientCodec(size_t size, float ratio)
+  : ratio_(ratio), residual_(size) {
+  CHECK_GT(ratio, 0);
+  CHECK_LE(ratio, 1);
+}
+
+template <typename Dtype>
+void TopKGradientCodec<Dtype>::Encode(const Dtype* data, size_t offset,
+    size_t count, vector<char>* message) {
+  CHECK_LE(offset + count, residual_.size());
+  CHECK_LE(count, UINT32_MAX);
+  Dtype* residual = residual_.data() + offset;
+  magnitudes_.resize(count);
+  for (size_t i = 0; i < count; ++i) {
+    residual[i] += data[i];
+    magnitudes_[i] = std::fabs(residual[i]);
+  }
+  const size_t k = std::min(count, std::max<size_t>(count ? 1 : 0,
+      static_cast<size_t>(ratio_ * count)));
+  Dtype threshold = 0;
+  if (k > 0) {
+    std::nth_element(magnitudes_.begin(), magnitudes_.begin() + count - k,
+        magnitudes_.end());
+    threshold = magnitudes_[count - k];
+  }
+  message->resize(sizeof(uint64_t) + k * (sizeof(Dtype) + sizeof(uint32_t)));
+  uint64_t* header = reinterpret_cast<uint64_t*>(message->data());
+  Dtype* values = reinterpret_cast<Dtype*>(header + 1);
+  uint32_t* indices = reinterpret_cast<uint32_t*>(values + k);
+  size_t sent = 0;
+  for (size_t i = 0; i < count && sent < k; ++i) {
+    if (std::fabs(residual[i]) >= threshold) {
+      values[sent] = residual[i];
+      indices[sent] = i;
+      residual[i] = 0;
+      ++sent;
+    }
+  }
+  CHECK_EQ(sent, k);
+  *header = k;
+}
+
+template <typename Dtype>
+void TopKGradientCodec<Dtype>::DecodeAdd(const char* message, size_t count,
+    Dtype* data) {
+  const uint64_t* header = reinterpret_cast<const uint64_t*>(message);
+  const size_t k = *header;
+  const Dtype* values = reinterpret_cast<const Dtype*>(header + 1);
+  const uint32_t* indices = reinterpret_cast<const uint32_t*>(values + k);
+  for (size_t i = 0; i < k; ++i) {
+    CHECK_LT(indices[i], count);
+    data[indices[i]] += values[i];
+  }
+}
+
+// Messages hold the magnitude, then one bit per value, set for the
+// non-negative ones.
+template <typename Dtype>
+SignGradientCodec<Dtype>::SignGradientCodec(size_t size)
+  : residual_(size) {
+}
+
+template <typename Dtype>
+void SignGradientCodec<Dtype>::Encode(const Dtype* data, size_t offset,
+    size_t count, vector<char>* message) {
+  CHECK_LE(offset + count, residual_.size());
+  Dtype* residual = residual_.data() + offset;
+  Dtype sum = 0;
+  for (size_t i = 0; i < count; ++i) {
+    residual[i] += data[i];
+    sum += std::fabs(residual[i]);
+  }
+  const Dtype scale = count ? sum / count : 0;
+  message->assign(sizeof(Dtype) + (count + 7) / 8, 0);
+  *reinterpret_cast<Dtype*>(message->data()) = scale;
+  uint8_t* bits = reinterpret_cast<uint8_t*>(message->data() + sizeof(Dtype));
+  for (size_t i = 0; i < count; ++i) {
+    if (residual[i] >= 0) {
+      bits[i / 8] |= 1 << (i % 8);
+      residual[i] -= scale;
+    } else {
+      residual[i] += scale;
+    }
+  }
+}
+
+template <typename Dtype>
+void SignGradientCodec<Dtype>::DecodeAdd(const char* message, size_t count,
+    Dtype* data) {
+  const Dtype scale = *reinterpret_cast<const Dtype*>(message);
+  const uint8_t* bits =
+      reinterpret_cast<const uint8_t*>(message + sizeof(Dtype));
+  for (size_t i = 0; i < count; ++i) {
+    data[i] += (bits[i / 8] >> (i % 8)) & 1 ? scale : -scale;
+  }
+}
+
+template <typename Dtype>
+GradientCodec<Dtype>* GetGradientCodec(const SolverParameter& param,
+    size_t size) {
+  switch (param.gradient_compression()) {
+  case SolverParameter_GradientCompression_NONE:
+    return NULL;
+  case SolverParameter_GradientCompression_FP16:
+    return new FP16GradientCodec<Dtype>();
+  case SolverParameter_GradientCompression_TOPK:
+    return new TopKGradientCodec<Dtype>(size, param.gradient_topk_ratio());
+  case SolverParameter_GradientCompression_SIGN:
+    return new SignGradientCodec<Dtype>(size);
+  default:
+    LOG(FATAL) << "Unknown gradient compression: "
+        << param.gradient_compression();
+  }
+  return NULL;  // Avoid warnings
+}
+
+template GradientCodec<float>* GetGradientCodec(const SolverParameter& param,
+    size_t size);
+template GradientCodec<double>* GetGradientCodec(const SolverParameter& param,
+    size_t size);
+
+INSTANTIATE_CLASS(FP16GradientCodec);
+INSTANTIATE_CLASS(TopKGradientCodec);
+INSTANTIATE_CLASS(SignGradientCodec);
+
+}  // namespace caffe
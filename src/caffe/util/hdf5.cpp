@@ -1,10 +1,17 @@
 #include "caffe/util/hdf5.hpp"
 
+#include <boost/thread/mutex.hpp>
 #include <string>
 #include <vector>
 
 namespace caffe {
 
+static boost::mutex hdf5_mutex_;
+
+boost::mutex& hdf5_mutex() {
+  return hdf5_mutex_;
+}
+
 // Verifies format of data stored in HDF5 file and reshapes blob accordingly.
 template <typename Dtype>
 void hdf5_load_nd_dataset_helper(
@@ -103,6 +110,74 @@ void hdf5_load_nd_dataset<double>(hid_t file_id, const char* dataset_name_,
   CHECK_GE(status, 0) << "Failed to read double dataset " << dataset_name_;
 }
 
+// Reads a hyperslab of whole rows of a dataset as mem_type.
+template <typename Dtype>
+static void hdf5_load_rows_helper(
+    hid_t file_id, const char* dataset_name_, hsize_t first_row,
+    hsize_t num_rows, hid_t mem_type, Blob<Dtype>* blob) {
+  CHECK(H5LTfind_dataset(file_id, dataset_name_))
+      << "Failed to find HDF5 dataset " << dataset_name_;
+  hid_t dataset_id = H5Dopen2(file_id, dataset_name_, H5P_DEFAULT);
+  CHECK_GE(dataset_id, 0) << "Failed to open dataset " << dataset_name_;
+  hid_t file_space = H5Dget_space(dataset_id);
+  CHECK_GE(file_space, 0) << "Failed to get dataspace of " << dataset_name_;
+  const int ndims = H5Sget_simple_extent_ndims(file_space);
+  CHECK_GE(ndims, 1) << "Input must have at least 1 axis.";
+  std::vector<hsize_t> dims(ndims);
+  H5Sget_simple_extent_dims(file_space, dims.data(), NULL);
+  CHECK_LE(first_row + num_rows, dims[0])
+      << "Rows out of range for dataset " << dataset_name_;
+
+  vector<int> blob_dims(ndims);
+  std::vector<hsize_t> start(ndims, 0);
+  dims[0] = num_rows;
+  start[0] = first_row;
+  for (int i = 0; i < ndims; ++i) {
+    blob_dims[i] = dims[i];
+  }
+  blob->Reshape(blob_dims);
+
+  herr_t status = H5Sselect_hyperslab(file_space, H5S_SELECT_SET,
+      start.data(), NULL, dims.data(), NULL);
+  CHECK_GE(status, 0) << "Failed to select rows of " << dataset_name_;
+  hid_t mem_space = H5Screate_simple(ndims, dims.data(), NULL);
+  CHECK_GE(mem_space, 0) << "Failed to create dataspace";
+  status = H5Dread(dataset_id, mem_type, mem_space, file_space, H5P_DEFAULT,
+      blob->mutable_cpu_data());
+  CHECK_GE(status, 0) << "Failed to read rows of dataset " << dataset_name_;
+  H5Sclose(mem_space);
+  H5Sclose(file_space);
+  H5Dclose(dataset_id);
+}
+
+template <>
+void hdf5_load_nd_dataset_rows<float>(hid_t file_id, const char* dataset_name_,
+    hsize_t first_row, hsize_t num_rows, Blob<float>* blob) {
+  hdf5_load_rows_helper(file_id, dataset_name_, first_row, num_rows,
+      H5T_NATIVE_FLOAT, blob);
+}
+
+template <>
+void hdf5_load_nd_dataset_rows<double>(hid_t file_id, const char* dataset_name_,
+    hsize_t first_row, hsize_t num_rows, Blob<double>* blob) {
+  hdf5_load_rows_helper(file_id, dataset_name_, first_row, num_rows,
+      H5T_NATIVE_DOUBLE, blob);
+}
+
+hsize_t hdf5_get_num_rows(hid_t file_id, const char* dataset_name_) {
+  CHECK(H5LTfind_dataset(file_id, dataset_name_))
+      << "Failed to find HDF5 dataset " << dataset_name_;
+  int ndims;
+  herr_t status = H5LTget_dataset_ndims(file_id, dataset_name_, &ndims);
+  CHECK_GE(status, 0) << "Failed to get dataset ndims for " << dataset_name_;
+  CHECK_GE(ndims, 1) << "Input must have at least 1 axis.";
+  std::vector<hsize_t> dims(ndims);
+  status = H5LTget_dataset_info(file_id, dataset_name_, dims.data(), NULL,
+      NULL);
+  CHECK_GE(status, 0) << "Failed to get dataset info for " << dataset_name_;
+  return dims[0];
+}
+
 template <>
 void hdf5_save_nd_dataset<float>(
     const hid_t file_id, const string& dataset_name, const Blob<float>& blob,
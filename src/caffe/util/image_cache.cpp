@@ -0,0 +1,85 @@
+#ifdef USE_OPENCV
+#include <boost/thread.hpp>
+#include <opencv2/core/core.hpp>
+
+#include <map>
+#include <string>
+
+#include "caffe/util/image_cache.hpp"
+
+namespace caffe {
+
+class ImageCache::Impl {
+ public:
+  struct Entry {
+    cv::Mat image;
+    int label;
+  };
+
+  Impl() : size_(0), capacity_(0) {}
+
+  mutable boost::mutex mutex_;
+  std::map<string, Entry> entries_;
+  size_t size_;
+  size_t capacity_;
+};
+
+ImageCache& ImageCache::Get() {
+  static ImageCache cache;
+  return cache;
+}
+
+ImageCache::ImageCache()
+    : impl_(new Impl()) {
+}
+
+void ImageCache::Reserve(size_t capacity) {
+  boost::mutex::scoped_lock lock(impl_->mutex_);
+  if (capacity > impl_->capacity_) {
+    impl_->capacity_ = capacity;
+    LOG(INFO) << "Decoded image cache capacity: " << capacity << " bytes";
+  }
+}
+
+bool ImageCache::Lookup(const string& key, cv::Mat* image, int* label) const {
+  boost::mutex::scoped_lock lock(impl_->mutex_);
+  std::map<string, Impl::Entry>::const_iterator it = impl_->entries_.find(key);
+  if (it == impl_->entries_.end()) {
+    return false;
+  }
+  *image = it->second.image;
+  *label = it->second.label;
+  return true;
+}
+
+void ImageCache::Insert(const string& key, const cv::Mat& image, int label) {
+  const size_t bytes = key.size() + image.total() * image.elemSize();
+  boost::mutex::scoped_lock lock(impl_->mutex_);
+  if (impl_->size_ + bytes > impl_->capacity_) {
+    LOG_FIRST_N(INFO, 1) << "Decoded image cache is full after "
+        << impl_->entries_.size() << " images (" << impl_->size_ << " bytes)";
+    return;
+  }
+  Impl::Entry& entry = impl_->entries_[key];
+  if (entry.image.data) {
+    // Another layer cached the same image in the meantime.
+    return;
+  }
+  // Views into a larger image are compacted so they don't pin its pixels.
+  entry.image = image.isContinuous() ? image : image.clone();
+  entry.label = label;
+  impl_->size_ += bytes;
+}
+
+size_t ImageCache::size() const {
+  boost::mutex::scoped_lock lock(impl_->mutex_);
+  return impl_->size_;
+}
+
+size_t ImageCache::capacity() const {
+  boost::mutex::scoped_lock lock(impl_->mutex_);
+  return impl_->capacity_;
+}
+
+}  // namespace caffe
+#endif  // USE_OPENCV
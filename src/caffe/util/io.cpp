@@ -234,5 +234,27 @@ void CVMatToDatum(const cv::Mat& cv_img, Datum* datum) {
   }
   datum->set_data(buffer);
 }
+
+cv::Mat DatumToCVMat(const Datum& datum) {
+  CHECK(!datum.encoded()) << "Datum is encoded; decode it instead";
+  const int datum_channels = datum.channels();
+  const int datum_height = datum.height();
+  const int datum_width = datum.width();
+  const string& buffer = datum.data();
+  CHECK_EQ(buffer.size(), datum_channels * datum_height * datum_width)
+      << "Datum must hold uint8 data";
+  cv::Mat cv_img(datum_height, datum_width, CV_8UC(datum_channels));
+  for (int h = 0; h < datum_height; ++h) {
+    uchar* ptr = cv_img.ptr<uchar>(h);
+    int img_index = 0;
+    for (int w = 0; w < datum_width; ++w) {
+      for (int c = 0; c < datum_channels; ++c) {
+        int datum_index = (c * datum_height + h) * datum_width + w;
+        ptr[img_index++] = static_cast<uchar>(buffer[datum_index]);
+      }
+    }
+  }
+  return cv_img;
+}
 #endif  // USE_OPENCV
 }  // namespace caffe
@@ -0,0 +1,129 @@
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "caffe/util/layer_cost.hpp"
+
+namespace caffe {
+
+namespace {
+
+template <typename Dtype>
+double Count(const vector<Blob<Dtype>*>& blobs) {
+  double count = 0;
+  for (int i = 0; i < blobs.size(); ++i) {
+    count += blobs[i]->count();
+  }
+  return count;
+}
+
+// Counts the tops that are not computed in place.
+template <typename Dtype>
+double CountOwnTops(const vector<Blob<Dtype>*>& bottom,
+    const vector<Blob<Dtype>*>& top) {
+  double count = 0;
+  for (int i = 0; i < top.size(); ++i) {
+    if (std::find(bottom.begin(), bottom.end(), top[i]) == bottom.end()) {
+      count += top[i]->count();
+    }
+  }
+  return count;
+}
+
+// FLOPs of a forward pass.
+template <typename Dtype>
+double ForwardFlops(Layer<Dtype>* layer, const vector<Blob<Dtype>*>& bottom,
+    const vector<Blob<Dtype>*>& top) {
+  const string type = layer->type();
+  const LayerParameter& param = layer->layer_param();
+  const double top_count = top.size() ? top[0]->count() : 0;
+  const double bottom_count = bottom.size() ? bottom[0]->count() : 0;
+  const vector<shared_ptr<Blob<Dtype> > >& blobs = layer->blobs();
+  if (type == "Convolution" || type == "Deconvolution") {
+    // A multiply-add per weight of a filter, per output of convolution:
+    // the tops of convolution, the bottoms of deconvolution.
+    const Blob<Dtype>& weights = *blobs[0];
+    const double filter_size = weights.count() / weights.shape(0);
+    const double outputs = type == "Convolution" ? top_count : bottom_count;
+    return 2 * outputs * filter_size * top.size()
+        + (blobs.size() > 1 ? top_count * top.size() : 0);
+  }
+  if (type == "InnerProduct") {
+    const int axis =
+        bottom[0]->CanonicalAxisIndex(param.inner_product_param().axis());
+    const double inputs = bottom[0]->count(axis);
+    return 2 * top_count * inputs + (blobs.size() > 1 ? top_count : 0);
+  }
+  if (type == "Pooling") {
+    const PoolingParameter& pool = param.pooling_param();
+    if (pool.global_pooling()) {
+      return bottom_count;
+    }
+    const double kernel_h = pool.has_kernel_h() ? pool.kernel_h() :
+        pool.kernel_size();
+    const double kernel_w = pool.has_kernel_w() ? pool.kernel_w() :
+        pool.kernel_size();
+    return top_count * kernel_h * kernel_w;
+  }
+  if (type == "LRN") {
+    return bottom_count * (param.lrn_param().local_size() + 4);
+  }
+  if (type == "BatchNorm" || type == "MVN") {
+    // Mean, variance, then normalization
+    return 5 * bottom_count;
+  }
+  if (type == "Softmax" || type == "SoftmaxWithLoss") {
+    // Max, exponential, sum and division
+    return 4 * bottom_count;
+  }
+  if (type == "Eltwise") {
+    return (bottom.size() - 1) * top_count;
+  }
+  if (type == "ReLU" || type == "PReLU" || type == "ELU" || type == "Sigmoid"
+      || type == "TanH" || type == "AbsVal" || type == "BNLL"
+      || type == "Power" || type == "Exp" || type == "Log" || type == "Scale"
+      || type == "Bias" || type == "Dropout" || type == "Threshold") {
+    return bottom_count;
+  }
+  return 0;
+}
+
+}  // namespace
+
+template <typename Dtype>
+LayerCost EstimateLayerCost(Layer<Dtype>* layer,
+    const vector<Blob<Dtype>*>& bottom, const vector<Blob<Dtype>*>& top,
+    const vector<bool>& propagate_down) {
+  const vector<shared_ptr<Blob<Dtype> > >& blobs = layer->blobs();
+  double params = 0;
+  bool param_gradients = false;
+  for (int i = 0; i < blobs.size(); ++i) {
+    params += blobs[i]->count();
+    param_gradients |= layer->param_propagate_down(i);
+  }
+  bool bottom_gradients = false;
+  for (int i = 0; i < propagate_down.size(); ++i) {
+    bottom_gradients |= propagate_down[i];
+  }
+  LayerCost cost;
+  cost.forward_flops = ForwardFlops(layer, bottom, top);
+  cost.forward_bytes = sizeof(Dtype) *
+      (Count(bottom) + CountOwnTops(bottom, top) + params);
+  // Each gradient computed, of the bottoms or of the params, costs about one
+  // forward pass and reads the top diffs along with the forward inputs.
+  const int gradients = bottom_gradients + param_gradients;
+  cost.backward_flops = gradients * cost.forward_flops;
+  cost.backward_bytes = gradients == 0 ? 0 : sizeof(Dtype) *
+      (Count(top) + Count(bottom) * (1 + bottom_gradients)
+       + params * (1 + param_gradients));
+  return cost;
+}
+
+template LayerCost EstimateLayerCost(Layer<float>* layer,
+    const vector<Blob<float>*>& bottom, const vector<Blob<float>*>& top,
+    const vector<bool>& propagate_down);
+template LayerCost EstimateLayerCost(Layer<double>* layer,
+    const vector<Blob<double>*>& bottom, const vector<Blob<double>*>& top,
+    const vector<bool>& propagate_down);
+
+}  // namespace caffe
@@ -1,10 +1,15 @@
+#include <boost/bind.hpp>
 #include <boost/math/special_functions/next.hpp>
 #include <boost/random.hpp>
+#include <boost/thread.hpp>
 
+#include <algorithm>
+#include <cmath>
 #include <limits>
 
 #include "caffe/common.hpp"
 #include "caffe/util/math_functions.hpp"
+#include "caffe/util/philox.hpp"
 #include "caffe/util/rng.hpp"
 
 namespace caffe {
@@ -252,17 +257,133 @@ float caffe_nextafter(const float b);
 template
 double caffe_nextafter(const double b);
 
+namespace {
+
+// Bulk draws come from the Philox generator, keyed anew from the Caffe RNG
+// stream for every call. Element i only depends on the key and on i, so the
+// blocks below can be filled by any number of threads with the same result.
+const int kRngBlockSize = 1 << 16;
+
+struct PhiloxKey {
+  uint32_t k[2];
+};
+
+// Uniform values in [0, 1), as many per Philox call as its 128 bits can
+// give at the precision of Dtype.
+template <typename Dtype> struct PhiloxUniform;
+
+template <>
+struct PhiloxUniform<float> {
+  enum { kPerCall = 4 };
+  static float Get(const uint32_t w[4], int j) {
+    return (w[j] >> 8) * (1.0f / 16777216.0f);
+  }
+};
+
+template <>
+struct PhiloxUniform<double> {
+  enum { kPerCall = 2 };
+  static double Get(const uint32_t w[4], int j) {
+    return ((w[2 * j] >> 5) * 67108864.0 + (w[2 * j + 1] >> 6))
+        * (1.0 / 9007199254740992.0);
+  }
+};
+
+template <typename Dtype>
+struct UniformOp {
+  typedef Dtype Type;
+  enum { kPerCall = PhiloxUniform<Dtype>::kPerCall };
+  Dtype a, range;
+  void operator()(const uint32_t w[4], int count, Dtype* r) const {
+    for (int j = 0; j < count; ++j) {
+      r[j] = a + range * PhiloxUniform<Dtype>::Get(w, j);
+    }
+  }
+};
+
+// Box-Muller, each pair of uniforms giving a pair of normal values.
+template <typename Dtype>
+struct GaussianOp {
+  typedef Dtype Type;
+  enum { kPerCall = PhiloxUniform<Dtype>::kPerCall };
+  Dtype mu, sigma;
+  void operator()(const uint32_t w[4], int count, Dtype* r) const {
+    const Dtype kTwoPi = Dtype(6.283185307179586);
+    for (int j = 0; j < count; j += 2) {
+      const Dtype u1 = Dtype(1) - PhiloxUniform<Dtype>::Get(w, j);
+      const Dtype u2 = PhiloxUniform<Dtype>::Get(w, j + 1);
+      const Dtype radius = sigma * std::sqrt(Dtype(-2) * std::log(u1));
+      r[j] = mu + radius * std::cos(kTwoPi * u2);
+      if (j + 1 < count) {
+        r[j + 1] = mu + radius * std::sin(kTwoPi * u2);
+      }
+    }
+  }
+};
+
+template <typename IntType>
+struct BernoulliOp {
+  typedef IntType Type;
+  enum { kPerCall = 4 };
+  // p scaled to the range of the 32 bit words.
+  double limit;
+  void operator()(const uint32_t w[4], int count, IntType* r) const {
+    for (int j = 0; j < count; ++j) {
+      r[j] = static_cast<IntType>(w[j] < limit);
+    }
+  }
+};
+
+template <typename Op>
+void philox_fill_range(const PhiloxKey& key, const Op& op, int begin,
+    int end, typename Op::Type* r) {
+  for (int i = begin; i < end; i += Op::kPerCall) {
+    const uint32_t counter[4] = {static_cast<uint32_t>(i / Op::kPerCall),
+        0, 0, 0};
+    uint32_t w[4];
+    philox4x32(key.k, counter, w);
+    op(w, std::min<int>(Op::kPerCall, end - i), r + i);
+  }
+}
+
+template <typename Op>
+void philox_fill(const int n, const Op& op, typename Op::Type* r) {
+  PhiloxKey key;
+  key.k[0] = caffe_rng_rand();
+  key.k[1] = caffe_rng_rand();
+  const int num_blocks = (n + kRngBlockSize - 1) / kRngBlockSize;
+  int num_threads = Caffe::rng_threads();
+  if (num_threads <= 0) {
+    num_threads = std::max(1u, boost::thread::hardware_concurrency());
+  }
+  num_threads = std::max(1, std::min(num_threads, num_blocks));
+  if (num_threads == 1) {
+    philox_fill_range(key, op, 0, n, r);
+    return;
+  }
+  // Whole blocks per thread; the calling thread takes the first part.
+  const int blocks_per_thread = (num_blocks + num_threads - 1) / num_threads;
+  const int part_size = blocks_per_thread * kRngBlockSize;
+  boost::thread_group threads;
+  for (int begin = part_size; begin < n; begin += part_size) {
+    threads.create_thread(boost::bind(&philox_fill_range<Op>, key, op,
+        begin, std::min(n, begin + part_size), r));
+  }
+  philox_fill_range(key, op, 0, std::min(n, part_size), r);
+  threads.join_all();
+}
+
+}  // namespace
+
 template <typename Dtype>
 void caffe_rng_uniform(const int n, const Dtype a, const Dtype b, Dtype* r) {
   CHECK_GE(n, 0);
   CHECK(r);
   CHECK_LE(a, b);
-  boost::uniform_real<Dtype> random_distribution(a, caffe_nextafter<Dtype>(b));
-  boost::variate_generator<caffe::rng_t*, boost::uniform_real<Dtype> >
-      variate_generator(caffe_rng(), random_distribution);
-  for (int i = 0; i < n; ++i) {
-    r[i] = variate_generator();
-  }
+  UniformOp<Dtype> op;
+  op.a = a;
+  op.range = b - a;
+  philox_fill(n, op, r);
 }
 
 template
@@ -279,12 +400,10 @@ void caffe_rng_gaussian(const int n, const Dtype a,
   CHECK_GE(n, 0);
   CHECK(r);
   CHECK_GT(sigma, 0);
-  boost::normal_distribution<Dtype> random_distribution(a, sigma);
-  boost::variate_generator<caffe::rng_t*, boost::normal_distribution<Dtype> >
-      variate_generator(caffe_rng(), random_distribution);
-  for (int i = 0; i < n; ++i) {
-    r[i] = variate_generator();
-  }
+  GaussianOp<Dtype> op;
+  op.mu = a;
+  op.sigma = sigma;
+  philox_fill(n, op, r);
 }
 
 template
@@ -301,12 +420,9 @@ void caffe_rng_bernoulli(const int n, const Dtype p, int* r) {
   CHECK(r);
   CHECK_GE(p, 0);
   CHECK_LE(p, 1);
-  boost::bernoulli_distribution<Dtype> random_distribution(p);
-  boost::variate_generator<caffe::rng_t*, boost::bernoulli_distribution<Dtype> >
-      variate_generator(caffe_rng(), random_distribution);
-  for (int i = 0; i < n; ++i) {
-    r[i] = variate_generator();
-  }
+  BernoulliOp<int> op;
+  op.limit = p * 4294967296.0;
+  philox_fill(n, op, r);
 }
 
 template
@@ -321,12 +437,9 @@ void caffe_rng_bernoulli(const int n, const Dtype p, unsigned int* r) {
   CHECK(r);
   CHECK_GE(p, 0);
   CHECK_LE(p, 1);
-  boost::bernoulli_distribution<Dtype> random_distribution(p);
-  boost::variate_generator<caffe::rng_t*, boost::bernoulli_distribution<Dtype> >
-      variate_generator(caffe_rng(), random_distribution);
-  for (int i = 0; i < n; ++i) {
-    r[i] = static_cast<unsigned int>(variate_generator());
-  }
+  BernoulliOp<unsigned int> op;
+  op.limit = p * 4294967296.0;
+  philox_fill(n, op, r);
 }
 
 template
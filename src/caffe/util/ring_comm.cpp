@@ -0,0 +1,544 @@
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "caffe/util/math_functions.hpp"
+#include "caffe/util/ring_comm.hpp"
+
+namespace caffe {
+
+namespace {
+
+// How long ranks retry to reach rank 0 or its shared memory segment.
+const int kRendezvousTimeoutSeconds = 300;
+
+void WriteAll(int fd, const void* data, size_t size) {
+  const char* p = static_cast<const char*>(data);
+  while (size > 0) {
+    ssize_t n = send(fd, p, size, MSG_NOSIGNAL);
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    CHECK_GT(n, 0) << "Ring send failed: " << strerror(errno);
+    p += n;
+    size -= n;
+  }
+}
+
+void ReadAll(int fd, void* data, size_t size) {
+  char* p = static_cast<char*>(data);
+  while (size > 0) {
+    ssize_t n = recv(fd, p, size, 0);
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    CHECK_GT(n, 0) << "Ring receive failed: "
+        << (n == 0 ? "connection closed" : strerror(errno));
+    p += n;
+    size -= n;
+  }
+}
+
+// Returns a socket listening on port, or on any free port if 0.
+int Listen(int port, int backlog, int* bound_port) {
+  int fd = socket(AF_INET, SOCK_STREAM, 0);
+  CHECK_GE(fd, 0) << "Failed to create socket: " << strerror(errno);
+  int one = 1;
+  setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+  sockaddr_in addr;
+  caffe_memset(sizeof(addr), 0, &addr);
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_ANY);
+  addr.sin_port = htons(port);
+  CHECK_EQ(bind(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)), 0)
+      << "Failed to bind port " << port << ": " << strerror(errno);
+  CHECK_EQ(listen(fd, backlog), 0) << "Failed to listen: " << strerror(errno);
+  socklen_t len = sizeof(addr);
+  CHECK_EQ(getsockname(fd, reinterpret_cast<sockaddr*>(&addr), &len), 0);
+  *bound_port = ntohs(addr.sin_port);
+  return fd;
+}
+
+int Accept(int listener) {
+  int fd;
+  do {
+    fd = accept(listener, NULL, NULL);
+  } while (fd < 0 && errno == EINTR);
+  CHECK_GE(fd, 0) << "Failed to accept: " << strerror(errno);
+  return fd;
+}
+
+// Connects to addr, retrying while the peer is not listening yet.
+int Connect(const sockaddr_in& addr) {
+  for (int attempt = 0; ; ++attempt) {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    CHECK_GE(fd, 0) << "Failed to create socket: " << strerror(errno);
+    if (connect(fd, reinterpret_cast<const sockaddr*>(&addr),
+        sizeof(addr)) == 0) {
+      return fd;
+    }
+    close(fd);
+    CHECK_LT(attempt, kRendezvousTimeoutSeconds * 10)
+        << "Failed to connect to " << inet_ntoa(addr.sin_addr) << ":"
+        << ntohs(addr.sin_port) << ": " << strerror(errno);
+    usleep(100000);
+  }
+}
+
+sockaddr_in Resolve(const string& host, int port) {
+  addrinfo hints;
+  caffe_memset(sizeof(hints), 0, &hints);
+  hints.ai_family = AF_INET;
+  hints.ai_socktype = SOCK_STREAM;
+  addrinfo* result = NULL;
+  CHECK_EQ(getaddrinfo(host.c_str(), NULL, &hints, &result), 0)
+      << "Failed to resolve " << host;
+  sockaddr_in addr = *reinterpret_cast<sockaddr_in*>(result->ai_addr);
+  freeaddrinfo(result);
+  addr.sin_port = htons(port);
+  return addr;
+}
+
+// Address of a rank's ring listener, as exchanged at rendezvous.
+struct RingAddress {
+  uint32_t ip;  // network byte order
+  uint16_t port;  // network byte order
+};
+
+}  // namespace
+
+TCPRingTransport::TCPRingTransport(const string& host, int port, int rank,
+    int size)
+    : RingTransport(rank, size), next_fd_(-1), prev_fd_(-1) {
+  CHECK_GE(rank, 0);
+  CHECK_LT(rank, size);
+  if (size == 1) {
+    return;
+  }
+  int ring_port;
+  const int ring_listener = Listen(0, 1, &ring_port);
+  vector<RingAddress> addresses(size);
+  if (rank == 0) {
+    int bound_port;
+    const int listener = Listen(port, size, &bound_port);
+    vector<int> fds;
+    for (int i = 1; i < size; ++i) {
+      fds.push_back(Accept(listener));
+      int32_t peer_rank;
+      uint16_t peer_port;
+      ReadAll(fds.back(), &peer_rank, sizeof(peer_rank));
+      ReadAll(fds.back(), &peer_port, sizeof(peer_port));
+      CHECK(peer_rank > 0 && peer_rank < size) << "Bad rank " << peer_rank;
+      sockaddr_in peer;
+      socklen_t len = sizeof(peer);
+      CHECK_EQ(getpeername(fds.back(), reinterpret_cast<sockaddr*>(&peer),
+          &len), 0);
+      addresses[peer_rank].ip = peer.sin_addr.s_addr;
+      addresses[peer_rank].port = peer_port;
+    }
+    // Ranks use the address they reached rank 0 at for its entry.
+    addresses[0].port = htons(ring_port);
+    for (int i = 0; i < fds.size(); ++i) {
+      WriteAll(fds[i], &addresses[0], size * sizeof(RingAddress));
+      close(fds[i]);
+    }
+    close(listener);
+  } else {
+    const int fd = Connect(Resolve(host, port));
+    const int32_t own_rank = rank;
+    const uint16_t own_port = htons(ring_port);
+    WriteAll(fd, &own_rank, sizeof(own_rank));
+    WriteAll(fd, &own_port, sizeof(own_port));
+    ReadAll(fd, &addresses[0], size * sizeof(RingAddress));
+    sockaddr_in root;
+    socklen_t len = sizeof(root);
+    CHECK_EQ(getpeername(fd, reinterpret_cast<sockaddr*>(&root), &len), 0);
+    addresses[0].ip = root.sin_addr.s_addr;
+    close(fd);
+  }
+  // Connecting completes through the listen backlog, so every rank can
+  // connect to the next one before accepting the previous one.
+  const int next = (rank + 1) % size;
+  sockaddr_in next_addr;
+  caffe_memset(sizeof(next_addr), 0, &next_addr);
+  next_addr.sin_family = AF_INET;
+  next_addr.sin_addr.s_addr = addresses[next].ip;
+  next_addr.sin_port = addresses[next].port;
+  next_fd_ = Connect(next_addr);
+  const int32_t own_rank = rank;
+  WriteAll(next_fd_, &own_rank, sizeof(own_rank));
+  prev_fd_ = Accept(ring_listener);
+  int32_t prev_rank;
+  ReadAll(prev_fd_, &prev_rank, sizeof(prev_rank));
+  CHECK_EQ(prev_rank, (rank + size - 1) % size)
+      << "Unexpected connection in the ring";
+  close(ring_listener);
+  int one = 1;
+  setsockopt(next_fd_, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+  setsockopt(prev_fd_, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+  fcntl(next_fd_, F_SETFL, fcntl(next_fd_, F_GETFL) | O_NONBLOCK);
+  fcntl(prev_fd_, F_SETFL, fcntl(prev_fd_, F_GETFL) | O_NONBLOCK);
+}
+
+TCPRingTransport::~TCPRingTransport() {
+  if (next_fd_ >= 0) {
+    close(next_fd_);
+  }
+  if (prev_fd_ >= 0) {
+    close(prev_fd_);
+  }
+}
+
+void TCPRingTransport::SendRecv(const void* send_data, size_t send_size,
+    void* recv_data, size_t recv_size) {
+  const char* send_ptr = static_cast<const char*>(send_data);
+  char* recv_ptr = static_cast<char*>(recv_data);
+  size_t sent = 0, received = 0;
+  // Both directions progress together, as the next rank only reads once it
+  // is done writing to its own next rank.
+  while (sent < send_size || received < recv_size) {
+    pollfd fds[2];
+    int num_fds = 0;
+    if (sent < send_size) {
+      fds[num_fds].fd = next_fd_;
+      fds[num_fds].events = POLLOUT;
+      ++num_fds;
+    }
+    if (received < recv_size) {
+      fds[num_fds].fd = prev_fd_;
+      fds[num_fds].events = POLLIN;
+      ++num_fds;
+    }
+    if (poll(fds, num_fds, -1) < 0) {
+      CHECK_EQ(errno, EINTR) << "Ring poll failed: " << strerror(errno);
+      continue;
+    }
+    for (int i = 0; i < num_fds; ++i) {
+      if (fds[i].revents == 0) {
+        continue;
+      }
+      if (fds[i].fd == next_fd_ && sent < send_size) {
+        ssize_t n = send(next_fd_, send_ptr + sent, send_size - sent,
+            MSG_NOSIGNAL);
+        if (n < 0 && (errno == EAGAIN || errno == EINTR)) {
+          continue;
+        }
+        CHECK_GT(n, 0) << "Ring send failed: " << strerror(errno);
+        sent += n;
+      } else {
+        ssize_t n = recv(prev_fd_, recv_ptr + received, recv_size - received,
+            0);
+        if (n < 0 && (errno == EAGAIN || errno == EINTR)) {
+          continue;
+        }
+        CHECK_GT(n, 0) << "Ring receive failed: "
+            << (n == 0 ? "connection closed" : strerror(errno));
+        received += n;
+      }
+    }
+  }
+}
+
+namespace {
+
+const size_t kShmSlotBytes = 1 << 20;
+// Counters live on their own cache lines.
+const size_t kShmLineBytes = 64;
+
+struct ShmHeader {
+  volatile int32_t ready;
+  volatile int32_t attached;
+};
+
+struct ShmCounters {
+  volatile uint64_t written;
+  volatile uint64_t read;
+};
+
+ShmHeader* Header(void* segment) {
+  return static_cast<ShmHeader*>(segment);
+}
+
+ShmCounters* Counters(void* segment, int rank) {
+  return reinterpret_cast<ShmCounters*>(static_cast<char*>(segment) +
+      kShmLineBytes * (rank + 1));
+}
+
+char* Slot(void* segment, int size, int rank) {
+  return static_cast<char*>(segment) + kShmLineBytes * (size + 1) +
+      kShmSlotBytes * rank;
+}
+
+// Busy waits for a short while, then yields to other processes.
+void Pause(int* spins) {
+  if (++*spins > 1000) {
+    sched_yield();
+  }
+}
+
+}  // namespace
+
+ShmRingTransport::ShmRingTransport(const string& name, int rank, int size)
+    : RingTransport(rank, size), segment_(NULL),
+      segment_size_(kShmLineBytes * (size + 1) + kShmSlotBytes * size),
+      pieces_sent_(0), pieces_received_(0) {
+  CHECK_GE(rank, 0);
+  CHECK_LT(rank, size);
+  if (size == 1) {
+    return;
+  }
+  const string shm_name = (name.empty() || name[0] != '/') ? "/" + name : name;
+  int fd;
+  if (rank == 0) {
+    shm_unlink(shm_name.c_str());
+    fd = shm_open(shm_name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+    CHECK_GE(fd, 0) << "Failed to create " << shm_name << ": "
+        << strerror(errno);
+    CHECK_EQ(ftruncate(fd, segment_size_), 0) << "Failed to size "
+        << shm_name << ": " << strerror(errno);
+  } else {
+    for (int attempt = 0; ; ++attempt) {
+      fd = shm_open(shm_name.c_str(), O_RDWR, 0600);
+      struct stat st;
+      if (fd >= 0 && fstat(fd, &st) == 0
+          && static_cast<size_t>(st.st_size) == segment_size_) {
+        break;
+      }
+      if (fd >= 0) {
+        close(fd);
+      }
+      CHECK_LT(attempt, kRendezvousTimeoutSeconds * 10)
+          << "Failed to open " << shm_name;
+      usleep(100000);
+    }
+  }
+  segment_ = mmap(NULL, segment_size_, PROT_READ | PROT_WRITE, MAP_SHARED,
+      fd, 0);
+  CHECK(segment_ != MAP_FAILED) << "Failed to map " << shm_name;
+  close(fd);
+  ShmHeader* header = Header(segment_);
+  if (rank == 0) {
+    __sync_synchronize();
+    header->ready = 1;
+  } else {
+    for (int spins = 0; !header->ready; ) {
+      Pause(&spins);
+    }
+  }
+  __sync_fetch_and_add(&header->attached, 1);
+  if (rank == 0) {
+    // The segment stays mapped, only its name goes away.
+    for (int spins = 0; header->attached < size; ) {
+      Pause(&spins);
+    }
+    shm_unlink(shm_name.c_str());
+  }
+}
+
+ShmRingTransport::~ShmRingTransport() {
+  if (segment_) {
+    munmap(segment_, segment_size_);
+  }
+}
+
+void ShmRingTransport::SendRecv(const void* send_data, size_t send_size,
+    void* recv_data, size_t recv_size) {
+  const int prev = (rank_ + size_ - 1) % size_;
+  ShmCounters* out = Counters(segment_, rank_);
+  ShmCounters* in = Counters(segment_, prev);
+  char* out_slot = Slot(segment_, size_, rank_);
+  const char* in_slot = Slot(segment_, size_, prev);
+  const char* send_ptr = static_cast<const char*>(send_data);
+  char* recv_ptr = static_cast<char*>(recv_data);
+  size_t sent = 0, received = 0;
+  // Alternate writing a piece and reading one. A piece can be written once
+  // the next rank has read the previous one, which it does right after
+  // writing its own, so the ring never waits on itself.
+  while (sent < send_size || received < recv_size) {
+    if (sent < send_size) {
+      for (int spins = 0; out->read != pieces_sent_; ) {
+        Pause(&spins);
+      }
+      __sync_synchronize();
+      const size_t n = std::min(kShmSlotBytes, send_size - sent);
+      memcpy(out_slot, send_ptr + sent, n);  // NOLINT(caffe/alt_fn)
+      __sync_synchronize();
+      out->written = ++pieces_sent_;
+      sent += n;
+    }
+    if (received < recv_size) {
+      for (int spins = 0; in->written == pieces_received_; ) {
+        Pause(&spins);
+      }
+      __sync_synchronize();
+      const size_t n = std::min(kShmSlotBytes, recv_size - received);
+      memcpy(recv_ptr + received, in_slot, n);  // NOLINT(caffe/alt_fn)
+      __sync_synchronize();
+      in->read = ++pieces_received_;
+      received += n;
+    }
+  }
+}
+
+RingTransport* GetRingTransport(const string& uri, int rank, int size) {
+  const string tcp = "tcp://";
+  const string shm = "shm://";
+  if (uri.compare(0, tcp.size(), tcp) == 0) {
+    const string address = uri.substr(tcp.size());
+    const size_t colon = address.rfind(':');
+    CHECK(colon != string::npos) << "Expected tcp://HOST:PORT, got " << uri;
+    return new TCPRingTransport(address.substr(0, colon),
+        atoi(address.c_str() + colon + 1), rank, size);
+  }
+  if (uri.compare(0, shm.size(), shm) == 0) {
+    return new ShmRingTransport(uri.substr(shm.size()), rank, size);
+  }
+  LOG(FATAL) << "Unknown ring transport " << uri;
+  return NULL;  // Avoid warnings
+}
+
+template <typename Dtype>
+void RingComm<Dtype>::AllReduce(Dtype* data, size_t count) {
+  const int n = size();
+  if (n == 1) {
+    return;
+  }
+  const int r = rank();
+  buffer_.resize(ChunkSize(count, n - 1) + 1);
+  // Reduce-scatter: rank r ends up with the sum of chunk r + 1.
+  for (int step = 0; step < n - 1; ++step) {
+    const int send_chunk = (r - step + n) % n;
+    const int recv_chunk = (r - step - 1 + n) % n;
+    SendRecv(data + ChunkBegin(count, send_chunk),
+        ChunkSize(count, send_chunk) * sizeof(Dtype), &buffer_[0],
+        ChunkSize(count, recv_chunk) * sizeof(Dtype));
+    caffe_axpy<Dtype>(ChunkSize(count, recv_chunk), Dtype(1), &buffer_[0],
+        data + ChunkBegin(count, recv_chunk));
+  }
+  // All-gather the summed chunks.
+  for (int step = 0; step < n - 1; ++step) {
+    const int send_chunk = (r - step + 1 + n) % n;
+    const int recv_chunk = (r - step + n) % n;
+    SendRecv(data + ChunkBegin(count, send_chunk),
+        ChunkSize(count, send_chunk) * sizeof(Dtype),
+        data + ChunkBegin(count, recv_chunk),
+        ChunkSize(count, recv_chunk) * sizeof(Dtype));
+  }
+}
+
+template <typename Dtype>
+void RingComm<Dtype>::AllReduce(Dtype* data, size_t count, size_t offset,
+    GradientCodec<Dtype>* codec) {
+  if (size() == 1) {
+    return;
+  }
+  if (codec->value_size() > 0) {
+    RingAllReduce(data, count, offset, codec);
+  } else {
+    GatherAllReduce(data, count, offset, codec);
+  }
+}
+
+template <typename Dtype>
+void RingComm<Dtype>::RingAllReduce(Dtype* data, size_t count,
+    size_t offset, GradientCodec<Dtype>* codec) {
+  const int n = size();
+  const int r = rank();
+  const size_t value_size = codec->value_size();
+  messages_.resize(2);
+  vector<char>* send = &messages_[0];
+  vector<char>* recv = &messages_[1];
+  // Reduce-scatter, re-encoding the partial sums at every hop.
+  for (int step = 0; step < n - 1; ++step) {
+    const int send_chunk = (r - step + n) % n;
+    const int recv_chunk = (r - step - 1 + n) % n;
+    const size_t begin = ChunkBegin(count, send_chunk);
+    codec->Encode(data + begin, offset + begin,
+        ChunkSize(count, send_chunk), send);
+    recv->resize(ChunkSize(count, recv_chunk) * value_size);
+    SendRecv(send->data(), send->size(), recv->data(), recv->size());
+    codec->DecodeAdd(recv->data(), ChunkSize(count, recv_chunk),
+        data + ChunkBegin(count, recv_chunk));
+  }
+  // Decode the summed chunk as the other ranks will, so that all ranks
+  // hold the same values, then forward the messages as received.
+  const int own_chunk = (r + 1) % n;
+  const size_t begin = ChunkBegin(count, own_chunk);
+  codec->Encode(data + begin, offset + begin, ChunkSize(count, own_chunk),
+      send);
+  caffe_set(ChunkSize(count, own_chunk), Dtype(0), data + begin);
+  codec->DecodeAdd(send->data(), ChunkSize(count, own_chunk), data + begin);
+  for (int step = 0; step < n - 1; ++step) {
+    const int recv_chunk = (r - step + n) % n;
+    recv->resize(ChunkSize(count, recv_chunk) * value_size);
+    SendRecv(send->data(), send->size(), recv->data(), recv->size());
+    Dtype* recv_data = data + ChunkBegin(count, recv_chunk);
+    caffe_set(ChunkSize(count, recv_chunk), Dtype(0), recv_data);
+    codec->DecodeAdd(recv->data(), ChunkSize(count, recv_chunk), recv_data);
+    std::swap(send, recv);
+  }
+}
+
+template <typename Dtype>
+void RingComm<Dtype>::GatherAllReduce(Dtype* data, size_t count,
+    size_t offset, GradientCodec<Dtype>* codec) {
+  const int n = size();
+  const int r = rank();
+  messages_.resize(n);
+  codec->Encode(data, offset, count, &messages_[r]);
+  // All-gather the messages, which differ in size.
+  for (int step = 0; step < n - 1; ++step) {
+    const vector<char>& send = messages_[(r - step + n) % n];
+    vector<char>* recv = &messages_[(r - step - 1 + n) % n];
+    uint64_t send_size = send.size();
+    uint64_t recv_size;
+    SendRecv(&send_size, sizeof(send_size), &recv_size, sizeof(recv_size));
+    recv->resize(recv_size);
+    SendRecv(send.data(), send.size(), recv->data(), recv->size());
+  }
+  // Sum in rank order, so that all ranks get the same rounding.
+  caffe_set(count, Dtype(0), data);
+  for (int i = 0; i < n; ++i) {
+    codec->DecodeAdd(messages_[i].data(), count, data);
+  }
+}
+
+template <typename Dtype>
+void RingComm<Dtype>::Broadcast(Dtype* data, size_t count) {
+  const int n = size();
+  if (n == 1) {
+    return;
+  }
+  const int r = rank();
+  // Forward in pieces, so that the ranks down the ring work in parallel.
+  const size_t kPiece = (1 << 20) / sizeof(Dtype);
+  for (size_t begin = 0; begin < count; begin += kPiece) {
+    const size_t bytes = std::min(kPiece, count - begin) * sizeof(Dtype);
+    if (r > 0) {
+      SendRecv(NULL, 0, data + begin, bytes);
+    }
+    if (r < n - 1) {
+      SendRecv(data + begin, bytes, NULL, 0);
+    }
+  }
+}
+
+INSTANTIATE_CLASS(RingComm);
+
+}  // namespace caffe
@@ -0,0 +1,263 @@
+#include <boost/thread.hpp>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "google/protobuf/text_format.h"
+#include "hdf5.h"
+
+#include "caffe/blob.hpp"
+#include "caffe/util/benchmark.hpp"
+#include "caffe/util/format.hpp"
+#include "caffe/util/hdf5.hpp"
+#include "caffe/util/snapshot_writer.hpp"
+
+namespace caffe {
+
+namespace {
+
+string TempFilename(const string& filename) {
+  return filename + ".tmp";
+}
+
+// Flushes a file written under its temporary name to disk and moves it to
+// its final name, so that readers only ever see complete files.
+void SyncAndRename(const string& filename) {
+  const string temp_filename = TempFilename(filename);
+  int fd = open(temp_filename.c_str(), O_RDONLY);
+  CHECK_GE(fd, 0) << "Failed to open " << temp_filename;
+  CHECK_EQ(fsync(fd), 0) << "Failed to sync " << temp_filename;
+  close(fd);
+  CHECK_EQ(std::rename(temp_filename.c_str(), filename.c_str()), 0)
+      << "Failed to rename " << temp_filename << " to " << filename;
+}
+
+void WriteBinaryProto(const google::protobuf::Message& proto,
+    const string& filename) {
+  string contents;
+  CHECK(proto.SerializeToString(&contents));
+  const string temp_filename = TempFilename(filename);
+  FILE* file = fopen(temp_filename.c_str(), "wb");
+  CHECK(file) << "Failed to open " << temp_filename;
+  CHECK_EQ(fwrite(contents.data(), 1, contents.size(), file), contents.size())
+      << "Failed to write " << temp_filename;
+  CHECK_EQ(fclose(file), 0) << "Failed to write " << temp_filename;
+  SyncAndRename(filename);
+}
+
+// Saves the data, or the diff, of a blob copied to a proto as an HDF5
+// dataset, in the layout of hdf5_save_nd_dataset.
+template <typename Dtype>
+void SaveBlobProto(hid_t loc_id, const string& dataset_name,
+    const BlobProto& proto, bool write_diff) {
+  vector<int> shape(proto.shape().dim_size());
+  for (int i = 0; i < shape.size(); ++i) {
+    shape[i] = proto.shape().dim(i);
+  }
+  Blob<Dtype> blob(shape);
+  Dtype* values = write_diff ? blob.mutable_cpu_diff() :
+      blob.mutable_cpu_data();
+  if (write_diff ? proto.double_diff_size() : proto.double_data_size()) {
+    const google::protobuf::RepeatedField<double>& src =
+        write_diff ? proto.double_diff() : proto.double_data();
+    CHECK_EQ(src.size(), blob.count());
+    for (int i = 0; i < src.size(); ++i) {
+      values[i] = src.Get(i);
+    }
+  } else {
+    const google::protobuf::RepeatedField<float>& src =
+        write_diff ? proto.diff() : proto.data();
+    CHECK_EQ(src.size(), blob.count());
+    for (int i = 0; i < src.size(); ++i) {
+      values[i] = src.Get(i);
+    }
+  }
+  hdf5_save_nd_dataset<Dtype>(loc_id, dataset_name, blob, write_diff);
+}
+
+bool HasData(const BlobProto& proto) {
+  return proto.data_size() > 0 || proto.double_data_size() > 0;
+}
+
+// Writes a net in the layout of Net::ToHDF5. Blobs whose data was cleared,
+// i.e. shared params not owned by their layer, only get their diff saved.
+template <typename Dtype>
+void WriteNetToHDF5(const NetParameter& net, bool write_diff,
+    const string& filename) {
+  const string temp_filename = TempFilename(filename);
+  boost::mutex::scoped_lock lock(hdf5_mutex());
+  hid_t file_hid = H5Fcreate(temp_filename.c_str(), H5F_ACC_TRUNC,
+      H5P_DEFAULT, H5P_DEFAULT);
+  CHECK_GE(file_hid, 0)
+      << "Couldn't open " << temp_filename << " to save weights.";
+  hid_t data_hid = H5Gcreate2(file_hid, "data", H5P_DEFAULT, H5P_DEFAULT,
+      H5P_DEFAULT);
+  CHECK_GE(data_hid, 0) << "Error saving weights to " << filename << ".";
+  hid_t diff_hid = -1;
+  if (write_diff) {
+    diff_hid = H5Gcreate2(file_hid, "diff", H5P_DEFAULT, H5P_DEFAULT,
+        H5P_DEFAULT);
+    CHECK_GE(diff_hid, 0) << "Error saving weights to " << filename << ".";
+  }
+  for (int layer_id = 0; layer_id < net.layer_size(); ++layer_id) {
+    const LayerParameter& layer = net.layer(layer_id);
+    hid_t layer_data_hid = H5Gcreate2(data_hid, layer.name().c_str(),
+        H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT);
+    CHECK_GE(layer_data_hid, 0)
+        << "Error saving weights to " << filename << ".";
+    hid_t layer_diff_hid = -1;
+    if (write_diff) {
+      layer_diff_hid = H5Gcreate2(diff_hid, layer.name().c_str(),
+          H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT);
+      CHECK_GE(layer_diff_hid, 0)
+          << "Error saving weights to " << filename << ".";
+    }
+    for (int param_id = 0; param_id < layer.blobs_size(); ++param_id) {
+      const BlobProto& blob = layer.blobs(param_id);
+      const string dataset_name = format_int(param_id);
+      if (HasData(blob)) {
+        SaveBlobProto<Dtype>(layer_data_hid, dataset_name, blob, false);
+      }
+      if (write_diff) {
+        SaveBlobProto<Dtype>(layer_diff_hid, dataset_name, blob, true);
+      }
+    }
+    H5Gclose(layer_data_hid);
+    if (write_diff) {
+      H5Gclose(layer_diff_hid);
+    }
+  }
+  H5Gclose(data_hid);
+  if (write_diff) {
+    H5Gclose(diff_hid);
+  }
+  H5Fclose(file_hid);
+  lock.unlock();
+  SyncAndRename(filename);
+}
+
+// Writes a solver state in the layout read by
+// SGDSolver::RestoreSolverStateFromHDF5.
+template <typename Dtype>
+void WriteSolverStateToHDF5(const SolverState& state,
+    const string& filename) {
+  const string temp_filename = TempFilename(filename);
+  boost::mutex::scoped_lock lock(hdf5_mutex());
+  hid_t file_hid = H5Fcreate(temp_filename.c_str(), H5F_ACC_TRUNC,
+      H5P_DEFAULT, H5P_DEFAULT);
+  CHECK_GE(file_hid, 0)
+      << "Couldn't open " << temp_filename << " to save solver state.";
+  hdf5_save_int(file_hid, "iter", state.iter());
+  hdf5_save_string(file_hid, "learned_net", state.learned_net());
+  hdf5_save_int(file_hid, "current_step", state.current_step());
+  hid_t history_hid = H5Gcreate2(file_hid, "history", H5P_DEFAULT, H5P_DEFAULT,
+      H5P_DEFAULT);
+  CHECK_GE(history_hid, 0)
+      << "Error saving solver state to " << filename << ".";
+  for (int i = 0; i < state.history_size(); ++i) {
+    SaveBlobProto<Dtype>(history_hid, format_int(i), state.history(i), false);
+  }
+  H5Gclose(history_hid);
+  if (state.data_reader_size() > 0) {
+    SolverState readers;
+    readers.mutable_data_reader()->CopyFrom(state.data_reader());
+    string readers_text;
+    google::protobuf::TextFormat::PrintToString(readers, &readers_text);
+    hdf5_save_string(file_hid, "data_reader", readers_text);
+  }
+  H5Fclose(file_hid);
+  lock.unlock();
+  SyncAndRename(filename);
+}
+
+// Frees the copies held by a written snapshot, which would otherwise stay
+// resident until the next one overwrites them. Clear() would keep the
+// allocated blobs around for reuse, hence the swaps.
+void ReleaseSnapshot(SnapshotData* data) {
+  NetParameter().Swap(&data->net);
+  SolverState().Swap(&data->state);
+}
+
+}  // namespace
+
+template <typename Dtype>
+SnapshotWriter<Dtype>::SnapshotWriter(bool async)
+    : async_(async) {
+  free_.push(&data_);
+  if (async_) {
+    StartInternalThread();
+  }
+}
+
+template <typename Dtype>
+SnapshotWriter<Dtype>::~SnapshotWriter() {
+  Wait();
+  StopInternalThread();
+}
+
+template <typename Dtype>
+SnapshotData* SnapshotWriter<Dtype>::Acquire() {
+  return free_.pop("Waiting for the previous snapshot to be written");
+}
+
+template <typename Dtype>
+void SnapshotWriter<Dtype>::Submit(SnapshotData* data) {
+  if (async_) {
+    full_.push(data);
+  } else {
+    Write(*data);
+    ReleaseSnapshot(data);
+    free_.push(data);
+  }
+}
+
+template <typename Dtype>
+void SnapshotWriter<Dtype>::Wait() {
+  free_.push(Acquire());
+}
+
+template <typename Dtype>
+void SnapshotWriter<Dtype>::InternalThreadEntry() {
+  try {
+    while (!must_stop()) {
+      SnapshotData* data = full_.pop();
+      Write(*data);
+      ReleaseSnapshot(data);
+      free_.push(data);
+    }
+  } catch (boost::thread_interrupted&) {
+    // Interrupted exception is expected on shutdown
+  }
+}
+
+template <typename Dtype>
+void SnapshotWriter<Dtype>::Write(const SnapshotData& data) {
+  CPUTimer timer;
+  timer.Start();
+  switch (data.format) {
+  case caffe::SolverParameter_SnapshotFormat_BINARYPROTO:
+    LOG(INFO) << "Snapshotting to binary proto file " << data.model_filename;
+    WriteBinaryProto(data.net, data.model_filename);
+    LOG(INFO) << "Snapshotting solver state to binary proto file "
+        << data.state_filename;
+    WriteBinaryProto(data.state, data.state_filename);
+    break;
+  case caffe::SolverParameter_SnapshotFormat_HDF5:
+    LOG(INFO) << "Snapshotting to HDF5 file " << data.model_filename;
+    WriteNetToHDF5<Dtype>(data.net, data.write_diff, data.model_filename);
+    LOG(INFO) << "Snapshotting solver state to HDF5 file "
+        << data.state_filename;
+    WriteSolverStateToHDF5<Dtype>(data.state, data.state_filename);
+    break;
+  default:
+    LOG(FATAL) << "Unsupported snapshot format.";
+  }
+  LOG(INFO) << "Snapshot written in " << timer.MilliSeconds() << " ms.";
+}
+
+INSTANTIATE_CLASS(SnapshotWriter);
+
+}  // namespace caffe
@@ -0,0 +1,86 @@
+#include <boost/bind.hpp>
+#include <boost/thread.hpp>
+
+#include "caffe/util/worker_pool.hpp"
+
+namespace caffe {
+
+class WorkerPool::sync {
+ public:
+  sync() : task_(NULL), generation_(0), pending_(0), stop_(false) {}
+
+  boost::mutex mutex_;
+  boost::condition_variable start_;
+  boost::condition_variable done_;
+  boost::thread_group threads_;
+  // The task of the current Run, and the number of Runs so far, which the
+  // workers compare against the last one they ran to detect a new task.
+  const boost::function<void(int)>* task_;
+  int generation_;
+  // The number of workers still running the current task.
+  int pending_;
+  bool stop_;
+};
+
+WorkerPool::WorkerPool(int num_threads)
+    : num_threads_(num_threads), sync_(new sync()) {
+  CHECK_GE(num_threads_, 1);
+  for (int part = 1; part < num_threads_; ++part) {
+    sync_->threads_.create_thread(boost::bind(&WorkerPool::Entry, this,
+        part));
+  }
+}
+
+WorkerPool::~WorkerPool() {
+  {
+    boost::mutex::scoped_lock lock(sync_->mutex_);
+    sync_->stop_ = true;
+  }
+  sync_->start_.notify_all();
+  sync_->threads_.join_all();
+}
+
+void WorkerPool::Run(const boost::function<void(int)>& task) {
+  if (num_threads_ == 1) {
+    task(0);
+    return;
+  }
+  {
+    boost::mutex::scoped_lock lock(sync_->mutex_);
+    sync_->task_ = &task;
+    sync_->pending_ = num_threads_ - 1;
+    ++sync_->generation_;
+  }
+  sync_->start_.notify_all();
+  task(0);
+  boost::mutex::scoped_lock lock(sync_->mutex_);
+  while (sync_->pending_ > 0) {
+    sync_->done_.wait(lock);
+  }
+  sync_->task_ = NULL;
+}
+
+void WorkerPool::Entry(int part) {
+  int generation = 0;
+  while (true) {
+    const boost::function<void(int)>* task;
+    {
+      boost::mutex::scoped_lock lock(sync_->mutex_);
+      while (sync_->generation_ == generation && !sync_->stop_) {
+        sync_->start_.wait(lock);
+      }
+      if (sync_->stop_) {
+        return;
+      }
+      generation = sync_->generation_;
+      task = sync_->task_;
+    }
+    (*task)(part);
+    boost::mutex::scoped_lock lock(sync_->mutex_);
+    if (--sync_->pending_ == 0) {
+      sync_->done_.notify_one();
+    }
+  }
+}
+
+}  // namespace caffe
@@ -5,14 +5,23 @@ namespace bp = boost::python;
 
 #include <gflags/gflags.h>
 #include <glog/logging.h>
+#include <sys/wait.h>
+#include <unistd.h>
 
+#include <algorithm>
+#include <cmath>
+#include <csignal>
 #include <cstring>
+#include <fstream>  // NOLINT(readability/streams)
+#include <iomanip>
 #include <map>
 #include <string>
+#include <utility>
 #include <vector>
 
 #include "boost/algorithm/string.hpp"
 #include "caffe/caffe.hpp"
+#include "caffe/util/layer_cost.hpp"
 #include "caffe/util/signal_handler.h"
 
 using caffe::Blob;
@@ -30,6 +39,20 @@ DEFINE_string(gpu, "",
     "Optional; run in GPU mode on given device IDs separated by ','."
     "Use '-gpu all' to run on all available GPUs. The effective training "
     "batch size is multiplied by the number of devices.");
+DEFINE_int32(threads, 1,
+    "Optional; in CPU mode, train with this many solvers running on "
+    "threads. The effective training batch size is multiplied by the "
+    "number of threads.");
+DEFINE_int32(ranks, 1,
+    "Optional; in CPU mode, train with this many solvers running in "
+    "separate processes, which meet at -rendezvous. The effective training "
+    "batch size is multiplied by the number of ranks.");
+DEFINE_int32(rank, -1,
+    "Optional; the rank of this process among -ranks. If unset, the "
+    "other ranks are forked on this host.");
+DEFINE_string(rendezvous, "tcp://127.0.0.1:23456",
+    "Optional; where the -ranks processes meet, tcp://HOST:PORT with the "
+    "address of rank 0, or shm://NAME for processes on a single host.");
 DEFINE_string(solver, "",
     "The solver definition protocol buffer text file.");
 DEFINE_string(model, "",
@@ -54,6 +77,15 @@ DEFINE_string(sigint_effect, "stop",
 DEFINE_string(sighup_effect, "snapshot",
              "Optional; action to take when a SIGHUP signal is received: "
              "snapshot, stop or none.");
+DEFINE_string(report, "",
+    "Optional; write the per-layer results of 'time' to this file, as JSON "
+    "if its name ends with .json and as CSV otherwise.");
+DEFINE_string(baseline, "",
+    "Optional; a CSV report of an earlier 'time' run to compare with. "
+    "'time' fails if a layer got slower by more than -baseline_tolerance.");
+DEFINE_double(baseline_tolerance, 0.1,
+    "Optional; the fraction by which the median times of 'time' may exceed "
+    "those of -baseline.");
 
 // A simple registry for caffe commands.
 typedef int (*BrewFunction)();
@@ -162,6 +194,37 @@ caffe::SolverAction::Enum GetRequestedAction(
   LOG(FATAL) << "Invalid signal effect \""<< flag_value << "\" was specified";
 }
 
+// Forks the processes of the other ranks unless -rank was given, and returns
+// the rank of this process.
+int fork_ranks() {
+  if (FLAGS_rank >= 0) {
+    CHECK_LT(FLAGS_rank, FLAGS_ranks);
+    return FLAGS_rank;
+  }
+  for (int rank = 1; rank < FLAGS_ranks; ++rank) {
+    pid_t pid = fork();
+    CHECK_GE(pid, 0) << "Failed to fork rank " << rank;
+    if (pid == 0) {
+      return rank;
+    }
+  }
+  return 0;
+}
+
+// Waits for the processes forked by fork_ranks.
+void wait_ranks() {
+  if (FLAGS_rank >= 0) {
+    return;
+  }
+  for (int rank = 1; rank < FLAGS_ranks; ++rank) {
+    int status;
+    pid_t pid = wait(&status);
+    CHECK_GE(pid, 0) << "Failed to wait for rank processes";
+    CHECK(WIFEXITED(status) && WEXITSTATUS(status) == 0)
+        << "Rank process " << pid << " failed";
+  }
+}
+
 // Train / Finetune a model.
 int train() {
   CHECK_GT(FLAGS_solver.size(), 0) << "Need a solver definition to train.";
@@ -193,10 +256,22 @@ int train() {
 
   vector<int> gpus;
   get_gpus(&gpus);
+  CHECK_GE(FLAGS_threads, 1);
+  CHECK_GE(FLAGS_ranks, 1);
+  CHECK(FLAGS_threads == 1 || FLAGS_ranks == 1)
+      << "-threads and -ranks cannot be combined.";
   if (gpus.size() == 0) {
     LOG(INFO) << "Use CPU.";
     Caffe::set_mode(Caffe::CPU);
+    Caffe::set_solver_count(FLAGS_threads);
+    if (FLAGS_ranks > 1) {
+      Caffe::set_solver_count(FLAGS_ranks);
+      Caffe::set_solver_rank(fork_ranks());
+      Caffe::set_multiprocess(true);
+    }
   } else {
+    CHECK_EQ(FLAGS_threads, 1) << "-threads is only supported in CPU mode.";
+    CHECK_EQ(FLAGS_ranks, 1) << "-ranks is only supported in CPU mode.";
     ostringstream s;
     for (int i = 0; i < gpus.size(); ++i) {
       s << (i ? ", " : "") << gpus[i];
@@ -218,6 +293,12 @@ int train() {
   caffe::SignalHandler signal_handler(
         GetRequestedAction(FLAGS_sigint_effect),
         GetRequestedAction(FLAGS_sighup_effect));
+  if (Caffe::solver_rank() > 0) {
+    // Rank 0 decides for all ranks, see RingSync::SetActionFunction. A
+    // terminal sends SIGINT to every rank, so the others ignore it.
+    signal(SIGINT, SIG_IGN);
+    signal(SIGHUP, SIG_IGN);
+  }
 
   if (FLAGS_snapshot.size()) {
     solver_param.clear_weights();
@@ -244,6 +325,20 @@ int train() {
 #else
     LOG(FATAL) << "Multi-GPU execution not available - rebuild with USE_NCCL";
 #endif
+  } else if (FLAGS_threads > 1) {
+    caffe::CPUSync<float> sync(solver);
+    sync.Run(FLAGS_threads,
+        FLAGS_snapshot.size() > 0 ? FLAGS_snapshot.c_str() : NULL);
+  } else if (FLAGS_ranks > 1) {
+    caffe::RingSync<float> sync(solver, FLAGS_rendezvous);
+    if (Caffe::root_solver()) {
+      sync.SetActionFunction(signal_handler.GetActionFunction());
+    }
+    sync.Run();
+    if (Caffe::solver_rank() > 0) {
+      return 0;
+    }
+    wait_ranks();
   } else {
     solver->Solve();
   }
@@ -326,6 +421,228 @@ int test() {
 RegisterBrewFunction(test);
 
 
+// Summary of the times of a pass over the iterations, in ms.
+struct TimeStats {
+  double mean;
+  double stddev;
+  double p50;
+  double p90;
+  double p99;
+};
+
+TimeStats get_time_stats(vector<double> times) {
+  TimeStats stats = TimeStats();
+  if (times.empty()) {
+    return stats;
+  }
+  std::sort(times.begin(), times.end());
+  const int n = times.size();
+  for (int i = 0; i < n; ++i) {
+    stats.mean += times[i] / n;
+  }
+  for (int i = 0; i < n; ++i) {
+    stats.stddev += (times[i] - stats.mean) * (times[i] - stats.mean) / n;
+  }
+  stats.stddev = std::sqrt(stats.stddev);
+  // Nearest-rank percentiles
+  stats.p50 = times[std::max(0, static_cast<int>(std::ceil(0.5 * n)) - 1)];
+  stats.p90 = times[std::max(0, static_cast<int>(std::ceil(0.9 * n)) - 1)];
+  stats.p99 = times[std::max(0, static_cast<int>(std::ceil(0.99 * n)) - 1)];
+  return stats;
+}
+
+// The results of 'time' for a layer, or for the whole net.
+struct TimeRecord {
+  string name;
+  string type;
+  TimeStats forward;
+  TimeStats backward;
+  caffe::LayerCost cost;
+};
+
+// Achieved rate, in units per ns, i.e. G per second.
+double get_rate(double amount, double ms) {
+  return ms > 0 ? amount / ms / 1e6 : 0;
+}
+
+const char* const kTimeStatNames[] = {"mean_ms", "stddev_ms", "p50_ms",
+    "p90_ms", "p99_ms"};
+
+vector<double> get_time_stat_values(const TimeStats& stats) {
+  const double values[] = {stats.mean, stats.stddev, stats.p50, stats.p90,
+      stats.p99};
+  return vector<double>(values, values + 5);
+}
+
+string json_escape(const string& text) {
+  string escaped;
+  for (int i = 0; i < text.size(); ++i) {
+    if (text[i] == '"' || text[i] == '\\') {
+      escaped += '\\';
+    }
+    escaped += text[i];
+  }
+  return escaped;
+}
+
+// Quotes a CSV field holding commas or quotes, doubling the quotes.
+string csv_escape(const string& text) {
+  if (text.find_first_of(",\"\n") == string::npos) {
+    return text;
+  }
+  string escaped = "\"";
+  for (int i = 0; i < text.size(); ++i) {
+    if (text[i] == '"') {
+      escaped += '"';
+    }
+    escaped += text[i];
+  }
+  return escaped + "\"";
+}
+
+// Splits a CSV line written with csv_escape into its fields.
+vector<string> csv_split(const string& line) {
+  vector<string> fields(1);
+  bool quoted = false;
+  for (int i = 0; i < line.size(); ++i) {
+    const char c = line[i];
+    if (quoted && c == '"' && i + 1 < line.size() && line[i + 1] == '"') {
+      fields.back() += '"';
+      ++i;
+    } else if (c == '"') {
+      quoted = !quoted;
+    } else if (c == ',' && !quoted) {
+      fields.push_back(string());
+    } else {
+      fields.back() += c;
+    }
+  }
+  return fields;
+}
+
+void write_time_report(const string& filename,
+    const vector<TimeRecord>& records) {
+  std::ofstream out(filename.c_str());
+  CHECK(out.good()) << "Failed to open " << filename;
+  const bool json = boost::algorithm::ends_with(filename, ".json");
+  if (json) {
+    out << "{\n  \"iterations\": " << FLAGS_iterations
+        << ",\n  \"mode\": \"" << (Caffe::mode() == Caffe::CPU ? "CPU" : "GPU")
+        << "\",\n  \"layers\": [\n";
+  } else {
+    out << "layer,type";
+    for (int pass = 0; pass < 2; ++pass) {
+      for (int i = 0; i < 5; ++i) {
+        out << (pass ? ",backward_" : ",forward_") << kTimeStatNames[i];
+      }
+    }
+    out << ",forward_gflop,backward_gflop,forward_mb,backward_mb,"
+        "forward_gflops,backward_gflops,forward_gbps,backward_gbps\n";
+  }
+  for (int r = 0; r < records.size(); ++r) {
+    const TimeRecord& record = records[r];
+    const caffe::LayerCost& cost = record.cost;
+    const vector<double> forward = get_time_stat_values(record.forward);
+    const vector<double> backward = get_time_stat_values(record.backward);
+    const double derived[] = {cost.forward_flops / 1e9,
+        cost.backward_flops / 1e9, cost.forward_bytes / 1e6,
+        cost.backward_bytes / 1e6,
+        get_rate(cost.forward_flops, record.forward.mean),
+        get_rate(cost.backward_flops, record.backward.mean),
+        get_rate(cost.forward_bytes, record.forward.mean),
+        get_rate(cost.backward_bytes, record.backward.mean)};
+    const char* const derived_names[] = {"forward_gflop", "backward_gflop",
+        "forward_mb", "backward_mb", "forward_gflops", "backward_gflops",
+        "forward_gbps", "backward_gbps"};
+    if (json) {
+      out << "    {\"layer\": \"" << json_escape(record.name)
+          << "\", \"type\": \"" << json_escape(record.type) << "\"";
+      for (int i = 0; i < 5; ++i) {
+        out << ", \"forward_" << kTimeStatNames[i] << "\": " << forward[i];
+      }
+      for (int i = 0; i < 5; ++i) {
+        out << ", \"backward_" << kTimeStatNames[i] << "\": " << backward[i];
+      }
+      for (int i = 0; i < 8; ++i) {
+        out << ", \"" << derived_names[i] << "\": " << derived[i];
+      }
+      out << "}" << (r + 1 < records.size() ? "," : "") << "\n";
+    } else {
+      out << csv_escape(record.name) << "," << csv_escape(record.type);
+      for (int i = 0; i < 5; ++i) {
+        out << "," << forward[i];
+      }
+      for (int i = 0; i < 5; ++i) {
+        out << "," << backward[i];
+      }
+      for (int i = 0; i < 8; ++i) {
+        out << "," << derived[i];
+      }
+      out << "\n";
+    }
+  }
+  if (json) {
+    out << "  ]\n}\n";
+  }
+  CHECK(out.good()) << "Failed to write " << filename;
+  LOG(INFO) << "Wrote the benchmark report to " << filename;
+}
+
+// Compares the median times with those of a CSV report, and returns the
+// number of passes that got slower than allowed by -baseline_tolerance.
+int compare_time_baseline(const string& filename,
+    const vector<TimeRecord>& records) {
+  std::ifstream in(filename.c_str());
+  CHECK(in.good()) << "Failed to open baseline " << filename;
+  string line;
+  CHECK(std::getline(in, line)) << "Empty baseline " << filename;
+  const vector<string> columns = csv_split(line);
+  const int forward_column = std::find(columns.begin(), columns.end(),
+      "forward_p50_ms") - columns.begin();
+  const int backward_column = std::find(columns.begin(), columns.end(),
+      "backward_p50_ms") - columns.begin();
+  CHECK_LT(std::max(forward_column, backward_column), columns.size())
+      << "Baseline " << filename << " is not a CSV report of 'time'";
+  std::map<string, std::pair<double, double> > baseline;
+  while (std::getline(in, line)) {
+    const vector<string> fields = csv_split(line);
+    CHECK_EQ(fields.size(), columns.size())
+        << "Malformed line in baseline " << filename << ": " << line;
+    baseline[fields[0]] = std::make_pair(
+        atof(fields[forward_column].c_str()),
+        atof(fields[backward_column].c_str()));
+  }
+  int regressions = 0;
+  for (int r = 0; r < records.size(); ++r) {
+    const TimeRecord& record = records[r];
+    if (!baseline.count(record.name)) {
+      LOG(WARNING) << record.name << " is not in the baseline.";
+      continue;
+    }
+    for (int pass = 0; pass < 2; ++pass) {
+      const double base = pass ? baseline[record.name].second :
+          baseline[record.name].first;
+      const double time = pass ? record.backward.p50 : record.forward.p50;
+      const double change = base > 0 ? time / base - 1 : 0;
+      // Differences of a few us are timer noise, whatever their ratio.
+      const bool regression = change > FLAGS_baseline_tolerance
+          && time - base > 0.01;
+      regressions += regression;
+      ostringstream message;
+      message << std::setfill(' ') << std::setw(10) << record.name
+          << (pass ? "\tbackward" : "\tforward") << " p50: " << time
+          << " ms vs. " << base << " ms (" << (change >= 0 ? "+" : "")
+          << 100 * change << "%)";
+      if (regression) {
+        LOG(WARNING) << message.str() << " exceeds the tolerance.";
+      } else {
+        LOG(INFO) << message.str();
+      }
+    }
+  }
+  return regressions;
+}
+
 // Time: benchmark the execution time of a model.
 int time() {
   CHECK_GT(FLAGS_model.size(), 0) << "Need a model definition to time.";
@@ -369,10 +686,9 @@ int time() {
   Timer forward_timer;
   Timer backward_timer;
   Timer timer;
-  std::vector<double> forward_time_per_layer(layers.size(), 0.0);
-  std::vector<double> backward_time_per_layer(layers.size(), 0.0);
-  double forward_time = 0.0;
-  double backward_time = 0.0;
+  // Times of every iteration in ms, per layer then for the whole net.
+  vector<vector<double> > forward_times(layers.size() + 1);
+  vector<vector<double> > backward_times(layers.size() + 1);
   for (int j = 0; j < FLAGS_iterations; ++j) {
     Timer iter_timer;
     iter_timer.Start();
@@ -380,39 +696,81 @@ int time() {
     for (int i = 0; i < layers.size(); ++i) {
       timer.Start();
       layers[i]->Forward(bottom_vecs[i], top_vecs[i]);
-      forward_time_per_layer[i] += timer.MicroSeconds();
+      forward_times[i].push_back(timer.MicroSeconds() / 1000.);
     }
-    forward_time += forward_timer.MicroSeconds();
+    forward_times[layers.size()].push_back(
+        forward_timer.MicroSeconds() / 1000.);
     backward_timer.Start();
     for (int i = layers.size() - 1; i >= 0; --i) {
       timer.Start();
       layers[i]->Backward(top_vecs[i], bottom_need_backward[i],
                           bottom_vecs[i]);
-      backward_time_per_layer[i] += timer.MicroSeconds();
+      backward_times[i].push_back(timer.MicroSeconds() / 1000.);
     }
-    backward_time += backward_timer.MicroSeconds();
+    backward_times[layers.size()].push_back(
+        backward_timer.MicroSeconds() / 1000.);
     LOG(INFO) << "Iteration: " << j + 1 << " forward-backward time: "
       << iter_timer.MilliSeconds() << " ms.";
   }
+  total_timer.Stop();
+  vector<TimeRecord> records(layers.size() + 1);
+  caffe::LayerCost& net_cost = records[layers.size()].cost;
+  net_cost = caffe::LayerCost();
+  for (int i = 0; i < records.size(); ++i) {
+    TimeRecord& record = records[i];
+    record.forward = get_time_stats(forward_times[i]);
+    record.backward = get_time_stats(backward_times[i]);
+    if (i < layers.size()) {
+      record.name = layers[i]->layer_param().name();
+      record.type = layers[i]->type();
+      record.cost = caffe::EstimateLayerCost(layers[i].get(), bottom_vecs[i],
+          top_vecs[i], bottom_need_backward[i]);
+      net_cost.forward_flops += record.cost.forward_flops;
+      net_cost.backward_flops += record.cost.backward_flops;
+      net_cost.forward_bytes += record.cost.forward_bytes;
+      net_cost.backward_bytes += record.cost.backward_bytes;
+    } else {
+      record.name = "(net)";
+      record.type = "Net";
+    }
+  }
   LOG(INFO) << "Average time per layer: ";
   for (int i = 0; i < layers.size(); ++i) {
-    const caffe::string& layername = layers[i]->layer_param().name();
-    LOG(INFO) << std::setfill(' ') << std::setw(10) << layername <<
-      "\tforward: " << forward_time_per_layer[i] / 1000 /
-      FLAGS_iterations << " ms.";
-    LOG(INFO) << std::setfill(' ') << std::setw(10) << layername  <<
-      "\tbackward: " << backward_time_per_layer[i] / 1000 /
-      FLAGS_iterations << " ms.";
+    const TimeRecord& record = records[i];
+    for (int pass = 0; pass < 2; ++pass) {
+      const TimeStats& stats = pass ? record.backward : record.forward;
+      LOG(INFO) << std::setfill(' ') << std::setw(10) << record.name
+          << (pass ? "\tbackward: " : "\tforward: ") << stats.mean
+          << " ms. (stddev " << stats.stddev << ", p50 " << stats.p50
+          << ", p90 " << stats.p90 << ", p99 " << stats.p99 << " ms, "
+          << get_rate(pass ? record.cost.backward_flops :
+                      record.cost.forward_flops, stats.mean) << " GFLOP/s, "
+          << get_rate(pass ? record.cost.backward_bytes :
+                      record.cost.forward_bytes, stats.mean) << " GB/s)";
+    }
   }
-  total_timer.Stop();
-  LOG(INFO) << "Average Forward pass: " << forward_time / 1000 /
-    FLAGS_iterations << " ms.";
-  LOG(INFO) << "Average Backward pass: " << backward_time / 1000 /
-    FLAGS_iterations << " ms.";
+  const TimeRecord& net_record = records[layers.size()];
+  LOG(INFO) << "Average Forward pass: " << net_record.forward.mean
+    << " ms. (p50 " << net_record.forward.p50 << ", p99 "
+    << net_record.forward.p99 << " ms)";
+  LOG(INFO) << "Average Backward pass: " << net_record.backward.mean
+    << " ms. (p50 " << net_record.backward.p50 << ", p99 "
+    << net_record.backward.p99 << " ms)";
   LOG(INFO) << "Average Forward-Backward: " << total_timer.MilliSeconds() /
     FLAGS_iterations << " ms.";
   LOG(INFO) << "Total Time: " << total_timer.MilliSeconds() << " ms.";
   LOG(INFO) << "*** Benchmark ends ***";
+  if (FLAGS_report.size()) {
+    write_time_report(FLAGS_report, records);
+  }
+  if (FLAGS_baseline.size()) {
+    const int regressions = compare_time_baseline(FLAGS_baseline, records);
+    if (regressions > 0) {
+      LOG(ERROR) << regressions << " passes are more than "
+          << 100 * FLAGS_baseline_tolerance << "% slower than the baseline.";
+      return 1;
+    }
+  }
   return 0;
 }
 RegisterBrewFunction(time);
@@ -1,14 +1,18 @@
 #include <stdint.h>
 #include <algorithm>
+#include <cmath>
 #include <string>
 #include <utility>
 #include <vector>
 
 #include "boost/scoped_ptr.hpp"
+#include "boost/thread.hpp"
 #include "gflags/gflags.h"
 #include "glog/logging.h"
 
+#include "caffe/common.hpp"
 #include "caffe/proto/caffe.pb.h"
+#include "caffe/util/blocking_queue.hpp"
 #include "caffe/util/db.hpp"
 #include "caffe/util/io.hpp"
 
@@ -20,6 +24,72 @@ using boost::scoped_ptr;
 
 DEFINE_string(backend, "lmdb",
         "The backend {leveldb, lmdb} containing the images");
+DEFINE_int32(threads, 0,
+        "Number of worker threads; 0 uses the hardware concurrency");
+
+#ifdef USE_OPENCV
+// Records are read once, by the main thread, in batches of this many.
+const int kBatchRecords = 64;
+
+// Per-thread partial sums. The main thread reads the raw records into batch
+// slots, whose ids go through full_slots to the workers, which parse and
+// accumulate them and hand the ids back through free_slots. No other
+// state is shared until the final reduction.
+struct MeanAccumulator {
+  std::vector<double> sum;          // per-element sum over images
+  std::vector<double> channel_sq;   // per-channel sum of squared pixels
+  int count;
+};
+
+void AccumulateMean(const std::vector<std::vector<std::string> >* batches,
+    BlockingQueue<int>* free_slots, BlockingQueue<int>* full_slots,
+    int channels, int data_size, MeanAccumulator* acc) {
+  const int dim = data_size / channels;
+  acc->sum.assign(data_size, 0.);
+  acc->channel_sq.assign(channels, 0.);
+  acc->count = 0;
+  Datum datum;
+  // A negative id marks the end of the records.
+  for (int slot = full_slots->pop(); slot >= 0; slot = full_slots->pop()) {
+    const std::vector<std::string>& batch = (*batches)[slot];
+    for (int record = 0; record < batch.size(); ++record) {
+      datum.ParseFromString(batch[record]);
+      DecodeDatumNative(&datum);
+
+      const std::string& data = datum.data();
+      const int size_in_datum = std::max<int>(datum.data().size(),
+          datum.float_data_size());
+      CHECK_EQ(size_in_datum, data_size) << "Incorrect data field size " <<
+          size_in_datum;
+      if (data.size() != 0) {
+        CHECK_EQ(data.size(), size_in_datum);
+        for (int c = 0; c < channels; ++c) {
+          double sq = 0.;
+          for (int i = c * dim; i < (c + 1) * dim; ++i) {
+            const double value = static_cast<uint8_t>(data[i]);
+            acc->sum[i] += value;
+            sq += value * value;
+          }
+          acc->channel_sq[c] += sq;
+        }
+      } else {
+        CHECK_EQ(datum.float_data_size(), size_in_datum);
+        for (int c = 0; c < channels; ++c) {
+          double sq = 0.;
+          for (int i = c * dim; i < (c + 1) * dim; ++i) {
+            const double value = datum.float_data(i);
+            acc->sum[i] += value;
+            sq += value * value;
+          }
+          acc->channel_sq[c] += sq;
+        }
+      }
+      ++acc->count;
+    }
+    free_slots->push(slot);
+  }
+}
+#endif  // USE_OPENCV
 
 int main(int argc, char** argv) {
 #ifdef USE_OPENCV
@@ -61,62 +131,81 @@ int main(int argc, char** argv) {
   sum_blob.set_channels(datum.channels());
   sum_blob.set_height(datum.height());
   sum_blob.set_width(datum.width());
+  const int channels = datum.channels();
   const int data_size = datum.channels() * datum.height() * datum.width();
-  int size_in_datum = std::max<int>(datum.data().size(),
-                                    datum.float_data_size());
-  for (int i = 0; i < size_in_datum; ++i) {
-    sum_blob.add_data(0.);
+  const int dim = datum.height() * datum.width();
+
+  int num_threads = FLAGS_threads;
+  if (num_threads <= 0) {
+    num_threads = std::max<int>(boost::thread::hardware_concurrency(), 1);
+  }
+  LOG(INFO) << "Starting iteration with " << num_threads << " threads";
+  // Two batch slots per worker let the reading run ahead of the parsing.
+  std::vector<std::vector<std::string> > batches(2 * num_threads);
+  BlockingQueue<int> free_slots;
+  BlockingQueue<int> full_slots;
+  for (int slot = 0; slot < batches.size(); ++slot) {
+    free_slots.push(slot);
   }
-  LOG(INFO) << "Starting iteration";
+  std::vector<MeanAccumulator> accumulators(num_threads);
+  boost::thread_group workers;
+  for (int rank = 0; rank < num_threads; ++rank) {
+    workers.create_thread(boost::bind(&AccumulateMean, &batches, &free_slots,
+        &full_slots, channels, data_size, &accumulators[rank]));
+  }
+  int num_read = 0;
   while (cursor->valid()) {
-    Datum datum;
-    datum.ParseFromString(cursor->value());
-    DecodeDatumNative(&datum);
-
-    const std::string& data = datum.data();
-    size_in_datum = std::max<int>(datum.data().size(),
-        datum.float_data_size());
-    CHECK_EQ(size_in_datum, data_size) << "Incorrect data field size " <<
-        size_in_datum;
-    if (data.size() != 0) {
-      CHECK_EQ(data.size(), size_in_datum);
-      for (int i = 0; i < size_in_datum; ++i) {
-        sum_blob.set_data(i, sum_blob.data(i) + (uint8_t)data[i]);
-      }
-    } else {
-      CHECK_EQ(datum.float_data_size(), size_in_datum);
-      for (int i = 0; i < size_in_datum; ++i) {
-        sum_blob.set_data(i, sum_blob.data(i) +
-            static_cast<float>(datum.float_data(i)));
+    const int slot = free_slots.pop();
+    std::vector<std::string>& batch = batches[slot];
+    batch.clear();
+    for (; cursor->valid() && batch.size() < kBatchRecords; cursor->Next()) {
+      batch.push_back(cursor->value());
+      if (++num_read % 10000 == 0) {
+        LOG(INFO) << "Read " << num_read << " files.";
       }
     }
-    ++count;
-    if (count % 10000 == 0) {
-      LOG(INFO) << "Processed " << count << " files.";
+    full_slots.push(slot);
+  }
+  for (int rank = 0; rank < num_threads; ++rank) {
+    full_slots.push(-1);
+  }
+  workers.join_all();
+
+  // Reduce the per-thread partial sums in double precision.
+  std::vector<double> sum(data_size, 0.);
+  std::vector<double> channel_sq(channels, 0.);
+  for (int rank = 0; rank < num_threads; ++rank) {
+    const MeanAccumulator& acc = accumulators[rank];
+    for (int i = 0; i < data_size; ++i) {
+      sum[i] += acc.sum[i];
     }
-    cursor->Next();
+    for (int c = 0; c < channels; ++c) {
+      channel_sq[c] += acc.channel_sq[c];
+    }
+    count += acc.count;
   }
+  LOG(INFO) << "Processed " << count << " files.";
+  CHECK_GT(count, 0) << "No records in " << argv[1];
 
-  if (count % 10000 != 0) {
-    LOG(INFO) << "Processed " << count << " files.";
-  }
-  for (int i = 0; i < sum_blob.data_size(); ++i) {
-    sum_blob.set_data(i, sum_blob.data(i) / count);
+  for (int i = 0; i < data_size; ++i) {
+    sum_blob.add_data(sum[i] / count);
   }
   // Write to disk
   if (argc == 3) {
     LOG(INFO) << "Write to " << argv[2];
     WriteProtoToBinaryFile(sum_blob, argv[2]);
   }
-  const int channels = sum_blob.channels();
-  const int dim = sum_blob.height() * sum_blob.width();
-  std::vector<float> mean_values(channels, 0.0);
   LOG(INFO) << "Number of channels: " << channels;
   for (int c = 0; c < channels; ++c) {
+    double channel_sum = 0.;
     for (int i = 0; i < dim; ++i) {
-      mean_values[c] += sum_blob.data(dim * c + i);
+      channel_sum += sum[dim * c + i];
     }
-    LOG(INFO) << "mean_value channel [" << c << "]: " << mean_values[c] / dim;
+    const double n = static_cast<double>(count) * dim;
+    const double mean = channel_sum / n;
+    const double var = std::max(channel_sq[c] / n - mean * mean, 0.);
+    LOG(INFO) << "mean_value channel [" << c << "]: " << mean;
+    LOG(INFO) << "std_value channel [" << c << "]: " << std::sqrt(var);
   }
 #else
   LOG(FATAL) << "This tool requires OpenCV; compile with USE_OPENCV.";
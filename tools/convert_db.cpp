@@ -0,0 +1,69 @@
+// This program copies every record of a database into a database of another
+// backend, e.g. to turn an lmdb into the packed format.
+// Usage:
+//   convert_db [FLAGS] INPUT_DB OUTPUT_DB
+
+#include <string>
+
+#include "boost/scoped_ptr.hpp"
+#include "gflags/gflags.h"
+#include "glog/logging.h"
+
+#include "caffe/proto/caffe.pb.h"
+#include "caffe/util/db.hpp"
+
+using namespace caffe;  // NOLINT(build/namespaces)
+using boost::scoped_ptr;
+
+DEFINE_string(input_backend, "lmdb",
+        "The backend {lmdb, leveldb, packed} of the input database");
+DEFINE_string(output_backend, "packed",
+        "The backend {lmdb, leveldb, packed} for storing the result");
+DEFINE_int32(commit_every, 1000,
+        "Number of records written per transaction");
+
+int main(int argc, char** argv) {
+  ::google::InitGoogleLogging(argv[0]);
+  // Print output to stderr (while still logging)
+  FLAGS_alsologtostderr = 1;
+
+#ifndef GFLAGS_GFLAGS_H_
+  namespace gflags = google;
+#endif
+
+  gflags::SetUsageMessage("Copy a leveldb/lmdb/packed database into another\n"
+        "backend, preserving the record order.\n"
+        "Usage:\n"
+        "    convert_db [FLAGS] INPUT_DB OUTPUT_DB\n");
+  gflags::ParseCommandLineFlags(&argc, &argv, true);
+
+  if (argc != 3) {
+    gflags::ShowUsageWithFlagsRestrict(argv[0], "tools/convert_db");
+    return 1;
+  }
+  CHECK_GT(FLAGS_commit_every, 0);
+
+  scoped_ptr<db::DB> input(db::GetDB(FLAGS_input_backend));
+  input->Open(argv[1], db::READ);
+  scoped_ptr<db::Cursor> cursor(input->NewCursor());
+
+  scoped_ptr<db::DB> output(db::GetDB(FLAGS_output_backend));
+  output->Open(argv[2], db::NEW);
+  scoped_ptr<db::Transaction> txn(output->NewTransaction());
+
+  int count = 0;
+  for (; cursor->valid(); cursor->Next()) {
+    txn->Put(cursor->key(), cursor->value());
+    if (++count % FLAGS_commit_every == 0) {
+      txn->Commit();
+      txn.reset(output->NewTransaction());
+      LOG(INFO) << "Processed " << count << " records.";
+    }
+  }
+  // write the last batch
+  if (count % FLAGS_commit_every != 0) {
+    txn->Commit();
+    LOG(INFO) << "Processed " << count << " records.";
+  }
+  return 0;
+}